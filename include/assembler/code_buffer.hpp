@@ -0,0 +1,176 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _JCC__ASSEMBLER__CODE_BUFFER__H_
+#define _JCC__ASSEMBLER__CODE_BUFFER__H_
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+
+namespace jcc {
+
+  /*!
+     \class code_buffer_full_error
+     \brief Thrown when code is emitted past the end of a code buffer that
+            cannot grow.
+   */
+  class code_buffer_full_error: public std::runtime_error
+  {
+   public:
+    code_buffer_full_error (const std::string& str)
+        : std::runtime_error (str)
+    { }
+  };
+
+
+  /*!
+     \class code_buffer
+     \brief The memory that an assembler emits machine code into.
+
+     The buffer either owns its memory, in which case it grows as needed, or
+     writes into a fixed region supplied by the user (e.g. a mapped
+     executable region of a JIT), so that the code never has to be copied.
+
+     Emission is split in two: reserve() makes room for a worst-case sized
+     piece of code (e.g. the longest x86-64 instruction) and returns the
+     write position, the caller writes its bytes there without any further
+     checks, and commit() moves the end of the buffer past them.
+
+     Near the end of an external buffer, where the worst case might not fit
+     but the actual code still can, reserve() hands out a small staging area
+     instead, and commit() copies the code into the buffer if it fits.
+   */
+  class code_buffer
+  {
+   public:
+    //! \brief The most that can be reserved at once near the end of an
+    //!        external buffer.
+    static constexpr size_t max_staged_size = 16;
+
+   private:
+    unsigned char *mem;
+    unsigned char *cur;
+    unsigned char *lim;
+    bool owned;
+    unsigned char stage[max_staged_size];
+
+   public:
+    inline unsigned char* get_data () { return this->mem; }
+    inline const unsigned char* get_data () const { return this->mem; }
+    inline size_t get_size () const { return this->cur - this->mem; }
+    inline size_t get_capacity () const { return this->lim - this->mem; }
+
+    //! \brief Checks whether the buffer writes into user-supplied memory.
+    inline bool is_external () const { return !this->owned; }
+
+   public:
+    //! \brief Creates an empty buffer that owns and grows its memory.
+    code_buffer ();
+
+    //! \brief Creates a buffer that writes into the cap bytes at mem.
+    //!        The memory is not freed by the buffer, and it does not grow.
+    code_buffer (void *mem, size_t cap);
+
+    code_buffer (code_buffer&& other);
+    code_buffer& operator= (code_buffer&& other);
+
+    code_buffer (const code_buffer&) = delete;
+    code_buffer& operator= (const code_buffer&) = delete;
+
+    ~code_buffer ();
+
+   public:
+    /*!
+       \brief Returns a pointer to n bytes that code can be written into, to
+              be appended onto the buffer by commit().
+
+       This is normally the end of the buffer, which is grown if needed. An
+       external buffer with less than n bytes left hands out its staging
+       area instead (if n is at most max_staged_size), and the bytes are
+       only checked against the room left when they are committed.
+
+       The pointer stays valid until the next call to reserve(), which might
+       move an owned buffer.
+     */
+    inline unsigned char*
+    reserve (size_t n)
+    {
+      if ((size_t)(this->lim - this->cur) < n)
+        return this->grow (n);
+      return this->cur;
+    }
+
+    /*!
+       \brief Moves the end of the buffer past the code written up to the
+              specified position, which must lie within the memory last
+              returned by reserve().
+       \throws code_buffer_full_error if staged code does not fit.
+     */
+    inline void
+    commit (unsigned char *end)
+    {
+      if (this->is_staged (end))
+        this->commit_staged (end);
+      else
+        this->cur = end;
+    }
+
+    //! \brief Returns the offset that a position within the memory last
+    //!        returned by reserve() will have once committed.
+    inline size_t
+    offset_of (const unsigned char *p) const
+    {
+      return this->is_staged (p) ? this->get_size () + (p - this->stage)
+                                 : (size_t)(p - this->mem);
+    }
+
+    //! \brief Returns a pointer to the specified offset into the buffer.
+    inline unsigned char*
+    at (size_t off)
+    { return this->mem + off; }
+
+    //! \brief Appends the specified bytes onto the buffer.
+    inline void
+    append (const void *data, size_t len)
+    {
+      auto p = this->reserve (len);
+      auto src = static_cast<const unsigned char *> (data);
+      for (size_t i = 0; i < len; ++i)
+        p[i] = src[i];
+      this->commit (p + len);
+    }
+
+    //! \brief Discards the contents of the buffer, keeping its memory.
+    inline void
+    clear ()
+    { this->cur = this->mem; }
+
+   private:
+    unsigned char* grow (size_t n);
+    void commit_staged (unsigned char *end);
+
+    inline bool
+    is_staged (const unsigned char *p) const
+    { return (uintptr_t)p - (uintptr_t)this->stage <= max_staged_size; }
+  };
+}
+
+#endif //_JCC__ASSEMBLER__CODE_BUFFER__H_
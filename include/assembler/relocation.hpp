@@ -83,6 +83,7 @@ namespace jcc {
     size_t offset;
     unsigned int size;
     int add;
+    bool branch; // the field is the operand of a direct call or jump
   };
   
   
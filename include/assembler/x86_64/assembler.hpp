@@ -20,9 +20,12 @@
 #define _JCC__ASSEMBLER__X86_64__ASSEMBLER__H_
 
 #include "assembler/x86_64/instruction.hpp"
+#include "assembler/x86_64/encoder.hpp"
 #include "assembler/relocation.hpp"
+#include "assembler/code_buffer.hpp"
 #include <cstdint>
 #include <vector>
+#include <unordered_map>
 #include <cstddef>
 
 
@@ -30,23 +33,25 @@ namespace jcc {
 
   namespace x86_64 {
 
-    /*!
-       \class invalid_instruction_error
-       \brief Thrown by the assembler when an attmept to emit a malformed
-              instruction is made.
-     */
-    class invalid_instruction_error: public std::runtime_error
-    {
-     public:
-      invalid_instruction_error (const std::string& str)
-          : std::runtime_error (str)
-      { }
-    };
-
-    
     /*!
        \class assembler 
        \brief The x86-64 assembler.
+
+       Instructions can be emitted in two ways. The emit_<name> functions
+       build an instruction and encode it at runtime, driven by its
+       instruction_flags. The emit<mnemonic> templates look the operand form
+       up in the encoding table (see encoding.hpp) at compile time, so all
+       that is left at runtime is to fill in the operands.
+
+       In the table-driven functions, immediate sizes are chosen by the
+       assembler (the shortest encoding the instruction has), and a memory
+       operand with a displacement size of zero gets the shortest
+       displacement that holds its displacement.
+
+       Code goes into a code_buffer: each instruction reserves room for the
+       longest possible instruction once and is then written without bounds
+       checks. The buffer can also be memory supplied by the user, in which
+       case the code is emitted in place.
      */
     class assembler
     {
@@ -55,12 +60,16 @@ namespace jcc {
         lbl_t lbl;
         size_t pos;
         int add;
+
+        // relaxable references only:
+        size_t ins_pos;   // start of the instruction
+        int short_opcode; // opcode of the rel8 form, or -1
       };
 
      private:
-      std::vector<unsigned char> data;
-      size_t pos;
-      size_t sz;
+      code_buffer code;
+      unsigned char *out; // write position of the current instruction
+      unsigned char *ins; // start of the current instruction
 
       // relocations:
       std::vector<relocation> relocs;
@@ -71,14 +80,23 @@ namespace jcc {
       std::unordered_map<label_id, size_t> lbl_fixes;
 
      public:
-      inline const unsigned char* get_data () const { return this->data.data (); }
-      inline size_t get_size () const { return this->sz; }
+      inline const unsigned char* get_data () const { return this->code.get_data (); }
+      inline size_t get_size () const { return this->code.get_size (); }
+
+      inline code_buffer& get_buffer () { return this->code; }
+      inline const code_buffer& get_buffer () const { return this->code; }
 
       inline const std::vector<relocation>& get_relocations () const { return this->relocs; }
       
      public:
+      //! \brief Creates an assembler that emits into a growable buffer of
+      //!        its own.
       assembler ();
 
+      //! \brief Creates an assembler that emits directly into the cap bytes
+      //!        at mem (e.g. executable memory).
+      assembler (void *mem, size_t cap);
+
      public:
       //! \brief Creates and returns a new label.
       label_id make_label ();
@@ -89,14 +107,26 @@ namespace jcc {
       //! \brief Calls make_label() and mark_label() in succession.
       label_id make_and_mark_label ();
 
-      //! \brief Fixes label references in the generated code.
+      /*!
+         \brief Fixes label references in the generated code.
+
+         Relaxable references to labels that have been marked are shrunk to
+         their short form wherever the displacement fits, which moves the code
+         that follows them. Offsets recorded by the assembler (labels,
+         relocations) are updated, but code must not hard-code offsets that
+         span a relaxable reference.
+       */
       void fix_labels ();
 
      private:
-      void put_u8 (uint8_t v);
-      void put_u16 (uint16_t v);
-      void put_u32 (uint32_t v);
-      void put_u64 (uint64_t v);
+      // unchecked writes into the space reserved for the current instruction
+      inline void put_u8 (uint8_t v) { *this->out++ = v; }
+      inline void put_u16 (uint16_t v) { this->out = encoder::put_imm (this->out, v, 2); }
+      inline void put_u32 (uint32_t v) { this->out = encoder::put_imm (this->out, v, 4); }
+      inline void put_u64 (uint64_t v) { this->out = encoder::put_imm (this->out, v, 8); }
+
+      //! \brief Returns the offset of the current write position.
+      inline size_t out_pos () const { return this->code.offset_of (this->out); }
       
      private:
       void emit_prefixes (const instruction& ins);
@@ -303,7 +333,433 @@ namespace jcc {
          Emits the specified instruction onto the underlying buffer.
        */
       void emit (const instruction& ins);
+
+     public:
+      //! \brief Emits an instruction without operands.
+      template<mnemonic M> void emit ();
+
+      //! \brief Emits an instruction with two register operands.
+      template<mnemonic M> void emit (const reg_t& dest, const reg_t& src);
+
+      //! \brief Emits an instruction with a register destination and a
+      //!        memory source.
+      template<mnemonic M> void emit (const reg_t& dest, const mem_t& src);
+
+      //! \brief Emits an instruction with a memory destination and a
+      //!        register source.
+      template<mnemonic M> void emit (const mem_t& dest, const reg_t& src);
+
+      //! \brief Emits an instruction with a register destination and an
+      //!        immediate source.
+      template<mnemonic M> void emit (const reg_t& dest, const imm_t& src);
+
+      //! \brief Emits an instruction with a memory destination and an
+      //!        immediate source.
+      template<mnemonic M> void emit (const mem_t& dest, const imm_t& src);
+
+      //! \brief Emits an instruction with a single register operand.
+      template<mnemonic M> void emit (const reg_t& opr);
+
+      //! \brief Emits an instruction with a single memory operand.
+      template<mnemonic M> void emit (const mem_t& opr);
+
+      //! \brief Emits an instruction with a single immediate operand.
+      template<mnemonic M> void emit (const imm_t& opr);
+
+      //! \brief Emits a relative call or jump to a relocation symbol.
+      template<mnemonic M> void emit (const rel_t& opr);
+
+      //! \brief Emits a relative jump to a label, with a rel8 displacement
+      //!        if the label's size specifier is SS_BYTE, or the shortest
+      //!        one that fits if it is relaxed.
+      template<mnemonic M> void emit (const lbl_t& opr);
+
+      //! \brief Emits an instruction with a register destination, a register
+      //!        source and an immediate.
+      template<mnemonic M> void emit (const reg_t& dest, const reg_t& src,
+                                      const imm_t& imm);
+
+      //! \brief Emits an instruction with a register destination, a memory
+      //!        source and an immediate.
+      template<mnemonic M> void emit (const reg_t& dest, const mem_t& src,
+                                      const imm_t& imm);
+
+      //! \brief Emits a VEX instruction with three register operands.
+      template<mnemonic M> void emit (const reg_t& dest, const reg_t& src1,
+                                      const reg_t& src2);
+
+      //! \brief Emits a VEX instruction with two register operands and a
+      //!        memory operand.
+      template<mnemonic M> void emit (const reg_t& dest, const reg_t& src1,
+                                      const mem_t& src2);
+
+     private:
+      //! \brief Commits the code written up to END, forgetting relocations
+      //!        and label references recorded past the specified counts if
+      //!        it does not fit.
+      void commit (unsigned char *end, size_t num_relocs, size_t num_uses);
+
+      //! \brief Writes the displacement of a relative label reference at P,
+      //!        in an instruction that starts at INS.
+      unsigned char* emit_label_ref (unsigned char *ins, unsigned char *p,
+                                     const lbl_t& lbl, int disp_size,
+                                     int short_opcode);
+
+      //! \brief Shrinks relaxable label references to their short form.
+      void relax_branches ();
     };
+
+
+
+//------------------------------------------------------------------------------
+
+    template<mnemonic M>
+    void
+    assembler::emit ()
+    {
+      constexpr op_encoding e = find_encoding (M, op_form::np);
+      static_assert (e.valid, "instruction has no operand-less form");
+
+      auto buf = this->code.reserve (max_instruction_size);
+      auto p = encoder::encode_opcode (buf, e, e.opcode, 0, 0, 0, 0, 0, 0,
+                                       false, 0);
+      this->code.commit (p);
+    }
+
+    template<mnemonic M>
+    void
+    assembler::emit (const reg_t& dest, const reg_t& src)
+    {
+      constexpr op_encoding e_rm = find_encoding (M, op_form::r_rm);
+      constexpr op_encoding e_mr = find_encoding (M, op_form::rm_r);
+      static_assert (e_rm.valid || e_mr.valid,
+                     "instruction has no register-register form");
+
+      // moves between general purpose and vector registers go in the
+      // direction of the destination. VEX instructions keep an extended
+      // register out of r/m if they can, which allows the 2-byte VEX prefix.
+      bool mr;
+      if (!e_rm.valid || !e_mr.valid)
+        mr = !e_rm.valid;
+      else if (src.is_vector () != dest.is_vector ())
+        mr = !dest.is_vector ();
+      else if (e_mr.flags & ENC_VEX)
+        mr = (src.number () & 8) && !(dest.number () & 8);
+      else
+        mr = !(e_mr.flags & ENC_VEC);
+      const op_encoding& e = mr ? e_mr : e_rm;
+      const reg_t& reg = mr ? src : dest;
+      const reg_t& rm = mr ? dest : src;
+
+      int size = encoder::gpr_size (reg);
+      if (size == 0)
+        size = encoder::gpr_size (rm);
+      bool use8 = !(e.flags & ENC_VEC)
+                  && (((e.flags & ENC_SRC8) ? rm.register_size () : size) == 8);
+      int opcode = encoder::select_opcode (e, use8);
+
+      auto buf = this->code.reserve (max_instruction_size);
+      auto p = encoder::encode_rr (buf, e, opcode, size, reg.number (),
+                                   rm.number (), 0, encoder::vex_l (dest),
+                                   encoder::byte_reg_flags (reg)
+                                   | encoder::byte_reg_flags (rm));
+      this->code.commit (p);
+    }
+
+    template<mnemonic M>
+    void
+    assembler::emit (const reg_t& dest, const mem_t& src)
+    {
+      constexpr op_encoding e = find_encoding (M, op_form::r_rm);
+      static_assert (e.valid, "instruction has no register-memory form");
+
+      int size = encoder::gpr_size (dest);
+      if (size == 0)
+        size = encoder::mem_size (src);
+      bool use8 = !(e.flags & ENC_VEC)
+                  && (((e.flags & ENC_SRC8) ? encoder::mem_size (src) : size) == 8);
+      int opcode = encoder::select_opcode (e, use8);
+
+      auto buf = this->code.reserve (max_instruction_size);
+      auto p = encoder::encode_rm (buf, e, opcode, size, dest.number (), src,
+                                   0, encoder::vex_l (dest),
+                                   encoder::byte_reg_flags (dest));
+      this->code.commit (p);
+    }
+
+    template<mnemonic M>
+    void
+    assembler::emit (const mem_t& dest, const reg_t& src)
+    {
+      constexpr op_encoding e = find_encoding (M, op_form::rm_r);
+      static_assert (e.valid, "instruction has no memory-register form");
+
+      int size = encoder::gpr_size (src);
+      if (size == 0)
+        size = encoder::mem_size (dest);
+      int opcode = encoder::select_opcode (e, !(e.flags & ENC_VEC) && size == 8);
+
+      auto buf = this->code.reserve (max_instruction_size);
+      auto p = encoder::encode_rm (buf, e, opcode, size, src.number (), dest,
+                                   0, encoder::vex_l (src),
+                                   encoder::byte_reg_flags (src));
+      this->code.commit (p);
+    }
+
+    template<mnemonic M>
+    void
+    assembler::emit (const reg_t& dest, const imm_t& src)
+    {
+      constexpr op_encoding e_i8 = find_encoding (M, op_form::rm_i8);
+      constexpr op_encoding e_i = find_encoding (M, op_form::rm_i);
+      constexpr op_encoding e_ri = find_encoding (M, op_form::r_i);
+      static_assert (e_i8.valid || e_i.valid || e_ri.valid,
+                     "instruction has no register-immediate form");
+
+      int size = encoder::gpr_size (dest);
+      int byte_flags = encoder::byte_reg_flags (dest);
+      auto buf = this->code.reserve (max_instruction_size);
+      unsigned char *p;
+
+      if (e_i8.valid && (encoder::fits_i8 (src.val) || !e_i.valid)
+          && !(size == 8 && e_i8.opcode8 < 0 && e_i.valid))
+        {
+          int opcode = encoder::select_opcode (e_i8, size == 8);
+          p = encoder::encode_rr (buf, e_i8, opcode, size, e_i8.digit,
+                                  dest.number (), 0, 0, byte_flags);
+          p = encoder::put_imm (p, src.val, 1);
+        }
+      else if (e_ri.valid && (size < 64 || !e_i.valid || !encoder::fits_i32 (src.val)))
+        {
+          int opcode = encoder::select_opcode (e_ri, size == 8) + (dest.number () & 7);
+          p = encoder::encode_opcode (buf, e_ri, opcode, size, 0, 0,
+                                      dest.number (), 0, 0, false, byte_flags);
+          p = encoder::put_imm (p, src.val, size / 8);
+        }
+      else if (e_i.valid)
+        {
+          if (size == 64 && !encoder::fits_i32 (src.val))
+            throw invalid_instruction_error ("immediate operand does not fit in 32 bits");
+          int opcode = encoder::select_opcode (e_i, size == 8);
+          p = encoder::encode_rr (buf, e_i, opcode, size, e_i.digit,
+                                  dest.number (), 0, 0, byte_flags);
+          p = encoder::put_imm (p, src.val, (size == 64) ? 4 : size / 8);
+        }
+      else
+        throw invalid_instruction_error ("immediate operand does not fit in 8 bits");
+
+      this->code.commit (p);
+    }
+
+    template<mnemonic M>
+    void
+    assembler::emit (const mem_t& dest, const imm_t& src)
+    {
+      constexpr op_encoding e_i8 = find_encoding (M, op_form::rm_i8);
+      constexpr op_encoding e_i = find_encoding (M, op_form::rm_i);
+      static_assert (e_i8.valid || e_i.valid,
+                     "instruction has no memory-immediate form");
+
+      int size = encoder::mem_size (dest);
+      auto buf = this->code.reserve (max_instruction_size);
+      unsigned char *p;
+
+      if (e_i8.valid && (encoder::fits_i8 (src.val) || !e_i.valid)
+          && !(size == 8 && e_i8.opcode8 < 0 && e_i.valid))
+        {
+          int opcode = encoder::select_opcode (e_i8, size == 8);
+          p = encoder::encode_rm (buf, e_i8, opcode, size, e_i8.digit, dest,
+                                  0, 0, 0);
+          p = encoder::put_imm (p, src.val, 1);
+        }
+      else if (e_i.valid)
+        {
+          if (size == 64 && !encoder::fits_i32 (src.val))
+            throw invalid_instruction_error ("immediate operand does not fit in 32 bits");
+          int opcode = encoder::select_opcode (e_i, size == 8);
+          p = encoder::encode_rm (buf, e_i, opcode, size, e_i.digit, dest,
+                                  0, 0, 0);
+          p = encoder::put_imm (p, src.val, (size == 64) ? 4 : size / 8);
+        }
+      else
+        throw invalid_instruction_error ("immediate operand does not fit in 8 bits");
+
+      this->code.commit (p);
+    }
+
+    template<mnemonic M>
+    void
+    assembler::emit (const reg_t& opr)
+    {
+      constexpr op_encoding e_o = find_encoding (M, op_form::o);
+      constexpr op_encoding e_m = find_encoding (M, op_form::rm);
+      static_assert (e_o.valid || e_m.valid,
+                     "instruction has no single register form");
+
+      int size = encoder::gpr_size (opr);
+      auto buf = this->code.reserve (max_instruction_size);
+      unsigned char *p;
+      if (e_o.valid)
+        p = encoder::encode_opcode (buf, e_o, e_o.opcode + (opr.number () & 7),
+                                    size, 0, 0, opr.number (), 0, 0, false,
+                                    encoder::byte_reg_flags (opr));
+      else
+        p = encoder::encode_rr (buf, e_m, encoder::select_opcode (e_m, size == 8),
+                                size, e_m.digit, opr.number (), 0, 0,
+                                encoder::byte_reg_flags (opr));
+
+      this->code.commit (p);
+    }
+
+    template<mnemonic M>
+    void
+    assembler::emit (const mem_t& opr)
+    {
+      constexpr op_encoding e = find_encoding (M, op_form::rm);
+      static_assert (e.valid, "instruction has no single memory form");
+
+      int size = encoder::mem_size (opr);
+      auto buf = this->code.reserve (max_instruction_size);
+      auto p = encoder::encode_rm (buf, e, encoder::select_opcode (e, size == 8),
+                                   size, e.digit, opr, 0, 0, 0);
+      this->code.commit (p);
+    }
+
+    template<mnemonic M>
+    void
+    assembler::emit (const imm_t& opr)
+    {
+      constexpr op_encoding e_i8 = find_encoding (M, op_form::i8);
+      constexpr op_encoding e_i = find_encoding (M, op_form::i);
+      static_assert (e_i8.valid || e_i.valid,
+                     "instruction has no single immediate form");
+
+      bool short_form = e_i8.valid && (encoder::fits_i8 (opr.val) || !e_i.valid);
+      const op_encoding& e = short_form ? e_i8 : e_i;
+
+      auto buf = this->code.reserve (max_instruction_size);
+      auto p = encoder::encode_opcode (buf, e, e.opcode, 0, 0, 0, 0, 0, 0,
+                                       false, 0);
+      p = encoder::put_imm (p, opr.val, short_form ? 1 : 4);
+      this->code.commit (p);
+    }
+
+    template<mnemonic M>
+    void
+    assembler::emit (const rel_t& opr)
+    {
+      constexpr op_encoding e = find_encoding (M, op_form::rel32);
+      static_assert (e.valid, "instruction has no rel32 form");
+
+      auto buf = this->code.reserve (max_instruction_size);
+      auto p = encoder::encode_opcode (buf, e, e.opcode, 0, 0, 0, 0, 0, 0,
+                                       false, 0);
+
+      relocation reloc;
+      reloc.type = R_PC32;
+      reloc.sym = opr.sym;
+      reloc.offset = this->code.offset_of (p);
+      reloc.size = 4;
+      reloc.add = -4;
+      reloc.branch = true;
+
+      p = encoder::put_imm (p, 0, 4);
+      this->code.commit (p);
+      this->relocs.push_back (reloc);
+    }
+
+    template<mnemonic M>
+    void
+    assembler::emit (const lbl_t& opr)
+    {
+      constexpr op_encoding e8 = find_encoding (M, op_form::rel8);
+      constexpr op_encoding e32 = find_encoding (M, op_form::rel32);
+      static_assert (e8.valid || e32.valid, "instruction has no relative form");
+
+      // relaxable references start out long, see fix_labels()
+      bool short_form = e8.valid && (opr.ss == SS_BYTE || !e32.valid);
+      const op_encoding& e = short_form ? e8 : e32;
+      bool relax = opr.relax && e8.valid && e32.valid
+                   && e8.map == 0 && e8.prefix == 0;
+
+      size_t num_uses = this->lbl_uses.size ();
+      auto buf = this->code.reserve (max_instruction_size);
+      auto p = encoder::encode_opcode (buf, e, e.opcode, 0, 0, 0, 0, 0, 0,
+                                       false, 0);
+      p = this->emit_label_ref (buf, p, opr, short_form ? 1 : 4,
+                                relax ? e8.opcode : -1);
+      this->commit (p, this->relocs.size (), num_uses);
+    }
+
+    template<mnemonic M>
+    void
+    assembler::emit (const reg_t& dest, const reg_t& src, const imm_t& imm)
+    {
+      constexpr op_encoding e_i8 = find_encoding (M, op_form::r_rm_i8);
+      constexpr op_encoding e_i = find_encoding (M, op_form::r_rm_i);
+      static_assert (e_i8.valid || e_i.valid,
+                     "instruction has no register-register-immediate form");
+
+      bool short_form = e_i8.valid && (encoder::fits_i8 (imm.val) || !e_i.valid);
+      const op_encoding& e = short_form ? e_i8 : e_i;
+      int size = encoder::gpr_size (dest);
+
+      auto buf = this->code.reserve (max_instruction_size);
+      auto p = encoder::encode_rr (buf, e, e.opcode, size, dest.number (),
+                                   src.number (), 0, encoder::vex_l (dest),
+                                   encoder::byte_reg_flags (dest)
+                                   | encoder::byte_reg_flags (src));
+      p = encoder::put_imm (p, imm.val, short_form ? 1 : (size == 16) ? 2 : 4);
+      this->code.commit (p);
+    }
+
+    template<mnemonic M>
+    void
+    assembler::emit (const reg_t& dest, const mem_t& src, const imm_t& imm)
+    {
+      constexpr op_encoding e_i8 = find_encoding (M, op_form::r_rm_i8);
+      constexpr op_encoding e_i = find_encoding (M, op_form::r_rm_i);
+      static_assert (e_i8.valid || e_i.valid,
+                     "instruction has no register-memory-immediate form");
+
+      bool short_form = e_i8.valid && (encoder::fits_i8 (imm.val) || !e_i.valid);
+      const op_encoding& e = short_form ? e_i8 : e_i;
+      int size = encoder::gpr_size (dest);
+
+      auto buf = this->code.reserve (max_instruction_size);
+      auto p = encoder::encode_rm (buf, e, e.opcode, size, dest.number (), src,
+                                   0, encoder::vex_l (dest),
+                                   encoder::byte_reg_flags (dest));
+      p = encoder::put_imm (p, imm.val, short_form ? 1 : (size == 16) ? 2 : 4);
+      this->code.commit (p);
+    }
+
+    template<mnemonic M>
+    void
+    assembler::emit (const reg_t& dest, const reg_t& src1, const reg_t& src2)
+    {
+      constexpr op_encoding e = find_encoding (M, op_form::r_v_rm);
+      static_assert (e.valid, "instruction has no three operand form");
+
+      auto buf = this->code.reserve (max_instruction_size);
+      auto p = encoder::encode_rr (buf, e, e.opcode, 0, dest.number (),
+                                   src2.number (), src1.number (),
+                                   encoder::vex_l (dest), 0);
+      this->code.commit (p);
+    }
+
+    template<mnemonic M>
+    void
+    assembler::emit (const reg_t& dest, const reg_t& src1, const mem_t& src2)
+    {
+      constexpr op_encoding e = find_encoding (M, op_form::r_v_rm);
+      static_assert (e.valid, "instruction has no three operand form");
+
+      auto buf = this->code.reserve (max_instruction_size);
+      auto p = encoder::encode_rm (buf, e, e.opcode, 0, dest.number (), src2,
+                                   src1.number (), encoder::vex_l (dest), 0);
+      this->code.commit (p);
+    }
   }
 }
 
@@ -0,0 +1,315 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _JCC__ASSEMBLER__X86_64__ENCODER__H_
+#define _JCC__ASSEMBLER__X86_64__ENCODER__H_
+
+#include "assembler/x86_64/instruction.hpp"
+#include "assembler/x86_64/encoding.hpp"
+#include <stdexcept>
+#include <string>
+
+
+namespace jcc {
+
+  namespace x86_64 {
+
+    /*!
+       \class invalid_instruction_error
+       \brief Thrown by the assembler when an attmept to emit a malformed
+              instruction is made.
+     */
+    class invalid_instruction_error: public std::runtime_error
+    {
+     public:
+      invalid_instruction_error (const std::string& str)
+          : std::runtime_error (str)
+      { }
+    };
+
+
+    //! \brief The length of the longest x86-64 instruction, in bytes.
+    constexpr size_t max_instruction_size = 15;
+
+
+    /*
+       Byte-level encoding of table-driven instructions.
+
+       Every routine writes at P, which must have room for a whole
+       instruction (max_instruction_size bytes), and returns the position past what it wrote.
+       Given an encoding that is known at compile time, they reduce to a
+       handful of stores and tests on the operands.
+     */
+    namespace encoder {
+
+      // byte register flags
+      enum
+      {
+        BYTE_REG_NEEDS_REX = 1,  // SPL/BPL/SIL/DIL or R8B-R15B
+        BYTE_REG_HIGH      = 2,  // AH/CH/DH/BH
+      };
+
+      //! \brief Returns the byte register flags of the specified register.
+      inline int
+      byte_reg_flags (const reg_t& reg)
+      {
+        if ((reg.code >> 4) == 4 || (reg.code >= REG_R8B && reg.code <= REG_R15B))
+          return BYTE_REG_NEEDS_REX;
+        if (reg.code >= REG_AH && reg.code <= REG_BH)
+          return BYTE_REG_HIGH;
+        return 0;
+      }
+
+      //! \brief Returns the size of a general purpose register in bits, or 0
+      //!        for any other register.
+      inline int
+      gpr_size (const reg_t& reg)
+      {
+        int sz = reg.register_size ();
+        return (sz <= 64) ? sz : 0;
+      }
+
+      //! \brief Returns the size of a memory operand in bits.
+      inline int
+      mem_size (const mem_t& mem)
+      {
+        switch (mem.ss)
+          {
+          case SS_BYTE: return 8;
+          case SS_WORD: return 16;
+          case SS_DWORD: return 32;
+          case SS_QWORD: return 64;
+          }
+        return 0;
+      }
+
+      //! \brief Returns the VEX.L bit for the specified vector register.
+      inline int
+      vex_l (const reg_t& reg)
+      {
+        return (reg.register_size () == 256) ? 1 : 0;
+      }
+
+      //! \brief Returns the register number used in ModR/M, REX and VEX
+      //!        fields, or zero for no register.
+      inline int
+      reg_number (const reg_t& reg)
+      {
+        return (reg.code == REG_NONE || reg.code == REG_RIP) ? 0 : reg.number ();
+      }
+
+      //! \brief Returns the opcode for the specified operand size, throwing
+      //!        if the instruction has no 8-bit form.
+      inline int
+      select_opcode (const op_encoding& e, bool use8)
+      {
+        if (!use8)
+          return e.opcode;
+        if (e.opcode8 < 0)
+          throw invalid_instruction_error ("instruction has no 8-bit operand form");
+        return e.opcode8;
+      }
+
+      //! \brief Writes the low BYTES bytes of VAL in little-endian order.
+      inline unsigned char*
+      put_imm (unsigned char *p, int64_t val, int bytes)
+      {
+        for (int i = 0; i < bytes; ++i)
+          *p++ = (unsigned char)(val >> (i * 8));
+        return p;
+      }
+
+      //! \brief Checks whether the specified value fits in a sign-extended
+      //!        8-bit immediate.
+      inline bool
+      fits_i8 (int64_t val)
+      { return val >= -128 && val <= 127; }
+
+      //! \brief Checks whether the specified value fits in a sign-extended
+      //!        32-bit immediate.
+      inline bool
+      fits_i32 (int64_t val)
+      { return val >= -2147483648LL && val <= 2147483647LL; }
+
+
+      /*!
+         \brief Writes the prefixes (legacy and REX, or VEX) and the opcode.
+         \param size The operand size in bits (selects 0x66 and REX.W), or
+                     0 if none applies.
+         \param r, x, b Register numbers whose fourth bits go into the
+                        REX/VEX R, X and B bits.
+         \param v The VEX.vvvv register number.
+         \param l The VEX.L bit.
+       */
+      inline unsigned char*
+      encode_opcode (unsigned char *p, const op_encoding& e, int opcode,
+                     int size, int r, int x, int b, int v, int l,
+                     bool addr32, int byte_flags)
+      {
+        bool w = (e.flags & ENC_W)
+                 || (size == 64 && ((e.flags & ENC_VEC) ? (e.flags & ENC_GPR_W)
+                                                        : !(e.flags & ENC_D64)));
+        if (addr32)
+          *p++ = 0x67;
+
+        if (e.flags & ENC_VEX)
+          {
+            int pp = (e.prefix == 0x66) ? 1 : (e.prefix == 0xF3) ? 2
+                     : (e.prefix == 0xF2) ? 3 : 0;
+            int nr = (~r >> 3) & 1, nx = (~x >> 3) & 1, nb = (~b >> 3) & 1;
+            int nv = ~v & 15;
+            if (e.map == 1 && nx && nb && !w)
+              {
+                *p++ = 0xC5;
+                *p++ = (unsigned char)((nr << 7) | (nv << 3) | (l << 2) | pp);
+              }
+            else
+              {
+                *p++ = 0xC4;
+                *p++ = (unsigned char)((nr << 7) | (nx << 6) | (nb << 5) | e.map);
+                *p++ = (unsigned char)(((int)w << 7) | (nv << 3) | (l << 2) | pp);
+              }
+
+            *p++ = (unsigned char)opcode;
+            return p;
+          }
+
+        if (size == 16 && !(e.flags & ENC_VEC))
+          *p++ = 0x66;
+        if (e.prefix)
+          *p++ = e.prefix;
+
+        int rex = ((int)w << 3) | (((r >> 3) & 1) << 2) | (((x >> 3) & 1) << 1)
+                  | ((b >> 3) & 1);
+        if (rex || (byte_flags & BYTE_REG_NEEDS_REX))
+          {
+            if (byte_flags & BYTE_REG_HIGH)
+              throw invalid_instruction_error ("AH/CH/DH/BH cannot be encoded with a REX prefix");
+            *p++ = (unsigned char)(0x40 | rex);
+          }
+
+        if (e.map >= 1)
+          *p++ = 0x0F;
+        if (e.map == 2)
+          *p++ = 0x38;
+        else if (e.map == 3)
+          *p++ = 0x3A;
+        *p++ = (unsigned char)opcode;
+        return p;
+      }
+
+      /*!
+         \brief Writes the ModR/M byte, SIB byte and displacement of a memory
+                operand.
+
+         A displacement size of zero lets the encoder choose the shortest
+         displacement that holds the operand's displacement.
+       */
+      inline unsigned char*
+      encode_mem (unsigned char *p, int reg, const mem_t& mem)
+      {
+        reg &= 7;
+        if (mem.base.code == REG_RIP)
+          {
+            if (mem.index.code != REG_NONE)
+              throw invalid_instruction_error ("RIP register cannot be indexed");
+            *p++ = (unsigned char)((reg << 3) | 5);
+            return put_imm (p, mem.disp, 4);
+          }
+
+        int ss = 0;
+        switch (mem.scale)
+          {
+          case 1: ss = 0; break;
+          case 2: ss = 1; break;
+          case 4: ss = 2; break;
+          case 8: ss = 3; break;
+          default:
+            throw invalid_instruction_error ("invalid index register scale");
+          }
+
+        int index = 4; // none
+        if (mem.index.code != REG_NONE)
+          {
+            if (mem.index.number () == 4)
+              throw invalid_instruction_error ("stack pointer cannot be an index register");
+            index = mem.index.number () & 7;
+          }
+
+        if (mem.base.code == REG_NONE)
+          {
+            // [index * scale + disp32] or [disp32]
+            *p++ = (unsigned char)((reg << 3) | 4);
+            *p++ = (unsigned char)((ss << 6) | (index << 3) | 5);
+            return put_imm (p, mem.disp, 4);
+          }
+
+        int base = mem.base.number () & 7;
+        int disp_size = mem.disp_size;
+        if (disp_size == 0)
+          disp_size = (mem.disp == 0 && base != 5) ? 0 : fits_i8 (mem.disp) ? 1 : 4;
+        else if (disp_size != 1)
+          disp_size = 4;
+        int mod = (disp_size == 0) ? 0 : (disp_size == 1) ? 1 : 2;
+
+        if (mem.index.code != REG_NONE || base == 4)
+          {
+            *p++ = (unsigned char)((mod << 6) | (reg << 3) | 4);
+            *p++ = (unsigned char)((ss << 6) | (index << 3) | base);
+          }
+        else
+          *p++ = (unsigned char)((mod << 6) | (reg << 3) | base);
+
+        return put_imm (p, mem.disp, disp_size);
+      }
+
+      //! \brief Checks whether a memory operand needs an address-size
+      //!        override prefix.
+      inline bool
+      is_addr32 (const mem_t& mem)
+      {
+        return mem.base.register_size () == 32 || mem.index.register_size () == 32;
+      }
+
+      //! \brief Encodes an instruction with a register r/m operand, up to
+      //!        its immediate operand.
+      inline unsigned char*
+      encode_rr (unsigned char *p, const op_encoding& e, int opcode, int size,
+                 int reg, int rm, int v, int l, int byte_flags)
+      {
+        p = encode_opcode (p, e, opcode, size, reg, 0, rm, v, l, false, byte_flags);
+        *p++ = (unsigned char)(0xC0 | ((reg & 7) << 3) | (rm & 7));
+        return p;
+      }
+
+      //! \brief Encodes an instruction with a memory r/m operand, up to its
+      //!        immediate operand.
+      inline unsigned char*
+      encode_rm (unsigned char *p, const op_encoding& e, int opcode, int size,
+                 int reg, const mem_t& mem, int v, int l, int byte_flags)
+      {
+        p = encode_opcode (p, e, opcode, size, reg, reg_number (mem.index),
+                           reg_number (mem.base), v, l, is_addr32 (mem),
+                           byte_flags);
+        return encode_mem (p, reg, mem);
+      }
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,525 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _JCC__ASSEMBLER__X86_64__ENCODING__H_
+#define _JCC__ASSEMBLER__X86_64__ENCODING__H_
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace jcc {
+
+  namespace x86_64 {
+
+    /*!
+       \enum mnemonic
+       \brief Instructions known to the encoding table.
+
+       Conditional instructions are listed in condition code order (o, no,
+       b, ae, e, ne, be, a, s, ns, p, np, l, ge, le, g), so that the
+       mnemonic of condition CC is the first one plus CC.
+     */
+    enum class mnemonic
+    {
+      // integer:
+      add, or_, adc, sbb, and_, sub, xor_, cmp,
+      mov, movzx, movsx, movsxd, lea, test, xchg,
+      imul, mul, div, idiv, neg, not_, inc, dec,
+      rol, ror, rcl, rcr, shl, shr, sar,
+      push, pop, call, jmp, ret, leave,
+      cbw, cwde, cdqe, cwd, cdq, cqo,
+      bswap, popcnt, lzcnt, tzcnt, bt,
+      nop, int3, ud2, syscall,
+
+      jo, jno, jb, jae, je, jne, jbe, ja,
+      js, jns, jp, jnp, jl, jge, jle, jg,
+      seto, setno, setb, setae, sete, setne, setbe, seta,
+      sets, setns, setp, setnp, setl, setge, setle, setg,
+      cmovo, cmovno, cmovb, cmovae, cmove, cmovne, cmovbe, cmova,
+      cmovs, cmovns, cmovp, cmovnp, cmovl, cmovge, cmovle, cmovg,
+
+      // SSE/SSE2/SSE4.1:
+      movss, movsd, movaps, movups, movapd, movupd, movdqa, movdqu,
+      movd, movq,
+      addss, addsd, addps, addpd,
+      subss, subsd, subps, subpd,
+      mulss, mulsd, mulps, mulpd,
+      divss, divsd, divps, divpd,
+      minss, minsd, minps, minpd,
+      maxss, maxsd, maxps, maxpd,
+      sqrtss, sqrtsd, sqrtps, sqrtpd,
+      andps, andpd, andnps, andnpd, orps, orpd, xorps, xorpd,
+      ucomiss, ucomisd, comiss, comisd,
+      cvtsi2ss, cvtsi2sd, cvttss2si, cvttsd2si, cvtss2sd, cvtsd2ss,
+      cvtdq2ps, cvttps2dq,
+      paddb, paddw, paddd, paddq, psubb, psubw, psubd, psubq,
+      pmullw, pmulld, pand, pandn, por, pxor,
+      pcmpeqb, pcmpeqw, pcmpeqd, pcmpgtd,
+      pshufd, shufps,
+
+      // AVX/AVX2/FMA:
+      vmovaps, vmovups, vmovdqa, vmovdqu, vbroadcastss, vzeroupper,
+      vaddss, vaddsd, vaddps, vaddpd,
+      vsubss, vsubsd, vsubps, vsubpd,
+      vmulss, vmulsd, vmulps, vmulpd,
+      vdivss, vdivsd, vdivps, vdivpd,
+      vminps, vminpd, vmaxps, vmaxpd,
+      vandps, vandpd, vorps, vorpd, vxorps, vxorpd,
+      vpaddb, vpaddw, vpaddd, vpaddq, vpsubb, vpsubw, vpsubd, vpsubq,
+      vpmullw, vpmulld, vpand, vpandn, vpor, vpxor,
+      vpcmpeqb, vpcmpeqw, vpcmpeqd, vpcmpgtd,
+      vfmadd231ps, vfmadd231pd, vfmadd231ss, vfmadd231sd,
+    };
+
+    //! \brief Returns the mnemonic of a conditional instruction with the
+    //!        specified condition code (0-15).
+    constexpr mnemonic
+    with_condition (mnemonic first, int cc)
+    {
+      return (mnemonic)((int)first + cc);
+    }
+
+
+    /*!
+       \enum op_form
+       \brief Operand forms of encodings.
+
+       "rm" is a ModR/M r/m operand (a register or a memory operand), "r" is
+       the ModR/M reg operand and "v" is the VEX.vvvv operand.
+     */
+    enum class op_form
+    {
+      np,         // no operands
+      r_rm,       // reg, r/m
+      rm_r,       // r/m, reg
+      rm,         // r/m; the reg field holds the opcode extension
+      rm_i8,      // r/m, imm8
+      rm_i,       // r/m, imm of operand size (at most 32 bits)
+      r_i,        // register added to opcode, imm of operand size
+      o,          // register added to opcode
+      r_rm_i8,    // reg, r/m, imm8
+      r_rm_i,     // reg, r/m, imm of operand size (at most 32 bits)
+      r_v_rm,     // reg, vvvv, r/m
+      i8,         // imm8
+      i,          // imm32
+      rel8,       // 8-bit displacement
+      rel32,      // 32-bit displacement
+    };
+
+
+    /*!
+       \enum encoding_flags
+       \brief Flags of op_encoding.
+     */
+    enum encoding_flags
+    {
+      //! \brief Always sets REX.W (or VEX.W).
+      ENC_W = 1 << 0,
+
+      //! \brief Operand size defaults to 64 bits, without REX.W.
+      ENC_D64 = 1 << 1,
+
+      //! \brief Vector instruction: the operand size neither adds a 0x66
+      //!        prefix nor sets REX.W.
+      ENC_VEC = 1 << 2,
+
+      //! \brief Vector instruction with a general purpose operand that sets
+      //!        REX.W (or VEX.W) if it is 64 bits wide.
+      ENC_GPR_W = 1 << 3,
+
+      //! \brief VEX encoded.
+      ENC_VEX = 1 << 4,
+
+      //! \brief The 8-bit opcode is chosen by the size of the r/m operand
+      //!        rather than by the operand size (movzx, movsx).
+      ENC_SRC8 = 1 << 5,
+    };
+
+
+    /*!
+       \struct op_encoding
+       \brief The encoding of one operand form of an instruction.
+     */
+    struct op_encoding
+    {
+      mnemonic mn = mnemonic::nop;
+      op_form form = op_form::np;
+      uint8_t prefix = 0;  // mandatory prefix (0x66, 0xF2 or 0xF3), or 0
+      uint8_t map = 0;     // 0: one-byte, 1: 0F, 2: 0F 38, 3: 0F 3A
+      uint8_t opcode = 0;  // for 16/32/64-bit operands
+      int16_t opcode8 = -1; // for 8-bit operands, or -1 if not allowed
+      int8_t digit = -1;   // ModR/M reg opcode extension, or -1
+      uint8_t flags = 0;
+      bool valid = false;
+    };
+
+    //! \brief Creates an op_encoding.
+    constexpr op_encoding
+    make_encoding (mnemonic mn, op_form form, uint8_t prefix, uint8_t map,
+                   uint8_t opcode, int opcode8, int digit, unsigned flags)
+    {
+      op_encoding e {};
+      e.mn = mn;
+      e.form = form;
+      e.prefix = prefix;
+      e.map = map;
+      e.opcode = opcode;
+      e.opcode8 = (int16_t)opcode8;
+      e.digit = (int8_t)digit;
+      e.flags = (uint8_t)flags;
+      e.valid = true;
+      return e;
+    }
+
+
+
+//------------------------------------------------------------------------------
+
+    static constexpr size_t max_encodings = 512;
+
+    /*!
+       \struct encoding_table
+       \brief The encodings of all instruction forms known to the assembler.
+     */
+    struct encoding_table
+    {
+      op_encoding rows[max_encodings];
+      size_t size;
+    };
+
+    namespace detail {
+
+      constexpr void
+      add (encoding_table& t, mnemonic mn, op_form form, uint8_t prefix,
+           uint8_t map, uint8_t opcode, int opcode8 = -1, int digit = -1,
+           unsigned flags = 0)
+      {
+        t.rows[t.size ++] = make_encoding (mn, form, prefix, map, opcode,
+                                           opcode8, digit, flags);
+      }
+
+      //! \brief Adds one of add/or/adc/sbb/and/sub/xor/cmp.
+      constexpr void
+      add_alu (encoding_table& t, mnemonic mn, int digit)
+      {
+        uint8_t base = (uint8_t)(digit << 3);
+        add (t, mn, op_form::rm_r, 0, 0, base + 1, base);
+        add (t, mn, op_form::r_rm, 0, 0, base + 3, base + 2);
+        add (t, mn, op_form::rm_i8, 0, 0, 0x83, -1, digit);
+        add (t, mn, op_form::rm_i, 0, 0, 0x81, 0x80, digit);
+      }
+
+      //! \brief Adds a unary group 3/4/5 instruction (F6/F7 or FE/FF).
+      constexpr void
+      add_unary (encoding_table& t, mnemonic mn, uint8_t opcode, int digit)
+      {
+        add (t, mn, op_form::rm, 0, 0, opcode, opcode - 1, digit);
+      }
+
+      //! \brief Adds a rotate or shift, by an immediate or by CL.
+      constexpr void
+      add_shift (encoding_table& t, mnemonic mn, int digit)
+      {
+        add (t, mn, op_form::rm_i8, 0, 0, 0xC1, 0xC0, digit);
+        add (t, mn, op_form::rm, 0, 0, 0xD3, 0xD2, digit);
+      }
+
+      //! \brief Adds a legacy SSE instruction in the 0F map.
+      constexpr void
+      add_sse (encoding_table& t, mnemonic mn, uint8_t prefix, uint8_t opcode,
+               op_form form = op_form::r_rm, unsigned flags = 0)
+      {
+        add (t, mn, form, prefix, 1, opcode, -1, -1, ENC_VEC | flags);
+      }
+
+      //! \brief Adds the ss, sd, ps and pd variants of an SSE instruction.
+      constexpr void
+      add_sse4 (encoding_table& t, mnemonic first, uint8_t opcode)
+      {
+        add_sse (t, first, 0xF3, opcode);
+        add_sse (t, (mnemonic)((int)first + 1), 0xF2, opcode);
+        add_sse (t, (mnemonic)((int)first + 2), 0, opcode);
+        add_sse (t, (mnemonic)((int)first + 3), 0x66, opcode);
+      }
+
+      //! \brief Adds a VEX encoded instruction.
+      constexpr void
+      add_vex (encoding_table& t, mnemonic mn, uint8_t prefix, uint8_t map,
+               uint8_t opcode, op_form form = op_form::r_v_rm,
+               unsigned flags = 0)
+      {
+        add (t, mn, form, prefix, map, opcode, -1, -1, ENC_VEC | ENC_VEX | flags);
+      }
+
+      //! \brief Adds the ss, sd, ps and pd variants of an AVX instruction.
+      constexpr void
+      add_vex4 (encoding_table& t, mnemonic first, uint8_t opcode)
+      {
+        add_vex (t, first, 0xF3, 1, opcode);
+        add_vex (t, (mnemonic)((int)first + 1), 0xF2, 1, opcode);
+        add_vex (t, (mnemonic)((int)first + 2), 0, 1, opcode);
+        add_vex (t, (mnemonic)((int)first + 3), 0x66, 1, opcode);
+      }
+
+      constexpr encoding_table
+      make_encoding_table ()
+      {
+        encoding_table t {};
+        using m = mnemonic;
+        using f = op_form;
+
+        add_alu (t, m::add, 0);
+        add_alu (t, m::or_, 1);
+        add_alu (t, m::adc, 2);
+        add_alu (t, m::sbb, 3);
+        add_alu (t, m::and_, 4);
+        add_alu (t, m::sub, 5);
+        add_alu (t, m::xor_, 6);
+        add_alu (t, m::cmp, 7);
+
+        add (t, m::mov, f::rm_r, 0, 0, 0x89, 0x88);
+        add (t, m::mov, f::r_rm, 0, 0, 0x8B, 0x8A);
+        add (t, m::mov, f::rm_i, 0, 0, 0xC7, 0xC6, 0);
+        add (t, m::mov, f::r_i, 0, 0, 0xB8, 0xB0);
+        add (t, m::movzx, f::r_rm, 0, 1, 0xB7, 0xB6, -1, ENC_SRC8);
+        add (t, m::movsx, f::r_rm, 0, 1, 0xBF, 0xBE, -1, ENC_SRC8);
+        add (t, m::movsxd, f::r_rm, 0, 0, 0x63, -1, -1, ENC_W);
+        add (t, m::lea, f::r_rm, 0, 0, 0x8D);
+        add (t, m::test, f::rm_r, 0, 0, 0x85, 0x84);
+        add (t, m::test, f::rm_i, 0, 0, 0xF7, 0xF6, 0);
+        add (t, m::xchg, f::rm_r, 0, 0, 0x87, 0x86);
+
+        add (t, m::imul, f::r_rm, 0, 1, 0xAF);
+        add (t, m::imul, f::r_rm_i8, 0, 0, 0x6B);
+        add (t, m::imul, f::r_rm_i, 0, 0, 0x69);
+        add_unary (t, m::imul, 0xF7, 5);
+        add_unary (t, m::mul, 0xF7, 4);
+        add_unary (t, m::div, 0xF7, 6);
+        add_unary (t, m::idiv, 0xF7, 7);
+        add_unary (t, m::neg, 0xF7, 3);
+        add_unary (t, m::not_, 0xF7, 2);
+        add_unary (t, m::inc, 0xFF, 0);
+        add_unary (t, m::dec, 0xFF, 1);
+
+        add_shift (t, m::rol, 0);
+        add_shift (t, m::ror, 1);
+        add_shift (t, m::rcl, 2);
+        add_shift (t, m::rcr, 3);
+        add_shift (t, m::shl, 4);
+        add_shift (t, m::shr, 5);
+        add_shift (t, m::sar, 7);
+
+        add (t, m::push, f::o, 0, 0, 0x50, -1, -1, ENC_D64);
+        add (t, m::push, f::rm, 0, 0, 0xFF, -1, 6, ENC_D64);
+        add (t, m::push, f::i8, 0, 0, 0x6A);
+        add (t, m::push, f::i, 0, 0, 0x68);
+        add (t, m::pop, f::o, 0, 0, 0x58, -1, -1, ENC_D64);
+        add (t, m::pop, f::rm, 0, 0, 0x8F, -1, 0, ENC_D64);
+        add (t, m::call, f::rel32, 0, 0, 0xE8);
+        add (t, m::call, f::rm, 0, 0, 0xFF, -1, 2, ENC_D64);
+        add (t, m::jmp, f::rel32, 0, 0, 0xE9);
+        add (t, m::jmp, f::rel8, 0, 0, 0xEB);
+        add (t, m::jmp, f::rm, 0, 0, 0xFF, -1, 4, ENC_D64);
+        add (t, m::ret, f::np, 0, 0, 0xC3);
+        add (t, m::leave, f::np, 0, 0, 0xC9);
+
+        add (t, m::cbw, f::np, 0x66, 0, 0x98);
+        add (t, m::cwde, f::np, 0, 0, 0x98);
+        add (t, m::cdqe, f::np, 0, 0, 0x98, -1, -1, ENC_W);
+        add (t, m::cwd, f::np, 0x66, 0, 0x99);
+        add (t, m::cdq, f::np, 0, 0, 0x99);
+        add (t, m::cqo, f::np, 0, 0, 0x99, -1, -1, ENC_W);
+
+        add (t, m::bswap, f::o, 0, 1, 0xC8);
+        add (t, m::popcnt, f::r_rm, 0xF3, 1, 0xB8);
+        add (t, m::lzcnt, f::r_rm, 0xF3, 1, 0xBD);
+        add (t, m::tzcnt, f::r_rm, 0xF3, 1, 0xBC);
+        add (t, m::bt, f::rm_r, 0, 1, 0xA3);
+        add (t, m::bt, f::rm_i8, 0, 1, 0xBA, -1, 4);
+
+        add (t, m::nop, f::np, 0, 0, 0x90);
+        add (t, m::int3, f::np, 0, 0, 0xCC);
+        add (t, m::ud2, f::np, 0, 1, 0x0B);
+        add (t, m::syscall, f::np, 0, 1, 0x05);
+
+        for (int cc = 0; cc < 16; ++cc)
+          {
+            add (t, with_condition (m::jo, cc), f::rel32, 0, 1, 0x80 + cc);
+            add (t, with_condition (m::jo, cc), f::rel8, 0, 0, 0x70 + cc);
+          }
+        for (int cc = 0; cc < 16; ++cc)
+          add (t, with_condition (m::seto, cc), f::rm, 0, 1, 0x90 + cc, 0x90 + cc, 0);
+        for (int cc = 0; cc < 16; ++cc)
+          add (t, with_condition (m::cmovo, cc), f::r_rm, 0, 1, 0x40 + cc);
+
+        // SSE
+        add_sse (t, m::movss, 0xF3, 0x10);
+        add_sse (t, m::movss, 0xF3, 0x11, f::rm_r);
+        add_sse (t, m::movsd, 0xF2, 0x10);
+        add_sse (t, m::movsd, 0xF2, 0x11, f::rm_r);
+        add_sse (t, m::movaps, 0, 0x28);
+        add_sse (t, m::movaps, 0, 0x29, f::rm_r);
+        add_sse (t, m::movups, 0, 0x10);
+        add_sse (t, m::movups, 0, 0x11, f::rm_r);
+        add_sse (t, m::movapd, 0x66, 0x28);
+        add_sse (t, m::movapd, 0x66, 0x29, f::rm_r);
+        add_sse (t, m::movupd, 0x66, 0x10);
+        add_sse (t, m::movupd, 0x66, 0x11, f::rm_r);
+        add_sse (t, m::movdqa, 0x66, 0x6F);
+        add_sse (t, m::movdqa, 0x66, 0x7F, f::rm_r);
+        add_sse (t, m::movdqu, 0xF3, 0x6F);
+        add_sse (t, m::movdqu, 0xF3, 0x7F, f::rm_r);
+        add_sse (t, m::movd, 0x66, 0x6E);
+        add_sse (t, m::movd, 0x66, 0x7E, f::rm_r);
+        add_sse (t, m::movq, 0x66, 0x6E, f::r_rm, ENC_W);
+        add_sse (t, m::movq, 0x66, 0x7E, f::rm_r, ENC_W);
+
+        add_sse4 (t, m::addss, 0x58);
+        add_sse4 (t, m::subss, 0x5C);
+        add_sse4 (t, m::mulss, 0x59);
+        add_sse4 (t, m::divss, 0x5E);
+        add_sse4 (t, m::minss, 0x5D);
+        add_sse4 (t, m::maxss, 0x5F);
+        add_sse4 (t, m::sqrtss, 0x51);
+        add_sse (t, m::andps, 0, 0x54);
+        add_sse (t, m::andpd, 0x66, 0x54);
+        add_sse (t, m::andnps, 0, 0x55);
+        add_sse (t, m::andnpd, 0x66, 0x55);
+        add_sse (t, m::orps, 0, 0x56);
+        add_sse (t, m::orpd, 0x66, 0x56);
+        add_sse (t, m::xorps, 0, 0x57);
+        add_sse (t, m::xorpd, 0x66, 0x57);
+        add_sse (t, m::ucomiss, 0, 0x2E);
+        add_sse (t, m::ucomisd, 0x66, 0x2E);
+        add_sse (t, m::comiss, 0, 0x2F);
+        add_sse (t, m::comisd, 0x66, 0x2F);
+
+        add_sse (t, m::cvtsi2ss, 0xF3, 0x2A, f::r_rm, ENC_GPR_W);
+        add_sse (t, m::cvtsi2sd, 0xF2, 0x2A, f::r_rm, ENC_GPR_W);
+        add_sse (t, m::cvttss2si, 0xF3, 0x2C, f::r_rm, ENC_GPR_W);
+        add_sse (t, m::cvttsd2si, 0xF2, 0x2C, f::r_rm, ENC_GPR_W);
+        add_sse (t, m::cvtss2sd, 0xF3, 0x5A);
+        add_sse (t, m::cvtsd2ss, 0xF2, 0x5A);
+        add_sse (t, m::cvtdq2ps, 0, 0x5B);
+        add_sse (t, m::cvttps2dq, 0xF3, 0x5B);
+
+        add_sse (t, m::paddb, 0x66, 0xFC);
+        add_sse (t, m::paddw, 0x66, 0xFD);
+        add_sse (t, m::paddd, 0x66, 0xFE);
+        add_sse (t, m::paddq, 0x66, 0xD4);
+        add_sse (t, m::psubb, 0x66, 0xF8);
+        add_sse (t, m::psubw, 0x66, 0xF9);
+        add_sse (t, m::psubd, 0x66, 0xFA);
+        add_sse (t, m::psubq, 0x66, 0xFB);
+        add_sse (t, m::pmullw, 0x66, 0xD5);
+        add (t, m::pmulld, f::r_rm, 0x66, 2, 0x40, -1, -1, ENC_VEC);
+        add_sse (t, m::pand, 0x66, 0xDB);
+        add_sse (t, m::pandn, 0x66, 0xDF);
+        add_sse (t, m::por, 0x66, 0xEB);
+        add_sse (t, m::pxor, 0x66, 0xEF);
+        add_sse (t, m::pcmpeqb, 0x66, 0x74);
+        add_sse (t, m::pcmpeqw, 0x66, 0x75);
+        add_sse (t, m::pcmpeqd, 0x66, 0x76);
+        add_sse (t, m::pcmpgtd, 0x66, 0x66);
+        add_sse (t, m::pshufd, 0x66, 0x70, f::r_rm_i8);
+        add_sse (t, m::shufps, 0, 0xC6, f::r_rm_i8);
+
+        // AVX
+        add_vex (t, m::vmovaps, 0, 1, 0x28, f::r_rm);
+        add_vex (t, m::vmovaps, 0, 1, 0x29, f::rm_r);
+        add_vex (t, m::vmovups, 0, 1, 0x10, f::r_rm);
+        add_vex (t, m::vmovups, 0, 1, 0x11, f::rm_r);
+        add_vex (t, m::vmovdqa, 0x66, 1, 0x6F, f::r_rm);
+        add_vex (t, m::vmovdqa, 0x66, 1, 0x7F, f::rm_r);
+        add_vex (t, m::vmovdqu, 0xF3, 1, 0x6F, f::r_rm);
+        add_vex (t, m::vmovdqu, 0xF3, 1, 0x7F, f::rm_r);
+        add_vex (t, m::vbroadcastss, 0x66, 2, 0x18, f::r_rm);
+        add_vex (t, m::vzeroupper, 0, 1, 0x77, f::np);
+
+        add_vex4 (t, m::vaddss, 0x58);
+        add_vex4 (t, m::vsubss, 0x5C);
+        add_vex4 (t, m::vmulss, 0x59);
+        add_vex4 (t, m::vdivss, 0x5E);
+        add_vex (t, m::vminps, 0, 1, 0x5D);
+        add_vex (t, m::vminpd, 0x66, 1, 0x5D);
+        add_vex (t, m::vmaxps, 0, 1, 0x5F);
+        add_vex (t, m::vmaxpd, 0x66, 1, 0x5F);
+        add_vex (t, m::vandps, 0, 1, 0x54);
+        add_vex (t, m::vandpd, 0x66, 1, 0x54);
+        add_vex (t, m::vorps, 0, 1, 0x56);
+        add_vex (t, m::vorpd, 0x66, 1, 0x56);
+        add_vex (t, m::vxorps, 0, 1, 0x57);
+        add_vex (t, m::vxorpd, 0x66, 1, 0x57);
+
+        add_vex (t, m::vpaddb, 0x66, 1, 0xFC);
+        add_vex (t, m::vpaddw, 0x66, 1, 0xFD);
+        add_vex (t, m::vpaddd, 0x66, 1, 0xFE);
+        add_vex (t, m::vpaddq, 0x66, 1, 0xD4);
+        add_vex (t, m::vpsubb, 0x66, 1, 0xF8);
+        add_vex (t, m::vpsubw, 0x66, 1, 0xF9);
+        add_vex (t, m::vpsubd, 0x66, 1, 0xFA);
+        add_vex (t, m::vpsubq, 0x66, 1, 0xFB);
+        add_vex (t, m::vpmullw, 0x66, 1, 0xD5);
+        add_vex (t, m::vpmulld, 0x66, 2, 0x40);
+        add_vex (t, m::vpand, 0x66, 1, 0xDB);
+        add_vex (t, m::vpandn, 0x66, 1, 0xDF);
+        add_vex (t, m::vpor, 0x66, 1, 0xEB);
+        add_vex (t, m::vpxor, 0x66, 1, 0xEF);
+        add_vex (t, m::vpcmpeqb, 0x66, 1, 0x74);
+        add_vex (t, m::vpcmpeqw, 0x66, 1, 0x75);
+        add_vex (t, m::vpcmpeqd, 0x66, 1, 0x76);
+        add_vex (t, m::vpcmpgtd, 0x66, 1, 0x66);
+
+        add_vex (t, m::vfmadd231ps, 0x66, 2, 0xB8);
+        add_vex (t, m::vfmadd231pd, 0x66, 2, 0xB8, f::r_v_rm, ENC_W);
+        add_vex (t, m::vfmadd231ss, 0x66, 2, 0xB9);
+        add_vex (t, m::vfmadd231sd, 0x66, 2, 0xB9, f::r_v_rm, ENC_W);
+
+        return t;
+      }
+    }
+
+    //! \brief The encoding table, built at compile time.
+    constexpr encoding_table encodings = detail::make_encoding_table ();
+
+    /*!
+       \brief Finds the encoding of the specified form of an instruction.
+       \return An encoding whose valid field is false if there is none.
+
+       Meant to be evaluated at compile time.
+     */
+    constexpr op_encoding
+    find_encoding (mnemonic mn, op_form form)
+    {
+      for (size_t i = 0; i < encodings.size; ++i)
+        if (encodings.rows[i].mn == mn && encodings.rows[i].form == form)
+          return encodings.rows[i];
+      return op_encoding {};
+    }
+
+    //! \brief Checks whether the specified instruction has the specified form.
+    constexpr bool
+    has_encoding (mnemonic mn, op_form form)
+    {
+      return find_encoding (mn, form).valid;
+    }
+  }
+}
+
+#endif
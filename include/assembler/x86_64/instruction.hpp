@@ -27,6 +27,15 @@ namespace jcc {
 
   namespace x86_64 {
     
+    /*!
+       \enum reg_code
+       \brief Register codes.
+
+       The upper nibble holds the register's class (and so its size), the
+       lower nibble the register's number. AH/CH/DH/BH cannot be encoded in
+       an instruction that has a REX prefix, and SPL/BPL/SIL/DIL and the
+       extended registers (R8-R15) need one.
+     */
     enum reg_code
     {
       REG_NONE    = 0xFF,
@@ -39,6 +48,14 @@ namespace jcc {
       REG_CH      = 0x05,
       REG_DH      = 0x06,
       REG_BH      = 0x07,
+      REG_R8B     = 0x08,
+      REG_R9B     = 0x09,
+      REG_R10B    = 0x0A,
+      REG_R11B    = 0x0B,
+      REG_R12B    = 0x0C,
+      REG_R13B    = 0x0D,
+      REG_R14B    = 0x0E,
+      REG_R15B    = 0x0F,
       
       REG_AX      = 0x10,
       REG_CX      = 0x11,
@@ -48,6 +65,14 @@ namespace jcc {
       REG_BP      = 0x15,
       REG_SI      = 0x16,
       REG_DI      = 0x17,
+      REG_R8W     = 0x18,
+      REG_R9W     = 0x19,
+      REG_R10W    = 0x1A,
+      REG_R11W    = 0x1B,
+      REG_R12W    = 0x1C,
+      REG_R13W    = 0x1D,
+      REG_R14W    = 0x1E,
+      REG_R15W    = 0x1F,
       
       REG_EAX     = 0x20,
       REG_ECX     = 0x21,
@@ -57,6 +82,14 @@ namespace jcc {
       REG_EBP     = 0x25,
       REG_ESI     = 0x26,
       REG_EDI     = 0x27,
+      REG_R8D     = 0x28,
+      REG_R9D     = 0x29,
+      REG_R10D    = 0x2A,
+      REG_R11D    = 0x2B,
+      REG_R12D    = 0x2C,
+      REG_R13D    = 0x2D,
+      REG_R14D    = 0x2E,
+      REG_R15D    = 0x2F,
       
       REG_RAX     = 0x30,
       REG_RCX     = 0x31,
@@ -66,8 +99,34 @@ namespace jcc {
       REG_RBP     = 0x35,
       REG_RSI     = 0x36,
       REG_RDI     = 0x37,
-      REG_RIP     = 0x38,
+      REG_R8      = 0x38,
+      REG_R9      = 0x39,
+      REG_R10     = 0x3A,
+      REG_R11     = 0x3B,
+      REG_R12     = 0x3C,
+      REG_R13     = 0x3D,
+      REG_R14     = 0x3E,
+      REG_R15     = 0x3F,
+
+      // low bytes of SP/BP/SI/DI (need a REX prefix)
+      REG_SPL     = 0x44,
+      REG_BPL     = 0x45,
+      REG_SIL     = 0x46,
+      REG_DIL     = 0x47,
+
+      // XMM0-XMM15
+      REG_XMM0    = 0x50,
+      // YMM0-YMM15
+      REG_YMM0    = 0x60,
+
+      REG_RIP     = 0x70,
     };
+
+    //! \brief Returns the code of XMM register N.
+    inline int reg_xmm (int n) { return REG_XMM0 + n; }
+
+    //! \brief Returns the code of YMM register N.
+    inline int reg_ymm (int n) { return REG_YMM0 + n; }
     
     enum size_specifier
     {
@@ -108,6 +167,13 @@ namespace jcc {
     public:
       //! /brief Returns the size of the register in bits.
       int register_size () const;
+
+      //! \brief Returns the register's number (0-15), as encoded in ModR/M,
+      //!        REX and VEX fields.
+      inline int number () const { return this->code & 0xF; }
+
+      //! \brief Checks whether the register is an XMM or a YMM register.
+      inline bool is_vector () const { return (this->code >> 4) == 5 || (this->code >> 4) == 6; }
     };
     
     struct mem_t
@@ -141,24 +207,37 @@ namespace jcc {
 
     struct fixed_t { };
 
+    /*!
+       \struct lbl_t
+       \brief A relative reference to a label, or a fixed displacement.
+
+       A label reference without an explicit size specifier is relaxed: the
+       assembler emits it in its long form, and fix_labels() shrinks it to a
+       rel8 displacement if the label turns out to be close enough.
+     */
     struct lbl_t
     {
       label_id id;
       size_specifier ss;
       bool fixed;
+      bool relax;
       long long val;
 
      public:
-      lbl_t (label_id id, size_specifier ss = SS_DWORD)
-          : id (id), ss (ss), fixed (false), val (0)
+      lbl_t (label_id id)
+          : id (id), ss (SS_DWORD), fixed (false), relax (true), val (0)
+      { }
+
+      lbl_t (label_id id, size_specifier ss)
+          : id (id), ss (ss), fixed (false), relax (false), val (0)
       { }
 
       lbl_t (fixed_t, long long val, size_specifier ss = SS_DWORD)
-          : id (0), ss (ss), fixed (true), val (val)
+          : id (0), ss (ss), fixed (true), relax (false), val (val)
       { }
 
       lbl_t ()
-          : id (0), ss (SS_DWORD), fixed (false), val (0)
+          : id (0), ss (SS_DWORD), fixed (false), relax (false), val (0)
       { }
     };
     
@@ -0,0 +1,181 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _JCC__COMMON__BIT_VECTOR__H_
+#define _JCC__COMMON__BIT_VECTOR__H_
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+
+namespace jcc {
+
+  /*!
+     \class bit_vector
+     \brief Dense, fixed-size set of bits.
+
+     Used wherever a set over a small, densely numbered universe is needed
+     (e.g. data-flow facts), where std::set would be far too slow.
+   */
+  class bit_vector
+  {
+    std::vector<uint64_t> words;
+    size_t sz;
+
+   public:
+    inline size_t size () const { return this->sz; }
+
+   public:
+    bit_vector ()
+        : sz (0)
+    { }
+
+    explicit bit_vector (size_t size, bool value = false)
+        : words ((size + 63) / 64, value ? ~(uint64_t)0 : 0), sz (size)
+    { this->trim (); }
+
+   public:
+    inline bool
+    test (size_t idx) const
+    { return (this->words[idx >> 6] >> (idx & 63)) & 1; }
+
+    inline void
+    set (size_t idx)
+    { this->words[idx >> 6] |= (uint64_t)1 << (idx & 63); }
+
+    inline void
+    reset (size_t idx)
+    { this->words[idx >> 6] &= ~((uint64_t)1 << (idx & 63)); }
+
+    //! \brief Sets all bits to the specified value.
+    inline void
+    fill (bool value)
+    {
+      for (auto& w : this->words)
+        w = value ? ~(uint64_t)0 : 0;
+      this->trim ();
+    }
+
+    //! \brief Returns the number of set bits.
+    inline size_t
+    count () const
+    {
+      size_t n = 0;
+      for (auto w : this->words)
+        n += (size_t)__builtin_popcountll (w);
+      return n;
+    }
+
+    inline bool
+    none () const
+    {
+      for (auto w : this->words)
+        if (w)
+          return false;
+      return true;
+    }
+
+    /*!
+       \brief Returns the index of the first set bit whose index is greater
+              than or equal to the one specified, or size() if there is none.
+     */
+    inline size_t
+    find_next (size_t idx) const
+    {
+      if (idx >= this->sz)
+        return this->sz;
+
+      size_t wi = idx >> 6;
+      uint64_t w = this->words[wi] & (~(uint64_t)0 << (idx & 63));
+      for (;;)
+        {
+          if (w)
+            return (wi << 6) + (size_t)__builtin_ctzll (w);
+          if (++ wi == this->words.size ())
+            return this->sz;
+          w = this->words[wi];
+        }
+    }
+
+    inline size_t find_first () const { return this->find_next (0); }
+
+    //! \brief Calls the specified function for every set bit, in order.
+    template<typename Fn>
+    void
+    for_each (Fn&& fn) const
+    {
+      for (size_t wi = 0; wi < this->words.size (); ++wi)
+        for (uint64_t w = this->words[wi]; w; w &= w - 1)
+          fn ((wi << 6) + (size_t)__builtin_ctzll (w));
+    }
+
+   public:
+    //! \brief this |= other
+    inline void
+    unite (const bit_vector& other)
+    {
+      for (size_t i = 0; i < this->words.size (); ++i)
+        this->words[i] |= other.words[i];
+    }
+
+    //! \brief this &= other
+    inline void
+    intersect (const bit_vector& other)
+    {
+      for (size_t i = 0; i < this->words.size (); ++i)
+        this->words[i] &= other.words[i];
+    }
+
+    //! \brief this &= ~other
+    inline void
+    subtract (const bit_vector& other)
+    {
+      for (size_t i = 0; i < this->words.size (); ++i)
+        this->words[i] &= ~other.words[i];
+    }
+
+    //! \brief this = gen | (in & ~kill)
+    inline void
+    assign_transfer (const bit_vector& gen, const bit_vector& in,
+                     const bit_vector& kill)
+    {
+      for (size_t i = 0; i < this->words.size (); ++i)
+        this->words[i] = gen.words[i] | (in.words[i] & ~kill.words[i]);
+    }
+
+    inline bool
+    operator== (const bit_vector& other) const
+    { return this->sz == other.sz && this->words == other.words; }
+
+    inline bool
+    operator!= (const bit_vector& other) const
+    { return !(*this == other); }
+
+   private:
+    //! \brief Clears the unused bits in the last word.
+    inline void
+    trim ()
+    {
+      if (this->sz & 63)
+        this->words.back () &= ((uint64_t)1 << (this->sz & 63)) - 1;
+    }
+  };
+}
+
+#endif //_JCC__COMMON__BIT_VECTOR__H_
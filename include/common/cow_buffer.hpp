@@ -0,0 +1,144 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _JCC__COMMON__COW_BUFFER__H_
+#define _JCC__COMMON__COW_BUFFER__H_
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+
+namespace jcc {
+
+  /*!
+     \class cow_buffer
+     \brief A byte array that is either owned, or a read-only view into memory
+            owned by someone else (e.g. a mapped_file).
+
+     Views are cheap to copy: all copies share the viewed memory, which is kept
+     alive through a shared_ptr to its owner. The bytes are copied into a
+     buffer of their own only on the first mutable access (copy-on-write).
+   */
+  class cow_buffer
+  {
+    std::shared_ptr<const void> owner; // set only for views
+    const unsigned char *view;
+    size_t view_len;
+    std::vector<unsigned char> own;
+
+   public:
+    inline bool is_view () const { return this->view != nullptr; }
+
+    inline const unsigned char*
+    data () const
+    { return this->view ? this->view : this->own.data (); }
+
+    inline size_t
+    size () const
+    { return this->view ? this->view_len : this->own.size (); }
+
+    inline bool empty () const { return this->size () == 0; }
+
+    inline const unsigned char* begin () const { return this->data (); }
+    inline const unsigned char* end () const { return this->data () + this->size (); }
+
+   public:
+    cow_buffer ()
+        : view (nullptr), view_len (0)
+    { }
+
+    cow_buffer (const unsigned char *data, size_t len)
+        : view (nullptr), view_len (0), own (data, data + len)
+    { }
+
+    cow_buffer (const std::vector<unsigned char>& data)
+        : view (nullptr), view_len (0), own (data)
+    { }
+
+    cow_buffer (std::vector<unsigned char>&& data)
+        : view (nullptr), view_len (0), own (std::move (data))
+    { }
+
+    //! \brief Creates a view of len bytes at data, which is kept alive by owner.
+    static cow_buffer
+    make_view (std::shared_ptr<const void> owner, const unsigned char *data,
+               size_t len)
+    {
+      cow_buffer buf;
+      if (len == 0)
+        return buf;
+
+      buf.owner = std::move (owner);
+      buf.view = data;
+      buf.view_len = len;
+      return buf;
+    }
+
+   public:
+    //! \brief Returns the underlying vector, copying the viewed bytes first.
+    inline std::vector<unsigned char>&
+    get_vector ()
+    {
+      this->make_own ();
+      return this->own;
+    }
+
+    //! \brief Returns a writable pointer to the bytes, copying them first if
+    //!        the buffer is a view.
+    inline unsigned char*
+    get_mutable_data ()
+    { return this->get_vector ().data (); }
+
+    //! \brief Replaces the contents of the buffer with a copy of the given bytes.
+    inline void
+    assign (const unsigned char *data, size_t len)
+    {
+      // copy first, the bytes might belong to the current view
+      std::vector<unsigned char> copy (data, data + len);
+      this->drop_view ();
+      this->own = std::move (copy);
+    }
+
+    inline void
+    resize (size_t len)
+    { this->get_vector ().resize (len); }
+
+   private:
+    inline void
+    make_own ()
+    {
+      if (!this->view)
+        return;
+
+      std::vector<unsigned char> copy (this->view, this->view + this->view_len);
+      this->drop_view ();
+      this->own = std::move (copy);
+    }
+
+    inline void
+    drop_view ()
+    {
+      this->view = nullptr;
+      this->view_len = 0;
+      this->owner.reset ();
+    }
+  };
+}
+
+#endif //_JCC__COMMON__COW_BUFFER__H_
@@ -0,0 +1,65 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _JCC__COMMON__EXECUTABLE_MEMORY__H_
+#define _JCC__COMMON__EXECUTABLE_MEMORY__H_
+
+#include <cstddef>
+
+
+namespace jcc {
+
+  /*!
+     \class executable_memory
+     \brief Anonymous memory pages that hold generated code.
+
+     The pages are never writable and executable at the same time (W^X):
+     they start out writable, and are flipped to read-only executable once
+     the code has been written.
+   */
+  class executable_memory
+  {
+    unsigned char *ptr;
+    size_t len;
+    bool exec;
+
+   public:
+    inline unsigned char* data () { return this->ptr; }
+    inline const unsigned char* data () const { return this->ptr; }
+    inline size_t size () const { return this->len; }
+    inline bool is_executable () const { return this->exec; }
+
+   public:
+    //! \brief Maps writable pages that hold at least the specified number
+    //!        of bytes.
+    explicit executable_memory (size_t size);
+    executable_memory (const executable_memory& other) = delete;
+    ~executable_memory ();
+
+    executable_memory& operator= (const executable_memory& other) = delete;
+
+   public:
+    //! \brief Makes the pages writable (and not executable).
+    void make_writable ();
+
+    //! \brief Makes the pages executable (and not writable).
+    void make_executable ();
+  };
+}
+
+#endif //_JCC__COMMON__EXECUTABLE_MEMORY__H_
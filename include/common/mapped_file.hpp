@@ -0,0 +1,86 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _JCC__COMMON__MAPPED_FILE__H_
+#define _JCC__COMMON__MAPPED_FILE__H_
+
+#include <string>
+#include <cstddef>
+
+
+namespace jcc {
+
+  /*!
+     \class mapped_file
+     \brief A file mapped read-only into memory.
+
+     The mapping lives as long as the object does; byte views into it (see
+     cow_buffer) hold a shared_ptr to the file to keep it alive.
+   */
+  class mapped_file
+  {
+    const unsigned char *ptr;
+    size_t len;
+
+   public:
+    inline const unsigned char* data () const { return this->ptr; }
+    inline size_t size () const { return this->len; }
+
+   public:
+    //! \brief Maps the file at the specified path.
+    explicit mapped_file (const std::string& path);
+    mapped_file (const mapped_file& other) = delete;
+    ~mapped_file ();
+
+    mapped_file& operator= (const mapped_file& other) = delete;
+  };
+
+
+
+  /*!
+     \class mapped_output_file
+     \brief A file mapped writable into memory.
+
+     Either created (or truncated) with a known size, in which case it starts
+     out zero-filled, or an existing file mapped as is. Whatever is written
+     into the mapping ends up in the file once the object is destroyed.
+   */
+  class mapped_output_file
+  {
+    unsigned char *ptr;
+    size_t len;
+
+   public:
+    inline unsigned char* data () { return this->ptr; }
+    inline size_t size () const { return this->len; }
+
+   public:
+    //! \brief Creates (or truncates) the file at the specified path.
+    mapped_output_file (const std::string& path, size_t size);
+
+    //! \brief Maps the existing file at the specified path, keeping its
+    //!        contents.
+    explicit mapped_output_file (const std::string& path);
+    mapped_output_file (const mapped_output_file& other) = delete;
+    ~mapped_output_file ();
+
+    mapped_output_file& operator= (const mapped_output_file& other) = delete;
+  };
+}
+
+#endif //_JCC__COMMON__MAPPED_FILE__H_
@@ -0,0 +1,157 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _JCC__COMMON__THREAD_POOL__H_
+#define _JCC__COMMON__THREAD_POOL__H_
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <type_traits>
+
+
+namespace jcc {
+
+  /*!
+     \class thread_pool
+     \brief Fixed-size pool of worker threads with work stealing.
+
+     Every worker owns a task deque. Workers pop tasks from the back of their
+     own deque (so that recently spawned, cache-warm work runs first) and,
+     once it runs dry, steal from the front of the other workers' deques.
+     Tasks submitted from a worker thread go to that worker's own deque;
+     tasks submitted from outside the pool are spread round-robin.
+
+     Threads that wait on the pool (see parallel_for()) execute pending tasks
+     themselves instead of blocking, so nested parallelism cannot deadlock.
+   */
+  class thread_pool
+  {
+    struct task_queue
+    {
+      std::mutex mtx;
+      std::deque<std::function<void ()>> tasks;
+    };
+
+   private:
+    std::vector<std::unique_ptr<task_queue>> queues;
+    std::vector<std::thread> threads;
+
+    std::mutex wake_mtx;
+    std::condition_variable wake_cv;
+    std::atomic<size_t> pending;    // tasks queued, but not yet taken
+    std::atomic<size_t> next_queue; // round-robin counter for outside submits
+    bool stopping;
+
+   public:
+    inline unsigned get_thread_count () const { return (unsigned)this->threads.size (); }
+
+   public:
+    /*!
+       \brief Starts the specified number of worker threads.
+       \param num_threads Number of workers; zero picks the number of hardware
+                          threads.
+     */
+    explicit thread_pool (unsigned num_threads = 0);
+    ~thread_pool ();
+
+    thread_pool (const thread_pool&) = delete;
+    thread_pool& operator= (const thread_pool&) = delete;
+
+   public:
+    /*!
+       \brief Queues a task for execution.
+       \return A future that holds the task's result (or exception).
+     */
+    template<typename Fn>
+    auto
+    submit (Fn&& fn) -> std::future<typename std::result_of<Fn ()>::type>
+    {
+      using result_type = typename std::result_of<Fn ()>::type;
+      auto task = std::make_shared<std::packaged_task<result_type ()>> (
+          std::forward<Fn> (fn));
+      auto fut = task->get_future ();
+      this->push_task ([task] { (*task) (); });
+      return fut;
+    }
+
+    /*!
+       \brief Calls fn(i) for every i in [0, count) and waits for all calls to
+              complete.
+
+       The calling thread takes part in the work. If any call throws, the
+       first exception is rethrown once all calls have finished.
+     */
+    template<typename Fn>
+    void
+    parallel_for (size_t count, Fn&& fn)
+    {
+      std::atomic<size_t> remaining (count);
+      std::exception_ptr error;
+      std::mutex error_mtx;
+
+      for (size_t i = 0; i < count; ++i)
+        this->push_task ([&, i] {
+          try
+            {
+              fn (i);
+            }
+          catch (...)
+            {
+              std::lock_guard<std::mutex> guard (error_mtx);
+              if (!error)
+                error = std::current_exception ();
+            }
+          -- remaining;
+        });
+
+      while (remaining.load () != 0)
+        if (!this->run_pending_task ())
+          std::this_thread::yield ();
+
+      if (error)
+        std::rethrow_exception (error);
+    }
+
+    /*!
+       \brief Runs a single queued task on the calling thread, if there is
+              one.
+       \return True if a task was run.
+     */
+    bool run_pending_task ();
+
+   private:
+    //! \brief Inserts a task into the deque of the appropriate worker.
+    void push_task (std::function<void ()>&& task);
+
+    //! \brief Takes a task from the specified worker's deque, or steals one.
+    bool take_task (size_t idx, std::function<void ()>& task);
+
+    //! \brief Worker thread entry point.
+    void worker_main (size_t idx);
+  };
+}
+
+#endif //_JCC__COMMON__THREAD_POOL__H_
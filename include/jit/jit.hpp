@@ -0,0 +1,135 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _JCC__JIT__JIT__H_
+#define _JCC__JIT__JIT__H_
+
+#include "assembler/relocation.hpp"
+#include "assembler/x86_64/assembler.hpp"
+#include "common/executable_memory.hpp"
+#include "jtac/translate/x86_64/procedure.hpp"
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace jcc {
+
+  /*!
+     \class jit_error
+     \brief Thrown when code cannot be loaded into the JIT (e.g. because of an
+            undefined symbol).
+   */
+  class jit_error: public std::runtime_error
+  {
+   public:
+    jit_error (const std::string& str)
+        : std::runtime_error (str)
+    { }
+  };
+
+
+  /*!
+     \class jit
+     \brief Loads generated x86-64 code into the running process.
+
+     Each piece of loaded code gets pages of its own, which are written
+     while writable and then flipped to executable (see executable_memory),
+     so that nothing is ever writable and executable at once.
+
+     Relocations are resolved against the JIT's symbol table. It holds
+     symbols defined by the user (e.g. host functions) and everything
+     loaded so far. A relative call that cannot reach its target (which is
+     likely for host functions, as JIT pages can be mapped anywhere) goes
+     through a stub placed right after the code, which jumps to the target
+     through an absolute address. Only relocations marked as branches can
+     be redirected this way; other relative references (e.g. RIP-relative
+     loads) must reach their target directly.
+   */
+  class jit
+  {
+    struct region
+    {
+      std::unique_ptr<executable_memory> mem;
+      bool loaded;
+    };
+
+   private:
+    std::vector<region> regions;
+    std::unordered_map<std::string, const void *> syms;
+
+   public:
+    jit ();
+    jit (const jit& other) = delete;
+    jit& operator= (const jit& other) = delete;
+
+   public:
+    //! \brief Defines (or redefines) a symbol that loaded code can refer to.
+    void define_symbol (const std::string& name, const void *addr);
+
+    //! \brief Returns the address of the specified symbol, or null if it is
+    //!        not defined.
+    const void* find_symbol (const std::string& name) const;
+
+    //! \brief Returns the specified symbol as a pointer to a function of
+    //!        type T, or null if it is not defined.
+    template<typename T>
+    T*
+    get_function (const std::string& name) const
+    { return reinterpret_cast<T *> (const_cast<void *> (this->find_symbol (name))); }
+
+   public:
+    /*!
+       \brief Allocates writable memory for code of up to SIZE bytes.
+
+       An assembler can emit straight into this memory (see code_buffer),
+       in which case load() does not copy the code. Stubs for out-of-range
+       calls are placed after the code, so the memory should be left with
+       some room to spare (16 bytes per called symbol).
+     */
+    unsigned char* allocate (size_t size);
+
+    /*!
+       \brief Loads code into executable memory and defines NAME as its
+              address.
+
+       The code is copied into memory of its own, unless it lies in memory
+       returned by allocate(), in which case it is relocated in place.
+       Relocations to NAME refer to the code itself.
+
+       \return The address of the loaded code.
+       \throws jit_error if a symbol is undefined, or if a relocation that is
+               not a branch cannot reach its target.
+     */
+    void* load (const std::string& name, const unsigned char *code,
+                size_t size, const std::vector<relocation>& relocs);
+
+    //! \brief Loads the code generated by the specified assembler.
+    void* load (const std::string& name, const x86_64::assembler& asem);
+
+    //! \brief Loads a procedure translated from JTAC, under its own name.
+    void* load (const jtac::x86_64_procedure& proc);
+
+   private:
+    region* find_region (const unsigned char *ptr);
+  };
+}
+
+#endif //_JCC__JIT__JIT__H_
@@ -21,6 +21,7 @@
 
 #include "jtac/control_flow.hpp"
 #include <unordered_map>
+#include <memory>
 
 
 namespace jcc {
@@ -43,6 +44,9 @@ namespace jtac {
 
     //! \brief Returns the color of the specified variable.
     register_color get_color (jtac_var_id var) const;
+
+    //! \brief Checks whether the specified variable has been given a color.
+    bool has_color (jtac_var_id var) const;
   };
 
 
@@ -73,6 +77,23 @@ namespace jtac {
     virtual register_allocation allocate (control_flow_graph& cfg,
                                           int num_colors) = 0;
   };
+
+
+
+  /*!
+     \enum register_allocator_type
+     \brief The register allocators available to the back ends.
+   */
+  enum class register_allocator_type
+  {
+    basic,       //! \brief basic_register_allocator
+    irc,         //! \brief irc_register_allocator (iterated register coalescing)
+    linear_scan, //! \brief linear_scan_register_allocator (fast compile mode)
+  };
+
+  //! \brief Creates a register allocator of the specified type.
+  std::unique_ptr<register_allocator> make_register_allocator (
+      register_allocator_type type);
 }
 }
 
@@ -20,9 +20,10 @@
 #define _JCC__JTAC__ALLOCATORS__BASIC__BASIC__H_
 
 #include "jtac/allocation/allocator.hpp"
-#include "jtac/allocation/basic/undirected_graph.hpp"
+#include "jtac/allocation/interference_graph.hpp"
 #include "jtac/name_map.hpp"
 #include <set>
+#include <iosfwd>
 
 
 namespace jcc {
@@ -45,12 +46,15 @@ namespace jtac {
     std::set<live_range> spilled_lrs;
     int tmp_idx;
 
-    undirected_graph infer_graph; // inference graph
+    interference_graph infer_graph; // inference graph
+    std::vector<interference_graph::node_id> select_order; // order of coloring
+    interference_graph::node_id next_constrained;
 
     register_allocation *res; // result goes here
 
     // DEBUG:
     const name_map<jtac_var_id> *var_names;
+    std::ostream *dbg;
 
    public:
     basic_register_allocator ();
@@ -86,32 +90,32 @@ namespace jtac {
     bool color_graph ();
 
     //! \brief Picks a constrained node to remove from the inference graph.
-    undirected_graph::node_id pick_constrained_node ();
+    interference_graph::node_id pick_constrained_node ();
 
     //! \brief Picks a node to spill from the inference graph.
-    undirected_graph::node_id pick_node_to_spill (
-        const std::unordered_map<undirected_graph::node_id, register_color>& color_map);
+    interference_graph::node_id pick_node_to_spill (
+        const std::vector<register_color>& colors);
 
 
     //! \brief Inserts spill code for the specified live range into the CFG.
     void insert_spill_code (const live_range& lr);
 
-    /*!
-       Checks whether the specified instruction's operands contain variables
-       from the the given live range.
-     */
-    bool contains_live_range_use (const jtac_instruction& inst, const live_range& lr);
-
    public:
     //! \brief DEBUG
     void print (const name_map<jtac_var_id>& var_names);
 
     //! \brief DEBUG
-    void print_inference_graph (
-        std::unordered_map<undirected_graph::node_id, register_color>& color_map);
+    void print_inference_graph (const std::vector<register_color>& colors);
 
-    //! \brief DEBUG
+    /*!
+       \brief Sets the name table used in debug output.
+
+       NOTE: Debug output is only produced while a name table is set.
+     */
     void set_var_names (const name_map<jtac_var_id>& var_names);
+
+    //! \brief Sets the stream debug output is written to (std::cout by default).
+    void set_debug_stream (std::ostream& strm);
   };
 }
 }
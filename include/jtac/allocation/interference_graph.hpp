@@ -0,0 +1,127 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _JCC__JTAC__ALLOCATION__INTERFERENCE_GRAPH__H_
+#define _JCC__JTAC__ALLOCATION__INTERFERENCE_GRAPH__H_
+
+#include "common/bit_vector.hpp"
+#include <vector>
+#include <utility>
+
+
+namespace jcc {
+namespace jtac {
+
+  /*!
+     \class interference_graph
+     \brief Interference graph over densely numbered nodes [0, n).
+
+     Edges are stored twice: in a triangular bit-matrix, for constant-time
+     interference queries, and in per-node adjacency vectors, for fast
+     iteration over neighbours.
+
+     Nodes can be removed from the graph (as done during simplification)
+     and restored later on. Removing a node keeps its edges; the degree of
+     a node only counts neighbours that are still in the graph. Nodes in the
+     graph are kept in buckets by degree, along with a lower bound on the
+     least degree that is only raised when a node of low degree is looked
+     for. While nodes are being removed (each removal lowers the bound by
+     at most one), finding a node of least degree takes amortized constant
+     time.
+   */
+  class interference_graph
+  {
+   public:
+    using node_id = int;
+
+   private:
+    int n;
+    bit_vector matrix; // lower triangle, without the diagonal
+    std::vector<std::vector<node_id>> adj;
+    std::vector<int> degrees;
+    std::vector<char> present;
+    int num_present;
+
+    // degree buckets, as intrusive doubly-linked lists
+    std::vector<node_id> bucket_heads;
+    std::vector<node_id> bucket_next;
+    std::vector<node_id> bucket_prev;
+    mutable int min_degree; // buckets below it are empty
+
+   public:
+    //! \brief Returns the number of nodes currently in the graph.
+    inline size_t size () const { return (size_t)this->num_present; }
+    inline bool empty () const { return this->num_present == 0; }
+
+    //! \brief Returns the number of nodes, including removed ones.
+    inline int get_node_count () const { return this->n; }
+
+    inline bool contains (node_id id) const { return this->present[id]; }
+    inline int get_degree (node_id id) const { return this->degrees[id]; }
+
+    //! \brief Returns all neighbours of a node, including removed ones.
+    inline const std::vector<node_id>& get_adjacent (node_id id) const { return this->adj[id]; }
+
+    //! \brief Checks whether there is an edge between the specified nodes.
+    inline bool
+    interferes (node_id a, node_id b) const
+    { return a != b && this->matrix.test (this->matrix_index (a, b)); }
+
+   public:
+    interference_graph ();
+    explicit interference_graph (int n);
+
+   public:
+    //! \brief Removes all edges and resets the graph to contain n lone nodes.
+    void reset (int n);
+
+    //! \brief Inserts an edge between two distinct nodes (if not present).
+    void add_edge (node_id a, node_id b);
+
+    //! \brief Removes a node from the graph, keeping its edges.
+    void remove_node (node_id id);
+
+    //! \brief Puts a previously removed node back into the graph.
+    void restore_node (node_id id);
+
+    //! \brief Checks whether the graph contains a node of degree less than K.
+    bool has_less_k (int k) const;
+
+    //! \brief Returns a node of least degree, which must be less than K.
+    node_id find_less_k (int k) const;
+
+   private:
+    inline size_t
+    matrix_index (node_id a, node_id b) const
+    {
+      if (a < b)
+        std::swap (a, b);
+      return (size_t)a * (size_t)(a - 1) / 2 + (size_t)b;
+    }
+
+    void bucket_insert (node_id id);
+    void bucket_remove (node_id id);
+
+    //! \brief Returns the least degree of a node in the graph, or n if the
+    //!        graph is empty.
+    int least_degree () const;
+  };
+}
+}
+
+#endif //_JCC__JTAC__ALLOCATION__INTERFERENCE_GRAPH__H_
@@ -0,0 +1,184 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _JCC__JTAC__ALLOCATION__IRC__IRC__H_
+#define _JCC__JTAC__ALLOCATION__IRC__IRC__H_
+
+#include "jtac/allocation/allocator.hpp"
+#include "jtac/allocation/spill.hpp"
+#include "common/bit_vector.hpp"
+#include <vector>
+#include <unordered_map>
+
+
+namespace jcc {
+namespace jtac {
+
+  /*!
+     \class irc_register_allocator
+     \brief Chaitin-Briggs register allocator with iterated register
+            coalescing.
+
+     Implements the allocator described by George and Appel ("Iterated
+     Register Coalescing"). Nodes of the interference graph are live ranges
+     (SSA names joined through phi-functions). Simplification and
+     conservative coalescing (using both the Briggs and the George test) are
+     interleaved, move-related nodes are frozen only when nothing else can be
+     done, and coloring is optimistic: spill candidates are pushed onto the
+     select stack and only spilled if no color is left for them.
+
+     Spill candidates are chosen by the ratio of their spill cost (every
+     definition and use weighted by 10^(loop depth)) to their degree.
+     Temporaries introduced by spill code are never chosen again.
+
+     Moves whose source and destination end up in the same register are
+     removed from the CFG.
+   */
+  class irc_register_allocator: public register_allocator
+  {
+    enum class node_state: unsigned char
+    {
+      simplify,
+      freeze,
+      spill,
+      spilled,
+      coalesced,
+      colored,
+      select,
+    };
+
+    enum class move_state: unsigned char
+    {
+      worklist,
+      active,
+      coalesced,
+      constrained,
+      frozen,
+    };
+
+    struct move
+    {
+      int dest;
+      int src;
+    };
+
+   private:
+    control_flow_graph *cfg;
+    int num_colors;
+    int tmp_idx;
+
+    std::vector<int> loop_depths; // by index in the CFG's block list
+
+    // nodes
+    std::vector<live_range> live_ranges;
+    std::unordered_map<jtac_var_id, int> live_range_map;
+    std::vector<double> spill_costs;   // of the merged node, once coalesced
+    std::vector<char> temps;           // made up only of spill temporaries
+
+    // interference graph
+    std::vector<bit_vector> adj_set;
+    std::vector<std::vector<int>> adj_list;
+    std::vector<int> degrees;
+
+    // moves
+    std::vector<move> moves;
+    std::vector<move_state> move_states;
+    std::vector<std::vector<int>> move_lists; // moves each node takes part in
+
+    // worklists (states are authoritative, lists may hold stale entries)
+    std::vector<node_state> states;
+    std::vector<int> simplify_worklist;
+    std::vector<int> freeze_worklist;
+    std::vector<int> spill_worklist;
+    std::vector<int> move_worklist;
+    std::vector<int> select_stack;
+    std::vector<int> spilled_nodes;
+
+    std::vector<int> aliases;
+    std::vector<register_color> colors;
+
+   public:
+    irc_register_allocator ();
+
+   public:
+    virtual register_allocation allocate (control_flow_graph& cfg,
+                                          int num_colors) override;
+
+   private:
+    //! \brief Builds the interference graph, the move list and spill costs.
+    void build ();
+
+    //! \brief Inserts an interference edge between the specified nodes.
+    void add_edge (int u, int v);
+
+    //! \brief Distributes the nodes among the initial worklists.
+    void make_worklist ();
+
+    /*!
+       \brief Runs simplification, coalescing, freezing and spill selection
+              until all worklists are empty.
+     */
+    void reduce ();
+
+    //! \brief Pops nodes off the select stack and assigns them colors.
+    void assign_colors ();
+
+   private:
+    //! \brief Checks whether the specified node is still in the graph.
+    inline bool
+    in_graph (int n) const
+    {
+      return this->states[n] != node_state::select
+             && this->states[n] != node_state::coalesced;
+    }
+
+    //! \brief Calls the specified function for every neighbour still in the graph.
+    template<typename Fn>
+    void
+    for_each_adjacent (int n, Fn&& fn)
+    {
+      for (int m : this->adj_list[n])
+        if (this->in_graph (m))
+          fn (m);
+    }
+
+    //! \brief Checks whether the specified node is involved in pending moves.
+    bool is_move_related (int n) const;
+
+    //! \brief Returns the node the specified node was coalesced into.
+    int get_alias (int n) const;
+
+    void simplify ();
+    void decrement_degree (int m);
+    void enable_moves (int n);
+
+    void coalesce ();
+    void add_work_list (int u);
+    bool george_test (int u, int v);
+    bool briggs_test (int u, int v);
+    void combine (int u, int v);
+
+    void freeze ();
+    void freeze_moves (int u);
+
+    void select_spill ();
+  };
+}
+}
+
+#endif //_JCC__JTAC__ALLOCATION__IRC__IRC__H_
@@ -0,0 +1,149 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _JCC__JTAC__ALLOCATION__LINEAR_SCAN__LINEAR_SCAN__H_
+#define _JCC__JTAC__ALLOCATION__LINEAR_SCAN__LINEAR_SCAN__H_
+
+#include "jtac/allocation/allocator.hpp"
+#include "jtac/allocation/spill.hpp"
+#include <vector>
+#include <unordered_map>
+#include <utility>
+
+
+namespace jcc {
+namespace jtac {
+
+  /*!
+     \class live_interval
+     \brief The positions at which a live range is live, in a linear order
+            of the CFG's instructions.
+
+     Stored as a sorted list of disjoint half-open ranges [from, to); the gaps
+     between them are lifetime holes, during which the live range's register
+     can be used by other intervals.
+   */
+  class live_interval
+  {
+    std::vector<std::pair<int, int>> ranges;
+
+   public:
+    inline bool empty () const { return this->ranges.empty (); }
+    inline int get_start () const { return this->ranges.front ().first; }
+    inline int get_end () const { return this->ranges.back ().second; }
+
+   public:
+    /*!
+       \brief Inserts the range [from, to), merging it with the first range if
+              they overlap or touch.
+
+       Intervals are built backwards, so a new range never starts after the
+       current first one.
+     */
+    void add_range (int from, int to);
+
+    /*!
+       \brief Shortens the first range to start at the specified definition,
+              or inserts a range of length one if there is no range covering it.
+     */
+    void set_from (int from);
+
+    //! \brief Puts the ranges in order once the interval has been built.
+    void finish ();
+
+    //! \brief Checks whether the interval covers the specified position.
+    bool covers (int pos) const;
+
+    //! \brief Returns the first position covered by both intervals, or -1.
+    int next_intersection (const live_interval& other) const;
+
+    //! \brief Returns the number of positions the interval covers.
+    int get_length () const;
+  };
+
+
+
+  /*!
+     \class linear_scan_register_allocator
+     \brief Linear scan register allocator.
+
+     Meant for cold code, where the cost of graph coloring cannot be
+     justified. The SSA CFG is linearized in reverse postorder, and every live
+     range (SSA names joined through phi-functions) is given a live interval
+     with lifetime holes. Intervals are then assigned registers in order of
+     their start positions, in a single pass; an interval may take a register
+     held by another interval that is currently in a hole, as long as the two
+     do not intersect (binpacking).
+
+     When no register is free, the interval with the lowest spill weight
+     (cost of its uses and definitions, weighted by loop depth, per position
+     covered) among the current interval and the ones blocking a register is
+     spilled. A spilled live range is split at every use by the spill code:
+     each reload gets its own short interval, and gets a second chance at a
+     register when the scan is rerun.
+
+     Moves get their partner's register as a hint, and moves whose source and
+     destination end up in the same register are removed from the CFG.
+   */
+  class linear_scan_register_allocator: public register_allocator
+  {
+    control_flow_graph *cfg;
+    int num_colors;
+    int tmp_idx;
+
+    std::vector<int> loop_depths; // by index in the CFG's block list
+
+    std::vector<live_range> live_ranges;
+    std::unordered_map<jtac_var_id, int> live_range_map;
+
+    std::vector<live_interval> intervals; // by live range
+    std::vector<double> spill_costs;
+    std::vector<int> hints;
+    std::vector<register_color> regs;
+
+    std::vector<int> active;
+    std::vector<int> inactive;
+    std::vector<int> spilled;
+
+   public:
+    linear_scan_register_allocator ();
+
+   public:
+    virtual register_allocation allocate (control_flow_graph& cfg,
+                                          int num_colors) override;
+
+   private:
+    //! \brief Builds the live intervals, spill costs and hints.
+    void build_intervals ();
+
+    //! \brief Assigns registers to all intervals in order of their start.
+    void scan ();
+
+    //! \brief Tries to assign a register that is free for the whole interval.
+    bool try_allocate_free_reg (int current);
+
+    //! \brief Frees a register for the interval by spilling, or spills it.
+    void allocate_blocked_reg (int current);
+
+    //! \brief Returns the spill weight of the specified interval.
+    double get_spill_weight (int n) const;
+  };
+}
+}
+
+#endif //_JCC__JTAC__ALLOCATION__LINEAR_SCAN__LINEAR_SCAN__H_
@@ -0,0 +1,94 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _JCC__JTAC__ALLOCATION__SPILL__H_
+#define _JCC__JTAC__ALLOCATION__SPILL__H_
+
+#include "jtac/control_flow.hpp"
+#include "jtac/allocation/allocator.hpp"
+#include <set>
+#include <vector>
+#include <unordered_map>
+
+
+namespace jcc {
+namespace jtac {
+
+  //! \brief A set of SSA names that share a single register (or stack slot).
+  using live_range = std::set<jtac_var_id>;
+
+  /*!
+     \brief Rewrites the CFG so that the specified live range lives in memory.
+
+     Phi-functions that involve the live range are removed. Every definition
+     of a name in the live range is redirected to a fresh temporary that is
+     stored right after it, and every use is redirected to a fresh temporary
+     that is loaded right before it (and unloaded after it). Temporaries are
+     marked by a non-zero var_special() component.
+
+     \param cfg     The control flow graph to rewrite (in SSA form).
+     \param lr      The SSA names that make up the live range.
+     \param tmp_idx Counter used to generate unique temporary names; updated.
+   */
+  void insert_spill_code (control_flow_graph& cfg, const live_range& lr,
+                          int& tmp_idx);
+
+  /*!
+     \brief Rewrites the CFG so that all of the specified live ranges live in
+            memory, in a single pass over the CFG.
+
+     Equivalent to spilling the live ranges one by one, but the cost does not
+     grow with the number of live ranges spilled.
+   */
+  void insert_spill_code (control_flow_graph& cfg,
+                          const std::vector<const live_range *>& lrs,
+                          int& tmp_idx);
+
+
+
+  /*!
+     \brief Groups SSA names that are joined by phi-functions into live ranges.
+     \param cfg            The control flow graph to scan (in SSA form).
+     \param live_ranges    Receives the live ranges.
+     \param live_range_map Receives the index of every name's live range.
+   */
+  void find_live_ranges (const control_flow_graph& cfg,
+                         std::vector<live_range>& live_ranges,
+                         std::unordered_map<jtac_var_id, int>& live_range_map);
+
+  /*!
+     \brief Computes the loop nesting depth of every block.
+     \return The depths, indexed by position in the CFG's block list.
+   */
+  std::vector<int> compute_loop_depths (const control_flow_graph& cfg);
+
+  //! \brief Returns the weight of a use or definition at the specified loop depth.
+  double get_loop_weight (int depth);
+
+  /*!
+     \brief Removes moves between names that share a register.
+
+     The destination of a removed move is left without a definition; it
+     shares the register of the move's source.
+   */
+  void remove_redundant_moves (control_flow_graph& cfg,
+                               const register_allocation& res);
+}
+}
+
+#endif //_JCC__JTAC__ALLOCATION__SPILL__H_
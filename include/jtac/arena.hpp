@@ -0,0 +1,98 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _JCC__JTAC__ARENA__H_
+#define _JCC__JTAC__ARENA__H_
+
+#include "jtac/jtac.hpp"
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+
+namespace jcc {
+namespace jtac {
+
+  /*!
+     \class jtac_arena
+     \brief Bump allocator for instruction operand storage.
+
+     Owns the "extra" operand lists of the instructions placed in it. The
+     containers that own an arena (control flow graphs, procedures) pass it
+     to the instructions they store, so a whole procedure's or CFG's operand
+     lists are freed at once instead of one delete[] per instruction.
+
+     NOTE: Instructions in an arena must not outlive it. Debug builds keep
+           count of them and assert that none are left when the arena is
+           destroyed.
+   */
+  class jtac_arena
+  {
+    struct chunk
+    {
+      std::unique_ptr<jtac_tagged_operand[]> data;
+      size_t size;
+    };
+
+   private:
+    std::vector<chunk> chunks;
+    size_t used;        // in the last chunk
+    size_t next_size;
+    size_t total;
+#ifndef NDEBUG
+    size_t num_insts;   // instructions placed in the arena
+#endif
+
+   public:
+    //! \brief Returns the number of operand slots handed out so far.
+    inline size_t get_allocated () const { return this->total; }
+
+   public:
+    jtac_arena (size_t initial_size = 1024);
+    ~jtac_arena ();
+
+    jtac_arena (const jtac_arena&) = delete;
+    jtac_arena& operator= (const jtac_arena&) = delete;
+
+   public:
+    //! \brief Allocates storage for the specified number of operands.
+    jtac_tagged_operand* allocate (size_t count);
+
+   public:
+    //! \brief Called when an instruction is placed in the arena.
+    inline void
+    attach ()
+    {
+#ifndef NDEBUG
+      ++ this->num_insts;
+#endif
+    }
+
+    //! \brief Called when an instruction leaves the arena.
+    inline void
+    detach ()
+    {
+#ifndef NDEBUG
+      -- this->num_insts;
+#endif
+    }
+  };
+}
+}
+
+#endif //_JCC__JTAC__ARENA__H_
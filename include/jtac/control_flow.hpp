@@ -20,9 +20,12 @@
 #define _JCC__JTAC__CONTROL_FLOW__H_
 
 #include "jtac/jtac.hpp"
+#include "jtac/arena.hpp"
 #include <vector>
 #include <memory>
 #include <unordered_map>
+#include <utility>
+#include <iterator>
 
 
 namespace jcc {
@@ -31,10 +34,14 @@ namespace jtac {
   /*!
      \class basic_block
      \brief A straight-line piece of code without any jumps.
+
+     Instructions inserted through the block's own methods are placed in the
+     block's arena (that of the CFG it belongs to).
    */
   class basic_block
   {
     basic_block_id id;
+    jtac_arena *arena;
     std::vector<jtac_instruction> insts;
     size_t base;
 
@@ -54,8 +61,10 @@ namespace jtac {
     inline size_t get_base () const { return this->base; }
     inline void set_base (size_t base) { this->base = base; }
 
+    inline jtac_arena* get_arena () const { return this->arena; }
+
    public:
-    basic_block (basic_block_id id);
+    basic_block (basic_block_id id, jtac_arena *arena = nullptr);
 
    public:
     //! \brief Inserts the specified instruction to the end of the block.
@@ -68,13 +77,30 @@ namespace jtac {
     template<typename Itr>
     void
     push_instructions_front (Itr start, Itr end)
-    { this->insts.insert (this->insts.begin (), start, end); }
+    {
+      std::vector<jtac_instruction> insts;
+      for (; start != end; ++start)
+        insts.emplace_back (*start, this->arena);
+      this->insts.insert (this->insts.begin (),
+                          std::make_move_iterator (insts.begin ()),
+                          std::make_move_iterator (insts.end ()));
+    }
+
+    //! \brief Replaces the block's instructions, moving them into the block's
+    //!        arena.
+    void set_instructions (std::vector<jtac_instruction>&& insts);
+
+    //! \brief Moves the block's instructions into the specified arena.
+    void set_arena (jtac_arena *arena);
 
     //! \brief Inserts a basic block to this block's list of predecessor blocks.
     void add_prev (std::shared_ptr<basic_block> blk);
 
     //! \brief Inserts a basic block to this block's list of successor blocks.
     void add_next (std::shared_ptr<basic_block> blk);
+
+    //! \brief Removes all predecessor and successor links.
+    void clear_edges ();
   };
 
 
@@ -92,10 +118,16 @@ namespace jtac {
   /*!
      \class control_flow_graph
      \brief A control flow graph!
+
+     Blocks are linked to each other through shared pointers. Since these
+     form cycles, the graph unlinks its blocks when it is destroyed; blocks
+     that are still referenced from outside the graph lose their edges. If
+     the graph has an arena, such blocks must not outlive the graph.
    */
   class control_flow_graph
   {
     control_flow_graph_type type;
+    std::shared_ptr<jtac_arena> arena;  // must outlive the blocks
     std::shared_ptr<basic_block> root;
 
     std::unordered_map<basic_block_id, std::shared_ptr<basic_block>> block_map;
@@ -113,12 +145,27 @@ namespace jtac {
 
     inline size_t get_size () const { return this->blocks.size (); }
 
+    //! \brief Returns the arena that owns the CFG's operand storage (may be
+    //!        null, in which case instructions allocate from the heap).
+    inline jtac_arena* get_arena () const { return this->arena.get (); }
+
    public:
     control_flow_graph (control_flow_graph_type type,
                         std::shared_ptr<basic_block> root);
+    ~control_flow_graph ();
+
+    control_flow_graph (const control_flow_graph&) = delete;
+    control_flow_graph& operator= (const control_flow_graph&) = delete;
+    control_flow_graph (control_flow_graph&& other);
+    control_flow_graph& operator= (control_flow_graph&& other);
 
    public:
-    //! \brief Inserts the specified <id, block> pair to the CFG.
+    //! \brief Moves the operand storage of all blocks into the specified
+    //!        arena (or onto the heap, if null).
+    void set_arena (std::shared_ptr<jtac_arena> arena);
+
+    //! \brief Inserts the specified <id, block> pair to the CFG, moving the
+    //!        block's instructions into the CFG's arena.
     void map_block (basic_block_id id,
                     std::shared_ptr<basic_block> blk);
 
@@ -129,6 +176,103 @@ namespace jtac {
 
 
 
+  /*!
+     \class flat_control_flow_graph
+     \brief Control flow graph with contiguous blocks and index-based edges.
+
+     Blocks are stored by value in program order and are numbered
+     consecutively, so a block's index is its ID minus the ID of the first
+     block and find_block() is a plain array access. Edges are not kept in the
+     blocks themselves (their prev/next lists are empty), but as compact index
+     arrays in CSR form: the predecessors of block i are
+     preds[pred_start[i] .. pred_start[i + 1]), and likewise for successors.
+   */
+  class flat_control_flow_graph
+  {
+    control_flow_graph_type type;
+    basic_block_id first_id;
+    std::shared_ptr<jtac_arena> arena;  // must outlive the blocks
+    std::vector<basic_block> blocks;
+
+    std::vector<int> pred_start, preds;
+    std::vector<int> succ_start, succs;
+
+   public:
+    inline control_flow_graph_type get_type () const { return this->type; }
+    inline void set_type (control_flow_graph_type type) { this->type = type; }
+
+    //! \brief The root is always the first block (index 0).
+    inline basic_block& get_root () { return this->blocks.front (); }
+    inline const basic_block& get_root () const { return this->blocks.front (); }
+
+    inline auto& get_blocks () { return this->blocks; }
+    inline const auto& get_blocks () const { return this->blocks; }
+
+    inline size_t get_size () const { return this->blocks.size (); }
+
+    inline basic_block& get_block (int idx) { return this->blocks[idx]; }
+    inline const basic_block& get_block (int idx) const { return this->blocks[idx]; }
+
+    inline const int* preds_begin (int idx) const { return this->preds.data () + this->pred_start[idx]; }
+    inline const int* preds_end (int idx) const { return this->preds.data () + this->pred_start[idx + 1]; }
+    inline const int* succs_begin (int idx) const { return this->succs.data () + this->succ_start[idx]; }
+    inline const int* succs_end (int idx) const { return this->succs.data () + this->succ_start[idx + 1]; }
+
+    //! \brief Returns the arena that owns the CFG's operand storage, or null.
+    inline jtac_arena* get_arena () const { return this->arena.get (); }
+
+   public:
+    flat_control_flow_graph (control_flow_graph_type type,
+                             basic_block_id first_id);
+
+   public:
+    //! \brief Moves the operand storage of all blocks into the specified
+    //!        arena (or onto the heap, if null).
+    void set_arena (std::shared_ptr<jtac_arena> arena);
+
+    /*!
+       \brief Appends a block to the CFG, moving its instructions into the
+              CFG's arena.
+       \throws std::runtime_error if the block's ID does not follow the ID of
+                                  the previously added block.
+     */
+    void add_block (basic_block&& blk);
+
+    /*!
+       \brief Replaces the CFG's edges with the specified <from, to> block
+              index pairs.
+
+       Edges keep their relative order within each block's predecessor and
+       successor ranges.
+     */
+    void set_edges (const std::vector<std::pair<int, int>>& edges);
+
+    //! \brief Returns the index of the block with the specified ID, or -1.
+    inline int
+    find_index (basic_block_id id) const
+    {
+      return (id >= this->first_id && id - this->first_id < (int)this->blocks.size ())
+             ? id - this->first_id : -1;
+    }
+
+    //! \brief Searches for a block in the CFG by ID (returns null if not found).
+    inline basic_block*
+    find_block (basic_block_id id)
+    {
+      int idx = this->find_index (id);
+      return (idx == -1) ? nullptr : &this->blocks[idx];
+    }
+
+    inline const basic_block*
+    find_block (basic_block_id id) const
+    {
+      int idx = this->find_index (id);
+      return (idx == -1) ? nullptr : &this->blocks[idx];
+    }
+  };
+
+
+
   /*!
      \class control_flow_analyzer
      \brief Performs control flow analysis.
@@ -136,6 +280,11 @@ namespace jtac {
   class control_flow_analyzer
   {
     basic_block_id next_blk_id;
+    bool use_arena;
+
+   public:
+    //! \brief When set, built CFGs get their own arena for operand storage.
+    inline void set_use_arena (bool use_arena) { this->use_arena = use_arena; }
 
    public:
     control_flow_analyzer ();
@@ -147,9 +296,21 @@ namespace jtac {
     control_flow_graph build_graph (
         const std::vector<jtac_instruction>& insts);
 
+    /*!
+       \brief Builds a control flow graph in the flat (contiguous, index-based)
+              representation.
+     */
+    flat_control_flow_graph build_flat_graph (
+        const std::vector<jtac_instruction>& insts);
+
    public:
     //! \brief Static method for convenience.
-    static control_flow_graph make_cfg (const std::vector<jtac_instruction>& insts);
+    static control_flow_graph make_cfg (const std::vector<jtac_instruction>& insts,
+                                        bool use_arena = false);
+
+    //! \brief Static method for convenience.
+    static flat_control_flow_graph make_flat_cfg (
+        const std::vector<jtac_instruction>& insts, bool use_arena = false);
   };
 }
 }
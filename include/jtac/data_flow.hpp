@@ -20,31 +20,121 @@
 #define _JCC__JTAC__DATA_FLOW__H_
 
 #include "jtac/control_flow.hpp"
+#include "common/bit_vector.hpp"
+#include <vector>
 #include <map>
 #include <memory>
 #include <set>
+#include <unordered_map>
 
 
 namespace jcc {
 namespace jtac {
 
+  /*!
+     \class block_numbering
+     \brief Dense numbering of a CFG's basic blocks.
+
+     Maps every block of a CFG to an index in the range [0, n), and stores the
+     CFG's edges as compact index arrays (in CSR form) along with a reverse
+     postorder of the blocks. This is what the data-flow solvers iterate over.
+   */
+  class block_numbering
+  {
+    std::vector<const basic_block *> blocks;
+    std::unordered_map<basic_block_id, int> index_map;
+    int root;
+
+    std::vector<int> pred_start, preds;
+    std::vector<int> succ_start, succs;
+    std::vector<int> rpo;
+
+   public:
+    inline size_t get_size () const { return this->blocks.size (); }
+    inline int get_root () const { return this->root; }
+
+    inline const basic_block& get_block (int idx) const { return *this->blocks[idx]; }
+    inline basic_block_id get_id (int idx) const { return this->blocks[idx]->get_id (); }
+
+    //! \brief Returns the blocks in reverse postorder (unreachable blocks last).
+    inline const auto& get_rpo () const { return this->rpo; }
+
+    inline const int* preds_begin (int idx) const { return this->preds.data () + this->pred_start[idx]; }
+    inline const int* preds_end (int idx) const { return this->preds.data () + this->pred_start[idx + 1]; }
+    inline const int* succs_begin (int idx) const { return this->succs.data () + this->succ_start[idx]; }
+    inline const int* succs_end (int idx) const { return this->succs.data () + this->succ_start[idx + 1]; }
+
+   public:
+    block_numbering (const control_flow_graph& cfg);
+
+    //! \brief Numbers a flat CFG, reusing its own indices and edge arrays.
+    block_numbering (const flat_control_flow_graph& cfg);
+
+   public:
+    //! \brief Returns the index of the block with the specified ID, or -1.
+    int find_index (basic_block_id id) const;
+
+    //! \brief Returns the index of the block with the specified ID.
+    int get_index (basic_block_id id) const;
+
+   private:
+    //! \brief Computes the reverse postorder of the blocks.
+    void compute_rpo ();
+  };
+
+
+
+  /*!
+     \enum data_flow_direction
+     \brief The direction in which facts flow through the CFG.
+   */
+  enum class data_flow_direction
+  {
+    forward,
+    backward,
+  };
+
+  /*!
+     \enum data_flow_meet
+     \brief The operator used to combine facts at join points.
+   */
+  enum class data_flow_meet
+  {
+    set_union,
+    set_intersection,
+  };
+
+  /*!
+     \struct data_flow_solution
+     \brief The fixed-point solution of a bit-vector data-flow problem.
+
+     Indexed by block number (as given by the solution's block numbering).
+   */
+  struct data_flow_solution
+  {
+    std::shared_ptr<const block_numbering> blocks;
+    std::vector<bit_vector> in;
+    std::vector<bit_vector> out;
+  };
+
   /*!
      \class iterative_analysis
-     \brief Base class for a special class of data-flow analyzers.
+     \brief Base class for bit-vector data-flow analyzers.
 
      Serves as the base class for global data-flow analyzers whose problems
-     can be solved using an iterative fixed-point algorithm.
+     can be expressed with gen/kill sets over a dense universe and solved using
+     an iterative fixed-point algorithm:
+
+       forward:  IN[b] = meet (OUT[p]),  OUT[b] = gen[b] | (IN[b] & ~kill[b])
+       backward: OUT[b] = meet (IN[s]),  IN[b] = gen[b] | (OUT[b] & ~kill[b])
+
+     The solver is worklist driven, seeded in reverse postorder (postorder for
+     backward problems), so most problems converge in a couple of passes.
    */
   class iterative_analyzer
   {
-   protected:
-    struct fragment
-    {
-      virtual ~fragment () { }
-    };
-
-   private:
-    std::map<basic_block_id, fragment *> frags;
+    data_flow_direction dir;
+    data_flow_meet meet;
 
    protected:
     const control_flow_graph *cfg;
@@ -53,31 +143,32 @@ namespace jtac {
     void set_active_cfg (const control_flow_graph& cfg) { this->cfg = &cfg; }
 
    public:
+    iterative_analyzer (data_flow_direction dir, data_flow_meet meet);
     virtual ~iterative_analyzer ();
 
    protected:
     /*!
-     * \brief Computes a fragment for the specified basic block.
-     * \return True if the fragment has been modified.
+       \brief Computes the local gen and kill sets of every block.
+       \param blocks The numbering of the blocks in the active CFG.
+       \param gen Filled with the gen set of every block (by index).
+       \param kill Filled with the kill set of every block (by index).
+       \return The size of the problem's universe.
      */
-    virtual bool compute_fragment (fragment& frag, const basic_block& blk) = 0;
-
-    //! \brief Initializes a fragment for the first time.
-    virtual std::unique_ptr<fragment> compute_init_fragment (const basic_block& blk) = 0;
-
-    //! \brief Returns the fragment associated with the specified basic block ID.
-    fragment& get_fragment (basic_block_id id);
-
-    fragment&
-    get_fragment (const basic_block& blk)
-    { return this->get_fragment (blk.get_id ()); }
+    virtual size_t compute_local_sets (const block_numbering& blocks,
+                                       std::vector<bit_vector>& gen,
+                                       std::vector<bit_vector>& kill) = 0;
 
    protected:
     /*!
        Solves the data-flow problem for the specified CFG using an iterative
        fixed-point algorithm.
      */
-    void solve (const control_flow_graph& cfg);
+    std::shared_ptr<data_flow_solution> solve (const control_flow_graph& cfg);
+    std::shared_ptr<data_flow_solution> solve (const flat_control_flow_graph& cfg);
+
+   private:
+    std::shared_ptr<data_flow_solution> solve (
+        std::shared_ptr<const block_numbering> blocks);
   };
 
 
@@ -86,15 +177,29 @@ namespace jtac {
 
   using definition = std::pair<basic_block_id, size_t>;
 
+  /*!
+     \class reach_def_analysis
+     \brief Reaching definitions analysis results.
+   */
   class reach_def_analysis
   {
+    std::shared_ptr<const data_flow_solution> sol;
+    std::vector<definition> defs;
     std::unordered_map<basic_block_id, std::set<definition>> block_map;
 
+   public:
+    reach_def_analysis () { }
+    reach_def_analysis (std::shared_ptr<const data_flow_solution> sol,
+                        std::vector<definition>&& defs);
+
    public:
     void add_block (basic_block_id id, std::set<definition>&& defs);
 
     //! \brief Returns the definitions reaching the specified block.
     const std::set<definition>& get_block (basic_block_id id);
+
+    //! \brief Checks whether the specified definition reaches a block.
+    bool reaches (basic_block_id id, const definition& def) const;
   };
 
   /*!
@@ -103,15 +208,11 @@ namespace jtac {
    */
   class reach_def_analyzer: public iterative_analyzer
   {
-   private:
-    struct my_fragment: public fragment
-    {
-      std::set<definition> defs;
-    };
-
    private:
     std::vector<definition> all_defs;
-    std::map<basic_block_id, std::set<definition>> de_defs, de_kills;
+
+   public:
+    reach_def_analyzer ();
 
    public:
     /*!
@@ -120,22 +221,12 @@ namespace jtac {
        \return The results of the analysis.
      */
     reach_def_analysis analyze (const control_flow_graph& cfg);
+    reach_def_analysis analyze (const flat_control_flow_graph& cfg);
 
    protected:
-    virtual bool compute_fragment (fragment& frag, const basic_block& blk) override;
-
-    virtual std::unique_ptr<fragment> compute_init_fragment (const basic_block& blk) override;
-
-   private:
-    //! \brief Finds all definitions that appear in the CFG.
-    void get_all_defs ();
-
-    //! \brief Returns a list of all downward-exposed definitions in a block.
-    std::set<definition>& de_def (const basic_block& blk);
-
-    //! \brief Returns a list of all definitions that are obscured by a
-    //!        defintion in a block.
-    std::set<definition>& de_kill (const basic_block& blk);
+    virtual size_t compute_local_sets (const block_numbering& blocks,
+                                       std::vector<bit_vector>& gen,
+                                       std::vector<bit_vector>& kill) override;
   };
 
 
@@ -145,46 +236,84 @@ namespace jtac {
   /*!
      \class dom_analysis
      \brief Dominance analysis results.
+
+     Stores the dominator tree of a CFG as an array of immediate dominators
+     (indexed by block number, see block_numbering), along with DFS pre/post
+     numbers of the tree so that dominance can be checked in constant time.
    */
   class dom_analysis
   {
+    std::shared_ptr<const block_numbering> blocks;
+    std::vector<int> idoms;
+    std::vector<int> pre, post;
+    std::vector<std::vector<int>> children;
+    std::vector<std::vector<int>> dfs;
+
+    // std::set views, created on demand
     std::unordered_map<basic_block_id, std::set<basic_block_id>> block_map;
-    std::unordered_map<basic_block_id, basic_block_id> idom_map;
     std::unordered_map<basic_block_id, std::set<basic_block_id>> df_map;
 
    public:
-    void add_block (basic_block_id id, std::set<basic_block_id>&& doms);
+    inline const block_numbering& get_numbering () const { return *this->blocks; }
+
+    //! \brief Returns the index of a block's immediate dominator, or -1 for
+    //!        the root and unreachable blocks.
+    inline int get_idom_index (int idx) const { return this->idoms[idx]; }
+
+    //! \brief Returns the indices of the blocks immediately dominated by the
+    //!        specified block, in CFG order.
+    inline const auto& get_children (int idx) const { return this->children[idx]; }
+
+    //! \brief Returns the dominance frontier of the specified block (by index).
+    inline const auto& get_df (int idx) const { return this->dfs[idx]; }
+
+    //! \brief Checks whether block a dominates block b (by index).
+    //!        Unreachable blocks neither dominate nor are dominated by any
+    //!        block.
+    inline bool
+    dominates_index (int a, int b) const
+    {
+      return this->pre[a] >= 0 && this->pre[b] >= 0
+             && this->pre[a] <= this->pre[b] && this->post[b] <= this->post[a];
+    }
+
+   public:
+    dom_analysis () { }
+    dom_analysis (std::shared_ptr<const block_numbering> blocks,
+                  std::vector<int>&& idoms);
 
+   public:
     //! \brief Returns the set of blocks dominating the specified block.
     const std::set<basic_block_id>& get_block (basic_block_id id);
 
-
-    //! \brief Sets a block's immediate dominator.
-    void set_idom (basic_block_id id, basic_block_id idom);
+    //! \brief Checks whether block a dominates block b.
+    bool dominates (basic_block_id a, basic_block_id b) const;
 
     //! \brief Returns the specified block's immediate dominator.
     basic_block_id get_idom (basic_block_id id) const;
 
-
-    //! \brief Inserts a block into a specified block's dominance frontier set.
-    void add_df (basic_block_id id, basic_block_id df);
-
     //! \brief Returns the dominance frontier set of a specified block.
     std::set<basic_block_id>& get_dfs (basic_block_id id);
+
+   private:
+    //! \brief Builds the dominator tree and numbers its nodes.
+    void build_tree ();
+
+    //! \brief Computes dominance frontiers.
+    void compute_dfs ();
   };
 
   /*!
      \class dom_analyzer
      \brief Dominance analyzer.
+
+     Computes immediate dominators using the iterative algorithm by Cooper,
+     Harvey and Kennedy ("A Simple, Fast Dominance Algorithm"), which walks
+     the blocks in reverse postorder and intersects dominator tree paths
+     instead of maintaining full dominator sets.
    */
-  class dom_analyzer: public iterative_analyzer
+  class dom_analyzer
   {
-   private:
-    struct my_fragment: public fragment
-    {
-      std::set<basic_block_id> doms;
-    };
-
    public:
     /*!
        \brief Performs dominance analysis on the specified CFG.
@@ -192,18 +321,11 @@ namespace jtac {
        \return The results of the analysis.
      */
     dom_analysis analyze (const control_flow_graph& cfg);
+    dom_analysis analyze (const flat_control_flow_graph& cfg);
 
    private:
     //! \brief Finds all immediate dominators.
-    void compute_idoms (dom_analysis& result);
-
-    //! \brief Computes dominance frontiers.
-    void compute_dfs (dom_analysis& result);
-
-   protected:
-    virtual bool compute_fragment (fragment& frag, const basic_block& blk) override;
-
-    virtual std::unique_ptr<fragment> compute_init_fragment (const basic_block& blk) override;
+    std::vector<int> compute_idoms (const block_numbering& blocks);
   };
 
 
@@ -216,13 +338,27 @@ namespace jtac {
    */
   class live_analysis
   {
+    std::shared_ptr<const data_flow_solution> sol;
+    std::unordered_map<jtac_var_id, size_t> var_map;
+    std::vector<jtac_var_id> vars;
     std::unordered_map<basic_block_id, std::set<jtac_var_id>> block_map;
 
+   public:
+    live_analysis () { }
+    live_analysis (std::shared_ptr<const data_flow_solution> sol,
+                   std::vector<jtac_var_id>&& vars);
+
    public:
     void add_block (basic_block_id id, std::set<jtac_var_id>&& live_out);
 
     //! \brief Returns the variables live on exit from the specified block.
     const std::set<jtac_var_id>& get_live_out (basic_block_id id);
+
+    //! \brief Checks whether a variable is live on exit from a block.
+    bool is_live_out (basic_block_id id, jtac_var_id var) const;
+
+    //! \brief Checks whether a variable is live on entry to a block.
+    bool is_live_in (basic_block_id id, jtac_var_id var) const;
   };
 
   /*!
@@ -231,14 +367,11 @@ namespace jtac {
    */
   class live_analyzer: public iterative_analyzer
   {
-    struct my_fragment: public fragment
-    {
-      std::set<jtac_var_id> live_out;
-    };
+    std::unordered_map<jtac_var_id, size_t> var_map;
+    std::vector<jtac_var_id> vars;
 
-   private:
-    std::map<basic_block_id, std::set<jtac_var_id>> ue_vars;
-    std::map<basic_block_id, std::set<jtac_var_id>> var_kills;
+   public:
+    live_analyzer ();
 
    public:
     /*!
@@ -247,15 +380,20 @@ namespace jtac {
        \return The results of the analysis.
      */
     live_analysis analyze (const control_flow_graph& cfg);
+    live_analysis analyze (const flat_control_flow_graph& cfg);
 
    private:
+    //! \brief Assigns a dense index to every variable that appears in the CFG.
+    void number_vars (const block_numbering& blocks);
+
     //! \brief Computes the sets of upward-exposed variables and killed variables.
-    void compute_ue_var_and_var_kill ();
+    void compute_ue_var_and_var_kill (const basic_block& blk,
+                                      bit_vector& ue_var, bit_vector& var_kill);
 
    protected:
-    virtual bool compute_fragment (fragment& frag, const basic_block& blk) override;
-
-    virtual std::unique_ptr<fragment> compute_init_fragment (const basic_block& blk) override;
+    virtual size_t compute_local_sets (const block_numbering& blocks,
+                                       std::vector<bit_vector>& gen,
+                                       std::vector<bit_vector>& kill) override;
   };
 }
 }
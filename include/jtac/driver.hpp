@@ -0,0 +1,90 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _JCC__JTAC__DRIVER__H_
+#define _JCC__JTAC__DRIVER__H_
+
+#include "jtac/program.hpp"
+#include "jtac/translate/x86_64/procedure.hpp"
+#include "common/thread_pool.hpp"
+#include <vector>
+#include <utility>
+
+
+namespace jcc {
+namespace jtac {
+
+  /*!
+     \class program_driver
+     \brief Runs a per-procedure pipeline over all procedures of a program
+            concurrently.
+
+     Procedures are independent of each other, so each one is handed to a
+     task on a work-stealing thread pool. Results are stored by procedure
+     index and returned in the program's original order, regardless of the
+     order in which the tasks finish.
+
+     Pipeline stages must not share mutable state between procedures: every
+     task should create its own analyzers, builders, allocators and printers.
+     Read-only access to the program (including name maps) is safe.
+   */
+  class program_driver
+  {
+    thread_pool pool;
+
+   public:
+    inline unsigned get_thread_count () const { return this->pool.get_thread_count (); }
+
+   public:
+    /*!
+       \brief Creates a driver with the specified number of worker threads
+              (zero picks the number of hardware threads).
+     */
+    explicit program_driver (unsigned num_threads = 0);
+
+   public:
+    /*!
+       \brief Calls fn(proc) for every procedure in the program concurrently.
+       \return The results of the calls, in procedure order.
+
+       If any call throws, the first exception is rethrown after all calls
+       have finished.
+     */
+    template<typename Fn>
+    auto
+    map_procedures (const program& prog, Fn&& fn)
+        -> std::vector<decltype (fn (std::declval<const procedure&> ()))>
+    {
+      auto& procs = prog.get_procedures ();
+      std::vector<decltype (fn (std::declval<const procedure&> ()))> results (
+          procs.size ());
+
+      this->pool.parallel_for (procs.size (), [&] (size_t i) {
+        results[i] = fn (procs[i]);
+      });
+
+      return results;
+    }
+
+    //! \brief Translates every procedure in the program into x86-64.
+    std::vector<x86_64_procedure> translate_x86_64 (const program& prog);
+  };
+}
+}
+
+#endif //_JCC__JTAC__DRIVER__H_
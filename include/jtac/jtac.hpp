@@ -20,12 +20,14 @@
 #define _JCC__JTAC__JTAC__H_
 
 #include <cstdint>
-#include <bits/move.h>
+#include <type_traits>
 
 
 namespace jcc {
 namespace jtac {
 
+  class jtac_arena;
+
   //! \brief Used to identify basic blocks.
   using basic_block_id = int;
 
@@ -34,7 +36,7 @@ namespace jtac {
      \enum jtac_opcode
      \brief Enumeration of JTAC instruction opcodes.
    */
-  enum jtac_opcode
+  enum jtac_opcode: unsigned short
   {
     JTAC_OP_UNDEF = 0xFFFF,
 
@@ -95,7 +97,7 @@ namespace jtac {
      \enum jtac_operand_type
      \brief Enumeration of possible instruction operand types.
    */
-  enum jtac_operand_type
+  enum jtac_operand_type: unsigned char
   {
     JTAC_OPR_CONST,     // constant
     JTAC_OPR_VAR,       // variable
@@ -106,23 +108,18 @@ namespace jtac {
   };
 
 
-  /*!
-     \class jtac_operand
-     \brief Base class for JTAC operands.
+  /*
+     NOTE: The operand classes below are plain (non-virtual, trivially
+           copyable) value types. They carry no type information of their own;
+           they are tagged by jtac_tagged_operand, which is what instructions
+           store and what emit functions accept (see jtac_operand).
    */
-  class jtac_operand
-  {
-   public:
-    //! \brief Returns the type of this operand.
-    virtual jtac_operand_type get_type () const = 0;
-  };
-
 
   /*!
      \class jtac_const
      \brief Constant operand.
    */
-  class jtac_const: public jtac_operand
+  class jtac_const
   {
     int64_t val;
 
@@ -140,7 +137,7 @@ namespace jtac {
     { }
 
    public:
-    virtual jtac_operand_type get_type () const override { return JTAC_OPR_CONST; }
+    inline jtac_operand_type get_type () const { return JTAC_OPR_CONST; }
   };
 
 
@@ -159,7 +156,7 @@ namespace jtac {
      \class jtac_var
      \brief Variable operand.
    */
-  class jtac_var: public jtac_operand
+  class jtac_var
   {
     jtac_var_id id;
 
@@ -177,7 +174,7 @@ namespace jtac {
     { }
 
    public:
-    virtual jtac_operand_type get_type () const override { return JTAC_OPR_VAR; }
+    inline jtac_operand_type get_type () const { return JTAC_OPR_VAR; }
   };
 
 
@@ -188,7 +185,7 @@ namespace jtac {
      \class jtac_label
      \brief Label operand (used in branch instructions).
    */
-  class jtac_label: public jtac_operand
+  class jtac_label
   {
     jtac_label_id id;
 
@@ -206,7 +203,7 @@ namespace jtac {
     { }
 
    public:
-    virtual jtac_operand_type get_type () const override { return JTAC_OPR_LABEL; }
+    inline jtac_operand_type get_type () const { return JTAC_OPR_LABEL; }
   };
 
 
@@ -214,7 +211,7 @@ namespace jtac {
      \struct jtac_offset
      \brief Constant displacement operand.
    */
-  class jtac_offset: public jtac_operand
+  class jtac_offset
   {
     int off;
 
@@ -232,7 +229,7 @@ namespace jtac {
     { }
 
    public:
-    virtual jtac_operand_type get_type () const override { return JTAC_OPR_OFFSET; }
+    inline jtac_operand_type get_type () const { return JTAC_OPR_OFFSET; }
   };
 
 
@@ -243,7 +240,7 @@ namespace jtac {
      \struct jtac_name
      \brief Known name operand.
    */
-  class jtac_name: public jtac_operand
+  class jtac_name
   {
     jtac_name_id id;
 
@@ -261,7 +258,7 @@ namespace jtac {
         { }
 
    public:
-    virtual jtac_operand_type get_type () const override { return JTAC_OPR_NAME; }
+    inline jtac_operand_type get_type () const { return JTAC_OPR_NAME; }
   };
 
 
@@ -274,7 +271,7 @@ namespace jtac {
      of a basic block, it makes more sense to have those branch instructions
      encode their destination with a basic block operand.
    */
-  class jtac_block_ref: public jtac_operand
+  class jtac_block_ref
   {
     basic_block_id id;
 
@@ -292,7 +289,7 @@ namespace jtac {
     { }
 
    public:
-    virtual jtac_operand_type get_type () const override { return JTAC_OPR_BLOCK_REF; }
+    inline jtac_operand_type get_type () const { return JTAC_OPR_BLOCK_REF; }
   };
 
 
@@ -300,6 +297,9 @@ namespace jtac {
      \struct jtac_tagged_operand
      \brief Stores a union of all possible operand types along with the type
             of the actual operand.
+
+     Packed into 16 bytes and trivially copyable, so that instructions (and
+     arrays of operands) can be copied around with memcpy.
    */
   struct jtac_tagged_operand
   {
@@ -318,28 +318,67 @@ namespace jtac {
       { }
     } val;
 
+   public:
+    //! \brief Returns the type of this operand.
+    inline jtac_operand_type get_type () const { return this->type; }
+
    public:
     jtac_tagged_operand ()
     { this->type = JTAC_OPR_CONST; }
 
-    jtac_tagged_operand (const jtac_tagged_operand& other)
-    { *this = other; }
+    jtac_tagged_operand (const jtac_const& opr)
+    { this->type = JTAC_OPR_CONST; this->val.konst = opr; }
 
-    jtac_tagged_operand (jtac_tagged_operand&& other)
-    { *this = std::move (other); }
+    jtac_tagged_operand (const jtac_var& opr)
+    { this->type = JTAC_OPR_VAR; this->val.var = opr; }
 
-   public:
-    jtac_tagged_operand& operator= (const jtac_tagged_operand& other);
-    jtac_tagged_operand& operator= (jtac_tagged_operand&& other);
-    jtac_tagged_operand& operator= (const jtac_operand& opr);
+    jtac_tagged_operand (const jtac_label& opr)
+    { this->type = JTAC_OPR_LABEL; this->val.lbl = opr; }
+
+    jtac_tagged_operand (const jtac_offset& opr)
+    { this->type = JTAC_OPR_OFFSET; this->val.off = opr; }
+
+    jtac_tagged_operand (const jtac_name& opr)
+    { this->type = JTAC_OPR_NAME; this->val.name = opr; }
+
+    jtac_tagged_operand (const jtac_block_ref& opr)
+    { this->type = JTAC_OPR_BLOCK_REF; this->val.blk = opr; }
   };
 
-  jtac_operand& tagged_operand_to_operand (jtac_tagged_operand& opr);
+  static_assert (sizeof (jtac_tagged_operand) <= 16,
+                 "jtac_tagged_operand must fit in 16 bytes");
+
+  /*!
+     Operands are passed around as tagged operands (any of the operand classes
+     above converts implicitly into one).
+   */
+  using jtac_operand = jtac_tagged_operand;
+
+  inline jtac_operand&
+  tagged_operand_to_operand (jtac_tagged_operand& opr)
+  { return opr; }
 
 
+//! \brief The maximum number of "extra" operands an instruction can hold.
+#define JTAC_MAX_EXTRA_OPERANDS 65535
+
   /*!
      \struct jtac_instruction
      \brief Stores a single JTAC instruction.
+
+     The opcode and the three fixed operands are copied with memcpy. The
+     "extra" operand list (call arguments, phi operands) is held through a
+     pointer, so the instruction as a whole is not trivially copyable; copies
+     duplicate the list.
+
+     The list lives in the instruction's arena, or on the heap if it has
+     none. The arena is chosen by the container the instruction is inserted
+     into (basic blocks and procedures pass their own), never implicitly:
+     copy construction yields a heap instruction, assignment keeps the
+     destination's arena, and a moved-from instruction keeps its arena but
+     loses its operands.
+
+     An instruction holds at most JTAC_MAX_EXTRA_OPERANDS extra operands.
    */
   struct jtac_instruction
   {
@@ -347,23 +386,48 @@ namespace jtac {
     jtac_tagged_operand oprs[3];
     struct
     {
-      unsigned char count;
-      unsigned char cap;
+      uint16_t count;
+      uint16_t cap;
+      jtac_arena *arena;  // owns oprs, if not null
       jtac_tagged_operand *oprs;
     } extra;
 
+   public:
+    //! \brief Returns the arena holding the extra operand list, or null.
+    inline jtac_arena* get_arena () const { return this->extra.arena; }
+
    public:
     jtac_instruction ();
     jtac_instruction (const jtac_instruction& other);
-    jtac_instruction (jtac_instruction&& other);
+    jtac_instruction (jtac_instruction&& other) noexcept;
+    ~jtac_instruction ();
+
+    //! \brief Copies an instruction into the specified arena (or onto the
+    //!        heap, if null).
+    jtac_instruction (const jtac_instruction& other, jtac_arena *arena);
 
    public:
     //! \brief Inserts the specified operand into the instruction's "extra" list.
     jtac_instruction& push_extra (const jtac_operand& opr);
 
+    //! \brief Moves the extra operand list into the specified arena (or onto
+    //!        the heap, if null).
+    void set_arena (jtac_arena *arena);
+
    public:
     jtac_instruction& operator= (const jtac_instruction& other);
     jtac_instruction& operator= (jtac_instruction&& other);
+
+   private:
+    //! \brief Copies the trivially copyable part of another instruction.
+    void copy_fixed (const jtac_instruction& other);
+
+    //! \brief Replaces the extra operand list with one of the specified
+    //!        capacity, allocated from the instruction's arena.
+    void realloc_extra (int cap);
+
+    //! \brief Releases the extra operand list (if it is not arena-owned).
+    void free_extra ();
   };
 }
 }
@@ -27,6 +27,13 @@
 namespace jcc {
 namespace jtac {
 
+  /*!
+     \class name_map
+     \brief Bidirectional mapping between names and values.
+
+     Lookups do not modify the map, so any number of threads may query a map
+     concurrently as long as nobody inserts into it at the same time.
+   */
   template<typename T>
   class name_map
   {
@@ -31,6 +31,9 @@ namespace jtac {
   /*!
      \class printer
      \brief JTAC pretty printer.
+
+     Printers keep per-block state while printing, so threads must not share
+     a printer; the name table they refer to may be shared.
    */
   class printer
   {
@@ -21,6 +21,8 @@
 
 #include "jtac/jtac.hpp"
 #include "jtac/name_map.hpp"
+#include "jtac/arena.hpp"
+#include <memory>
 #include <vector>
 #include <string>
 #include <unordered_map>
@@ -37,6 +39,7 @@ namespace jtac {
   {
     std::string name;
     std::vector<jtac_var_id> params;
+    std::shared_ptr<jtac_arena> arena;  // must outlive the body
     std::vector<jtac_instruction> body;
     name_map<jtac_var_id> var_names;
 
@@ -52,13 +55,22 @@ namespace jtac {
     inline const auto& get_body () const { return this->body; }
     inline auto& get_body () { return this->body; }
 
+    //! \brief Returns the arena owning the body's operand storage, or null.
+    inline jtac_arena* get_arena () const { return this->arena.get (); }
+
    public:
-    procedure (const std::string& name);
+    procedure (const std::string& name, bool use_arena = false);
 
    public:
+    //! \brief Appends a range of instructions to the body, placing them in
+    //!        the procedure's arena.
     template<typename Iterator>
-    void insert_instructions (Iterator start, Iterator end)
-    { this->body.insert (this->body.end (), start, end ); }
+    void
+    insert_instructions (Iterator start, Iterator end)
+    {
+      for (; start != end; ++start)
+        this->body.emplace_back (*start, this->arena.get ());
+    }
   };
 
 
@@ -84,7 +96,8 @@ namespace jtac {
 
    public:
     //! \brief Inserts a new procedure and returns a reference to it.
-    procedure& emplace_procedure (const std::string& name);
+    procedure& emplace_procedure (const std::string& name,
+                                  bool use_arena = false);
   };
 }
 }
@@ -30,6 +30,24 @@
 namespace jcc {
 namespace jtac {
 
+  /*!
+     \enum ssa_form_type
+     \brief Controls where phi-functions are placed during SSA construction.
+   */
+  enum class ssa_form_type
+  {
+    //! \brief Phi-functions are placed for every variable at the iterated
+    //!        dominance frontier of its definitions.
+    minimal,
+
+    //! \brief Only variables that are live across a block boundary (i.e.
+    //!        upward-exposed in some block) get phi-functions.
+    semi_pruned,
+
+    //! \brief Phi-functions are only placed where the variable is live-in.
+    pruned,
+  };
+
   /*!
      \class ssa_builder
      \brief Transforms control flow graphs into SSA form.
@@ -37,6 +55,7 @@ namespace jtac {
   class ssa_builder
   {
     control_flow_graph *cfg;
+    ssa_form_type form;
 
     std::set<jtac_var_id> globals;
     std::map<jtac_var_id, std::set<basic_block_id>> def_blocks;
@@ -50,17 +69,22 @@ namespace jtac {
     /*!
        \brief Transforms the specified CFG into SSA form.
        \param cfg The control flow graph to transform.
+       \param form Controls which phi-functions are inserted.
      */
-    void transform (control_flow_graph& cfg);
+    void transform (control_flow_graph& cfg,
+                    ssa_form_type form = ssa_form_type::semi_pruned);
 
    private:
     /*!
-       Inserts phi-functions at the start of every block that has multiple
-       predecessors. A phi-function is inserted for every name that is defined
-       or used in the control flow graph.
+       Inserts phi-functions at the iterated dominance frontier of the
+       definitions of every name that needs them (depending on the form
+       being built).
      */
     void insert_phi_functions ();
 
+    //! \brief Returns the names that are candidates for phi-functions.
+    std::set<jtac_var_id> get_phi_candidates ();
+
     //! \brief Initializes the stack/counter for the first block.
     void define_initial_names ();
 
@@ -19,6 +19,10 @@
 #ifndef _JCC__JTAC__TRASLATE__X86_64__PROCEDURE__H_
 #define _JCC__JTAC__TRASLATE__X86_64__PROCEDURE__H_
 
+#include "assembler/relocation.hpp"
+#include <memory>
+#include <string>
+#include <vector>
 
 namespace jcc {
 namespace jtac {
@@ -26,10 +30,36 @@ namespace jtac {
   /*!
      \class x86_64_procedure
      \brief x86-64 procedure.
+
+     Holds the machine code of a translated procedure along with its
+     relocations (calls to other procedures, by name). The symbols the
+     relocations refer to live in a store shared by all copies of the
+     procedure, so the relocations stay valid as the procedure is moved
+     around.
    */
   class x86_64_procedure
   {
+    std::string name;
+    std::vector<unsigned char> code;
+    std::vector<relocation> relocs;
+    std::shared_ptr<relocation_symbol_store> syms;
+
+   public:
+    inline const std::string& get_name () const { return this->name; }
+    inline const std::vector<unsigned char>& get_code () const { return this->code; }
+    inline const std::vector<relocation>& get_relocations () const { return this->relocs; }
+    inline const relocation_symbol_store* get_symbols () const { return this->syms.get (); }
+
+   public:
+    x86_64_procedure () { }
 
+    x86_64_procedure (const std::string& name,
+                      std::vector<unsigned char>&& code,
+                      std::vector<relocation>&& relocs,
+                      std::shared_ptr<relocation_symbol_store> syms)
+        : name (name), code (std::move (code)), relocs (std::move (relocs)),
+          syms (syms)
+    { }
   };
 }
 }
@@ -20,10 +20,15 @@
 #define _JCC__JTAC__TRASLATE__X86_64__X86_64_TRANSLATOR__H_
 
 #include "jtac/program.hpp"
+#include "jtac/name_map.hpp"
 #include "jtac/translate/x86_64/procedure.hpp"
 #include "jtac/control_flow.hpp"
+#include "jtac/data_flow.hpp"
 #include "jtac/allocation/allocator.hpp"
+#include "assembler/x86_64/assembler.hpp"
 #include <memory>
+#include <unordered_map>
+#include <vector>
 
 
 namespace jcc {
@@ -32,11 +37,74 @@ namespace jtac {
   /*!
      \class x86_64_translator
      \brief JTAC to x86-64 code translator.
+
+     Procedures are put into SSA form and register allocated, and are then
+     tiled into x86-64 instructions block by block, by maximal munch: each
+     tile covers as many JTAC instructions as it can. A comparison and the
+     conditional branch that follows it become a cmp/jcc pair, constant
+     operands are folded into immediates, additions into a different
+     register become a lea, and the loads and stores of spilled variables
+     are folded into memory operands of the instructions that use them.
+
+     Phi-functions are eliminated by parallel copies at the end of every
+     predecessor (or on a stub for a conditional branch's target).
+
+     The procedure follows the System V calling convention. R11 is kept out
+     of register allocation and serves as a scratch register.
    */
   class x86_64_translator
   {
+    // where the value of an operand is found
+    struct x86_64_operand
+    {
+      enum { REG, IMM, MEM } kind;
+      x86_64::reg_t reg;  // for MEM: the register the value is loaded into
+      int64_t imm;        // for MEM: the displacement from RBP
+    };
+
+    // a single move of a parallel copy
+    struct x86_64_move
+    {
+      x86_64::reg_t dest;
+      x86_64_operand src;
+    };
+
+    // a branch that needs phi copies before reaching its target
+    struct edge_stub
+    {
+      x86_64::label_id lbl;
+      const basic_block *from;
+      const basic_block *to;
+    };
+
+   private:
     std::unique_ptr<control_flow_graph> cfg;
     std::unique_ptr<register_allocation> reg_res;
+    register_allocator_type alloc_type;
+    const name_map<jtac_name_id> *names;
+
+    // instruction selection:
+    std::unique_ptr<x86_64::assembler> asem;
+    std::shared_ptr<relocation_symbol_store> syms;
+    std::vector<const basic_block *> layout;
+    std::unordered_map<basic_block_id, x86_64::label_id> blk_lbls;
+    std::unordered_map<int, int> slots;             // variable base -> stack slot
+    std::unordered_map<jtac_var_id, int64_t> deferred; // folded spill loads
+    std::vector<x86_64::reg_t> saved_regs;          // pushed by the prologue
+    std::vector<unsigned> live_after;               // register masks
+    std::vector<edge_stub> stubs;
+    x86_64::label_id lbl_exit;
+    bool has_exit;
+    bool has_frame;
+    int frame_size;
+
+   public:
+    //! \brief Selects the register allocator used for translated procedures.
+    inline void set_allocator_type (register_allocator_type type) { this->alloc_type = type; }
+
+    //! \brief Sets the names that procedure calls refer to (typically
+    //!        program::get_names()).
+    inline void set_names (const name_map<jtac_name_id> *names) { this->names = names; }
 
    public:
     x86_64_translator ();
@@ -46,6 +114,88 @@ namespace jtac {
        \brief Translates the specified procedure into x86-64.
      */
     x86_64_procedure translate_procedure (const procedure& proc);
+
+   private:
+    //! \brief Orders the blocks of the CFG in program order.
+    void lay_out_blocks ();
+
+    //! \brief Assigns stack slots to spilled variables and finds the
+    //!        callee-saved registers in use.
+    void allocate_frame (int num_params);
+
+    void emit_prologue ();
+    void emit_epilogue ();
+
+    //! \brief Moves incoming parameters into their variables.
+    //! \return The index of the first instruction past the parameters.
+    size_t emit_param_moves (const basic_block& root);
+
+    //! \brief Computes the registers live after every instruction of a block.
+    void compute_live_after (const basic_block& blk, live_analysis& la);
+
+    void select_block (size_t idx, live_analysis& la);
+
+    //! \brief Selects instructions for the tile starting at instruction I.
+    //! \return The index of the first instruction past the tile.
+    size_t select_instruction (const basic_block& blk, size_t i,
+                               const basic_block *next);
+
+    //! \brief Checks whether the variable loaded by the instruction at I
+    //!        can be read from memory by the instruction that uses it.
+    bool can_defer_load (const basic_block& blk, size_t i) const;
+
+    void select_assign (const jtac_instruction& inst, bool store);
+    bool select_arith (const jtac_instruction& inst, bool store);
+    void select_div (const jtac_instruction& inst, unsigned live);
+    void select_call (const jtac_instruction& inst, unsigned live);
+    void select_cmp (const basic_block& blk, const jtac_instruction& inst,
+                     const jtac_instruction *jcc, const basic_block *next);
+    void select_branch (const basic_block& blk, jtac_opcode op,
+                        const jtac_tagged_operand& target,
+                        const basic_block *next);
+
+    void emit_jcc (jtac_opcode op, x86_64::label_id lbl);
+
+    //! \brief Emits a jump to the specified block (null is the exit).
+    void emit_jump (const basic_block *blk, const basic_block *next);
+
+    //! \brief Returns the label that a branch from one block to another
+    //!        should target, going through a stub if phi copies are needed.
+    x86_64::label_id get_edge_label (const basic_block& from,
+                                     const basic_block *to);
+
+    //! \brief Emits the phi copies of the edge between the specified blocks.
+    void emit_phi_copies (const basic_block& from, const basic_block *to);
+    void collect_phi_copies (const basic_block& from, const basic_block *to,
+                             std::vector<x86_64_move>& moves);
+
+    //! \brief Performs the specified moves as if all at once.
+    void emit_parallel_copy (std::vector<x86_64_move>& moves);
+
+   private:
+    x86_64::reg_t get_reg (jtac_var_id var) const;
+    int64_t get_slot_disp (jtac_var_id var) const;
+    x86_64_operand get_operand (const jtac_tagged_operand& opr) const;
+    const basic_block* get_target (const jtac_tagged_operand& opr) const;
+    x86_64::label_id get_block_label (const basic_block *blk);
+
+    //! \brief Returns the register holding an operand, loading it into
+    //!        SCRATCH if it is a constant.
+    x86_64::reg_t to_reg (const x86_64_operand& opr, x86_64::reg_t scratch);
+
+    //! \brief Replaces a constant that does not fit in 32 bits with SCRATCH.
+    void fit_imm (x86_64_operand& opr, x86_64::reg_t scratch);
+
+    void emit_move (x86_64::reg_t dest, const x86_64_operand& src);
+    void emit_load_imm (x86_64::reg_t dest, int64_t val);
+
+    //! \brief Emits "M dest, src".
+    template<x86_64::mnemonic M>
+    void emit_op (x86_64::reg_t dest, const x86_64_operand& src);
+
+    //! \brief Emits "dest = a M b" in two-address form.
+    template<x86_64::mnemonic M>
+    void emit_binary (x86_64::reg_t dest, x86_64_operand a, x86_64_operand b);
   };
 }
 }
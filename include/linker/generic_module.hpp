@@ -83,6 +83,18 @@ namespace jcc {
   };
 
 
+  /*!
+     \struct module_range
+     \brief A range of bytes in a section: SECTION + [off, off + len).
+   */
+  struct module_range
+  {
+    section *sect;
+    size_t off;
+    size_t len;
+  };
+
+
   using version_symbol_id = int;
   using module_import_id = int;
 
@@ -161,6 +173,9 @@ namespace jcc {
     std::unordered_map<std::string, module_import_id> imp_map;
     std::unordered_map<relocation_symbol_id, import_symbol> imp_syms;
 
+    // keeps the store that relocations in the module refer to alive
+    std::shared_ptr<relocation_symbol_store> rstore;
+
   public:
     inline module_type get_type () const { return this->mtype; }
     inline target_architecture get_target_architecture () const { return this->tarch; }
@@ -182,6 +197,8 @@ namespace jcc {
     inline const std::string& get_export_name () const { return this->exp_name; }
     inline void set_export_name (const std::string& name) { this->exp_name = name; }
 
+    inline void set_relocation_store (std::shared_ptr<relocation_symbol_store> store) { this->rstore = store; }
+
     
   public:
     explicit generic_module (module_type mtype, target_architecture tarch);
@@ -0,0 +1,118 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _JCC__LINKER__LAYOUT_CACHE__H_
+#define _JCC__LINKER__LAYOUT_CACHE__H_
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <iosfwd>
+#include <cstdint>
+#include <cstddef>
+
+
+namespace jcc {
+
+  /*!
+     \class link_layout_cache
+     \brief The output layout of a previous incremental link.
+
+     Remembers where every input section was placed in the output (and how
+     much room it was given to grow), the output location of every symbol
+     resolved statically, and the relocation sites that refer to those
+     symbols. The linker uses it to place unchanged sections where they were
+     before, and to find the bytes that a relink actually changes.
+
+     The cache can be persisted across runs with save() and load().
+   */
+  class link_layout_cache
+  {
+   public:
+    /*!
+       \struct slot
+       \brief The placement of an input section.
+     */
+    struct slot
+    {
+      std::string name;     // name of input and output section
+      int type;             // section_type
+      size_t off;           // offset in the output section
+      size_t size;          // size of the input section
+      size_t capacity;      // room reserved for the input section
+      uint64_t hash;        // of the input section's contents and relocations
+    };
+
+    /*!
+       \struct symbol_location
+       \brief Where a statically resolved symbol ended up.
+     */
+    struct symbol_location
+    {
+      std::string sect;     // output section name
+      size_t off;
+    };
+
+    /*!
+       \struct reloc_site
+       \brief A relocation in the output that refers to a symbol resolved
+              statically.
+     */
+    struct reloc_site
+    {
+      size_t slot;          // index of the slot that contains the site
+      size_t off;           // offset in the output section
+      unsigned int size;
+      std::string sym;
+    };
+
+   private:
+    std::vector<slot> slots; // by input section, in link order
+    std::unordered_map<std::string, symbol_location> syms;
+    std::vector<reloc_site> sites;
+    uint64_t interface_hash; // of the output's imports and exports
+
+   public:
+    inline bool empty () const { return this->slots.empty (); }
+
+    inline auto& get_slots () { return this->slots; }
+    inline const auto& get_slots () const { return this->slots; }
+    inline auto& get_symbols () { return this->syms; }
+    inline const auto& get_symbols () const { return this->syms; }
+    inline auto& get_reloc_sites () { return this->sites; }
+    inline const auto& get_reloc_sites () const { return this->sites; }
+
+    inline uint64_t get_interface_hash () const { return this->interface_hash; }
+    inline void set_interface_hash (uint64_t hash) { this->interface_hash = hash; }
+
+   public:
+    link_layout_cache ();
+
+   public:
+    //! \brief Forgets the cached layout.
+    void clear ();
+
+    //! \brief Writes the cache into the specified stream.
+    void save (std::ostream& strm) const;
+
+    //! \brief Reads a cache previously written with save().
+    void load (std::istream& strm);
+  };
+}
+
+#endif //_JCC__LINKER__LAYOUT_CACHE__H_
@@ -20,6 +20,11 @@
 #define _JCC__LINKER__LINKER__H_
 
 #include "linker/generic_module.hpp"
+#include "linker/layout_cache.hpp"
+#include "linker/profile.hpp"
+#include "common/thread_pool.hpp"
+#include <unordered_map>
+#include <exception>
 
 
 namespace jcc {
@@ -38,13 +43,131 @@ namespace jcc {
 
 
 
+  /*!
+     \enum icf_mode
+     \brief Which code sections identical code folding may merge.
+   */
+  enum class icf_mode
+  {
+    // \brief No folding.
+    none,
+
+    // \brief Only sections whose address is never taken.
+    safe,
+
+    // \brief All identical code sections.
+    all,
+  };
+
+
+
   /*!
      \class linker
      \brief The generic module linker.
+
+     Sections of relocatable input modules that share a name are merged into
+     a single output section. Relocations against symbols exported by other
+     relocatable modules are resolved statically: PC-relative ones that stay
+     within a section are applied by the linker itself, the rest are left
+     to the module translator, which knows the final addresses. Only symbols
+     defined by shared objects are imported.
+
+     In parallel mode, input sections are copied and their relocations
+     resolved on a thread pool. Everything that modifies the output module's
+     bookkeeping (relocation lists, imports and the relocation store) still
+     happens on the calling thread, in input order, so the output is the same
+     as in serial mode.
+
+     In incremental mode, the layout of the previous link is taken from a
+     link_layout_cache, and every input section is given room to grow. If
+     all input sections still fit where they were, and the output's imports
+     and exports are unchanged, the layout is kept and the linker reports the
+     ranges of the output that differ from the previous link, so that only
+     those need to be rewritten (see module_translator::update_file()).
+     Otherwise, the output is laid out anew.
+
+     With section garbage collection enabled, only input sections reachable
+     from the entry point and from the symbols passed to keep_symbol() are
+     linked. A section is reachable if a relocation in a reachable code
+     section refers to a symbol it defines.
+
+     Identical code folding merges code sections that have the same name,
+     contents and relocations (up to the identity of sections that are
+     themselves folded) into one copy. Symbols defined by a folded section
+     resolve to the copy that is kept. In safe mode, sections whose address
+     is taken (referenced other than as the target of a direct call or jump,
+     or defining a kept symbol) are never folded.
+
+     Given a link_profile, code sections are reordered: first the sections
+     that define symbols in the profile's explicit order, then sections that
+     were executed, clustered along hot call edges (C3) with the densest
+     clusters first, and last the sections the profile does not mention, in
+     input order. Data sections keep their order.
    */
   class linker
   {
+    /*!
+       \struct global_symbol
+       \brief An entry in the linker's global symbol table.
+     */
+    struct global_symbol
+    {
+      generic_module *mod;       // defining module
+      const export_symbol *exp;
+      bool ambiguous;            // defined by more than one module
+    };
+
+    /*!
+       \struct section_placement
+       \brief Where an input section ends up in the output module.
+     */
+    struct section_placement
+    {
+      progbits_section *sect; // output section
+      size_t off;
+      unsigned char *data;    // the section's bytes in the output section
+    };
+
+    /*!
+       \struct prepared_section
+       \brief An input section that has been copied into its output section,
+              but whose unapplied relocations have not yet been recorded.
+     */
+    struct prepared_section
+    {
+      const section *in;
+      std::vector<const global_symbol *> reloc_syms; // by relocation
+      std::vector<char> applied;                     // by relocation
+      std::exception_ptr error;
+    };
+
+   private:
     std::vector<generic_module *> mods;
+    std::unique_ptr<thread_pool> pool; // null in serial mode
+
+    // export symbols of all input modules, by name
+    std::unordered_map<std::string, global_symbol> globals;
+
+    // by input section
+    std::unordered_map<const section *, section_placement> placements;
+
+    link_layout_cache *cache; // non-null in incremental mode
+    std::vector<size_t> capacities; // by input section, in link order
+    std::vector<uint64_t> hashes;   // by input section (incremental mode)
+    bool layout_reused;
+    std::vector<module_range> dirty;
+
+    bool gc;
+    std::vector<std::string> gc_roots; // symbols kept by keep_symbol()
+    size_t gc_sects;                   // sections removed by the last link
+    size_t gc_bytes;                   // bytes removed by the last link
+
+    icf_mode icf;
+    // folded input sections, mapped to the sections that replace them
+    std::unordered_map<const section *, const section *> folded;
+    size_t icf_bytes;
+
+    const link_profile *profile; // null if code is kept in input order
 
     generic_module *out; // output module
     generic_module *main; // main input module (containg program entry point)
@@ -53,13 +176,69 @@ namespace jcc {
     std::shared_ptr<relocation_symbol_store> rstore;
 
    public:
-    linker ();
+    /*!
+       \brief Creates a linker that uses the specified number of threads.
+
+       One thread (the default) links serially; zero picks the number of
+       hardware threads.
+     */
+    explicit linker (unsigned num_threads = 1);
     ~linker ();
 
+    /*!
+       \brief Checks whether the last link kept the layout of the previous
+              one, in which case only the ranges returned by
+              get_dirty_ranges() differ from the previous output.
+     */
+    inline bool is_incremental () const { return this->layout_reused; }
+
+    //! \brief Returns the ranges of the output that the last link changed.
+    inline const std::vector<module_range>& get_dirty_ranges () const { return this->dirty; }
+
+    //! \brief Returns the number of sections removed by the last link.
+    inline size_t get_collected_sections () const { return this->gc_sects; }
+
+    //! \brief Returns the number of bytes removed by the last link.
+    inline size_t get_collected_bytes () const { return this->gc_bytes; }
+
+    //! \brief Returns the number of sections folded by the last link.
+    inline size_t get_folded_sections () const { return this->folded.size (); }
+
+    //! \brief Returns the number of bytes saved by folding in the last link.
+    inline size_t get_folded_bytes () const { return this->icf_bytes; }
+
    public:
     //! \brief Inserts the specified module as input.
     void add_module (generic_module& mod);
 
+    /*!
+       \brief Enables incremental mode.
+
+       The cache holds the layout of the previous link (if any), and is
+       updated with the new layout by every call to link().
+     */
+    void set_layout_cache (link_layout_cache *cache);
+
+    //! \brief Enables or disables removal of unreferenced sections.
+    void set_gc_sections (bool enable);
+
+    /*!
+       \brief Treats the section that defines the specified symbol as
+              referenced when removing unreferenced sections.
+     */
+    void keep_symbol (const std::string& name);
+
+    //! \brief Sets which code sections identical code folding may merge.
+    void set_icf_mode (icf_mode mode);
+
+    /*!
+       \brief Orders code sections in the output by the specified profile.
+
+       The profile must outlive calls to link(). A null profile keeps code
+       sections in input order.
+     */
+    void set_profile (const link_profile *profile);
+
    public:
     /*!
        \brief Links all input modules together.
@@ -70,16 +249,61 @@ namespace jcc {
     //! \brief Finds the module that contains the symbol _start.
     generic_module& find_main_module ();
 
-    //! \brief Finds the input module that contains the specified export symbol name.
-    generic_module& find_module_containing_export (const std::string& name);
+    //! \brief Builds the global symbol table from the input modules' exports.
+    void build_symbol_table ();
+
+    //! \brief Looks up the global symbol with the specified name.
+    const global_symbol& find_global_symbol (const std::string& name);
 
 
     //! \brief Constructs the output module's sections.
     void add_sections ();
 
-    //! \brief Inserts the specified section into the output module.
-    void add_section (section& sect);
-    void add_code_section (code_section& sect);
+    //! \brief Removes input sections that are not reachable from the entry
+    //!        point or from kept symbols.
+    void collect_sections (std::vector<const section *>& in_sects);
+
+    //! \brief Removes duplicate code sections, remembering which section
+    //!        replaces each of them.
+    void fold_sections (std::vector<const section *>& in_sects);
+
+    //! \brief Reorders code sections by the profile, leaving data sections
+    //!        where they are.
+    void order_sections (std::vector<const section *>& in_sects);
+
+    //! \brief Lays out the output sections and creates them.
+    void place_sections (const std::vector<const section *>& in_sects);
+
+    //! \brief Checks whether the cached layout can hold the input sections.
+    bool can_reuse_layout (const std::vector<const section *>& in_sects) const;
+
+    //! \brief Finds the changed ranges of the output and updates the cache.
+    void update_layout_cache (const std::vector<prepared_section>& preps);
+
+    //! \brief Copies an input section into its output section and resolves
+    //!        its relocations.
+    void prepare_section (prepared_section& prep);
+
+    //! \brief Records the relocations of a prepared section that could not
+    //!        be applied by the linker in the output module.
+    void add_relocations (prepared_section& prep);
+
+    //! \brief Returns the location of a symbol defined by a relocatable
+    //!        module in the output module.
+    module_location find_definition (const global_symbol& gsym) const;
+
+    //! \brief Calls fn(i) for every i in [0, count), on the thread pool if
+    //!        there is one.
+    template<typename Fn>
+    void
+    for_each_index (size_t count, Fn&& fn)
+    {
+      if (this->pool)
+        this->pool->parallel_for (count, std::forward<Fn> (fn));
+      else
+        for (size_t i = 0; i < count; ++i)
+          fn (i);
+    }
   };
 }
 
@@ -0,0 +1,93 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _JCC__LINKER__PROFILE__H_
+#define _JCC__LINKER__PROFILE__H_
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <iosfwd>
+#include <cstdint>
+
+
+namespace jcc {
+
+  /*!
+     \class link_profile
+     \brief Execution profile used to order code in the linker's output.
+
+     Read from a text file with one entry per line, where everything after
+     a '#' is a comment:
+       <symbol>                    - the next symbol in an explicit order
+       <symbol> <count>            - number of times a function was called
+       <caller> <callee> <count>   - number of calls from one function to
+                                     another
+     Counts for the same function or call edge are added up.
+   */
+  class link_profile
+  {
+   public:
+    /*!
+       \struct call_edge
+       \brief Calls from one function to another.
+     */
+    struct call_edge
+    {
+      std::string caller;
+      std::string callee;
+      uint64_t count;
+    };
+
+   private:
+    std::vector<std::string> order;
+    std::unordered_map<std::string, uint64_t> counts;
+    std::vector<call_edge> edges;
+    std::unordered_map<std::string, size_t> edge_map; // "caller callee" to edge
+
+   public:
+    inline bool empty () const
+    { return this->order.empty () && this->counts.empty () && this->edges.empty (); }
+
+    inline const auto& get_order () const { return this->order; }
+    inline const auto& get_counts () const { return this->counts; }
+    inline const auto& get_call_edges () const { return this->edges; }
+
+   public:
+    //! \brief Appends a symbol to the explicit order.
+    void add_ordered_symbol (const std::string& name);
+
+    //! \brief Adds to the number of times a function was called.
+    void add_count (const std::string& name, uint64_t count);
+
+    //! \brief Adds to the number of calls from one function to another.
+    void add_call (const std::string& caller, const std::string& callee,
+                   uint64_t count);
+
+    //! \brief Forgets the profile.
+    void clear ();
+
+    /*!
+       \brief Reads profile entries from the specified stream.
+       \throws std::runtime_error if a line is malformed.
+     */
+    void load (std::istream& strm);
+  };
+}
+
+#endif //_JCC__LINKER__PROFILE__H_
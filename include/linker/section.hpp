@@ -20,6 +20,7 @@
 #define _JCC__LINKER__SECTION__H_
 
 #include "assembler/relocation.hpp"
+#include "common/cow_buffer.hpp"
 #include <memory>
 #include <string>
 #include <vector>
@@ -72,12 +73,12 @@ namespace jcc {
   class progbits_section: public section
   {
    protected:
-    std::vector<unsigned char> data;
+    cow_buffer data; // may be a view into a loaded module's file
     size_t vaddr;
 
    public:
-    inline std::vector<unsigned char>& get_data () { return this->data; }
-    inline const std::vector<unsigned char>& get_data () const { return this->data; }
+    inline cow_buffer& get_data () { return this->data; }
+    inline const cow_buffer& get_data () const { return this->data; }
 
     inline size_t get_vaddr () const { return this->vaddr; }
     inline void set_vaddr (size_t vaddr) { this->vaddr = vaddr; }
@@ -88,6 +89,8 @@ namespace jcc {
                       const std::vector<unsigned char>& data, size_t vaddr);
     progbits_section (const std::string& name,
                       const unsigned char *data, unsigned int len, size_t vaddr);
+    progbits_section (const std::string& name, const cow_buffer& data,
+                      size_t vaddr);
 
    public:
     virtual std::unique_ptr<section> clone () const override;
@@ -111,8 +114,8 @@ namespace jcc {
     std::unordered_map<relocation_symbol_id, size_t> reloc_map;
     
   public:
-    inline std::vector<unsigned char>& get_code () { return this->data; }
-    inline const std::vector<unsigned char>& get_code () const { return this->data; }
+    inline cow_buffer& get_code () { return this->data; }
+    inline const cow_buffer& get_code () const { return this->data; }
 
     inline std::vector<relocation>& get_relocations () { return this->relocs; }
     inline const std::vector<relocation>& get_relocations () const { return this->relocs; }
@@ -123,6 +126,8 @@ namespace jcc {
                   const std::vector<unsigned char>& data, size_t vaddr);
     code_section (const std::string& name,
                   const unsigned char *data, unsigned int len, size_t vaddr);
+    code_section (const std::string& name, const cow_buffer& data,
+                  size_t vaddr);
 
    public:
     //! \brief Inserts the specified relocation to the section's relocation list.
@@ -85,6 +85,7 @@ namespace jcc {
     SHT_SHLIB     = 10, //! \brief Reserved
     SHT_DYNSYM    = 11, //! \brief Contains a dynamic loader symbol table
 
+    SHT_GNU_HASH    = 0x6ffffff6, //! \brief GNU-style symbol hash table.
     SHT_GNU_VERDEF  = 0x6ffffffd, //! \brief Version definition section.
     SHT_GNU_VERNEED	= 0x6ffffffe, //! \brief Version needs section.
     SHT_GNU_VERSYM  = 0x6fffffff, //! \brief Version symbol table.
@@ -224,6 +225,7 @@ namespace jcc {
     DT_INIT_ARRAYSZ = 27,   //! \brief d_val Size, in bytes, of the array of initialization functions.
     DT_FINI_ARRAYSZ = 28,   //! \brief d_val Size, in bytes, of the array of termination functions.
     DT_LOOS   = 0x60000000, //! \brief Defines a range of dynamic table tags that are reserved for environment-specific use.
+    DT_GNU_HASH = 0x6ffffef5, //! \brief d_ptr Address of the GNU-style symbol hash table.
     DT_HIOS   = 0x6FFFFFFF,
     DT_LOPROC = 0x70000000, //! \brief Defines a range of dynamic table tags that are reserved for processor-specific use.
     DT_HIPROC = 0x7FFFFFFF,
@@ -273,6 +275,11 @@ namespace jcc {
      \brief The hash function used in ELF64 files.
    */
   elf64_word_t elf64_hash (const std::string& name);
+
+  /*!
+     \brief The hash function used in GNU-style hash tables (.gnu.hash).
+   */
+  elf64_word_t elf64_gnu_hash (const char *name);
 }
 
 #endif //_JCC__LINKER__TRANSLATORS__ELF64__ELF64__H_
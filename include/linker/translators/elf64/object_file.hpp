@@ -22,12 +22,26 @@
 #include "linker/translators/elf64/elf64.hpp"
 #include "linker/translators/elf64/section.hpp"
 #include "linker/translators/elf64/segment.hpp"
+#include "common/mapped_file.hpp"
 #include <vector>
 #include <memory>
 #include <iosfwd>
 
 namespace jcc {
 
+  /*!
+     \struct elf64_section_range
+     \brief A range of bytes in the contents of a section.
+   */
+  struct elf64_section_range
+  {
+    elf64_section *sect;
+    elf64_xword_t off;
+    elf64_xword_t len;
+  };
+
+
+
   /*!
      \class elf64_object_file
      \brief ELF64 object file.
@@ -42,6 +56,9 @@ namespace jcc {
 
     // used when loading:
     std::vector<elf64_shdr_t> shdrs;
+    std::shared_ptr<const void> image_owner;
+    const unsigned char *image;
+    size_t image_size;
 
     // entry point
     elf64_section *entry_sect;
@@ -105,6 +122,14 @@ namespace jcc {
                                           elf64_section& sect,
                                           elf64_symtab_section& symtab);
 
+    //! \brief Inserts a SysV symbol hash table section.
+    elf64_hash_section& add_hash_section (const std::string& name,
+                                          elf64_dynsym_section& dynsym);
+
+    //! \brief Inserts a GNU symbol hash table section.
+    elf64_gnu_hash_section& add_gnu_hash_section (const std::string& name,
+                                                  elf64_dynsym_section& dynsym);
+
 
     //! \brief Inserts a new program segment.
     elf64_segment& add_segment (elf64_segment_type type);
@@ -143,34 +168,66 @@ namespace jcc {
     void save (std::ostream& strm);
 
     /*!
-       \brief Loads the object file from the sshdrspecified stream.
+       \brief Saves the object file into the file at the specified path,
+              writing directly into a memory mapping of the file.
+     */
+    void save (const std::string& path);
+
+    /*!
+       \brief Rewrites the specified ranges of section contents in a file
+              previously saved with the same layout.
+       \return False, leaving the file untouched, if the file does not match
+               the object file's layout.
+
+       The file must have the same size, headers, and contents of all
+       sections other than PROGBITS ones; PROGBITS contents outside the
+       specified ranges are assumed to be unchanged.
+     */
+    bool update (const std::string& path,
+                 const std::vector<elf64_section_range>& ranges);
+
+    /*!
+       \brief Loads the object file from the specified stream.
      */
     void load (std::istream& strm);
 
+    /*!
+       \brief Loads the object file from a file mapped into memory, without
+              copying section contents.
+     */
+    void load (std::shared_ptr<const mapped_file> file);
+
     //! \brief Resets the object file to a clean state.
     void clear ();
 
    private:
-    void write_header (std::ostream& strm, size_t& curr_off);
-    void write_program_headers (std::ostream& strm, size_t& curr_off);
-    void write_section_headers (std::ostream& strm, size_t& curr_off);
+    size_t prepare_image ();
+    void write_image (unsigned char *out);
+    void write_header (unsigned char *out);
+    void write_program_headers (unsigned char *out);
+    void write_section_headers (unsigned char *out);
 
     void order_sections ();
     void compute_offsets ();
     void position_segments ();
     void bake_sections ();
 
-    void read_header (std::istream& strm);
-    void read_sections (std::istream& strm);
-
-    elf64_section* read_section (std::istream& strm, elf64_shdr_t& shdr);
-    elf64_strtab_section& read_strtab_section (std::istream& strm, elf64_shdr_t& shdr);
-    elf64_symtab_section& read_symtab_section (std::istream& strm, elf64_shdr_t& shdr);
-    elf64_verdef_section& read_verdef_section (std::istream& strm, elf64_shdr_t& shdr);
-    elf64_versym_section& read_versym_section (std::istream& strm, elf64_shdr_t& shdr);
-    elf64_progbits_section& read_progbits_section (std::istream& strm, elf64_shdr_t& shdr);
-    elf64_dynamic_section& read_dynamic_section (std::istream& strm, elf64_shdr_t& shdr);
-    void read_section_generic (elf64_section& s, std::istream& strm, elf64_shdr_t& shdr);
+    void load_image (std::shared_ptr<const void> owner,
+                     const unsigned char *data, size_t size);
+    const unsigned char* get_image_range (elf64_off_t off, size_t len) const;
+
+    void read_header ();
+    void read_sections ();
+
+    elf64_section* read_section (elf64_shdr_t& shdr);
+    elf64_strtab_section& read_strtab_section (elf64_shdr_t& shdr);
+    elf64_symtab_section& read_symtab_section (elf64_shdr_t& shdr);
+    elf64_verdef_section& read_verdef_section (elf64_shdr_t& shdr);
+    elf64_versym_section& read_versym_section (elf64_shdr_t& shdr);
+    elf64_progbits_section& read_progbits_section (elf64_shdr_t& shdr);
+    elf64_dynamic_section& read_dynamic_section (elf64_shdr_t& shdr);
+    void read_section_generic (elf64_section& s, elf64_shdr_t& shdr);
+    elf64_section& get_linked_section (elf64_shdr_t& shdr);
 
     /*!
        \brief Returns the correct address alignment for the specified section.
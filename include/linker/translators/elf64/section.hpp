@@ -20,9 +20,12 @@
 #define _JCC__LINKER__TRANSLATORS__ELF64__SECTION__H_
 
 #include "linker/translators/elf64/elf64.hpp"
+#include "common/cow_buffer.hpp"
 #include <string>
 #include <unordered_map>
 #include <vector>
+#include <memory>
+#include <algorithm>
 
 namespace jcc {
 
@@ -65,18 +68,37 @@ namespace jcc {
 
    public:
     /*!
-       \brief Prepares the section's binary data, and determines its size.
+       \brief Fills in the remaining header fields (links, sizes, symbol
+              indices) once the layout is known.
      */
     virtual void bake () = 0;
 
     //! \brief Determines the size of the section in bytes.
     virtual size_t compute_size () = 0;
 
-    //! \brief Returns the binary data of the section (created by bake()).
-    virtual const char* get_data () const = 0;
+    /*!
+       \brief Serializes the baked section into the specified buffer, which
+              has room for sh_size bytes.
+
+       Sections write straight into the output image; there is no
+       intermediate per-section buffer.
+     */
+    virtual void write (unsigned char *out) const = 0;
 
     //! \brief Loads section contents from the specified byte array.
     virtual void load_raw (const unsigned char *raw, unsigned int len) = 0;
+
+    /*!
+       \brief Loads section contents from memory that is kept alive by
+              \p owner (e.g. a mapped file).
+
+       Sections that are parsed into tables of their own just copy what they
+       need (the default); sections that hold raw bytes keep a view instead.
+     */
+    virtual void
+    load_view (std::shared_ptr<const void> owner, const unsigned char *raw,
+               unsigned int len)
+    { this->load_raw (raw, len); }
   };
 
 
@@ -89,18 +111,15 @@ namespace jcc {
    */
   class elf64_null_section: public elf64_section
   {
-    std::string data;
-
    public:
     elf64_null_section (elf64_object_file& obj);
 
    public:
-    virtual void bake () override;
+    virtual void bake () override { }
 
     virtual size_t compute_size () override;
 
-    virtual const char* get_data () const override
-    { return this->data.data (); }
+    virtual void write (unsigned char *out) const override { }
 
     virtual void load_raw (const unsigned char *raw, unsigned int len) override { }
   };
@@ -142,8 +161,7 @@ namespace jcc {
 
     virtual size_t compute_size () override;
 
-    virtual const char* get_data () const override
-      { return this->data.data (); }
+    virtual void write (unsigned char *out) const override;
 
     virtual void load_raw (const unsigned char *raw, unsigned int len) override;
   };
@@ -187,7 +205,10 @@ namespace jcc {
    protected:
     elf64_strtab_section& strtab; // associated string table
     std::vector<symbol> syms_local, syms_global;
-    std::string data;
+
+    // by symbol ID: index into syms_local if non-negative, otherwise
+    // -(index into syms_global) - 1.
+    std::vector<int> id_locs;
 
     int next_sym_id;
 
@@ -225,16 +246,32 @@ namespace jcc {
     //! \brief Returns the symbol has the specified ID.
     const symbol& get_symbol (int id) const;
 
+    /*!
+       \brief Reorders the global symbols of the table (stable).
+
+       Symbol IDs are unaffected; indices are only assigned when the table is
+       baked.
+     */
+    template<typename Compare>
+    void
+    sort_global_symbols (Compare cmp)
+    {
+      std::stable_sort (this->syms_global.begin (), this->syms_global.end (), cmp);
+      for (size_t i = 0; i < this->syms_global.size (); ++i)
+        this->id_locs[this->syms_global[i].id] = -(int)i - 1;
+    }
+
    private:
-    void write_symbol (std::ostream& strm, symbol& sym);
+    symbol& new_symbol (elf64_symbol_binding bind);
+
+    void write_symbol (unsigned char *out, const symbol& sym) const;
 
    public:
     virtual void bake () override;
 
     virtual size_t compute_size () override;
 
-    virtual const char* get_data () const override
-    { return this->data.data (); }
+    virtual void write (unsigned char *out) const override;
 
     virtual void load_raw (const unsigned char *raw, unsigned int len) override;
   };
@@ -263,7 +300,7 @@ namespace jcc {
    */
   class elf64_progbits_section: public elf64_section
   {
-    std::vector<unsigned char> data;
+    cow_buffer data;
 
    public:
     elf64_progbits_section (elf64_object_file& obj);
@@ -275,18 +312,26 @@ namespace jcc {
     void init ();
 
    public:
-    unsigned char* get_data () { return this->data.data (); }
+    //! \brief Returns writable section contents (copied out of the loaded
+    //!        file on first use).
+    unsigned char* get_data () { return this->data.get_mutable_data (); }
     void set_data (const unsigned char *data, size_t len);
 
+    inline const char* get_data () const { return (const char *)this->data.data (); }
+    inline const cow_buffer& get_buffer () const { return this->data; }
+
    public:
     virtual void bake () { }
 
     virtual size_t compute_size () override;
 
-    virtual const char* get_data () const override
-    { return (char *)this->data.data (); }
+    virtual void write (unsigned char *out) const override;
 
     virtual void load_raw (const unsigned char *raw, unsigned int len) override;
+
+    virtual void load_view (std::shared_ptr<const void> owner,
+                            const unsigned char *raw,
+                            unsigned int len) override;
   };
 
 
@@ -313,8 +358,7 @@ namespace jcc {
 
     virtual size_t compute_size () override;
 
-    virtual const char* get_data () const override
-    { return (char *)this->interp.data (); }
+    virtual void write (unsigned char *out) const override;
 
     virtual void load_raw (const unsigned char *raw, unsigned int len) override { }
   };
@@ -347,7 +391,6 @@ namespace jcc {
    private:
     elf64_strtab_section& strtab;
     std::vector<entry> entries;
-    std::string data;
 
    public:
     inline elf64_strtab_section& get_strtab () { return this->strtab; }
@@ -374,8 +417,7 @@ namespace jcc {
 
     virtual size_t compute_size () override;
 
-    virtual const char* get_data () const override
-    { return (char *)this->data.data (); }
+    virtual void write (unsigned char *out) const override;
 
     virtual void load_raw (const unsigned char *raw, unsigned int len) override;
   };
@@ -403,7 +445,6 @@ namespace jcc {
     elf64_section& sect;
     elf64_symtab_section& symtab;
     std::vector<entry> entries;
-    std::string data;
 
    public:
     elf64_rela_section (elf64_object_file& obj, elf64_section& sect,
@@ -423,8 +464,7 @@ namespace jcc {
 
     virtual size_t compute_size () override;
 
-    virtual const char* get_data () const override
-    { return (char *)this->data.data (); }
+    virtual void write (unsigned char *out) const override;
 
     virtual void load_raw (const unsigned char *raw, unsigned int len) override { }
   };
@@ -456,7 +496,6 @@ namespace jcc {
    private:
     elf64_strtab_section& strtab;
     std::vector<entry> entries;
-    std::string data;
 
    public:
     inline elf64_strtab_section& get_strtab () { return this->strtab; }
@@ -479,8 +518,7 @@ namespace jcc {
 
     virtual size_t compute_size () override;
 
-    virtual const char* get_data () const override
-    { return (char *)this->data.data (); }
+    virtual void write (unsigned char *out) const override;
 
     virtual void load_raw (const unsigned char *raw, unsigned int len) override;
   };
@@ -497,7 +535,6 @@ namespace jcc {
   {
     elf64_dynsym_section& dynsym;
     std::vector<elf64_half_t> entries;
-    std::string data;
 
    public:
     elf64_versym_section (elf64_object_file& obj,
@@ -513,11 +550,72 @@ namespace jcc {
 
     virtual size_t compute_size () override;
 
-    virtual const char* get_data () const override
-    { return (char *)this->data.data (); }
+    virtual void write (unsigned char *out) const override;
 
     virtual void load_raw (const unsigned char *raw, unsigned int len) override;
   };
+
+
+
+//------------------------------------------------------------------------------
+
+  /*!
+     \class elf64_hash_section
+     \brief SysV-style symbol hash table (.hash) for a dynamic symbol table.
+   */
+  class elf64_hash_section: public elf64_section
+  {
+    elf64_dynsym_section& dynsym;
+    elf64_word_t num_buckets;
+
+   public:
+    elf64_hash_section (elf64_object_file& obj, elf64_dynsym_section& dynsym);
+
+   public:
+    virtual void bake () override;
+
+    virtual size_t compute_size () override;
+
+    virtual void write (unsigned char *out) const override;
+
+    virtual void load_raw (const unsigned char *raw, unsigned int len) override { }
+  };
+
+
+
+//------------------------------------------------------------------------------
+
+  /*!
+     \class elf64_gnu_hash_section
+     \brief GNU-style symbol hash table (.gnu.hash) for a dynamic symbol table.
+
+     Only defined global symbols are hashed. These must come last in the
+     symbol table, grouped by bucket, and so the section reorders the table's
+     global symbols when it is baked (before the table assigns indices). A
+     bloom filter in front of the buckets lets the loader turn away most
+     lookups of symbols that are not defined here without walking a chain.
+   */
+  class elf64_gnu_hash_section: public elf64_section
+  {
+    elf64_dynsym_section& dynsym;
+    elf64_word_t num_buckets;
+    elf64_word_t bloom_size; // in 64-bit words
+    elf64_word_t bloom_shift;
+    size_t num_hashed;
+
+   public:
+    elf64_gnu_hash_section (elf64_object_file& obj,
+                            elf64_dynsym_section& dynsym);
+
+   public:
+    virtual void bake () override;
+
+    virtual size_t compute_size () override;
+
+    virtual void write (unsigned char *out) const override;
+
+    virtual void load_raw (const unsigned char *raw, unsigned int len) override { }
+  };
 }
 
 #endif //_JCC__LINKER__TRANSLATORS__ELF64__SECTION__H_
@@ -45,17 +45,26 @@ namespace jcc {
    public:
     virtual void save (generic_module& mod, std::ostream& strm) override;
 
+    virtual void save_file (generic_module& mod, const std::string& path) override;
+
+    virtual bool update_file (generic_module& mod, const std::string& path,
+                              const std::vector<module_range>& ranges) override;
+
     virtual std::shared_ptr<generic_module> load (std::istream& strm) override;
 
+    virtual std::shared_ptr<generic_module> load_file (const std::string& path) override;
+
    private:
     void build_object_file ();
 
     void handle_section (section& s);
     void handle_code_section (code_section& s);
+    void handle_progbits_section (progbits_section& s);
 
     void add_got_plt ();
     void add_plt ();
     void add_relocations ();
+    void add_exports ();
     void add_dynamic_section ();
     void fill_got_plt ();
     void fill_plt ();
@@ -63,22 +72,22 @@ namespace jcc {
     //! \brief Fixes relocations in code.
     void fix_relocations ();
 
+    //! \brief Returns the address the specified relocation refers to.
+    elf64_addr_t get_relocation_target (const relocation& reloc);
+
     void set_entry_point ();
 
     void add_segments ();
 
    private:
+    std::shared_ptr<generic_module> translate_loaded ();
+
     void parse_object_file ();
     void parse_sections ();
     void parse_progbits_section (elf64_progbits_section& s);
     void parse_dynamic_section (elf64_dynamic_section& s);
     void parse_version_definitions ();
     void parse_exports ();
-
-
-   private:
-    //! \brief Searches for the section that contains the specified relocation.
-    code_section& find_section_with_relocation (relocation_symbol_id id);
   };
 }
 
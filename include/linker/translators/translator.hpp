@@ -21,6 +21,8 @@
 
 #include "linker/generic_module.hpp"
 #include <iosfwd>
+#include <string>
+#include <vector>
 
 
 namespace jcc {
@@ -45,10 +47,40 @@ namespace jcc {
      */
     virtual void save (generic_module& mod, std::ostream& strm) = 0;
 
+    /*!
+       \brief Translates the specified generic module into the file at the
+              specified path.
+
+       The default implementation writes through a stream.
+     */
+    virtual void save_file (generic_module& mod, const std::string& path);
+
+    /*!
+       \brief Updates a file previously saved from an earlier version of the
+              specified module, which has kept its layout.
+       \param ranges The ranges of the module that have changed.
+       \return True if only the changed parts of the file were rewritten, false
+               if the whole file had to be saved again.
+
+       The default implementation always saves the whole file.
+     */
+    virtual bool update_file (generic_module& mod, const std::string& path,
+                              const std::vector<module_range>& ranges);
+
     /*!
        \brief Translates a platform-specific module into a generic module.
      */
     virtual std::shared_ptr<generic_module> load (std::istream& strm) = 0;
+
+    /*!
+       \brief Translates the platform-specific module stored in the file at
+              the specified path.
+
+       The default implementation reads the file through a stream; translators
+       that can work off a memory-mapped file override this to avoid copying
+       the module's contents.
+     */
+    virtual std::shared_ptr<generic_module> load_file (const std::string& path);
     
   public:
     /*!
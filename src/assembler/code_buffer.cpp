@@ -0,0 +1,118 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "assembler/code_buffer.hpp"
+#include <cstring>
+#include <utility>
+
+
+namespace jcc {
+
+  static const size_t _initial_capacity = 256;
+
+
+
+  code_buffer::code_buffer ()
+  {
+    this->mem = this->cur = this->lim = nullptr;
+    this->owned = true;
+  }
+
+  code_buffer::code_buffer (void *mem, size_t cap)
+  {
+    this->mem = this->cur = static_cast<unsigned char *> (mem);
+    this->lim = this->mem + cap;
+    this->owned = false;
+  }
+
+  code_buffer::code_buffer (code_buffer&& other)
+  {
+    this->mem = other.mem;
+    this->cur = other.cur;
+    this->lim = other.lim;
+    this->owned = other.owned;
+
+    other.mem = other.cur = other.lim = nullptr;
+    other.owned = true;
+  }
+
+  code_buffer&
+  code_buffer::operator= (code_buffer&& other)
+  {
+    if (this != &other)
+      {
+        std::swap (this->mem, other.mem);
+        std::swap (this->cur, other.cur);
+        std::swap (this->lim, other.lim);
+        std::swap (this->owned, other.owned);
+      }
+
+    return *this;
+  }
+
+  code_buffer::~code_buffer ()
+  {
+    if (this->owned)
+      delete[] this->mem;
+  }
+
+
+
+  unsigned char*
+  code_buffer::grow (size_t n)
+  {
+    if (!this->owned)
+      {
+        // the code itself might still fit, see commit_staged ()
+        if (n <= max_staged_size)
+          return this->stage;
+        throw code_buffer_full_error ("code does not fit in the supplied memory");
+      }
+
+    size_t size = this->get_size ();
+    size_t cap = this->get_capacity ();
+    if (cap < _initial_capacity)
+      cap = _initial_capacity;
+    while (cap - size < n)
+      cap *= 2;
+
+    auto mem = new unsigned char [cap];
+    if (size > 0)
+      std::memcpy (mem, this->mem, size);
+    delete[] this->mem;
+
+    this->mem = mem;
+    this->cur = mem + size;
+    this->lim = mem + cap;
+    return this->cur;
+  }
+
+  //! \brief Copies code written into the staging area onto the end of the
+  //!        buffer.
+  void
+  code_buffer::commit_staged (unsigned char *end)
+  {
+    size_t len = end - this->stage;
+    if ((size_t)(this->lim - this->cur) < len)
+      throw code_buffer_full_error ("code does not fit in the supplied memory");
+
+    if (len > 0)
+      std::memcpy (this->cur, this->stage, len);
+    this->cur += len;
+  }
+}
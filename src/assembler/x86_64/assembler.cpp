@@ -16,6 +16,8 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 #include "assembler/x86_64/assembler.hpp"
+#include <algorithm>
+#include <cstring>
 #include <utility>
 
 
@@ -43,8 +45,14 @@ namespace jcc {
 
     assembler::assembler ()
     {
-      this->pos = 0;
-      this->sz = 0;
+      this->out = this->ins = nullptr;
+      this->next_lbl_id = 1;
+    }
+
+    assembler::assembler (void *mem, size_t cap)
+        : code (mem, cap)
+    {
+      this->out = this->ins = nullptr;
       this->next_lbl_id = 1;
     }
 
@@ -61,7 +69,7 @@ namespace jcc {
     void
     assembler::mark_label (label_id id)
     {
-      this->lbl_fixes[id] = this->pos;
+      this->lbl_fixes[id] = this->code.get_size ();
     }
 
     //! \brief Calls make_label() and mark_label() in succession.
@@ -73,88 +81,216 @@ namespace jcc {
       return id;
     }
 
-    //! \brief Fixes label references in the generated code.
+    /*!
+       \brief Fixes label references in the generated code.
+
+       Relaxable references to labels that have been marked are shrunk to
+       their short form wherever the displacement fits, which moves the code
+       that follows them. Offsets recorded by the assembler (labels,
+       relocations) are updated, but code must not hard-code offsets that
+       span a relaxable reference.
+     */
     void
     assembler::fix_labels ()
     {
-      auto ppos = this->pos;
+      this->relax_branches ();
 
-      for (auto itr = this->lbl_uses.begin (); itr != this->lbl_uses.end (); )
+      // references are kept around and patched again on every call, since
+      // relaxing a later reference can move code that an earlier one spans.
+      for (auto& use : this->lbl_uses)
         {
-          auto& use = *itr;
           auto itr_fix = this->lbl_fixes.find (use.lbl.id);
           if (itr_fix == this->lbl_fixes.end ())
-            {
-              ++ itr;
-              continue;
-            }
+            continue;
 
           size_t fix = itr_fix->second;
           long long disp = (long long)fix - (long long)use.pos + use.add;
 
-          this->pos = use.pos;
+          auto p = this->code.at (use.pos);
           switch (use.lbl.ss)
             {
-            case SS_BYTE: this->put_u8 ((unsigned char)(char)disp); break;
-            case SS_WORD: this->put_u16 ((unsigned short)(short)disp); break;
-            case SS_DWORD: this->put_u32 ((unsigned int)(int)disp); break;
-            case SS_QWORD: this->put_u64 ((unsigned long long)disp); break;
+            case SS_BYTE: encoder::put_imm (p, disp, 1); break;
+            case SS_WORD: encoder::put_imm (p, disp, 2); break;
+            case SS_DWORD: encoder::put_imm (p, disp, 4); break;
+            case SS_QWORD: encoder::put_imm (p, disp, 8); break;
             }
-
-          itr = this->lbl_uses.erase (itr);
         }
-
-      this->pos = ppos;
     }
 
-    
-    
+
+
+    /*!
+       \brief Shrinks relaxable label references to their short form.
+
+       Every relaxable reference to a marked label starts out short, and the
+       code offsets are recomputed as if the short ones were already shrunk.
+       A reference whose displacement does not fit in 8 bits is made long
+       again, which can only push other labels further away, so this is
+       repeated until no reference changes. The code is then compacted in
+       place.
+
+       Later calls only ever remove code, which brings labels closer, so
+       references that have already been shrunk stay valid.
+     */
     void
-    assembler::put_u8 (uint8_t v)
+    assembler::relax_branches ()
     {
-      if (this->pos == this->data.size ())
+      // candidates, in code order
+      std::vector<label_use *> cands;
+      for (auto& use : this->lbl_uses)
+        if (use.short_opcode >= 0
+            && this->lbl_fixes.find (use.lbl.id) != this->lbl_fixes.end ())
+          cands.push_back (&use);
+      if (cands.empty ())
+        return;
+
+      size_t n = cands.size ();
+      std::vector<bool> is_short (n, true);
+
+      // saved[i] is the number of bytes saved by candidates before i.
+      std::vector<size_t> starts (n);
+      std::vector<size_t> saved (n + 1);
+      for (size_t i = 0; i < n; ++i)
+        starts[i] = cands[i]->ins_pos;
+      auto new_pos = [&] (size_t pos) -> size_t {
+        size_t i = std::lower_bound (starts.begin (), starts.end (), pos)
+                   - starts.begin ();
+        return pos - saved[i];
+      };
+
+      for (bool changed = true; changed; )
+        {
+          changed = false;
+
+          saved[0] = 0;
+          for (size_t i = 0; i < n; ++i)
+            {
+              size_t long_len = cands[i]->pos + 4 - cands[i]->ins_pos;
+              saved[i + 1] = saved[i] + (is_short[i] ? long_len - 2 : 0);
+            }
+
+          for (size_t i = 0; i < n; ++i)
+            {
+              if (!is_short[i])
+                continue;
+
+              auto use = cands[i];
+              long long end = (long long)(starts[i] - saved[i]) + 2;
+              long long disp = (long long)new_pos (this->lbl_fixes[use->lbl.id])
+                               - end;
+              if (!encoder::fits_i8 (disp))
+                {
+                  is_short[i] = false;
+                  changed = true;
+                }
+            }
+        }
+
+      if (saved[n] == 0)
+        return;
+
+      // compact the code
+      auto data = this->code.get_data ();
+      size_t dest = cands[0]->ins_pos;
+      size_t src = dest;
+      for (size_t i = 0; i < n; ++i)
         {
-          this->data.push_back (v);
-          ++ this->sz;
-          ++ this->pos;
+          if (!is_short[i])
+            continue;
+
+          auto use = cands[i];
+          std::memmove (data + dest, data + src, use->ins_pos - src);
+          dest += use->ins_pos - src;
+          data[dest ++] = (unsigned char)use->short_opcode;
+          data[dest ++] = 0;
+          src = use->pos + 4;
         }
-      else
-        this->data[this->pos ++] = v;
-    }
-    
-    void
-    assembler::put_u16 (uint16_t v)
-    {
-      this->put_u8 (v & 0xFF);
-      this->put_u8 (v >> 8);
+      std::memmove (data + dest, data + src, this->code.get_size () - src);
+      dest += this->code.get_size () - src;
+
+      // update offsets
+      for (auto& p : this->lbl_fixes)
+        p.second = new_pos (p.second);
+      for (auto& reloc : this->relocs)
+        reloc.offset = new_pos (reloc.offset);
+      for (auto& use : this->lbl_uses)
+        {
+          use.ins_pos = new_pos (use.ins_pos);
+          use.pos = new_pos (use.pos);
+        }
+      for (size_t i = 0; i < n; ++i)
+        if (is_short[i])
+          {
+            auto use = cands[i];
+            use->pos = use->ins_pos + 1;
+            use->add = -1;
+            use->lbl.ss = SS_BYTE;
+            use->short_opcode = -1;
+          }
+
+      this->code.commit (this->code.at (dest));
     }
-    
+
+
+
+    //! \brief Commits the code written up to END, forgetting relocations
+    //!        and label references recorded past the specified counts if
+    //!        it does not fit.
     void
-    assembler::put_u32 (uint32_t v)
+    assembler::commit (unsigned char *end, size_t num_relocs, size_t num_uses)
     {
-      this->put_u16 (v & 0xFFFF);
-      this->put_u16 (v >> 16);
+      try
+        {
+          this->code.commit (end);
+        }
+      catch (const code_buffer_full_error&)
+        {
+          this->relocs.resize (num_relocs);
+          this->lbl_uses.resize (num_uses);
+          throw;
+        }
     }
-    
-    void
-    assembler::put_u64 (uint64_t v)
+
+
+
+    //! \brief Writes the displacement of a relative label reference at P,
+    //!        in an instruction that starts at INS.
+    unsigned char*
+    assembler::emit_label_ref (unsigned char *ins, unsigned char *p,
+                               const lbl_t& lbl, int disp_size,
+                               int short_opcode)
     {
-      this->put_u32 (v & 0xFFFFFFFF);
-      this->put_u32 (v >> 32);
+      if (lbl.fixed)
+        return encoder::put_imm (p, lbl.val, disp_size);
+
+      label_use use;
+      use.lbl = lbl;
+      use.lbl.ss = (disp_size == 1) ? SS_BYTE : SS_DWORD;
+      use.pos = this->code.offset_of (p);
+      use.add = -disp_size;
+      use.ins_pos = this->code.offset_of (ins);
+      use.short_opcode = (disp_size == 4) ? short_opcode : -1;
+      this->lbl_uses.push_back (use);
+
+      return encoder::put_imm (p, 0, disp_size);
     }
-    
-    
-    
+
+
+
     /*!
        Emits the specified instruction onto the underlying buffer.
      */
     void
     assembler::emit (const instruction& ins)
     {
+      size_t num_relocs = this->relocs.size ();
+      size_t num_uses = this->lbl_uses.size ();
+      this->ins = this->out = this->code.reserve (max_instruction_size);
       this->emit_prefixes (ins);
       this->emit_opcode (ins);
       this->check_operands (ins);
       this->emit_operands (ins);
+      this->commit (this->out, num_relocs, num_uses);
     }
     
     
@@ -225,10 +361,21 @@ namespace jcc {
       this->emit_rex_prefix (ins);
     }
     
+    //! \brief Returns the fourth bit of the specified register's number,
+    //!        which goes into the REX prefix.
+    static inline int
+    _rex_bit (const reg_t& reg)
+    {
+      if (reg.code == REG_NONE || reg.code == REG_RIP)
+        return 0;
+      return (reg.number () >> 3) & 1;
+    }
+
     void
     assembler::emit_rex_prefix (const instruction& ins)
     {
       unsigned char rex = 0x40;
+      bool byte_rex = false;
       
       switch (ins.enc)
         {
@@ -236,29 +383,57 @@ namespace jcc {
         case OP_EN_X:
         case OP_EN_L:
         case OP_EN_I:
+          break;
+
         case OP_EN_M:
+          rex |= _rex_bit (ins.opr1.mem.index) << 1;
+          rex |= _rex_bit (ins.opr1.mem.base);
           break;
         
         case OP_EN_RR:
+          if (ins.opr1.reg.register_size () == 64)
+            rex |= 8;
+          rex |= _rex_bit (ins.opr2.reg) << 2;
+          rex |= _rex_bit (ins.opr1.reg);
+          byte_rex = (encoder::byte_reg_flags (ins.opr1.reg)
+                      | encoder::byte_reg_flags (ins.opr2.reg)) & encoder::BYTE_REG_NEEDS_REX;
+          break;
+
         case OP_EN_RM:
+          if (ins.opr1.reg.register_size () == 64)
+            rex |= 8;
+          rex |= _rex_bit (ins.opr1.reg) << 2;
+          rex |= _rex_bit (ins.opr2.mem.index) << 1;
+          rex |= _rex_bit (ins.opr2.mem.base);
+          byte_rex = encoder::byte_reg_flags (ins.opr1.reg) & encoder::BYTE_REG_NEEDS_REX;
+          break;
+
         case OP_EN_OI:
         case OP_EN_RI:
           if (ins.opr1.reg.register_size () == 64)
             rex |= 8;
+          rex |= _rex_bit (ins.opr1.reg);
+          byte_rex = encoder::byte_reg_flags (ins.opr1.reg) & encoder::BYTE_REG_NEEDS_REX;
           break;
         
         case OP_EN_MR:
           if (ins.opr2.reg.register_size () == 64)
             rex |= 8;
+          rex |= _rex_bit (ins.opr2.reg) << 2;
+          rex |= _rex_bit (ins.opr1.mem.index) << 1;
+          rex |= _rex_bit (ins.opr1.mem.base);
+          byte_rex = encoder::byte_reg_flags (ins.opr2.reg) & encoder::BYTE_REG_NEEDS_REX;
           break;
         
         case OP_EN_MI:
           if (ins.opr1.mem.ss == SS_QWORD)
             rex |= 8;
+          rex |= _rex_bit (ins.opr1.mem.index) << 1;
+          rex |= _rex_bit (ins.opr1.mem.base);
           break;
         }
       
-      if (rex != 0x40)
+      if (rex != 0x40 || byte_rex)
         this->put_u8 (rex);
     }
     
@@ -492,9 +667,10 @@ namespace jcc {
             relocation reloc;
             reloc.type = R_PC32;
             reloc.sym = ins.opr1.rel.sym;
-            reloc.offset = this->pos;
+            reloc.offset = this->out_pos ();
             reloc.size = 4;
             reloc.add = -4;
+            reloc.branch = true;
             this->relocs.push_back (reloc);
             this->put_u32 (0);
           }
@@ -502,32 +678,12 @@ namespace jcc {
 
         case OP_EN_L:
           {
-            if (ins.opr1.lbl.fixed)
-              {
-                switch (ins.opr1.lbl.ss)
-                  {
-                  case SS_BYTE: this->put_u8 ((unsigned char)(char)ins.opr1.lbl.val); break;
-                  case SS_WORD: this->put_u16 ((unsigned short)(short)ins.opr1.lbl.val); break;
-                  case SS_DWORD: this->put_u32 ((unsigned int)(int)ins.opr1.lbl.val); break;
-                  case SS_QWORD: this->put_u64 ((unsigned long long)ins.opr1.lbl.val); break;
-                  }
-              }
-            else
-              {
-                label_use use;
-                use.lbl = ins.opr1.lbl;
-                use.pos = this->pos;
-
-                switch (use.lbl.ss)
-                  {
-                    case SS_BYTE: use.add = -1; this->put_u8 (0); break;
-                    case SS_WORD: use.add = -2; this->put_u16 (0); break;
-                    case SS_DWORD: use.add = -4; this->put_u32 (0); break;
-                    case SS_QWORD: use.add = -8; this->put_u64 (0); break;
-                  }
-
-                this->lbl_uses.push_back (use);
-              }
+            // only byte and dword displacements pass check_operands ()
+            auto& lbl = ins.opr1.lbl;
+            bool relax = lbl.relax && (ins.flags & INS_FLAG_DEST_8_USE_OPCODE2);
+            this->out = this->emit_label_ref (this->ins, this->out, lbl,
+                                              (lbl.ss == SS_BYTE) ? 1 : 4,
+                                              relax ? ins.opcode2 : -1);
           }
           break;
 
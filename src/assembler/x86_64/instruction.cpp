@@ -34,6 +34,9 @@ namespace jcc {
         case 1: return 16;
         case 2: return 32;
         case 3: return 64;
+        case 4: return 8;
+        case 5: return 128;
+        case 6: return 256;
         
         default:
           return 0;
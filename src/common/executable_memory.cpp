@@ -0,0 +1,74 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common/executable_memory.hpp"
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+namespace jcc {
+
+  //! \brief Maps writable pages that hold at least the specified number
+  //!        of bytes.
+  executable_memory::executable_memory (size_t size)
+      : ptr (nullptr), len (0), exec (false)
+  {
+    size_t page = (size_t)::sysconf (_SC_PAGESIZE);
+    this->len = ((size ? size : 1) + page - 1) / page * page;
+
+    void *addr = ::mmap (nullptr, this->len, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED)
+      throw std::runtime_error ("executable_memory::executable_memory: mmap failed");
+
+    this->ptr = (unsigned char *)addr;
+  }
+
+  executable_memory::~executable_memory ()
+  {
+    if (this->ptr)
+      ::munmap (this->ptr, this->len);
+  }
+
+
+
+  //! \brief Makes the pages writable (and not executable).
+  void
+  executable_memory::make_writable ()
+  {
+    if (!this->exec)
+      return;
+
+    if (::mprotect (this->ptr, this->len, PROT_READ | PROT_WRITE) == -1)
+      throw std::runtime_error ("executable_memory::make_writable: mprotect failed");
+    this->exec = false;
+  }
+
+  //! \brief Makes the pages executable (and not writable).
+  void
+  executable_memory::make_executable ()
+  {
+    if (this->exec)
+      return;
+
+    if (::mprotect (this->ptr, this->len, PROT_READ | PROT_EXEC) == -1)
+      throw std::runtime_error ("executable_memory::make_executable: mprotect failed");
+    this->exec = true;
+  }
+}
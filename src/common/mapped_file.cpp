@@ -0,0 +1,136 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common/mapped_file.hpp"
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+namespace jcc {
+
+  //! \brief Maps the file at the specified path.
+  mapped_file::mapped_file (const std::string& path)
+      : ptr (nullptr), len (0)
+  {
+    int fd = ::open (path.c_str (), O_RDONLY);
+    if (fd == -1)
+      throw std::runtime_error ("mapped_file::mapped_file: could not open file");
+
+    struct stat st;
+    if (::fstat (fd, &st) == -1)
+      {
+        ::close (fd);
+        throw std::runtime_error ("mapped_file::mapped_file: could not stat file");
+      }
+
+    this->len = (size_t)st.st_size;
+    if (this->len > 0)
+      {
+        void *addr = ::mmap (nullptr, this->len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED)
+          {
+            ::close (fd);
+            throw std::runtime_error ("mapped_file::mapped_file: mmap failed");
+          }
+
+        this->ptr = (const unsigned char *)addr;
+      }
+
+    // the mapping stays valid after the descriptor is closed
+    ::close (fd);
+  }
+
+  mapped_file::~mapped_file ()
+  {
+    if (this->ptr)
+      ::munmap ((void *)this->ptr, this->len);
+  }
+
+
+
+//------------------------------------------------------------------------------
+
+  mapped_output_file::mapped_output_file (const std::string& path, size_t size)
+      : ptr (nullptr), len (size)
+  {
+    int fd = ::open (path.c_str (), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1)
+      throw std::runtime_error ("mapped_output_file::mapped_output_file: could not open file");
+
+    if (::ftruncate (fd, (off_t)size) == -1)
+      {
+        ::close (fd);
+        throw std::runtime_error ("mapped_output_file::mapped_output_file: could not resize file");
+      }
+
+    if (size > 0)
+      {
+        void *addr = ::mmap (nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED)
+          {
+            ::close (fd);
+            throw std::runtime_error ("mapped_output_file::mapped_output_file: mmap failed");
+          }
+
+        this->ptr = (unsigned char *)addr;
+      }
+
+    ::close (fd);
+  }
+
+  //! \brief Maps the existing file at the specified path, keeping its
+  //!        contents.
+  mapped_output_file::mapped_output_file (const std::string& path)
+      : ptr (nullptr), len (0)
+  {
+    int fd = ::open (path.c_str (), O_RDWR);
+    if (fd == -1)
+      throw std::runtime_error ("mapped_output_file::mapped_output_file: could not open file");
+
+    struct stat st;
+    if (::fstat (fd, &st) == -1)
+      {
+        ::close (fd);
+        throw std::runtime_error ("mapped_output_file::mapped_output_file: could not stat file");
+      }
+
+    this->len = (size_t)st.st_size;
+    if (this->len > 0)
+      {
+        void *addr = ::mmap (nullptr, this->len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED)
+          {
+            ::close (fd);
+            throw std::runtime_error ("mapped_output_file::mapped_output_file: mmap failed");
+          }
+
+        this->ptr = (unsigned char *)addr;
+      }
+
+    ::close (fd);
+  }
+
+  mapped_output_file::~mapped_output_file ()
+  {
+    if (this->ptr)
+      ::munmap (this->ptr, this->len);
+  }
+}
@@ -0,0 +1,158 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common/thread_pool.hpp"
+
+
+namespace jcc {
+
+  // the pool and worker index of the calling thread (if it is a worker)
+  static thread_local thread_pool *_worker_pool = nullptr;
+  static thread_local size_t _worker_idx = 0;
+
+
+
+  thread_pool::thread_pool (unsigned num_threads)
+      : pending (0), next_queue (0)
+  {
+    this->stopping = false;
+
+    if (num_threads == 0)
+      num_threads = std::thread::hardware_concurrency ();
+    if (num_threads == 0)
+      num_threads = 1;
+
+    for (unsigned i = 0; i < num_threads; ++i)
+      this->queues.emplace_back (new task_queue ());
+    for (unsigned i = 0; i < num_threads; ++i)
+      this->threads.emplace_back (&thread_pool::worker_main, this, (size_t)i);
+  }
+
+  thread_pool::~thread_pool ()
+  {
+    {
+      std::lock_guard<std::mutex> guard (this->wake_mtx);
+      this->stopping = true;
+    }
+    this->wake_cv.notify_all ();
+
+    for (auto& th : this->threads)
+      th.join ();
+  }
+
+
+
+  //! \brief Inserts a task into the deque of the appropriate worker.
+  void
+  thread_pool::push_task (std::function<void ()>&& task)
+  {
+    size_t idx = (_worker_pool == this)
+                 ? _worker_idx
+                 : this->next_queue++ % this->queues.size ();
+
+    // counted before the task becomes visible, so that the counter can
+    // never drop below zero when a worker takes the task right away.
+    {
+      std::lock_guard<std::mutex> guard (this->wake_mtx);
+      ++ this->pending;
+    }
+
+    {
+      auto& q = *this->queues[idx];
+      std::lock_guard<std::mutex> guard (q.mtx);
+      q.tasks.push_back (std::move (task));
+    }
+    this->wake_cv.notify_one ();
+  }
+
+  //! \brief Takes a task from the specified worker's deque, or steals one.
+  bool
+  thread_pool::take_task (size_t idx, std::function<void ()>& task)
+  {
+    size_t n = this->queues.size ();
+    for (size_t i = 0; i < n; ++i)
+      {
+        auto& q = *this->queues[(idx + i) % n];
+        std::lock_guard<std::mutex> guard (q.mtx);
+        if (q.tasks.empty ())
+          continue;
+
+        if (i == 0)
+          {
+            // own deque: LIFO
+            task = std::move (q.tasks.back ());
+            q.tasks.pop_back ();
+          }
+        else
+          {
+            // steal the oldest task
+            task = std::move (q.tasks.front ());
+            q.tasks.pop_front ();
+          }
+
+        -- this->pending;
+        return true;
+      }
+
+    return false;
+  }
+
+  /*!
+     \brief Runs a single queued task on the calling thread, if there is one.
+     \return True if a task was run.
+   */
+  bool
+  thread_pool::run_pending_task ()
+  {
+    size_t idx = (_worker_pool == this) ? _worker_idx : 0;
+
+    std::function<void ()> task;
+    if (!this->take_task (idx, task))
+      return false;
+
+    task ();
+    return true;
+  }
+
+
+
+  //! \brief Worker thread entry point.
+  void
+  thread_pool::worker_main (size_t idx)
+  {
+    _worker_pool = this;
+    _worker_idx = idx;
+
+    std::function<void ()> task;
+    for (;;)
+      {
+        if (this->take_task (idx, task))
+          {
+            task ();
+            task = nullptr;
+            continue;
+          }
+
+        std::unique_lock<std::mutex> lock (this->wake_mtx);
+        this->wake_cv.wait (lock, [this] {
+          return this->stopping || this->pending.load () != 0; });
+        if (this->stopping && this->pending.load () == 0)
+          return;
+      }
+  }
+}
@@ -0,0 +1,208 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "jit/jit.hpp"
+#include <cstring>
+
+
+namespace jcc {
+
+  // size of a stub: jmp qword [rip + 0] followed by the target address
+  static const size_t _stub_size = 16;
+
+  static inline size_t
+  _align16 (size_t n)
+  {
+    return (n + 15) & ~(size_t)15;
+  }
+
+  static inline bool
+  _fits_i32 (long long val)
+  {
+    return val >= -2147483648LL && val <= 2147483647LL;
+  }
+
+
+
+  jit::jit ()
+  {
+  }
+
+
+
+  //! \brief Defines (or redefines) a symbol that loaded code can refer to.
+  void
+  jit::define_symbol (const std::string& name, const void *addr)
+  {
+    this->syms[name] = addr;
+  }
+
+  //! \brief Returns the address of the specified symbol, or null if it is
+  //!        not defined.
+  const void*
+  jit::find_symbol (const std::string& name) const
+  {
+    auto itr = this->syms.find (name);
+    return (itr == this->syms.end ()) ? nullptr : itr->second;
+  }
+
+
+
+  //! \brief Allocates writable memory for code of up to SIZE bytes.
+  unsigned char*
+  jit::allocate (size_t size)
+  {
+    region reg;
+    reg.mem.reset (new executable_memory (size));
+    reg.loaded = false;
+    this->regions.push_back (std::move (reg));
+    return this->regions.back ().mem->data ();
+  }
+
+  jit::region*
+  jit::find_region (const unsigned char *ptr)
+  {
+    for (auto& reg : this->regions)
+      if (!reg.loaded && ptr >= reg.mem->data ()
+          && ptr < reg.mem->data () + reg.mem->size ())
+        return &reg;
+    return nullptr;
+  }
+
+
+
+  /*!
+     \brief Loads code into executable memory and defines NAME as its
+            address.
+   */
+  void*
+  jit::load (const std::string& name, const unsigned char *code, size_t size,
+             const std::vector<relocation>& relocs)
+  {
+    // look up targets first, so that nothing is mapped if one is missing
+    std::vector<const void *> targets;
+    std::unordered_map<const void *, size_t> stub_index;
+    for (auto& reloc : relocs)
+      {
+        if (reloc.type != R_PC32 || reloc.size != 4)
+          throw jit_error ("unsupported relocation type");
+
+        auto& sym_name = reloc.sym.store->get_name (reloc.sym.id);
+        const void *target = nullptr;
+        if (sym_name != name)
+          {
+            target = this->find_symbol (sym_name);
+            if (!target)
+              throw jit_error ("undefined symbol: " + sym_name);
+            if (reloc.branch)
+              stub_index.emplace (target, stub_index.size ());
+          }
+
+        targets.push_back (target);
+      }
+
+    // worst case, every branch target needs a stub
+    size_t stubs_off = _align16 (size);
+    size_t need = stubs_off + stub_index.size () * _stub_size;
+
+    auto reg = this->find_region (code);
+    bool copied = !reg;
+    unsigned char *dest;
+    if (reg)
+      {
+        dest = const_cast<unsigned char *> (code);
+        if ((size_t)(dest - reg->mem->data ()) + need > reg->mem->size ())
+          throw jit_error ("no room for call stubs after the code");
+      }
+    else
+      {
+        this->allocate (need);
+        reg = &this->regions.back ();
+        dest = reg->mem->data ();
+        std::memcpy (dest, code, size);
+      }
+
+    // a stub can only stand in for the target of a branch; any other
+    // reference (e.g. a RIP-relative load) would end up at the stub itself.
+    for (size_t i = 0; i < relocs.size (); ++i)
+      {
+        auto& reloc = relocs[i];
+        auto target = targets[i] ? (const unsigned char *)targets[i] : dest;
+        if (!reloc.branch
+            && !_fits_i32 ((long long)(target - (dest + reloc.offset)) + reloc.add))
+          {
+            if (copied)
+              this->regions.pop_back ();
+            throw jit_error ("relocation out of range");
+          }
+      }
+
+    unsigned char *stubs = dest + stubs_off;
+    std::vector<bool> stub_used (stub_index.size (), false);
+    for (size_t i = 0; i < relocs.size (); ++i)
+      {
+        auto& reloc = relocs[i];
+        auto p = dest + reloc.offset;
+        auto target = targets[i] ? (const unsigned char *)targets[i] : dest;
+
+        // S + A - P
+        long long val = (long long)(target - p) + reloc.add;
+        if (!_fits_i32 (val))
+          {
+            size_t idx = stub_index[targets[i]];
+            auto stub = stubs + idx * _stub_size;
+            if (!stub_used[idx])
+              {
+                static const unsigned char jmp_rip[] = { 0xFF, 0x25, 0, 0, 0, 0 };
+                std::memcpy (stub, jmp_rip, sizeof jmp_rip);
+                uint64_t addr = (uint64_t)target;
+                std::memcpy (stub + sizeof jmp_rip, &addr, sizeof addr);
+                stub[14] = stub[15] = 0xCC;
+                stub_used[idx] = true;
+              }
+
+            val = (long long)(stub - p) + reloc.add;
+          }
+
+        int32_t v32 = (int32_t)val;
+        std::memcpy (p, &v32, 4);
+      }
+
+    reg->mem->make_executable ();
+    reg->loaded = true;
+
+    this->define_symbol (name, dest);
+    return dest;
+  }
+
+  //! \brief Loads the code generated by the specified assembler.
+  void*
+  jit::load (const std::string& name, const x86_64::assembler& asem)
+  {
+    return this->load (name, asem.get_data (), asem.get_size (),
+                       asem.get_relocations ());
+  }
+
+  //! \brief Loads a procedure translated from JTAC, under its own name.
+  void*
+  jit::load (const jtac::x86_64_procedure& proc)
+  {
+    return this->load (proc.get_name (), proc.get_code ().data (),
+                       proc.get_code ().size (), proc.get_relocations ());
+  }
+}
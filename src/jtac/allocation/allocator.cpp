@@ -17,6 +17,9 @@
  */
 
 #include "jtac/allocation/allocator.hpp"
+#include "jtac/allocation/basic/basic.hpp"
+#include "jtac/allocation/irc/irc.hpp"
+#include "jtac/allocation/linear_scan/linear_scan.hpp"
 #include <stdexcept>
 
 
@@ -40,5 +43,32 @@ namespace jtac {
 
     return itr->second;
   }
+
+  //! \brief Checks whether the specified variable has been given a color.
+  bool
+  register_allocation::has_color (jtac_var_id var) const
+  {
+    return this->color_map.find (var) != this->color_map.end ();
+  }
+
+
+//------------------------------------------------------------------------------
+
+  //! \brief Creates a register allocator of the specified type.
+  std::unique_ptr<register_allocator>
+  make_register_allocator (register_allocator_type type)
+  {
+    switch (type)
+      {
+      case register_allocator_type::basic:
+        return std::unique_ptr<register_allocator> (new basic_register_allocator ());
+      case register_allocator_type::irc:
+        return std::unique_ptr<register_allocator> (new irc_register_allocator ());
+      case register_allocator_type::linear_scan:
+        return std::unique_ptr<register_allocator> (new linear_scan_register_allocator ());
+      }
+
+    throw std::runtime_error ("make_register_allocator: unknown allocator type");
+  }
 }
 }
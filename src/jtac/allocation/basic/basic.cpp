@@ -17,11 +17,11 @@
  */
 
 #include "jtac/allocation/basic/basic.hpp"
+#include "jtac/allocation/spill.hpp"
 #include "jtac/data_flow.hpp"
 #include "jtac/assembler.hpp"
 #include "jtac/jtac.hpp"
-#include <stack>
-#include <memory>
+#include <algorithm>
 
 #include "jtac/printer.hpp" // DEBUG
 #include <iostream> // DEBUG
@@ -49,8 +49,10 @@ namespace jtac {
     this->cfg = nullptr;
     this->num_colors = 0;
     this->tmp_idx = 0;
+    this->next_constrained = 0;
 
     this->var_names = nullptr;
+    this->dbg = &std::cout;
   }
 
 
@@ -201,13 +203,16 @@ namespace jtac {
 
     this->live_ranges = ord_lrs;
 
-    std::cout << "Discovered live ranges:" << std::endl;
-    for (size_t i = 0; i < this->live_ranges.size (); ++i)
+    if (this->var_names)
       {
-        std::cout << "    LR#" << (i + 1) << ": ";
-        for (auto var : this->live_ranges[i])
-          std::cout << _print_var (var, *this->var_names) << ' ';
-        std::cout << std::endl;
+        *this->dbg << "Discovered live ranges:" << std::endl;
+        for (size_t i = 0; i < this->live_ranges.size (); ++i)
+          {
+            *this->dbg << "    LR#" << (i + 1) << ": ";
+            for (auto var : this->live_ranges[i])
+              *this->dbg << _print_var (var, *this->var_names) << ' ';
+            *this->dbg << std::endl;
+          }
       }
   }
 
@@ -222,47 +227,46 @@ namespace jtac {
   void
   basic_register_allocator::build_inference_graph ()
   {
-    this->infer_graph.clear ();
-
     // insert a node for every global live range
-    for (size_t i = 0; i < this->live_ranges.size (); ++i)
-      this->infer_graph.add_node ((undirected_graph::node_id)i);
+    this->infer_graph.reset ((int)this->live_ranges.size ());
 
     live_analyzer la;
     auto live_results = la.analyze (*this->cfg);
 
-    std::cout << "Building inference graph:" << std::endl;
+    if (this->var_names)
+      *this->dbg << "Building inference graph:" << std::endl;
     for (auto& blk : this->cfg->get_blocks ())
       {
-        std::set<size_t> live_now;
+        bit_vector live_now (this->live_ranges.size ());
         for (auto var : live_results.get_live_out (blk->get_id ()))
-          live_now.insert (this->live_range_map[var]);
+          live_now.set (this->live_range_map[var]);
 
         auto& insts = blk->get_instructions ();
         for (auto itr = insts.rbegin (); itr != insts.rend (); ++itr)
           {
             auto& inst = *itr;
 
-            {
-              printer p;
-              p.set_var_names (*this->var_names);
-              std::cout << "    inst: " << p.print_instruction (inst) << std::endl;
-            }
+            if (this->var_names)
+              {
+                printer p;
+                p.set_var_names (*this->var_names);
+                *this->dbg << "    inst: " << p.print_instruction (inst) << std::endl;
+              }
 
             if (inst.op == JTAC_SOP_STORE || inst.op == JTAC_SOP_UNLOAD)
               {
                 if (inst.oprs[0].type == JTAC_OPR_VAR)
-                  live_now.insert (this->live_range_map[inst.oprs[0].val.var.get_id ()]);
+                  live_now.set (this->live_range_map[inst.oprs[0].val.var.get_id ()]);
               }
             else if (inst.op == JTAC_SOP_LOAD)
               {
                 auto lr_dest = this->live_range_map[inst.oprs[0].val.var.get_id ()];
-                for (auto lr : live_now)
-                  if (lr != lr_dest)
-                    this->infer_graph.add_edge (
-                        (undirected_graph::node_id)lr_dest, (undirected_graph::node_id)lr);
+                live_now.for_each ([&] (size_t lr) {
+                  this->infer_graph.add_edge (
+                      (interference_graph::node_id)lr_dest, (interference_graph::node_id)lr);
+                });
 
-                live_now.erase (lr_dest);
+                live_now.reset (lr_dest);
               }
             else
               {
@@ -272,30 +276,31 @@ namespace jtac {
                 if (is_opcode_assign (inst.op))
                   {
                     auto lr_dest = this->live_range_map[inst.oprs[0].val.var.get_id ()];
-                    for (auto lr : live_now)
-                      if (lr != lr_dest)
-                        this->infer_graph.add_edge (
-                            (undirected_graph::node_id)lr_dest, (undirected_graph::node_id)lr);
+                    live_now.for_each ([&] (size_t lr) {
+                      this->infer_graph.add_edge (
+                          (interference_graph::node_id)lr_dest, (interference_graph::node_id)lr);
+                    });
 
-                    live_now.erase (lr_dest);
+                    live_now.reset (lr_dest);
                   }
 
                 // insert operands into LiveNow set.
                 for (int i = opr_start; i < opr_end; ++i)
                   if (inst.oprs[i].type == JTAC_OPR_VAR)
-                    live_now.insert (this->live_range_map[inst.oprs[i].val.var.get_id ()]);
+                    live_now.set (this->live_range_map[inst.oprs[i].val.var.get_id ()]);
                 if (has_extra_operands (inst.op))
                   for (unsigned i = 0; i < inst.extra.count; ++i)
                     if (inst.extra.oprs[i].type == JTAC_OPR_VAR)
-                      live_now.insert (this->live_range_map[inst.extra.oprs[i].val.var.get_id ()]);
+                      live_now.set (this->live_range_map[inst.extra.oprs[i].val.var.get_id ()]);
               }
 
-            {
-              std::cout << "    LiveNow: ";
-              for (auto lri : live_now)
-                std::cout << "LR#" << (lri + 1) << " ";
-              std::cout << std::endl;
-            }
+            if (this->var_names)
+              {
+                *this->dbg << "    LiveNow: ";
+                live_now.for_each ([&] (size_t lri) {
+                  *this->dbg << "LR#" << (lri + 1) << " "; });
+                *this->dbg << std::endl;
+              }
           }
       }
   }
@@ -311,11 +316,12 @@ namespace jtac {
     //
     // Pick out nodes from the inference graph until it is empty.
     //
-    std::stack<std::unique_ptr<undirected_graph::node>> stk;
+    std::vector<interference_graph::node_id> stk;
+    this->next_constrained = 0;
     while (!this->infer_graph.empty ())
       {
         // pick node to remove from graph
-        undirected_graph::node_id id;
+        interference_graph::node_id id;
         if (this->infer_graph.has_less_k (this->num_colors))
           // pick an unconstrained node to remove from the graph.
           id = this->infer_graph.find_less_k (this->num_colors);
@@ -326,229 +332,139 @@ namespace jtac {
             id = this->pick_constrained_node ();
           }
 
-        stk.emplace (new undirected_graph::node (this->infer_graph.get_node (id)));
+        stk.push_back (id);
         this->infer_graph.remove_node (id);
       }
 
-    std::cout << "Reconstructing graph:" << std::endl;
+    if (this->var_names)
+      *this->dbg << "Reconstructing graph:" << std::endl;
 
     //
     // Reconstruct inference graph, coloring nodes at the same time.
     //
-    std::unordered_map<undirected_graph::node_id, register_color> color_map;
+    std::vector<register_color> colors (this->live_ranges.size (), -1);
+    std::vector<char> used (this->num_colors);
+    this->select_order.clear ();
+    size_t num_colored = 0;
     while (!stk.empty ())
       {
-        this->print_inference_graph (color_map);
+        if (this->var_names)
+          this->print_inference_graph (colors);
 
         // insert node back into the graph.
-        auto& ptr = stk.top ();
-        this->infer_graph.add_node (ptr->value);
-        for (auto id : ptr->nodes)
-          this->infer_graph.add_edge (ptr->value, id);
+        auto id = stk.back ();
+        stk.pop_back ();
+        this->infer_graph.restore_node (id);
+        this->select_order.push_back (id);
 
         // color node
-        std::set<register_color> avail;
+        std::fill (used.begin (), used.end (), 0);
+        for (auto n : this->infer_graph.get_adjacent (id))
+          if (this->infer_graph.contains (n) && colors[n] != -1)
+            used[colors[n]] = 1;
         for (int i = 0; i < this->num_colors; ++i)
-          avail.insert ((register_color)i);
-        for (auto n : ptr->nodes)
-          {
-            auto itr = color_map.find (n);
-            if (itr != color_map.end ())
-              avail.erase (itr->second);
-          }
-        if (!avail.empty ())
-          color_map[ptr->value] = *avail.begin ();
-
-        stk.pop ();
+          if (!used[i])
+            {
+              colors[id] = (register_color)i;
+              ++ num_colored;
+              break;
+            }
       }
 
-    this->print_inference_graph (color_map);
+    if (this->var_names)
+      this->print_inference_graph (colors);
 
-    if (color_map.size () != this->infer_graph.size ())
+    if (num_colored != this->infer_graph.size ())
       {
         // not all nodes colored.
         // spill.
 
-        auto id = this->pick_node_to_spill (color_map);
+        auto id = this->pick_node_to_spill (colors);
         this->insert_spill_code (this->live_ranges[id]);
 
-//        for (auto n : this->infer_graph.get_nodes ())
-//          if (color_map.find (n->value) != color_map.end ())
-//            {
-//              this->insert_spill_code (this->live_ranges[n->value]);
-//            }
-
         return false;
       }
 
     for (auto& p : this->live_range_map)
       {
         auto lr_id = p.second;
-        this->res->set_color (p.first, color_map[lr_id]);
+        this->res->set_color (p.first, colors[lr_id]);
       }
 
     return true;
   }
 
   //! \brief Picks a constrained node to remove from the inference graph.
-  undirected_graph::node_id
+  interference_graph::node_id
   basic_register_allocator::pick_constrained_node ()
   {
     //
     // TODO
     //
-    return this->infer_graph.get_nodes ()[0]->value;
+    // the node with the lowest ID still in the graph. nodes are only removed
+    // while the graph is being simplified, so the search can resume from
+    // where it last stopped.
+    while (!this->infer_graph.contains (this->next_constrained))
+      ++ this->next_constrained;
+    return this->next_constrained;
   }
 
   //! \brief Picks a node to spill from the inference graph.
-  undirected_graph::node_id
+  interference_graph::node_id
   basic_register_allocator::pick_node_to_spill (
-      const std::unordered_map<undirected_graph::node_id, register_color>& color_map)
+      const std::vector<register_color>& colors)
   {
     //
     // TODO
     //
-    for (auto n : this->infer_graph.get_nodes ())
-      if (color_map.find (n->value) == color_map.end ())
-        {
-          auto& lr = this->live_ranges[n->value];
-          if (this->spilled_lrs.find (lr) != this->spilled_lrs.end ())
-            continue;
+    // live ranges made up only of spill temporaries must never be spilled,
+    // since spilling them only creates more temporaries.
+    auto can_spill = [&] (interference_graph::node_id id) {
+      auto& lr = this->live_ranges[id];
+      if (this->spilled_lrs.find (lr) != this->spilled_lrs.end ())
+        return false;
+      for (auto var : lr)
+        if (var_special (var) == 0)
+          return true;
+      return false;
+    };
 
-          this->spilled_lrs.insert (lr);
-          return n->value;
+    for (auto id : this->select_order)
+      if (colors[id] == -1 && can_spill (id))
+        {
+          this->spilled_lrs.insert (this->live_ranges[id]);
+          return id;
         }
 
+    // only temporaries are left uncolored; free a register for one of them
+    // by spilling one of its colored neighbours instead.
+    for (auto id : this->select_order)
+      if (colors[id] == -1)
+        for (auto n : this->infer_graph.get_adjacent (id))
+          if (colors[n] != -1 && can_spill (n))
+            {
+              this->spilled_lrs.insert (this->live_ranges[n]);
+              return n;
+            }
+
 
     throw std::runtime_error ("basic_register_allocator::pick_node_to_spill: node not found");
   }
 
 
-  /*!
-       Checks whether the specified instruction's operands contain variables
-       from the the given live range.
-     */
-  bool
-  basic_register_allocator::contains_live_range_use (const jtac_instruction& inst,
-                                                     const live_range& lr)
-  {
-    int opr_start = is_opcode_assign (inst.op) ? 1 : 0;
-    int opr_end = get_operand_count (inst.op);
-    for (int i = opr_start; i < opr_end; ++i)
-      if (inst.oprs[i].type == JTAC_OPR_VAR
-          && lr.find (inst.oprs[i].val.var.get_id ()) != lr.end ())
-        return true;
-
-    if (has_extra_operands (inst.op))
-      for (int i = 0; i < inst.extra.count; ++i)
-        if (inst.extra.oprs[i].type == JTAC_OPR_VAR
-            && lr.find (inst.extra.oprs[i].val.var.get_id ()) != lr.end ())
-          return true;
-
-    return false;
-  }
-
   //! \brief Spills the specified live range.
   void
   basic_register_allocator::insert_spill_code (const live_range& lr)
   {
-    std::cout << "Spilling live range: ";
-    for (auto var : lr)
-      std::cout << this->var_names->get_name (var_base (var)) << "_" << var_subscript (var) << " ";
-    std::cout << std::endl;
-
-    assembler asem;
-    for (auto& blk : this->cfg->get_blocks ())
+    if (this->var_names)
       {
-        std::vector<jtac_instruction> insts;
-        for (auto& inst : blk->get_instructions ())
-          {
-            if (inst.op == JTAC_SOP_ASSIGN_PHI)
-              {
-                if (!(inst.oprs[0].type == JTAC_OPR_VAR
-                    && lr.find (inst.oprs[0].val.var.get_id ()) != lr.end ()))
-                  {
-                    bool found = false;
-                    for (int i = 0; i < inst.extra.count; ++i)
-                      if (inst.extra.oprs[i].type == JTAC_OPR_VAR
-                          && lr.find (inst.extra.oprs[i].val.var.get_id ()) != lr.end ())
-                        { found = true; break; }
-                    if (!found)
-                      insts.push_back (inst);
-                  }
-                continue;
-              }
-
-            bool need_store = false;
-            bool need_load = false;
-            auto tmp_var = make_var_id (var_base (*lr.begin ()), 0, this->tmp_idx + 1);
-
-            if (is_opcode_assign (inst.op))
-              {
-                // append store after definitions of variables in the live range.
-                if (inst.oprs[0].type == JTAC_OPR_VAR
-                    && lr.find (inst.oprs[0].val.var.get_id ()) != lr.end ())
-                  {
-                    need_store = true;
-
-                    // replace destination variable with temporary variable
-                    inst.oprs[0] = jtac_var (tmp_var);
-                  }
-              }
-
-            // wrap uses of varaibles in the live range with load+unload
-            if (this->contains_live_range_use (inst, lr))
-              {
-                need_load = true;
-
-                // replace uses with the temporary variable
-                int opr_start = is_opcode_assign (inst.op) ? 1 : 0;
-                int opr_end = get_operand_count (inst.op);
-                for (int i = opr_start; i < opr_end; ++i)
-                  if (inst.oprs[i].type == JTAC_OPR_VAR
-                      && lr.find (inst.oprs[i].val.var.get_id ()) != lr.end ())
-                    inst.oprs[i] = jtac_var (tmp_var);
-                if (has_extra_operands (inst.op))
-                  for (int i = 0; i < inst.extra.count; ++i)
-                    if (inst.extra.oprs[i].type == JTAC_OPR_VAR
-                        && lr.find (inst.extra.oprs[i].val.var.get_id ()) != lr.end ())
-                      inst.extra.oprs[i] = jtac_var (tmp_var);
-              }
-
-            if (need_load || need_store)
-              ++ this->tmp_idx;
-
-            if (need_load)
-              {
-                // load
-                auto& si = asem.emit_load (jtac_var (tmp_var));
-                for (auto var : lr)
-                  si.push_extra (jtac_var (var));
-                insts.push_back (asem.get_instructions ().back ());
-                asem.clear ();
-              }
-
-            insts.push_back (inst);
-
-            if (need_store)
-              {
-                // store
-                asem.emit_store (jtac_var (tmp_var));
-                insts.push_back (asem.get_instructions ().back ());
-                asem.clear ();
-              }
-            else if (need_load)
-              {
-                // unload
-                asem.emit_unload (jtac_var (tmp_var));
-                insts.push_back (asem.get_instructions ().back ());
-                asem.clear ();
-              }
-          }
-
-        blk->clear_instructions ();
-        blk->push_instructions_front (insts.begin (), insts.end ());
+        *this->dbg << "Spilling live range: ";
+        for (auto var : lr)
+          *this->dbg << _print_var (var, *this->var_names) << ' ';
+        *this->dbg << std::endl;
       }
+
+    jtac::insert_spill_code (*this->cfg, lr, this->tmp_idx);
   }
 
 
@@ -564,65 +480,88 @@ namespace jtac {
     //
     // print live ranges
     //
-    std::cout << "Live ranges:" << std::endl;
+    *this->dbg << "Live ranges:" << std::endl;
     for (size_t i = 0; i < this->live_ranges.size (); ++i)
       {
-        std::cout << "    LR#" << (i + 1) << ": ";
+        *this->dbg << "    LR#" << (i + 1) << ": ";
         for (auto var : this->live_ranges[i])
-          std::cout << _print_var (var, var_names) << ' ';
-        std::cout << std::endl;
+          *this->dbg << _print_var (var, var_names) << ' ';
+        *this->dbg << std::endl;
       }
-    std::cout << std::endl;
+    *this->dbg << std::endl;
 
     //
     // print inference graph
     //
-    std::cout << "Inference graph:" << std::endl;
-    for (auto n : this->infer_graph.get_nodes ())
+    *this->dbg << "Inference graph:" << std::endl;
+    for (int id = 0; id < this->infer_graph.get_node_count (); ++id)
       {
-        std::cout << "    LR#" << (n->value + 1) << " interferes with: ";
-        for (auto an : n->nodes)
-          std::cout << "LR#" << (an + 1) << " ";
-        std::cout << std::endl;
+        if (!this->infer_graph.contains (id))
+          continue;
+
+        auto adj = this->infer_graph.get_adjacent (id);
+        std::sort (adj.begin (), adj.end ());
+
+        *this->dbg << "    LR#" << (id + 1) << " interferes with: ";
+        for (auto an : adj)
+          if (this->infer_graph.contains (an))
+            *this->dbg << "LR#" << (an + 1) << " ";
+        *this->dbg << std::endl;
       }
-    std::cout << std::endl;
+    *this->dbg << std::endl;
   }
 
   //! \brief DEBUG
   void
   basic_register_allocator::print_inference_graph (
-      std::unordered_map<undirected_graph::node_id, register_color>& color_map)
+      const std::vector<register_color>& colors)
   {
-    std::cout << "    --------------------" << std::endl;
-    for (auto n : this->infer_graph.get_nodes ())
+    auto print_node = [&] (interference_graph::node_id id) {
+      *this->dbg << "LR#" << (id + 1);
+      if (colors[id] != -1)
+        *this->dbg << '[' << colors[id] << ']';
+      else
+        *this->dbg << "[]";
+    };
+
+    // nodes are listed in the order they were put back into the graph.
+    *this->dbg << "    --------------------" << std::endl;
+    for (auto id : this->select_order)
       {
-        std::cout << "    LR#" << (n->value + 1);
-        if (color_map.find (n->value) != color_map.end ())
-          std::cout << '[' << color_map[n->value] << ']';
-        else
-          std::cout << "[]";
-        std::cout << ": ";
-        for (auto id : n->nodes)
-          {
-            auto& other = infer_graph.get_node (id);
-            std::cout << "LR#" << (other.value + 1);
-            if (color_map.find (other.value) != color_map.end ())
-              std::cout << '[' << color_map[other.value] << ']';
-            else
-              std::cout << "[]";
-            std::cout << ' ';
-          }
-        std::cout << std::endl;
+        auto adj = this->infer_graph.get_adjacent (id);
+        std::sort (adj.begin (), adj.end ());
+
+        *this->dbg << "    ";
+        print_node (id);
+        *this->dbg << ": ";
+        for (auto an : adj)
+          if (this->infer_graph.contains (an))
+            {
+              print_node (an);
+              *this->dbg << ' ';
+            }
+        *this->dbg << std::endl;
       }
 
-    std::cout << std::endl;
+    *this->dbg << std::endl;
   }
 
-  //! \brief DEBUG
+  /*!
+     \brief Sets the name table used in debug output.
+
+     NOTE: Debug output is only produced while a name table is set.
+   */
   void
   basic_register_allocator::set_var_names (const name_map<jtac_var_id>& var_names)
   {
     this->var_names = &var_names;
   }
+
+  //! \brief Sets the stream debug output is written to (std::cout by default).
+  void
+  basic_register_allocator::set_debug_stream (std::ostream& strm)
+  {
+    this->dbg = &strm;
+  }
 }
 }
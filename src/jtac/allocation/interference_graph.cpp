@@ -0,0 +1,186 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "jtac/allocation/interference_graph.hpp"
+#include <stdexcept>
+
+
+namespace jcc {
+namespace jtac {
+
+  interference_graph::interference_graph ()
+  {
+    this->reset (0);
+  }
+
+  interference_graph::interference_graph (int n)
+  {
+    this->reset (n);
+  }
+
+
+
+  //! \brief Removes all edges and resets the graph to contain n lone nodes.
+  void
+  interference_graph::reset (int n)
+  {
+    this->n = n;
+    this->matrix = bit_vector ((size_t)n * (size_t)(n > 0 ? n - 1 : 0) / 2);
+    this->adj.assign (n, std::vector<node_id> ());
+    this->degrees.assign (n, 0);
+    this->present.assign (n, 1);
+    this->num_present = n;
+
+    this->bucket_heads.assign (n, -1);
+    this->bucket_next.assign (n, -1);
+    this->bucket_prev.assign (n, -1);
+    this->min_degree = 0;
+    for (node_id i = n - 1; i >= 0; --i)
+      this->bucket_insert (i);
+  }
+
+  //! \brief Inserts an edge between two distinct nodes (if not present).
+  void
+  interference_graph::add_edge (node_id a, node_id b)
+  {
+    if (a == b)
+      return;
+
+    size_t idx = this->matrix_index (a, b);
+    if (this->matrix.test (idx))
+      return;
+    this->matrix.set (idx);
+
+    this->adj[a].push_back (b);
+    this->adj[b].push_back (a);
+
+    if (this->present[a] && this->present[b])
+      {
+        this->bucket_remove (a);
+        this->bucket_remove (b);
+        ++ this->degrees[a];
+        ++ this->degrees[b];
+        this->bucket_insert (a);
+        this->bucket_insert (b);
+      }
+  }
+
+  //! \brief Removes a node from the graph, keeping its edges.
+  void
+  interference_graph::remove_node (node_id id)
+  {
+    if (!this->present[id])
+      throw std::runtime_error ("interference_graph::remove_node: node not in graph");
+
+    this->bucket_remove (id);
+    this->present[id] = 0;
+    -- this->num_present;
+
+    for (node_id m : this->adj[id])
+      if (this->present[m])
+        {
+          this->bucket_remove (m);
+          -- this->degrees[m];
+          this->bucket_insert (m);
+        }
+  }
+
+  //! \brief Puts a previously removed node back into the graph.
+  void
+  interference_graph::restore_node (node_id id)
+  {
+    if (this->present[id])
+      throw std::runtime_error ("interference_graph::restore_node: node already in graph");
+
+    int degree = 0;
+    for (node_id m : this->adj[id])
+      if (this->present[m])
+        {
+          this->bucket_remove (m);
+          ++ this->degrees[m];
+          this->bucket_insert (m);
+          ++ degree;
+        }
+
+    this->present[id] = 1;
+    ++ this->num_present;
+    this->degrees[id] = degree;
+    this->bucket_insert (id);
+  }
+
+
+  //! \brief Checks whether the graph contains a node of degree less than K.
+  bool
+  interference_graph::has_less_k (int k) const
+  {
+    int d = this->least_degree ();
+    return d < k && d < this->n;
+  }
+
+  //! \brief Returns a node of least degree, which must be less than K.
+  interference_graph::node_id
+  interference_graph::find_less_k (int k) const
+  {
+    int d = this->least_degree ();
+    if (d < k && d < this->n)
+      return this->bucket_heads[d];
+
+    throw std::runtime_error ("interference_graph::find_less_k: node not found");
+  }
+
+
+
+  void
+  interference_graph::bucket_insert (node_id id)
+  {
+    int d = this->degrees[id];
+    node_id head = this->bucket_heads[d];
+    this->bucket_prev[id] = -1;
+    this->bucket_next[id] = head;
+    if (head != -1)
+      this->bucket_prev[head] = id;
+    this->bucket_heads[d] = id;
+    if (d < this->min_degree)
+      this->min_degree = d;
+  }
+
+  void
+  interference_graph::bucket_remove (node_id id)
+  {
+    node_id prev = this->bucket_prev[id];
+    node_id next = this->bucket_next[id];
+    if (prev != -1)
+      this->bucket_next[prev] = next;
+    else
+      this->bucket_heads[this->degrees[id]] = next;
+    if (next != -1)
+      this->bucket_prev[next] = prev;
+  }
+
+  //! \brief Returns the least degree of a node in the graph, or n if the
+  //!        graph is empty.
+  int
+  interference_graph::least_degree () const
+  {
+    while (this->min_degree < this->n
+           && this->bucket_heads[this->min_degree] == -1)
+      ++ this->min_degree;
+    return this->min_degree;
+  }
+}
+}
@@ -0,0 +1,593 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "jtac/allocation/irc/irc.hpp"
+#include "jtac/data_flow.hpp"
+#include <stdexcept>
+#include <limits>
+#include <algorithm>
+
+
+namespace jcc {
+namespace jtac {
+
+  irc_register_allocator::irc_register_allocator ()
+  {
+    this->cfg = nullptr;
+    this->num_colors = 0;
+    this->tmp_idx = 0;
+  }
+
+
+
+  register_allocation
+  irc_register_allocator::allocate (control_flow_graph& cfg, int num_colors)
+  {
+    if (cfg.get_type () != control_flow_graph_type::ssa)
+      throw std::runtime_error ("irc_register_allocator::allocate: CFG must be in SSA form");
+    if (num_colors <= 0)
+      throw std::runtime_error ("irc_register_allocator::allocate: no registers available");
+
+    this->cfg = &cfg;
+    this->num_colors = num_colors;
+    this->tmp_idx = 0;
+
+    // spill code does not change the shape of the CFG
+    this->loop_depths = compute_loop_depths (cfg);
+
+    for (;;)
+      {
+        find_live_ranges (cfg, this->live_ranges, this->live_range_map);
+        this->build ();
+        this->make_worklist ();
+        this->reduce ();
+        this->assign_colors ();
+
+        if (this->spilled_nodes.empty ())
+          break;
+
+        // a spilled node takes the nodes coalesced into it along, except
+        // for spill temporaries.
+        std::vector<const live_range *> spilled_lrs;
+        for (int n : this->spilled_nodes)
+          {
+            size_t count = spilled_lrs.size ();
+            for (size_t m = 0; m < this->live_ranges.size (); ++m)
+              if (!this->temps[m] && this->get_alias ((int)m) == n)
+                spilled_lrs.push_back (&this->live_ranges[m]);
+            if (spilled_lrs.size () == count)
+              throw std::runtime_error ("irc_register_allocator::allocate: not enough registers");
+          }
+        insert_spill_code (cfg, spilled_lrs, this->tmp_idx);
+      }
+
+    register_allocation res;
+    for (auto& p : this->live_range_map)
+      res.set_color (p.first, this->colors[this->get_alias (p.second)]);
+
+    remove_redundant_moves (cfg, res);
+    return res;
+  }
+
+
+
+  //! \brief Builds the interference graph, the move list and spill costs.
+  void
+  irc_register_allocator::build ()
+  {
+    size_t n = this->live_ranges.size ();
+
+    this->adj_set.assign (n, bit_vector (n));
+    this->adj_list.assign (n, std::vector<int> ());
+    this->degrees.assign (n, 0);
+    this->moves.clear ();
+    this->move_states.clear ();
+    this->move_lists.assign (n, std::vector<int> ());
+
+    // live ranges made up only of spill temporaries must never be spilled
+    this->spill_costs.assign (n, 0.0);
+    this->temps.assign (n, 1);
+    for (auto& p : this->live_range_map)
+      if (var_special (p.first) == 0)
+        this->temps[p.second] = 0;
+
+    live_analyzer la;
+    auto live_results = la.analyze (*this->cfg);
+
+    auto node = [&] (const jtac_tagged_operand& opr) {
+      return this->live_range_map.at (opr.val.var.get_id ());
+    };
+
+    bit_vector live (n);
+    auto& cfg_blocks = this->cfg->get_blocks ();
+    for (size_t b = 0; b < cfg_blocks.size (); ++b)
+      {
+        auto& blk = cfg_blocks[b];
+        double weight = get_loop_weight (this->loop_depths[b]);
+
+        live.fill (false);
+        for (auto var : live_results.get_live_out (blk->get_id ()))
+          live.set ((size_t)this->live_range_map.at (var));
+
+        auto& insts = blk->get_instructions ();
+        for (auto itr = insts.rbegin (); itr != insts.rend (); ++itr)
+          {
+            auto& inst = *itr;
+
+            auto define = [&] (int d) {
+              live.for_each ([&] (size_t l) {
+                if ((int)l != d)
+                  this->add_edge (d, (int)l);
+              });
+              live.reset ((size_t)d);
+            };
+
+            if (inst.op == JTAC_SOP_UNLOAD)
+              {
+                // only marks the end of a reload; the temporary's register
+                // is free right after its last real use.
+                continue;
+              }
+            else if (inst.op == JTAC_SOP_STORE)
+              {
+                if (inst.oprs[0].type == JTAC_OPR_VAR)
+                  {
+                    int u = node (inst.oprs[0]);
+                    live.set ((size_t)u);
+                    this->spill_costs[u] += weight;
+                  }
+                continue;
+              }
+            else if (inst.op == JTAC_SOP_LOAD)
+              {
+                int d = node (inst.oprs[0]);
+                define (d);
+                this->spill_costs[d] += weight;
+                continue;
+              }
+
+            bool is_phi = inst.op == JTAC_SOP_ASSIGN_PHI;
+            if (inst.op == JTAC_OP_ASSIGN && inst.oprs[0].type == JTAC_OPR_VAR
+                && inst.oprs[1].type == JTAC_OPR_VAR)
+              {
+                // the source and destination of a move do not interfere
+                // (unless something else makes them).
+                int d = node (inst.oprs[0]);
+                int s = node (inst.oprs[1]);
+                live.reset ((size_t)s);
+                if (d != s)
+                  {
+                    int m = (int)this->moves.size ();
+                    this->moves.push_back ({ d, s });
+                    this->move_states.push_back (move_state::worklist);
+                    this->move_lists[d].push_back (m);
+                    this->move_lists[s].push_back (m);
+                  }
+              }
+
+            if (is_opcode_assign (inst.op) && inst.oprs[0].type == JTAC_OPR_VAR)
+              {
+                int d = node (inst.oprs[0]);
+                define (d);
+                if (!is_phi)
+                  this->spill_costs[d] += weight;
+              }
+
+            int opr_start = is_opcode_assign (inst.op) ? 1 : 0;
+            int opr_end = get_operand_count (inst.op);
+            for (int i = opr_start; i < opr_end; ++i)
+              if (inst.oprs[i].type == JTAC_OPR_VAR)
+                {
+                  int u = node (inst.oprs[i]);
+                  live.set ((size_t)u);
+                  this->spill_costs[u] += weight;
+                }
+            if (has_extra_operands (inst.op))
+              for (int i = 0; i < inst.extra.count; ++i)
+                if (inst.extra.oprs[i].type == JTAC_OPR_VAR)
+                  {
+                    int u = node (inst.extra.oprs[i]);
+                    live.set ((size_t)u);
+                    if (!is_phi)
+                      this->spill_costs[u] += weight;
+                  }
+          }
+      }
+
+    for (size_t i = 0; i < n; ++i)
+      if (this->temps[i])
+        this->spill_costs[i] = std::numeric_limits<double>::infinity ();
+  }
+
+  //! \brief Inserts an interference edge between the specified nodes.
+  void
+  irc_register_allocator::add_edge (int u, int v)
+  {
+    if (u == v || this->adj_set[u].test ((size_t)v))
+      return;
+
+    this->adj_set[u].set ((size_t)v);
+    this->adj_set[v].set ((size_t)u);
+    this->adj_list[u].push_back (v);
+    this->adj_list[v].push_back (u);
+    ++ this->degrees[u];
+    ++ this->degrees[v];
+  }
+
+  //! \brief Distributes the nodes among the initial worklists.
+  void
+  irc_register_allocator::make_worklist ()
+  {
+    size_t n = this->live_ranges.size ();
+
+    this->states.assign (n, node_state::simplify);
+    this->aliases.resize (n);
+    this->colors.assign (n, -1);
+    this->simplify_worklist.clear ();
+    this->freeze_worklist.clear ();
+    this->spill_worklist.clear ();
+    this->select_stack.clear ();
+    this->spilled_nodes.clear ();
+
+    this->move_worklist.clear ();
+    for (size_t m = 0; m < this->moves.size (); ++m)
+      this->move_worklist.push_back ((int)m);
+
+    for (size_t i = 0; i < n; ++i)
+      {
+        int u = (int)i;
+        this->aliases[u] = u;
+        if (this->degrees[u] >= this->num_colors)
+          {
+            this->states[u] = node_state::spill;
+            this->spill_worklist.push_back (u);
+          }
+        else if (this->is_move_related (u))
+          {
+            this->states[u] = node_state::freeze;
+            this->freeze_worklist.push_back (u);
+          }
+        else
+          this->simplify_worklist.push_back (u);
+      }
+  }
+
+  /*!
+     \brief Runs simplification, coalescing, freezing and spill selection
+            until all worklists are empty.
+   */
+  void
+  irc_register_allocator::reduce ()
+  {
+    auto pending = [] (std::vector<int>& wl, auto&& valid) {
+      while (!wl.empty () && !valid (wl.back ()))
+        wl.pop_back ();
+      return !wl.empty ();
+    };
+
+    auto in_state = [this] (node_state s) {
+      return [this, s] (int u) { return this->states[u] == s; };
+    };
+    auto move_pending = [this] (int m) {
+      return this->move_states[m] == move_state::worklist;
+    };
+
+    for (;;)
+      {
+        if (pending (this->simplify_worklist, in_state (node_state::simplify)))
+          this->simplify ();
+        else if (pending (this->move_worklist, move_pending))
+          this->coalesce ();
+        else if (pending (this->freeze_worklist, in_state (node_state::freeze)))
+          this->freeze ();
+        else if (pending (this->spill_worklist, in_state (node_state::spill)))
+          this->select_spill ();
+        else
+          break;
+      }
+  }
+
+  //! \brief Pops nodes off the select stack and assigns them colors.
+  void
+  irc_register_allocator::assign_colors ()
+  {
+    std::vector<char> used (this->num_colors);
+    while (!this->select_stack.empty ())
+      {
+        int n = this->select_stack.back ();
+        this->select_stack.pop_back ();
+
+        std::fill (used.begin (), used.end (), 0);
+        for (int w : this->adj_list[n])
+          {
+            int a = this->get_alias (w);
+            if (this->states[a] == node_state::colored)
+              used[this->colors[a]] = 1;
+          }
+
+        auto itr = std::find (used.begin (), used.end (), 0);
+        if (itr == used.end ())
+          {
+            this->states[n] = node_state::spilled;
+            this->spilled_nodes.push_back (n);
+          }
+        else
+          {
+            this->states[n] = node_state::colored;
+            this->colors[n] = (register_color)(itr - used.begin ());
+          }
+      }
+  }
+
+
+
+  //! \brief Checks whether the specified node is involved in pending moves.
+  bool
+  irc_register_allocator::is_move_related (int n) const
+  {
+    for (int m : this->move_lists[n])
+      if (this->move_states[m] == move_state::active
+          || this->move_states[m] == move_state::worklist)
+        return true;
+    return false;
+  }
+
+  //! \brief Returns the node the specified node was coalesced into.
+  int
+  irc_register_allocator::get_alias (int n) const
+  {
+    while (this->states[n] == node_state::coalesced)
+      n = this->aliases[n];
+    return n;
+  }
+
+
+
+  void
+  irc_register_allocator::simplify ()
+  {
+    int n = this->simplify_worklist.back ();
+    this->simplify_worklist.pop_back ();
+
+    this->states[n] = node_state::select;
+    this->select_stack.push_back (n);
+    this->for_each_adjacent (n, [this] (int m) { this->decrement_degree (m); });
+  }
+
+  void
+  irc_register_allocator::decrement_degree (int m)
+  {
+    int d = this->degrees[m]--;
+    if (d != this->num_colors || this->states[m] != node_state::spill)
+      return;
+
+    // m just became unconstrained: moves of its neighbours may now pass the
+    // conservative tests.
+    this->enable_moves (m);
+    this->for_each_adjacent (m, [this] (int a) { this->enable_moves (a); });
+
+    if (this->is_move_related (m))
+      {
+        this->states[m] = node_state::freeze;
+        this->freeze_worklist.push_back (m);
+      }
+    else
+      {
+        this->states[m] = node_state::simplify;
+        this->simplify_worklist.push_back (m);
+      }
+  }
+
+  void
+  irc_register_allocator::enable_moves (int n)
+  {
+    for (int m : this->move_lists[n])
+      if (this->move_states[m] == move_state::active)
+        {
+          this->move_states[m] = move_state::worklist;
+          this->move_worklist.push_back (m);
+        }
+  }
+
+
+
+  void
+  irc_register_allocator::coalesce ()
+  {
+    int m = this->move_worklist.back ();
+    this->move_worklist.pop_back ();
+
+    int u = this->get_alias (this->moves[m].dest);
+    int v = this->get_alias (this->moves[m].src);
+
+    if (u == v)
+      {
+        this->move_states[m] = move_state::coalesced;
+        this->add_work_list (u);
+      }
+    else if (this->adj_set[u].test ((size_t)v))
+      {
+        this->move_states[m] = move_state::constrained;
+        this->add_work_list (u);
+        this->add_work_list (v);
+      }
+    else if (this->george_test (u, v) || this->briggs_test (u, v))
+      {
+        this->move_states[m] = move_state::coalesced;
+        this->combine (u, v);
+        this->add_work_list (u);
+      }
+    else
+      this->move_states[m] = move_state::active;
+  }
+
+  void
+  irc_register_allocator::add_work_list (int u)
+  {
+    if (this->states[u] == node_state::freeze && !this->is_move_related (u)
+        && this->degrees[u] < this->num_colors)
+      {
+        this->states[u] = node_state::simplify;
+        this->simplify_worklist.push_back (u);
+      }
+  }
+
+  /*!
+     George's test: v can be merged into u if every neighbour of v either
+     already interferes with u or is of insignificant degree.
+   */
+  bool
+  irc_register_allocator::george_test (int u, int v)
+  {
+    bool ok = true;
+    this->for_each_adjacent (v, [&] (int t) {
+      if (this->degrees[t] >= this->num_colors && !this->adj_set[t].test ((size_t)u))
+        ok = false;
+    });
+    return ok;
+  }
+
+  /*!
+     Briggs' test: u and v can be merged if the combined node has fewer than
+     K neighbours of significant degree.
+   */
+  bool
+  irc_register_allocator::briggs_test (int u, int v)
+  {
+    int k = 0;
+    auto count = [&] (int t) {
+      if (this->degrees[t] >= this->num_colors)
+        ++ k;
+    };
+
+    this->for_each_adjacent (u, count);
+    this->for_each_adjacent (v, [&] (int t) {
+      if (!this->adj_set[u].test ((size_t)t))
+        count (t);
+    });
+    return k < this->num_colors;
+  }
+
+  void
+  irc_register_allocator::combine (int u, int v)
+  {
+    this->states[v] = node_state::coalesced;
+    this->aliases[v] = u;
+
+    // the merged node carries the uses of both (and cannot be spilled if
+    // either of them cannot).
+    this->spill_costs[u] += this->spill_costs[v];
+
+    auto& ml = this->move_lists[u];
+    ml.insert (ml.end (), this->move_lists[v].begin (), this->move_lists[v].end ());
+    this->enable_moves (v);
+
+    // copy, since add_edge() modifies adjacency lists
+    auto adj = this->adj_list[v];
+    for (int t : adj)
+      if (this->in_graph (t))
+        {
+          this->add_edge (t, u);
+          this->decrement_degree (t);
+        }
+
+    if (this->degrees[u] >= this->num_colors
+        && this->states[u] == node_state::freeze)
+      {
+        this->states[u] = node_state::spill;
+        this->spill_worklist.push_back (u);
+      }
+  }
+
+
+
+  void
+  irc_register_allocator::freeze ()
+  {
+    int u = this->freeze_worklist.back ();
+    this->freeze_worklist.pop_back ();
+
+    this->states[u] = node_state::simplify;
+    this->simplify_worklist.push_back (u);
+    this->freeze_moves (u);
+  }
+
+  void
+  irc_register_allocator::freeze_moves (int u)
+  {
+    for (int m : this->move_lists[u])
+      {
+        if (this->move_states[m] != move_state::active
+            && this->move_states[m] != move_state::worklist)
+          continue;
+
+        int x = this->moves[m].dest;
+        int y = this->moves[m].src;
+        int v = (this->get_alias (y) == this->get_alias (u))
+                ? this->get_alias (x) : this->get_alias (y);
+
+        this->move_states[m] = move_state::frozen;
+        if (this->states[v] == node_state::freeze && !this->is_move_related (v)
+            && this->degrees[v] < this->num_colors)
+          {
+            this->states[v] = node_state::simplify;
+            this->simplify_worklist.push_back (v);
+          }
+      }
+  }
+
+
+
+  void
+  irc_register_allocator::select_spill ()
+  {
+    // pick the node that is cheapest to spill relative to the number of
+    // interferences spilling it resolves (the lowest numbered one on ties),
+    // dropping stale entries along the way.
+    auto& wl = this->spill_worklist;
+    size_t count = 0;
+    size_t best_idx = 0;
+    double best_cost = 0.0;
+    for (int u : wl)
+      {
+        if (this->states[u] != node_state::spill)
+          continue;
+
+        double cost = this->spill_costs[u] / (double)this->degrees[u];
+        if (count == 0 || cost < best_cost
+            || (cost == best_cost && u < wl[best_idx]))
+          {
+            best_idx = count;
+            best_cost = cost;
+          }
+        wl[count ++] = u;
+      }
+
+    int best = wl[best_idx];
+    wl[best_idx] = wl[count - 1];
+    wl.resize (count - 1);
+
+    this->states[best] = node_state::simplify;
+    this->simplify_worklist.push_back (best);
+    this->freeze_moves (best);
+  }
+
+
+
+}
+}
@@ -0,0 +1,446 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "jtac/allocation/linear_scan/linear_scan.hpp"
+#include "jtac/data_flow.hpp"
+#include <stdexcept>
+#include <limits>
+#include <algorithm>
+
+
+namespace jcc {
+namespace jtac {
+
+  /*!
+     \brief Inserts the range [from, to), merging it with the first range if
+            they overlap or touch.
+   */
+  void
+  live_interval::add_range (int from, int to)
+  {
+    if (from >= to)
+      return;
+
+    // ranges are kept in reverse order while the interval is being built
+    // (see build_intervals ()), so the first range is at the back.
+    if (!this->ranges.empty () && to >= this->ranges.back ().first)
+      {
+        auto& first = this->ranges.back ();
+        first.first = std::min (first.first, from);
+        first.second = std::max (first.second, to);
+      }
+    else
+      this->ranges.emplace_back (from, to);
+  }
+
+  /*!
+     \brief Shortens the first range to start at the specified definition,
+            or inserts a range of length one if there is no range covering it.
+   */
+  void
+  live_interval::set_from (int from)
+  {
+    if (this->ranges.empty () || this->ranges.back ().first > from)
+      this->ranges.emplace_back (from, from + 1);
+    else
+      this->ranges.back ().first = from;
+  }
+
+  //! \brief Puts the ranges in order once the interval has been built.
+  void
+  live_interval::finish ()
+  {
+    std::reverse (this->ranges.begin (), this->ranges.end ());
+  }
+
+  //! \brief Checks whether the interval covers the specified position.
+  bool
+  live_interval::covers (int pos) const
+  {
+    auto itr = std::upper_bound (this->ranges.begin (), this->ranges.end (),
+                                 pos, [] (int pos, const std::pair<int, int>& r) {
+      return pos < r.first; });
+    if (itr == this->ranges.begin ())
+      return false;
+    return pos < (itr - 1)->second;
+  }
+
+  //! \brief Returns the first position covered by both intervals, or -1.
+  int
+  live_interval::next_intersection (const live_interval& other) const
+  {
+    size_t i = 0, j = 0;
+    while (i < this->ranges.size () && j < other.ranges.size ())
+      {
+        auto& a = this->ranges[i];
+        auto& b = other.ranges[j];
+        int from = std::max (a.first, b.first);
+        if (from < std::min (a.second, b.second))
+          return from;
+
+        if (a.second <= b.second)
+          ++ i;
+        else
+          ++ j;
+      }
+
+    return -1;
+  }
+
+  //! \brief Returns the number of positions the interval covers.
+  int
+  live_interval::get_length () const
+  {
+    int len = 0;
+    for (auto& r : this->ranges)
+      len += r.second - r.first;
+    return len;
+  }
+
+
+
+//------------------------------------------------------------------------------
+
+  linear_scan_register_allocator::linear_scan_register_allocator ()
+  {
+    this->cfg = nullptr;
+    this->num_colors = 0;
+    this->tmp_idx = 0;
+  }
+
+
+
+  register_allocation
+  linear_scan_register_allocator::allocate (control_flow_graph& cfg,
+                                            int num_colors)
+  {
+    if (cfg.get_type () != control_flow_graph_type::ssa)
+      throw std::runtime_error ("linear_scan_register_allocator::allocate: CFG must be in SSA form");
+    if (num_colors <= 0)
+      throw std::runtime_error ("linear_scan_register_allocator::allocate: no registers available");
+
+    this->cfg = &cfg;
+    this->num_colors = num_colors;
+    this->tmp_idx = 0;
+
+    // spill code does not change the shape of the CFG
+    this->loop_depths = compute_loop_depths (cfg);
+
+    for (;;)
+      {
+        find_live_ranges (cfg, this->live_ranges, this->live_range_map);
+        this->build_intervals ();
+        this->scan ();
+
+        if (this->spilled.empty ())
+          break;
+
+        std::vector<const live_range *> spilled_lrs;
+        for (int n : this->spilled)
+          spilled_lrs.push_back (&this->live_ranges[n]);
+        insert_spill_code (cfg, spilled_lrs, this->tmp_idx);
+      }
+
+    register_allocation res;
+    for (auto& p : this->live_range_map)
+      res.set_color (p.first, this->regs[p.second]);
+
+    remove_redundant_moves (cfg, res);
+    return res;
+  }
+
+
+
+  //! \brief Builds the live intervals, spill costs and hints.
+  void
+  linear_scan_register_allocator::build_intervals ()
+  {
+    size_t n = this->live_ranges.size ();
+    this->intervals.assign (n, live_interval ());
+    this->spill_costs.assign (n, 0.0);
+    this->hints.assign (n, -1);
+
+    // live ranges made up only of spill temporaries must never be spilled
+    std::vector<char> is_temp (n, 1);
+    for (auto& p : this->live_range_map)
+      if (var_special (p.first) == 0)
+        is_temp[p.second] = 0;
+
+    live_analyzer la;
+    auto live_results = la.analyze (*this->cfg);
+
+    auto node = [&] (const jtac_tagged_operand& opr) {
+      return this->live_range_map.at (opr.val.var.get_id ());
+    };
+
+    // linearize the blocks in reverse postorder. every instruction takes two
+    // positions: its operands are read at the first, and its result is
+    // written at the second, so that the destination may share a register
+    // with an operand that dies.
+    block_numbering blocks (*this->cfg);
+    auto& rpo = blocks.get_rpo ();
+    std::vector<int> block_from (rpo.size ());
+    int pos = 0;
+    for (int b : rpo)
+      {
+        block_from[b] = pos;
+        pos += 2 * (int)blocks.get_block (b).get_instructions ().size ();
+      }
+    int end_pos = pos;
+
+    std::unordered_map<basic_block_id, int> cfg_index;
+    auto& cfg_blocks = this->cfg->get_blocks ();
+    for (size_t i = 0; i < cfg_blocks.size (); ++i)
+      cfg_index[cfg_blocks[i]->get_id ()] = (int)i;
+
+    // intervals are built backwards, so that uses are seen before the
+    // definitions that shorten their ranges.
+    for (size_t k = rpo.size (); k-- > 0; )
+      {
+        int b = rpo[k];
+        auto& blk = blocks.get_block (b);
+        int from = block_from[b];
+        int to = (k + 1 < rpo.size ()) ? block_from[rpo[k + 1]] : end_pos;
+        double weight = get_loop_weight (this->loop_depths[cfg_index.at (blk.get_id ())]);
+
+        for (auto var : live_results.get_live_out (blk.get_id ()))
+          this->intervals[this->live_range_map.at (var)].add_range (from, to);
+
+        auto& insts = blk.get_instructions ();
+        pos = to;
+        for (auto itr = insts.rbegin (); itr != insts.rend (); ++itr)
+          {
+            auto& inst = *itr;
+            pos -= 2;
+
+            auto use = [&] (int u) {
+              this->intervals[u].add_range (from, pos + 1);
+              this->spill_costs[u] += weight;
+            };
+
+            if (inst.op == JTAC_SOP_UNLOAD)
+              {
+                // only marks the end of a reload; the temporary's register
+                // is free right after its last real use.
+                continue;
+              }
+            else if (inst.op == JTAC_SOP_STORE)
+              {
+                if (inst.oprs[0].type == JTAC_OPR_VAR)
+                  use (node (inst.oprs[0]));
+                continue;
+              }
+            else if (inst.op == JTAC_SOP_LOAD)
+              {
+                int d = node (inst.oprs[0]);
+                this->intervals[d].set_from (pos + 1);
+                this->spill_costs[d] += weight;
+                continue;
+              }
+            else if (inst.op == JTAC_SOP_ASSIGN_PHI)
+              {
+                // phi-functions take effect at the start of the block, and
+                // all of their operands are part of the same live range.
+                this->intervals[node (inst.oprs[0])].set_from (from);
+                continue;
+              }
+
+            if (inst.op == JTAC_OP_ASSIGN && inst.oprs[0].type == JTAC_OPR_VAR
+                && inst.oprs[1].type == JTAC_OPR_VAR)
+              {
+                int d = node (inst.oprs[0]);
+                int s = node (inst.oprs[1]);
+                if (this->hints[d] == -1)
+                  this->hints[d] = s;
+                if (this->hints[s] == -1)
+                  this->hints[s] = d;
+              }
+
+            if (is_opcode_assign (inst.op) && inst.oprs[0].type == JTAC_OPR_VAR)
+              {
+                int d = node (inst.oprs[0]);
+                this->intervals[d].set_from (pos + 1);
+                this->spill_costs[d] += weight;
+              }
+
+            int opr_start = is_opcode_assign (inst.op) ? 1 : 0;
+            int opr_end = get_operand_count (inst.op);
+            for (int i = opr_start; i < opr_end; ++i)
+              if (inst.oprs[i].type == JTAC_OPR_VAR)
+                use (node (inst.oprs[i]));
+            if (has_extra_operands (inst.op))
+              for (int i = 0; i < inst.extra.count; ++i)
+                if (inst.extra.oprs[i].type == JTAC_OPR_VAR)
+                  use (node (inst.extra.oprs[i]));
+          }
+      }
+
+    for (size_t i = 0; i < n; ++i)
+      {
+        if (is_temp[i])
+          this->spill_costs[i] = std::numeric_limits<double>::infinity ();
+        this->intervals[i].finish ();
+      }
+  }
+
+  //! \brief Returns the spill weight of the specified interval.
+  double
+  linear_scan_register_allocator::get_spill_weight (int n) const
+  {
+    return this->spill_costs[n] / (double)std::max (1, this->intervals[n].get_length ());
+  }
+
+
+
+  //! \brief Assigns registers to all intervals in order of their start.
+  void
+  linear_scan_register_allocator::scan ()
+  {
+    int n = (int)this->intervals.size ();
+    this->regs.assign (n, -1);
+    this->active.clear ();
+    this->inactive.clear ();
+    this->spilled.clear ();
+
+    std::vector<int> unhandled;
+    for (int i = 0; i < n; ++i)
+      if (!this->intervals[i].empty ())
+        unhandled.push_back (i);
+    std::stable_sort (unhandled.begin (), unhandled.end (), [&] (int a, int b) {
+      return this->intervals[a].get_start () < this->intervals[b].get_start (); });
+
+    std::vector<int> next_active, next_inactive;
+    for (int current : unhandled)
+      {
+        int pos = this->intervals[current].get_start ();
+
+        // intervals that have ended are dropped, the others are active or
+        // inactive depending on whether they are in a lifetime hole.
+        next_active.clear ();
+        next_inactive.clear ();
+        for (auto set : { &this->active, &this->inactive })
+          for (int m : *set)
+            {
+              auto& it = this->intervals[m];
+              if (it.get_end () <= pos)
+                continue;
+              if (it.covers (pos))
+                next_active.push_back (m);
+              else
+                next_inactive.push_back (m);
+            }
+        this->active.swap (next_active);
+        this->inactive.swap (next_inactive);
+
+        if (!this->try_allocate_free_reg (current))
+          this->allocate_blocked_reg (current);
+      }
+
+    // live ranges that are never live still need a color.
+    for (int i = 0; i < n; ++i)
+      if (this->regs[i] == -1)
+        this->regs[i] = 0;
+  }
+
+  //! \brief Tries to assign a register that is free for the whole interval.
+  bool
+  linear_scan_register_allocator::try_allocate_free_reg (int current)
+  {
+    auto& cur = this->intervals[current];
+    std::vector<int> free_until (this->num_colors,
+                                 std::numeric_limits<int>::max ());
+    for (int a : this->active)
+      free_until[this->regs[a]] = 0;
+    for (int i : this->inactive)
+      {
+        int x = this->intervals[i].next_intersection (cur);
+        if (x != -1)
+          free_until[this->regs[i]] = std::min (free_until[this->regs[i]], x);
+      }
+
+    int reg = 0;
+    for (int r = 1; r < this->num_colors; ++r)
+      if (free_until[r] > free_until[reg])
+        reg = r;
+
+    int hint = this->hints[current];
+    if (hint != -1 && this->regs[hint] != -1
+        && free_until[this->regs[hint]] >= cur.get_end ())
+      reg = this->regs[hint];
+
+    if (free_until[reg] < cur.get_end ())
+      return false;
+
+    this->regs[current] = reg;
+    this->active.push_back (current);
+    return true;
+  }
+
+  //! \brief Frees a register for the interval by spilling, or spills it.
+  void
+  linear_scan_register_allocator::allocate_blocked_reg (int current)
+  {
+    auto& cur = this->intervals[current];
+
+    // the cost of freeing each register is the weight of the intervals that
+    // would have to be spilled for it.
+    std::vector<double> cost (this->num_colors, 0.0);
+    for (int a : this->active)
+      cost[this->regs[a]] += this->get_spill_weight (a);
+    for (int i : this->inactive)
+      if (this->intervals[i].next_intersection (cur) != -1)
+        cost[this->regs[i]] += this->get_spill_weight (i);
+
+    int reg = 0;
+    for (int r = 1; r < this->num_colors; ++r)
+      if (cost[r] < cost[reg])
+        reg = r;
+
+    double weight = this->get_spill_weight (current);
+    if (weight <= cost[reg])
+      {
+        if (weight == std::numeric_limits<double>::infinity ())
+          throw std::runtime_error ("linear_scan_register_allocator::allocate: not enough registers");
+        this->spilled.push_back (current);
+        return;
+      }
+
+    auto evict = [&] (std::vector<int>& set, bool only_intersecting) {
+      size_t j = 0;
+      for (size_t i = 0; i < set.size (); ++i)
+        {
+          int m = set[i];
+          if (this->regs[m] == reg && (!only_intersecting
+              || this->intervals[m].next_intersection (cur) != -1))
+            {
+              this->regs[m] = -1;
+              this->spilled.push_back (m);
+            }
+          else
+            set[j++] = m;
+        }
+      set.resize (j);
+    };
+    evict (this->active, false);
+    evict (this->inactive, true);
+
+    this->regs[current] = reg;
+    this->active.push_back (current);
+  }
+}
+}
@@ -0,0 +1,361 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "jtac/allocation/spill.hpp"
+#include "jtac/assembler.hpp"
+#include "jtac/data_flow.hpp"
+#include <algorithm>
+#include <unordered_map>
+
+
+namespace jcc {
+namespace jtac {
+
+  /*!
+     \brief Rewrites the CFG so that the specified live range lives in memory.
+     \param cfg     The control flow graph to rewrite (in SSA form).
+     \param lr      The SSA names that make up the live range.
+     \param tmp_idx Counter used to generate unique temporary names; updated.
+   */
+  void
+  insert_spill_code (control_flow_graph& cfg, const live_range& lr,
+                     int& tmp_idx)
+  {
+    insert_spill_code (cfg, std::vector<const live_range *> { &lr }, tmp_idx);
+  }
+
+  /*!
+     \brief Rewrites the CFG so that all of the specified live ranges live in
+            memory, in a single pass over the CFG.
+   */
+  void
+  insert_spill_code (control_flow_graph& cfg,
+                     const std::vector<const live_range *>& lrs, int& tmp_idx)
+  {
+    std::unordered_map<jtac_var_id, int> lr_map;
+    for (size_t i = 0; i < lrs.size (); ++i)
+      for (auto var : *lrs[i])
+        lr_map[var] = (int)i;
+
+    auto find_lr = [&] (const jtac_tagged_operand& opr) {
+      if (opr.type != JTAC_OPR_VAR)
+        return -1;
+      auto itr = lr_map.find (opr.val.var.get_id ());
+      return (itr == lr_map.end ()) ? -1 : itr->second;
+    };
+
+    // the live ranges an instruction touches, in order of first appearance
+    struct spilled_opr
+    {
+      int lr;
+      jtac_var_id tmp_var;
+      bool is_def;
+      bool is_use;
+    };
+    std::vector<spilled_opr> touched;
+    auto touch = [&] (int lr) -> spilled_opr& {
+      for (auto& t : touched)
+        if (t.lr == lr)
+          return t;
+      touched.push_back ({ lr, 0, false, false });
+      return touched.back ();
+    };
+
+    assembler asem;
+    std::vector<jtac_instruction> insts;
+    for (auto& blk : cfg.get_blocks ())
+      {
+        insts.clear ();
+        for (auto& inst : blk->get_instructions ())
+          {
+            if (inst.op == JTAC_SOP_ASSIGN_PHI)
+              {
+                bool found = find_lr (inst.oprs[0]) != -1;
+                for (int i = 0; i < inst.extra.count && !found; ++i)
+                  found = find_lr (inst.extra.oprs[i]) != -1;
+                if (!found)
+                  insts.push_back (std::move (inst));
+                continue;
+              }
+
+            touched.clear ();
+            if (is_opcode_assign (inst.op))
+              {
+                int lr = find_lr (inst.oprs[0]);
+                if (lr != -1)
+                  touch (lr).is_def = true;
+              }
+
+            int opr_start = is_opcode_assign (inst.op) ? 1 : 0;
+            int opr_end = get_operand_count (inst.op);
+            for (int i = opr_start; i < opr_end; ++i)
+              {
+                int lr = find_lr (inst.oprs[i]);
+                if (lr != -1)
+                  touch (lr).is_use = true;
+              }
+            if (has_extra_operands (inst.op))
+              for (int i = 0; i < inst.extra.count; ++i)
+                {
+                  int lr = find_lr (inst.extra.oprs[i]);
+                  if (lr != -1)
+                    touch (lr).is_use = true;
+                }
+
+            if (touched.empty ())
+              {
+                insts.push_back (std::move (inst));
+                continue;
+              }
+
+            for (auto& t : touched)
+              t.tmp_var = make_var_id (var_base (*lrs[t.lr]->begin ()), 0,
+                                       ++ tmp_idx);
+
+            // replace the destination and uses with temporary variables
+            auto tmp_of = [&] (int lr) {
+              for (auto& t : touched)
+                if (t.lr == lr)
+                  return t.tmp_var;
+              return (jtac_var_id)0;
+            };
+            for (int i = 0; i < opr_end; ++i)
+              {
+                int lr = find_lr (inst.oprs[i]);
+                if (lr != -1)
+                  inst.oprs[i] = jtac_var (tmp_of (lr));
+              }
+            if (has_extra_operands (inst.op))
+              for (int i = 0; i < inst.extra.count; ++i)
+                {
+                  int lr = find_lr (inst.extra.oprs[i]);
+                  if (lr != -1)
+                    inst.extra.oprs[i] = jtac_var (tmp_of (lr));
+                }
+
+            // wrap uses of variables in the live range with load+unload
+            for (auto& t : touched)
+              if (t.is_use)
+                {
+                  auto& si = asem.emit_load (jtac_var (t.tmp_var));
+                  for (auto var : *lrs[t.lr])
+                    si.push_extra (jtac_var (var));
+                  insts.push_back (std::move (asem.get_instructions ().back ()));
+                  asem.clear ();
+                }
+
+            insts.push_back (std::move (inst));
+
+            // append store after definitions of variables in the live range.
+            for (auto& t : touched)
+              {
+                if (t.is_def)
+                  asem.emit_store (jtac_var (t.tmp_var));
+                else
+                  asem.emit_unload (jtac_var (t.tmp_var));
+                insts.push_back (std::move (asem.get_instructions ().back ()));
+                asem.clear ();
+              }
+          }
+
+        blk->set_instructions (std::move (insts));
+      }
+  }
+
+
+
+//------------------------------------------------------------------------------
+
+  //! \brief Computes the loop nesting depth of every block.
+  std::vector<int>
+  compute_loop_depths (const control_flow_graph& cfg)
+  {
+    auto& cfg_blocks = cfg.get_blocks ();
+    std::vector<int> loop_depths (cfg_blocks.size (), 0);
+
+    dom_analyzer da;
+    auto dr = da.analyze (cfg);
+    auto& blocks = dr.get_numbering ();
+    int n = (int)blocks.get_size ();
+
+    // an edge b->h where h dominates b is a back edge of the natural loop
+    // headed by h. The loop body consists of the blocks that can reach b
+    // without going through h.
+    std::vector<int> depths (n, 0);
+    std::vector<char> in_loop (n, 0);
+    std::vector<int> body;   // blocks marked in in_loop
+    std::vector<int> stack;
+    for (int h = 0; h < n; ++h)
+      {
+        for (auto p = blocks.preds_begin (h); p != blocks.preds_end (h); ++p)
+          if (dr.dominates_index (h, *p))
+            {
+              if (body.empty ())
+                {
+                  in_loop[h] = 1;
+                  body.push_back (h);
+                }
+              if (!in_loop[*p])
+                {
+                  in_loop[*p] = 1;
+                  body.push_back (*p);
+                  stack.push_back (*p);
+                }
+            }
+        if (body.empty ())
+          continue;
+
+        while (!stack.empty ())
+          {
+            int b = stack.back ();
+            stack.pop_back ();
+            for (auto p = blocks.preds_begin (b); p != blocks.preds_end (b); ++p)
+              if (!in_loop[*p])
+                {
+                  in_loop[*p] = 1;
+                  body.push_back (*p);
+                  stack.push_back (*p);
+                }
+          }
+
+        // only the loop's own blocks need resetting
+        for (int b : body)
+          {
+            ++ depths[b];
+            in_loop[b] = 0;
+          }
+        body.clear ();
+      }
+
+    for (size_t i = 0; i < cfg_blocks.size (); ++i)
+      loop_depths[i] = depths[blocks.get_index (cfg_blocks[i]->get_id ())];
+    return loop_depths;
+  }
+
+  //! \brief Groups SSA names that are joined by phi-functions into live ranges.
+  void
+  find_live_ranges (const control_flow_graph& cfg,
+                    std::vector<live_range>& live_ranges,
+                    std::unordered_map<jtac_var_id, int>& live_range_map)
+  {
+    live_ranges.clear ();
+    live_range_map.clear ();
+
+    // union-find over every name that appears in the CFG
+    std::unordered_map<jtac_var_id, int> var_idx;
+    std::vector<jtac_var_id> vars;
+    std::vector<int> parent;
+
+    auto find = [&] (int x) {
+      while (parent[x] != x)
+        x = parent[x] = parent[parent[x]];
+      return x;
+    };
+
+    auto get_idx = [&] (jtac_var_id var) {
+      auto itr = var_idx.find (var);
+      if (itr != var_idx.end ())
+        return itr->second;
+
+      int idx = (int)vars.size ();
+      var_idx[var] = idx;
+      vars.push_back (var);
+      parent.push_back (idx);
+      return idx;
+    };
+
+    for (auto& blk : cfg.get_blocks ())
+      for (auto& inst : blk->get_instructions ())
+        {
+          int opr_end = get_operand_count (inst.op);
+          if (inst.op == JTAC_SOP_LOAD || inst.op == JTAC_SOP_STORE
+              || inst.op == JTAC_SOP_UNLOAD)
+            opr_end = 1;
+          for (int i = 0; i < opr_end; ++i)
+            if (inst.oprs[i].type == JTAC_OPR_VAR)
+              get_idx (inst.oprs[i].val.var.get_id ());
+
+          if (inst.op == JTAC_SOP_ASSIGN_PHI)
+            {
+              int dest = find (get_idx (inst.oprs[0].val.var.get_id ()));
+              for (int i = 0; i < inst.extra.count; ++i)
+                if (inst.extra.oprs[i].type == JTAC_OPR_VAR)
+                  {
+                    int opr = find (get_idx (inst.extra.oprs[i].val.var.get_id ()));
+                    if (opr != dest)
+                      parent[opr] = dest;
+                  }
+            }
+          else if (has_extra_operands (inst.op))
+            {
+              for (int i = 0; i < inst.extra.count; ++i)
+                if (inst.extra.oprs[i].type == JTAC_OPR_VAR)
+                  get_idx (inst.extra.oprs[i].val.var.get_id ());
+            }
+        }
+
+    std::unordered_map<int, int> root_lr;
+    for (size_t i = 0; i < vars.size (); ++i)
+      {
+        int root = find ((int)i);
+        auto itr = root_lr.find (root);
+        int lr;
+        if (itr == root_lr.end ())
+          {
+            lr = (int)live_ranges.size ();
+            root_lr[root] = lr;
+            live_ranges.emplace_back ();
+          }
+        else
+          lr = itr->second;
+
+        live_ranges[lr].insert (vars[i]);
+        live_range_map[vars[i]] = lr;
+      }
+  }
+
+  //! \brief Returns the weight of a use or definition at the specified loop depth.
+  double
+  get_loop_weight (int depth)
+  {
+    double weight = 1.0;
+    for (int d = 0; d < std::min (depth, 8); ++d)
+      weight *= 10.0;
+    return weight;
+  }
+
+  //! \brief Removes moves between names that share a register.
+  void
+  remove_redundant_moves (control_flow_graph& cfg,
+                          const register_allocation& res)
+  {
+    for (auto& blk : cfg.get_blocks ())
+      {
+        auto& insts = blk->get_instructions ();
+        insts.erase (std::remove_if (insts.begin (), insts.end (),
+            [&] (const jtac_instruction& inst) {
+              return inst.op == JTAC_OP_ASSIGN
+                     && inst.oprs[0].type == JTAC_OPR_VAR
+                     && inst.oprs[1].type == JTAC_OPR_VAR
+                     && res.get_color (inst.oprs[0].val.var.get_id ())
+                        == res.get_color (inst.oprs[1].val.var.get_id ());
+            }), insts.end ());
+      }
+  }
+}
+}
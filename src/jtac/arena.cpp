@@ -0,0 +1,70 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "jtac/arena.hpp"
+#include <cassert>
+
+
+namespace jcc {
+namespace jtac {
+
+  jtac_arena::jtac_arena (size_t initial_size)
+  {
+    this->used = 0;
+    this->next_size = initial_size ? initial_size : 1;
+    this->total = 0;
+#ifndef NDEBUG
+    this->num_insts = 0;
+#endif
+  }
+
+  jtac_arena::~jtac_arena ()
+  {
+#ifndef NDEBUG
+    assert (this->num_insts == 0 && "instructions outlived their arena");
+#endif
+  }
+
+
+
+  //! \brief Allocates storage for the specified number of operands.
+  jtac_tagged_operand*
+  jtac_arena::allocate (size_t count)
+  {
+    if (this->chunks.empty () || this->used + count > this->chunks.back ().size)
+      {
+        // chunks grow geometrically so that the number of chunks stays
+        // logarithmic in the amount of storage handed out.
+        size_t size = this->next_size;
+        while (size < count)
+          size *= 2;
+        this->next_size = size * 2;
+
+        this->chunks.push_back ({
+            std::unique_ptr<jtac_tagged_operand[]> (new jtac_tagged_operand[size]),
+            size });
+        this->used = 0;
+      }
+
+    auto ptr = this->chunks.back ().data.get () + this->used;
+    this->used += count;
+    this->total += count;
+    return ptr;
+  }
+}
+}
@@ -98,6 +98,7 @@ namespace jtac {
     if (this->pos < this->insts.size ())
       {
         auto& inst = this->insts[this->pos];
+        inst.extra.count = 0;
         ++ this->pos;
         return inst;
       }
@@ -134,11 +135,8 @@ namespace jtac {
   void
   assembler::emit_basic1 (jtac_opcode op, const jtac_operand& opr)
   {
-    if (opr.get_type () == JTAC_OPR_LABEL)
-      {
-        auto& lbl = static_cast<const jtac_label&> (opr);
-        this->lbl_uses.push_back ({ lbl.get_id (), this->pos });
-      }
+    if (opr.type == JTAC_OPR_LABEL)
+      this->lbl_uses.push_back ({ opr.val.lbl.get_id (), this->pos });
 
     auto& inst = this->put_instruction ();
     inst.op = op;
@@ -162,8 +160,6 @@ namespace jtac {
     inst.op = JTAC_OP_CALL;
     inst.oprs[0] = target;
     inst.extra.count = 0;
-    inst.extra.cap = 4;
-    inst.extra.oprs = new jtac_tagged_operand[inst.extra.cap];
     return inst;
   }
 
@@ -175,8 +171,6 @@ namespace jtac {
     inst.oprs[0] = dest;
     inst.oprs[1] = target;
     inst.extra.count = 0;
-    inst.extra.cap = 4;
-    inst.extra.oprs = new jtac_tagged_operand[inst.extra.cap];
     return inst;
   }
 
@@ -187,8 +181,6 @@ namespace jtac {
     inst.op = JTAC_SOP_ASSIGN_PHI;
     inst.oprs[0] = dest;
     inst.extra.count = 0;
-    inst.extra.cap = 4;
-    inst.extra.oprs = new jtac_tagged_operand[inst.extra.cap];
     return inst;
   }
 
@@ -199,8 +191,6 @@ namespace jtac {
     inst.op = JTAC_SOP_LOAD;
     inst.oprs[0] = dest;
     inst.extra.count = 0;
-    inst.extra.cap = 4;
-    inst.extra.oprs = new jtac_tagged_operand[inst.extra.cap];
     return inst;
   }
 }
@@ -25,9 +25,10 @@
 namespace jcc {
 namespace jtac {
 
-  basic_block::basic_block (basic_block_id id)
+  basic_block::basic_block (basic_block_id id, jtac_arena *arena)
   {
     this->id = id;
+    this->arena = arena;
     this->base = 0;
   }
 
@@ -37,14 +38,35 @@ namespace jtac {
   void
   basic_block::push_instruction (const jtac_instruction& inst)
   {
-    this->insts.push_back (inst);
+    this->insts.emplace_back (inst, this->arena);
   }
 
   //! \brief Inserts the specified instruction to the beginning of the block.
   void
   basic_block::push_instruction_front (const jtac_instruction& inst)
   {
-    this->insts.insert (this->insts.begin (), inst);
+    this->insts.insert (this->insts.begin (), jtac_instruction (inst, this->arena));
+  }
+
+  /*!
+     \brief Replaces the block's instructions, moving them into the block's
+            arena.
+   */
+  void
+  basic_block::set_instructions (std::vector<jtac_instruction>&& insts)
+  {
+    this->insts = std::move (insts);
+    for (auto& inst : this->insts)
+      inst.set_arena (this->arena);
+  }
+
+  //! \brief Moves the block's instructions into the specified arena.
+  void
+  basic_block::set_arena (jtac_arena *arena)
+  {
+    this->arena = arena;
+    for (auto& inst : this->insts)
+      inst.set_arena (arena);
   }
 
   //! \brief Inserts a basic block to this block's list of predecessor blocks.
@@ -61,6 +83,14 @@ namespace jtac {
     this->next.push_back (blk);
   }
 
+  //! \brief Removes all predecessor and successor links.
+  void
+  basic_block::clear_edges ()
+  {
+    this->prev.clear ();
+    this->next.clear ();
+  }
+
 
 
 //------------------------------------------------------------------------------
@@ -72,6 +102,45 @@ namespace jtac {
     this->type = type;
   }
 
+  control_flow_graph::~control_flow_graph ()
+  {
+    // break the shared_ptr cycles formed by prev/next links
+    for (auto& blk : this->blocks)
+      blk->clear_edges ();
+  }
+
+  control_flow_graph::control_flow_graph (control_flow_graph&& other)
+      : type (other.type),
+        arena (std::move (other.arena)),
+        root (std::move (other.root)),
+        block_map (std::move (other.block_map)),
+        blocks (std::move (other.blocks))
+  {
+    other.block_map.clear ();
+    other.blocks.clear ();
+  }
+
+  control_flow_graph&
+  control_flow_graph::operator= (control_flow_graph&& other)
+  {
+    if (this == &other)
+      return *this;
+
+    for (auto& blk : this->blocks)
+      blk->clear_edges ();
+
+    // our blocks must be released before the arena they live in
+    this->type = other.type;
+    this->root = std::move (other.root);
+    this->block_map = std::move (other.block_map);
+    this->blocks = std::move (other.blocks);
+    this->arena = std::move (other.arena);
+    other.block_map.clear ();
+    other.blocks.clear ();
+
+    return *this;
+  }
+
 
 
   //! \brief Inserts the specified <id, block> pair to the CFG.
@@ -79,10 +148,23 @@ namespace jtac {
   control_flow_graph::map_block (basic_block_id id,
                                  std::shared_ptr<basic_block> blk)
   {
+    blk->set_arena (this->arena.get ());
     this->block_map[id] = blk;
     this->blocks.push_back (blk);
   }
 
+  /*!
+     \brief Moves the operand storage of all blocks into the specified arena
+            (or onto the heap, if null).
+   */
+  void
+  control_flow_graph::set_arena (std::shared_ptr<jtac_arena> arena)
+  {
+    for (auto& blk : this->blocks)
+      blk->set_arena (arena.get ());
+    this->arena = arena;
+  }
+
   //! \brief Searches for a block in the CFG by ID.
   std::shared_ptr<basic_block>
   control_flow_graph::find_block (basic_block_id id)
@@ -102,11 +184,88 @@ namespace jtac {
 
 
 
+//------------------------------------------------------------------------------
+
+  flat_control_flow_graph::flat_control_flow_graph (
+      control_flow_graph_type type, basic_block_id first_id)
+  {
+    this->type = type;
+    this->first_id = first_id;
+    this->pred_start.push_back (0);
+    this->succ_start.push_back (0);
+  }
+
+
+
+  /*!
+     \brief Appends a block to the CFG.
+     \throws std::runtime_error if the block's ID does not follow the ID of
+                                the previously added block.
+   */
+  void
+  flat_control_flow_graph::add_block (basic_block&& blk)
+  {
+    if (blk.get_id () != this->first_id + (int)this->blocks.size ())
+      throw std::runtime_error ("flat_control_flow_graph::add_block: non-consecutive block ID");
+
+    blk.set_arena (this->arena.get ());
+    this->blocks.push_back (std::move (blk));
+    this->pred_start.push_back ((int)this->preds.size ());
+    this->succ_start.push_back ((int)this->succs.size ());
+  }
+
+  /*!
+     \brief Moves the operand storage of all blocks into the specified arena
+            (or onto the heap, if null).
+   */
+  void
+  flat_control_flow_graph::set_arena (std::shared_ptr<jtac_arena> arena)
+  {
+    for (auto& blk : this->blocks)
+      blk.set_arena (arena.get ());
+    this->arena = arena;
+  }
+
+  //! \brief Replaces the CFG's edges with the specified <from, to> block index pairs.
+  void
+  flat_control_flow_graph::set_edges (const std::vector<std::pair<int, int>>& edges)
+  {
+    size_t n = this->blocks.size ();
+
+    // counting sort of the edges by source (successors) and target
+    // (predecessors).
+    this->pred_start.assign (n + 1, 0);
+    this->succ_start.assign (n + 1, 0);
+    for (auto& e : edges)
+      {
+        ++ this->succ_start[e.first + 1];
+        ++ this->pred_start[e.second + 1];
+      }
+    for (size_t i = 0; i < n; ++i)
+      {
+        this->succ_start[i + 1] += this->succ_start[i];
+        this->pred_start[i + 1] += this->pred_start[i];
+      }
+
+    this->succs.resize (edges.size ());
+    this->preds.resize (edges.size ());
+    std::vector<int> succ_pos (this->succ_start.begin (), this->succ_start.end () - 1);
+    std::vector<int> pred_pos (this->pred_start.begin (), this->pred_start.end () - 1);
+    for (auto& e : edges)
+      {
+        this->succs[succ_pos[e.first]++] = e.second;
+        this->preds[pred_pos[e.second]++] = e.first;
+      }
+  }
+
+
+
 //------------------------------------------------------------------------------
 
   control_flow_analyzer::control_flow_analyzer ()
   {
     this->next_blk_id = 1;
+    this->use_arena = false;
   }
 
 
@@ -144,21 +303,10 @@ namespace jtac {
       }
   }
 
-  /*!
-     \brief Builds a control flow graph.
-   */
-  control_flow_graph
-  control_flow_analyzer::build_graph (const std::vector<jtac_instruction>& insts)
+  //! \brief Marks the instructions that begin a basic block.
+  static std::vector<bool>
+  _find_leaders (const std::vector<jtac_instruction>& insts)
   {
-    if (insts.empty ())
-      {
-        auto root = std::make_shared<basic_block> (this->next_blk_id ++);
-        control_flow_graph cfg (control_flow_graph_type::normal, root);
-        cfg.map_block (root->get_id (), root);
-        return cfg;
-      }
-
-    // pick leaders
     std::vector<bool> leaders (insts.size (), false);
     leaders[0] = true; // first instruction is a leader
     for (size_t i = 0; i < insts.size (); ++i)
@@ -181,12 +329,38 @@ namespace jtac {
           }
       }
 
+    return leaders;
+  }
+
+  /*!
+     \brief Builds a control flow graph.
+   */
+  control_flow_graph
+  control_flow_analyzer::build_graph (const std::vector<jtac_instruction>& insts)
+  {
+    std::shared_ptr<jtac_arena> arena;
+    if (this->use_arena)
+      arena = std::make_shared<jtac_arena> ();
+
+    if (insts.empty ())
+      {
+        auto root = std::make_shared<basic_block> (this->next_blk_id ++,
+                                                   arena.get ());
+        control_flow_graph cfg (control_flow_graph_type::normal, root);
+        cfg.set_arena (arena);
+        cfg.map_block (root->get_id (), root);
+        return cfg;
+      }
+
+    auto leaders = _find_leaders (insts);
+
     // use leaders to build basic blocks
     std::unordered_map<size_t, std::shared_ptr<basic_block>> blocks;
     for (size_t i = 0; i < insts.size (); ++i)
       {
         size_t start = i;
-        auto blk = std::make_shared<basic_block> (this->next_blk_id ++);
+        auto blk = std::make_shared<basic_block> (this->next_blk_id ++,
+                                                  arena.get ());
 
         blk->push_instruction (insts[i++]);
         for (; i < insts.size () && !leaders[i]; ++i)
@@ -228,6 +402,7 @@ namespace jtac {
       }
 
     auto cfg = control_flow_graph (control_flow_graph_type::normal, blocks[0]);
+    cfg.set_arena (arena);
     for (auto& p : blocks)
       {
         cfg.map_block (p.second->get_id (), p.second);
@@ -238,12 +413,93 @@ namespace jtac {
 
 
 
+  /*!
+     \brief Builds a control flow graph in the flat (contiguous, index-based)
+            representation.
+   */
+  flat_control_flow_graph
+  control_flow_analyzer::build_flat_graph (const std::vector<jtac_instruction>& insts)
+  {
+    std::shared_ptr<jtac_arena> arena;
+    if (this->use_arena)
+      arena = std::make_shared<jtac_arena> ();
+
+    flat_control_flow_graph cfg (control_flow_graph_type::normal,
+                                 this->next_blk_id);
+    cfg.set_arena (arena);
+    if (insts.empty ())
+      {
+        cfg.add_block (basic_block (this->next_blk_id ++, arena.get ()));
+        return cfg;
+      }
+
+    auto leaders = _find_leaders (insts);
+
+    // blocks are created in program order, so the block containing
+    // instruction i can be found through a prefix count of the leaders.
+    std::vector<int> block_of (insts.size ());
+    for (size_t i = 0; i < insts.size (); ++i)
+      {
+        if (leaders[i])
+          {
+            basic_block blk (this->next_blk_id ++, arena.get ());
+            blk.set_base (i);
+            cfg.add_block (std::move (blk));
+          }
+
+        block_of[i] = (int)cfg.get_size () - 1;
+        cfg.get_blocks ().back ().push_instruction (insts[i]);
+      }
+
+    // link blocks together
+    std::vector<std::pair<int, int>> edges;
+    for (int b = 0; b < (int)cfg.get_size (); ++b)
+      {
+        auto& blk = cfg.get_block (b);
+        auto& last = blk.get_instructions ().back ();
+        size_t end = blk.get_base () + blk.get_instructions ().size ();
+
+        if (_is_branch_instruction (last))
+          {
+            size_t target_idx = end + last.oprs[0].val.off.get_offset ();
+            if (target_idx < insts.size ())
+              {
+                int target = block_of[target_idx];
+                edges.emplace_back (b, target);
+                last.oprs[0] = jtac_block_ref (cfg.get_block (target).get_id ());
+              }
+          }
+        if (last.op != JTAC_OP_JMP && !_is_end_instruction (last))
+          {
+            if (end < insts.size ())
+              edges.emplace_back (b, block_of[end]);
+          }
+      }
+
+    cfg.set_edges (edges);
+    return cfg;
+  }
+
+
+
   //! \brief Static method for convenience.
   control_flow_graph
-  control_flow_analyzer::make_cfg (const std::vector<jtac_instruction>& insts)
+  control_flow_analyzer::make_cfg (const std::vector<jtac_instruction>& insts,
+                                   bool use_arena)
   {
     control_flow_analyzer an;
+    an.set_use_arena (use_arena);
     return an.build_graph (insts);
   }
+
+  //! \brief Static method for convenience.
+  flat_control_flow_graph
+  control_flow_analyzer::make_flat_cfg (const std::vector<jtac_instruction>& insts,
+                                        bool use_arena)
+  {
+    control_flow_analyzer an;
+    an.set_use_arena (use_arena);
+    return an.build_flat_graph (insts);
+  }
 }
 }
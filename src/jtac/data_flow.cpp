@@ -16,77 +16,261 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <iostream>
 #include "jtac/data_flow.hpp"
+#include <stdexcept>
+#include <deque>
+#include <algorithm>
 
 
 namespace jcc {
 namespace jtac {
 
-  template<typename T>
-  static bool
-  _sets_equal (const T& a, const T& b)
+  block_numbering::block_numbering (const control_flow_graph& cfg)
   {
-    if (a.size () != b.size ())
-      return false;
+    auto& cfg_blocks = cfg.get_blocks ();
+    for (auto& blk : cfg_blocks)
+      {
+        this->index_map[blk->get_id ()] = (int)this->blocks.size ();
+        this->blocks.push_back (blk.get ());
+      }
+
+    this->root = cfg.get_root () ? this->find_index (cfg.get_root ()->get_id ()) : -1;
 
-    for (auto& e : a)
-      if (b.find (e) == b.end ())
-        return false;
+    // edges
+    size_t n = this->blocks.size ();
+    this->pred_start.reserve (n + 1);
+    this->succ_start.reserve (n + 1);
+    for (size_t i = 0; i < n; ++i)
+      {
+        this->pred_start.push_back ((int)this->preds.size ());
+        for (auto& prev : this->blocks[i]->get_prev ())
+          this->preds.push_back (this->get_index (prev->get_id ()));
+
+        this->succ_start.push_back ((int)this->succs.size ());
+        for (auto& next : this->blocks[i]->get_next ())
+          this->succs.push_back (this->get_index (next->get_id ()));
+      }
+    this->pred_start.push_back ((int)this->preds.size ());
+    this->succ_start.push_back ((int)this->succs.size ());
 
-    return true;
+    this->compute_rpo ();
   }
 
+  //! \brief Numbers a flat CFG, reusing its own indices and edge arrays.
+  block_numbering::block_numbering (const flat_control_flow_graph& cfg)
+  {
+    size_t n = cfg.get_size ();
+    this->blocks.reserve (n);
+    for (auto& blk : cfg.get_blocks ())
+      {
+        this->index_map[blk.get_id ()] = (int)this->blocks.size ();
+        this->blocks.push_back (&blk);
+      }
+
+    this->root = n ? 0 : -1;
 
+    this->pred_start.reserve (n + 1);
+    this->succ_start.reserve (n + 1);
+    for (size_t i = 0; i < n; ++i)
+      {
+        this->pred_start.push_back ((int)this->preds.size ());
+        this->preds.insert (this->preds.end (), cfg.preds_begin (i), cfg.preds_end (i));
 
-  iterative_analyzer::~iterative_analyzer ()
+        this->succ_start.push_back ((int)this->succs.size ());
+        this->succs.insert (this->succs.end (), cfg.succs_begin (i), cfg.succs_end (i));
+      }
+    this->pred_start.push_back ((int)this->preds.size ());
+    this->succ_start.push_back ((int)this->succs.size ());
+
+    this->compute_rpo ();
+  }
+
+
+
+  //! \brief Computes the reverse postorder of the blocks.
+  void
+  block_numbering::compute_rpo ()
   {
-    for (auto& p : this->frags)
-      delete p.second;
+    size_t n = this->blocks.size ();
+
+    // reverse postorder, using an explicit stack of <block, next succ> pairs
+    std::vector<char> visited (n, 0);
+    std::vector<int> post;
+    post.reserve (n);
+    std::vector<std::pair<int, const int *>> stack;
+    if (this->root != -1)
+      {
+        visited[this->root] = 1;
+        stack.emplace_back (this->root, this->succs_begin (this->root));
+      }
+    while (!stack.empty ())
+      {
+        auto& top = stack.back ();
+        if (top.second == this->succs_end (top.first))
+          {
+            post.push_back (top.first);
+            stack.pop_back ();
+            continue;
+          }
+
+        int succ = *top.second++;
+        if (!visited[succ])
+          {
+            visited[succ] = 1;
+            stack.emplace_back (succ, this->succs_begin (succ));
+          }
+      }
+
+    this->rpo.assign (post.rbegin (), post.rend ());
+    for (size_t i = 0; i < n; ++i)
+      if (!visited[i])
+        this->rpo.push_back ((int)i);
   }
 
 
 
-  //! \brief Returns the fragment associated with the specified basic block ID.
-  iterative_analyzer::fragment&
-  iterative_analyzer::get_fragment (basic_block_id id)
+  //! \brief Returns the index of the block with the specified ID, or -1.
+  int
+  block_numbering::find_index (basic_block_id id) const
   {
-    return *this->frags[id];
+    auto itr = this->index_map.find (id);
+    return (itr == this->index_map.end ()) ? -1 : itr->second;
   }
 
+  //! \brief Returns the index of the block with the specified ID.
+  int
+  block_numbering::get_index (basic_block_id id) const
+  {
+    auto itr = this->index_map.find (id);
+    if (itr == this->index_map.end ())
+      throw std::runtime_error ("block_numbering::get_index: invalid id");
+    return itr->second;
+  }
+
+
+
+//------------------------------------------------------------------------------
+
+  iterative_analyzer::iterative_analyzer (data_flow_direction dir,
+                                          data_flow_meet meet)
+      : dir (dir), meet (meet)
+  {
+    this->cfg = nullptr;
+  }
+
+  iterative_analyzer::~iterative_analyzer ()
+  { }
+
 
 
   /*!
      Solves the data-flow problem for the specified CFG using an iterative
      fixed-point algorithm.
    */
-  void
+  std::shared_ptr<data_flow_solution>
   iterative_analyzer::solve (const control_flow_graph& cfg)
   {
     this->set_active_cfg (cfg);
+    return this->solve (std::make_shared<block_numbering> (cfg));
+  }
 
-    for (auto& p : this->frags)
-      delete p.second;
-    this->frags.clear ();
+  std::shared_ptr<data_flow_solution>
+  iterative_analyzer::solve (const flat_control_flow_graph& cfg)
+  {
+    this->cfg = nullptr;
+    return this->solve (std::make_shared<block_numbering> (cfg));
+  }
 
-    // initialize fragments
-    for (auto& blk : cfg.get_blocks ())
-      this->frags[blk->get_id ()] = this->compute_init_fragment (*blk).release ();
+  std::shared_ptr<data_flow_solution>
+  iterative_analyzer::solve (std::shared_ptr<const block_numbering> blocks)
+  {
+    size_t n = blocks->get_size ();
+
+    std::vector<bit_vector> gen (n), kill (n);
+    size_t universe = this->compute_local_sets (*blocks, gen, kill);
+
+    bool forward = this->dir == data_flow_direction::forward;
+    bool intersect = this->meet == data_flow_meet::set_intersection;
+
+    auto sol = std::make_shared<data_flow_solution> ();
+    sol->blocks = blocks;
+    sol->in.assign (n, bit_vector (universe));
+    sol->out.assign (n, bit_vector (universe));
+
+    // the "input" and "output" sets of each block in the direction of flow
+    auto& inputs = forward ? sol->in : sol->out;
+    auto& outputs = forward ? sol->out : sol->in;
+
+    // optimistic initial value for must-problems
+    if (intersect)
+      for (size_t i = 0; i < n; ++i)
+        outputs[i].fill (true);
+
+    // seed worklist in reverse postorder (postorder for backward problems)
+    auto& rpo = blocks->get_rpo ();
+    std::deque<int> worklist;
+    std::vector<char> queued (n, 1);
+    if (forward)
+      worklist.assign (rpo.begin (), rpo.end ());
+    else
+      worklist.assign (rpo.rbegin (), rpo.rend ());
 
-    bool changed = true;
-    while (changed)
+    bit_vector nout (universe);
+    while (!worklist.empty ())
       {
-        changed = false;
-        for (auto& blk : cfg.get_blocks ())
-          if (this->compute_fragment (*this->frags[blk->get_id ()], *blk))
-            changed = true;
+        int b = worklist.front ();
+        worklist.pop_front ();
+        queued[b] = 0;
+
+        // meet over the neighbours facts flow in from
+        auto& input = inputs[b];
+        auto nbegin = forward ? blocks->preds_begin (b) : blocks->succs_begin (b);
+        auto nend = forward ? blocks->preds_end (b) : blocks->succs_end (b);
+        if (nbegin == nend || (forward && b == blocks->get_root ()))
+          input.fill (false); // boundary condition
+        else
+          {
+            input = outputs[*nbegin];
+            for (auto itr = nbegin + 1; itr != nend; ++itr)
+              {
+                if (intersect)
+                  input.intersect (outputs[*itr]);
+                else
+                  input.unite (outputs[*itr]);
+              }
+          }
+
+        // apply transfer function
+        nout.assign_transfer (gen[b], input, kill[b]);
+        if (nout == outputs[b])
+          continue;
+
+        std::swap (outputs[b], nout);
+        auto dbegin = forward ? blocks->succs_begin (b) : blocks->preds_begin (b);
+        auto dend = forward ? blocks->succs_end (b) : blocks->preds_end (b);
+        for (auto itr = dbegin; itr != dend; ++itr)
+          if (!queued[*itr])
+            {
+              queued[*itr] = 1;
+              worklist.push_back (*itr);
+            }
       }
+
+    return sol;
   }
 
 
 
 //------------------------------------------------------------------------------
 
+  reach_def_analysis::reach_def_analysis (
+      std::shared_ptr<const data_flow_solution> sol,
+      std::vector<definition>&& defs)
+      : sol (sol), defs (std::move (defs))
+  { }
+
+
+
   void
   reach_def_analysis::add_block (basic_block_id id, std::set<definition>&& defs)
   {
@@ -98,13 +282,47 @@ namespace jtac {
   reach_def_analysis::get_block (basic_block_id id)
   {
     auto itr = this->block_map.find (id);
-    if (itr == this->block_map.end ())
+    if (itr != this->block_map.end ())
+      return itr->second;
+
+    int idx = this->sol ? this->sol->blocks->find_index (id) : -1;
+    if (idx == -1)
       throw std::runtime_error ("reach_def_analysis: unknown id");
-    return itr->second;
+
+    auto& defs = this->block_map[id];
+    this->sol->in[idx].for_each ([&] (size_t i) {
+      defs.insert (this->defs[i]);
+    });
+    return defs;
+  }
+
+  //! \brief Checks whether the specified definition reaches a block.
+  bool
+  reach_def_analysis::reaches (basic_block_id id, const definition& def) const
+  {
+    auto itr = this->block_map.find (id);
+    if (itr != this->block_map.end ())
+      return itr->second.find (def) != itr->second.end ();
+
+    int idx = this->sol ? this->sol->blocks->find_index (id) : -1;
+    if (idx == -1)
+      throw std::runtime_error ("reach_def_analysis: unknown id");
+
+    auto ditr = std::lower_bound (this->defs.begin (), this->defs.end (), def);
+    if (ditr == this->defs.end () || *ditr != def)
+      return false;
+    return this->sol->in[idx].test (ditr - this->defs.begin ());
   }
 
 
 
+  reach_def_analyzer::reach_def_analyzer ()
+      : iterative_analyzer (data_flow_direction::forward,
+                            data_flow_meet::set_union)
+  { }
+
+
+
   /*!
      \brief Performs a reaching-definintions analysis on the specified CFG.
      \param cfg The control flow graph to analyze.
@@ -113,189 +331,221 @@ namespace jtac {
   reach_def_analysis
   reach_def_analyzer::analyze (const control_flow_graph& cfg)
   {
-    this->set_active_cfg (cfg);
-    this->get_all_defs ();
-    this->solve (cfg);
-
-    reach_def_analysis result;
-    for (auto& blk : cfg.get_blocks ())
-      {
-        auto& my_frag = static_cast<my_fragment&> (this->get_fragment (*blk));
-        result.add_block (blk->get_id (), std::move (my_frag.defs));
-      }
-
-    return result;
+    auto sol = this->solve (cfg);
+    return reach_def_analysis (sol, std::move (this->all_defs));
   }
 
-  bool
-  reach_def_analyzer::compute_fragment (fragment& frag, const basic_block& blk)
+  reach_def_analysis
+  reach_def_analyzer::analyze (const flat_control_flow_graph& cfg)
   {
-    auto& my_frag = static_cast<my_fragment&> (frag);
-    std::set<definition> ndefs;
+    auto sol = this->solve (cfg);
+    return reach_def_analysis (sol, std::move (this->all_defs));
+  }
 
-    for (auto& prev : blk.get_prev ())
+  size_t
+  reach_def_analyzer::compute_local_sets (const block_numbering& blocks,
+                                          std::vector<bit_vector>& gen,
+                                          std::vector<bit_vector>& kill)
+  {
+    // number all definitions that appear in the CFG
+    this->all_defs.clear ();
+    std::unordered_map<jtac_var_id, std::vector<size_t>> var_defs;
+    for (size_t b = 0; b < blocks.get_size (); ++b)
       {
-        auto kill = this->de_kill (*prev);
+        auto& blk = blocks.get_block ((int)b);
+        auto& insts = blk.get_instructions ();
+        for (size_t i = 0; i < insts.size (); ++i)
+          if (is_opcode_assign (insts[i].op))
+            this->all_defs.emplace_back (blk.get_id (), i);
+      }
 
-        auto& prev_frag = static_cast<my_fragment&> (this->get_fragment (*prev));
-        auto& reaches_prev = prev_frag.defs;
+    // keep definitions sorted so that they can be looked up by value
+    std::sort (this->all_defs.begin (), this->all_defs.end ());
+    for (size_t d = 0; d < this->all_defs.size (); ++d)
+      {
+        auto& def = this->all_defs[d];
+        auto& blk = blocks.get_block (blocks.get_index (def.first));
+        auto var = blk.get_instructions ()[def.second].oprs[0].val.var.get_id ();
+        var_defs[var].push_back (d);
+      }
 
-        auto de = this->de_def (*prev);
-        for (auto& def : de)
-          ndefs.insert (def);
+    size_t universe = this->all_defs.size ();
+    for (size_t b = 0; b < blocks.get_size (); ++b)
+      {
+        auto& blk = blocks.get_block ((int)b);
+        auto& insts = blk.get_instructions ();
+
+        // downward-exposed definitions are the last definition of each
+        // variable in the block. every other definition of a variable defined
+        // in the block is killed.
+        gen[b] = bit_vector (universe);
+        kill[b] = bit_vector (universe);
+
+        auto itr = std::lower_bound (this->all_defs.begin (), this->all_defs.end (),
+                                     definition (blk.get_id (), 0));
+        std::unordered_map<jtac_var_id, size_t> last_def;
+        for (; itr != this->all_defs.end () && itr->first == blk.get_id (); ++itr)
+          {
+            auto var = insts[itr->second].oprs[0].val.var.get_id ();
+            last_def[var] = itr - this->all_defs.begin ();
+          }
 
-        for (auto& def : reaches_prev)
-          if (kill.find (def) == kill.end ())
-            ndefs.insert (def);
+        for (auto& p : last_def)
+          {
+            gen[b].set (p.second);
+            for (auto d : var_defs[p.first])
+              if (d != p.second)
+                kill[b].set (d);
+          }
       }
 
-    bool modified = !_sets_equal (my_frag.defs, ndefs);
-    if (modified)
-      my_frag.defs = std::move (ndefs);
-    return modified;
+    return universe;
   }
 
-  std::unique_ptr<reach_def_analyzer::fragment>
-  reach_def_analyzer::compute_init_fragment (const basic_block& blk)
+
+
+//------------------------------------------------------------------------------
+
+  dom_analysis::dom_analysis (std::shared_ptr<const block_numbering> blocks,
+                              std::vector<int>&& idoms)
+      : blocks (blocks), idoms (std::move (idoms))
   {
-    auto frag = new my_fragment ();
-    return std::unique_ptr<fragment> (frag);
+    this->build_tree ();
+    this->compute_dfs ();
   }
 
 
 
-  //! \brief Finds all definitions that appear in the CFG.
+  //! \brief Builds the dominator tree and numbers its nodes.
   void
-  reach_def_analyzer::get_all_defs ()
+  dom_analysis::build_tree ()
   {
-    for (auto& blk : this->cfg->get_blocks ())
+    size_t n = this->blocks->get_size ();
+    this->children.assign (n, std::vector<int> ());
+    for (size_t b = 0; b < n; ++b)
+      if (this->idoms[b] != -1)
+        this->children[this->idoms[b]].push_back ((int)b);
+
+    // number the tree in DFS pre/post order. unreachable blocks are left
+    // with a negative number, which dominates_index () checks for.
+    this->pre.assign (n, -1);
+    this->post.assign (n, -2);
+
+    int root = this->blocks->get_root ();
+    if (root == -1)
+      return;
+
+    int counter = 0;
+    std::vector<std::pair<int, size_t>> stack;
+    stack.emplace_back (root, 0);
+    this->pre[root] = counter++;
+    while (!stack.empty ())
       {
-        auto& insts = blk->get_instructions ();
-        for (size_t i = 0; i < insts.size (); ++i)
+        auto& top = stack.back ();
+        auto& kids = this->children[top.first];
+        if (top.second == kids.size ())
           {
-            auto& inst = insts[i];
-            if (is_opcode_assign (inst.op))
-              {
-                this->all_defs.emplace_back (blk->get_id (), i);
-              }
+            this->post[top.first] = counter++;
+            stack.pop_back ();
+            continue;
           }
+
+        int child = kids[top.second++];
+        this->pre[child] = counter++;
+        stack.emplace_back (child, 0);
       }
   }
 
-  //! \brief Returns a list of all downward-exposed definitions in a block.
-  std::set<definition>&
-  reach_def_analyzer::de_def (const basic_block& blk)
+  //! \brief Computes dominance frontiers.
+  void
+  dom_analysis::compute_dfs ()
   {
-    auto ditr = this->de_defs.find (blk.get_id ());
-    if (ditr != this->de_defs.end ())
-      return ditr->second;
-
-    std::set<jtac_var_id> enc_vars;
-    auto& defs = this->de_defs[blk.get_id ()];
+    auto& blocks = *this->blocks;
+    size_t n = blocks.get_size ();
+    this->dfs.assign (n, std::vector<int> ());
 
-    auto& insts = blk.get_instructions ();
-    for (int i = (int)insts.size () - 1; i >= 0; --i)
+    for (size_t b = 0; b < n; ++b)
       {
-        auto& inst = insts[i];
-        if (is_opcode_assign (inst.op))
+        if (blocks.preds_end ((int)b) - blocks.preds_begin ((int)b) < 2)
+          continue;
+
+        int idom = this->idoms[b];
+        if (idom == -1 && (int)b != blocks.get_root ())
+          continue;
+
+        for (auto itr = blocks.preds_begin ((int)b); itr != blocks.preds_end ((int)b); ++itr)
           {
-            auto var = inst.oprs[0].val.var.get_id ();
-            auto sitr = enc_vars.find (var);
-            if (sitr == enc_vars.end ())
+            int runner = *itr;
+            if (runner != blocks.get_root () && this->idoms[runner] == -1)
+              continue; // unreachable predecessor
+
+            while (runner != idom && runner != -1)
               {
-                enc_vars.insert (var);
-                defs.emplace (blk.get_id (), i);
+                auto& df = this->dfs[runner];
+                if (df.empty () || df.back () != (int)b)
+                  df.push_back ((int)b);
+                runner = this->idoms[runner];
               }
           }
       }
-
-    return defs;
   }
 
-  //! \brief Returns a list of all definitions that are obscured by a
-  //!        defintion in a block.
-  std::set<definition>&
-  reach_def_analyzer::de_kill (const basic_block& blk)
-  {
-    auto ditr = this->de_kills.find (blk.get_id ());
-    if (ditr != this->de_kills.end ())
-      return ditr->second;
 
-    std::set<jtac_var_id> my_vars;
-    for (auto& inst : blk.get_instructions ())
-      if (is_opcode_assign (inst.op))
-        {
-          auto var = inst.oprs[0].val.var.get_id ();
-          my_vars.insert (var);
-        }
-
-    auto& defs = this->de_kills[blk.get_id ()];
-    for (auto& def : this->all_defs)
-      {
-        auto var = this->cfg->find_block (def.first)
-            ->get_instructions ()[def.second].oprs[0].val.var.get_id ();
-        if (my_vars.find (var) != my_vars.end ())
-          defs.insert (def);
-      }
-
-    auto de = this->de_def (blk);
-    for (auto& def : de)
-      defs.erase (def);
-
-    return defs;
-  }
-
-
-
-//------------------------------------------------------------------------------
-
-  void
-  dom_analysis::add_block (basic_block_id id, std::set<basic_block_id>&& doms)
-  {
-    this->block_map[id] = std::move (doms);
-  }
 
   //! \brief Returns the set of blocks dominating the specified block.
   const std::set<basic_block_id>&
   dom_analysis::get_block (basic_block_id id)
   {
     auto itr = this->block_map.find (id);
-    if (itr == this->block_map.end ())
+    if (itr != this->block_map.end ())
+      return itr->second;
+
+    int idx = this->blocks ? this->blocks->find_index (id) : -1;
+    if (idx == -1)
       throw std::runtime_error ("dom_analysis::get_block: invalid id");
-    return itr->second;
-  }
 
+    auto& doms = this->block_map[id];
+    doms.insert (id);
+    for (int d = this->idoms[idx]; d != -1; d = this->idoms[d])
+      doms.insert (this->blocks->get_id (d));
+    return doms;
+  }
 
-  //! \brief Sets a block's immediate dominator.
-  void
-  dom_analysis::set_idom (basic_block_id id, basic_block_id idom)
+  //! \brief Checks whether block a dominates block b.
+  bool
+  dom_analysis::dominates (basic_block_id a, basic_block_id b) const
   {
-    this->idom_map[id] = idom;
+    int idx_a = this->blocks ? this->blocks->find_index (a) : -1;
+    int idx_b = this->blocks ? this->blocks->find_index (b) : -1;
+    if (idx_a == -1 || idx_b == -1)
+      throw std::runtime_error ("dom_analysis::dominates: invalid id");
+    return (idx_a == idx_b) || this->dominates_index (idx_a, idx_b);
   }
 
   //! \brief Returns the specified block's immediate dominator.
   basic_block_id
   dom_analysis::get_idom (basic_block_id id) const
   {
-    auto itr = this->idom_map.find (id);
-    if (itr == this->idom_map.end ())
+    int idx = this->blocks ? this->blocks->find_index (id) : -1;
+    if (idx == -1 || this->idoms[idx] == -1)
       throw std::runtime_error ("dom_analysis::get_idom: invalid id");
-    return itr->second;
-  }
-
-
-  //! \brief Inserts a block into a specified block's dominance frontier set.
-  void
-  dom_analysis::add_df (basic_block_id id, basic_block_id df)
-  {
-    this->df_map[id].insert (df);
+    return this->blocks->get_id (this->idoms[idx]);
   }
 
   //! \brief Returns the dominance frontier set of a specified block.
   std::set<basic_block_id>&
   dom_analysis::get_dfs (basic_block_id id)
   {
-    return this->df_map[id];
+    auto itr = this->df_map.find (id);
+    if (itr != this->df_map.end ())
+      return itr->second;
+
+    auto& dfs = this->df_map[id];
+    int idx = this->blocks ? this->blocks->find_index (id) : -1;
+    if (idx != -1)
+      for (auto df : this->dfs[idx])
+        dfs.insert (this->blocks->get_id (df));
+    return dfs;
   }
 
 
@@ -308,132 +558,86 @@ namespace jtac {
   dom_analysis
   dom_analyzer::analyze (const control_flow_graph& cfg)
   {
-    this->set_active_cfg (cfg);
-    this->solve (cfg);
-
-    dom_analysis result;
-    for (auto& blk : cfg.get_blocks ())
-      {
-        auto& my_frag = static_cast<my_fragment &> (this->get_fragment (*blk));
-        result.add_block (blk->get_id (), std::move (my_frag.doms));
-      }
-
-    // compute immediate dominators
-    this->compute_idoms (result);
-
-    // compute dominance frontiers
-    this->compute_dfs (result);
+    auto blocks = std::make_shared<block_numbering> (cfg);
+    auto idoms = this->compute_idoms (*blocks);
+    return dom_analysis (blocks, std::move (idoms));
+  }
 
-    return result;
+  dom_analysis
+  dom_analyzer::analyze (const flat_control_flow_graph& cfg)
+  {
+    auto blocks = std::make_shared<block_numbering> (cfg);
+    auto idoms = this->compute_idoms (*blocks);
+    return dom_analysis (blocks, std::move (idoms));
   }
 
   //! \brief Finds all immediate dominators.
-  void
-  dom_analyzer::compute_idoms (dom_analysis& result)
+  std::vector<int>
+  dom_analyzer::compute_idoms (const block_numbering& blocks)
   {
-    for (auto& blk : this->cfg->get_blocks ())
+    size_t n = blocks.get_size ();
+    std::vector<int> idoms (n, -1);
+    int root = blocks.get_root ();
+    if (root == -1)
+      return idoms;
+
+    auto& rpo = blocks.get_rpo ();
+    std::vector<int> rpo_num (n, -1);
+    for (size_t i = 0; i < rpo.size (); ++i)
+      rpo_num[rpo[i]] = (int)i;
+
+    auto intersect = [&] (int a, int b) {
+      while (a != b)
+        {
+          while (rpo_num[a] > rpo_num[b])
+            a = idoms[a];
+          while (rpo_num[b] > rpo_num[a])
+            b = idoms[b];
+        }
+      return a;
+    };
+
+    idoms[root] = root;
+    bool changed = true;
+    while (changed)
       {
-        auto& doms = result.get_block (blk->get_id ());
-        for (auto dom : doms)
+        changed = false;
+        for (auto b : rpo)
           {
-            if (dom == blk->get_id ())
+            if (b == root)
               continue;
 
-            bool found = false;
-            for (auto other_dom : doms)
-              if (other_dom != blk->get_id () && other_dom != dom)
-                {
-                  auto& other_dom_doms = result.get_block (other_dom);
-                  if (other_dom_doms.find (dom) != other_dom_doms.end ())
-                    {
-                      found = true;
-                      break;
-                    }
-                }
-
-            if (!found)
-              result.set_idom (blk->get_id (), dom);
-          }
-      }
-  }
+            int new_idom = -1;
+            for (auto itr = blocks.preds_begin (b); itr != blocks.preds_end (b); ++itr)
+              if (idoms[*itr] != -1)
+                new_idom = (new_idom == -1) ? *itr : intersect (*itr, new_idom);
 
-  //! \brief Computes dominance frontiers.
-  void
-  dom_analyzer::compute_dfs (dom_analysis& result)
-  {
-    for (auto& blk : this->cfg->get_blocks ())
-      {
-        auto& prevs = blk->get_prev ();
-        if (prevs.size () > 1)
-          {
-            auto blk_idom = result.get_idom (blk->get_id ());
-            for (auto& prev : prevs)
+            if (new_idom != -1 && idoms[b] != new_idom)
               {
-                const basic_block *curr = prev.get ();
-                while (curr->get_id () != blk_idom)
-                  {
-                    result.add_df (curr->get_id (), blk->get_id ());
-                    curr = this->cfg->find_block (result.get_idom (curr->get_id ())).get ();
-                  }
+                idoms[b] = new_idom;
+                changed = true;
               }
           }
       }
-  }
-
 
+    idoms[root] = -1;
+    return idoms;
+  }
 
-  bool
-  dom_analyzer::compute_fragment (fragment& frag, const basic_block& blk)
-  {
-    auto& my_frag = static_cast<my_fragment&> (frag);
 
-    std::set<basic_block_id> ndoms;
 
-    auto& prevs = blk.get_prev ();
-    if (!prevs.empty ())
-      {
-        ndoms = static_cast<my_fragment&> (this->get_fragment (*prevs[0])).doms;
-        for (size_t i = 1; i < prevs.size (); ++i)
-          {
-            auto& prev_frag = static_cast<my_fragment&> (this->get_fragment (*prevs[i]));
-            for (auto itr = ndoms.begin (); itr != ndoms.end (); )
-              {
-                if (prev_frag.doms.find (*itr) == prev_frag.doms.end ())
-                  itr = ndoms.erase (itr);
-                else
-                  ++ itr;
-              }
-          }
-      }
-
-    ndoms.insert (blk.get_id ());
-
-    bool modified = !_sets_equal (my_frag.doms, ndoms);
-    if (modified)
-      my_frag.doms = std::move (ndoms);
-    return modified;
-  }
+//------------------------------------------------------------------------------
 
-  std::unique_ptr<dom_analyzer::fragment>
-  dom_analyzer::compute_init_fragment (const basic_block& blk)
+  live_analysis::live_analysis (std::shared_ptr<const data_flow_solution> sol,
+                                std::vector<jtac_var_id>&& vars)
+      : sol (sol), vars (std::move (vars))
   {
-    auto frag = new my_fragment ();
-
-    if (this->cfg->get_root ()->get_id () == blk.get_id ())
-      frag->doms.insert (blk.get_id ());
-    else
-      {
-        for (auto& b : this->cfg->get_blocks ())
-          frag->doms.insert (b->get_id ());
-      }
-
-    return std::unique_ptr<fragment> (frag);
+    for (size_t i = 0; i < this->vars.size (); ++i)
+      this->var_map[this->vars[i]] = i;
   }
 
 
 
-//------------------------------------------------------------------------------
-
   void
   live_analysis::add_block (basic_block_id id, std::set<jtac_var_id>&& live_out)
   {
@@ -444,9 +648,52 @@ namespace jtac {
   const std::set<jtac_var_id>&
   live_analysis::get_live_out (basic_block_id id)
   {
-    return this->block_map[id];
+    auto itr = this->block_map.find (id);
+    if (itr != this->block_map.end ())
+      return itr->second;
+
+    auto& live_out = this->block_map[id];
+    int idx = this->sol ? this->sol->blocks->find_index (id) : -1;
+    if (idx != -1)
+      this->sol->out[idx].for_each ([&] (size_t i) {
+        live_out.insert (this->vars[i]);
+      });
+    return live_out;
   }
 
+  //! \brief Checks whether a variable is live on exit from a block.
+  bool
+  live_analysis::is_live_out (basic_block_id id, jtac_var_id var) const
+  {
+    auto itr = this->block_map.find (id);
+    if (itr != this->block_map.end ())
+      return itr->second.find (var) != itr->second.end ();
+
+    int idx = this->sol ? this->sol->blocks->find_index (id) : -1;
+    auto vitr = this->var_map.find (var);
+    if (idx == -1 || vitr == this->var_map.end ())
+      return false;
+    return this->sol->out[idx].test (vitr->second);
+  }
+
+  //! \brief Checks whether a variable is live on entry to a block.
+  bool
+  live_analysis::is_live_in (basic_block_id id, jtac_var_id var) const
+  {
+    int idx = this->sol ? this->sol->blocks->find_index (id) : -1;
+    auto vitr = this->var_map.find (var);
+    if (idx == -1 || vitr == this->var_map.end ())
+      return false;
+    return this->sol->in[idx].test (vitr->second);
+  }
+
+
+
+  live_analyzer::live_analyzer ()
+      : iterative_analyzer (data_flow_direction::backward,
+                            data_flow_meet::set_union)
+  { }
+
 
 
   /*!
@@ -457,112 +704,124 @@ namespace jtac {
   live_analysis
   live_analyzer::analyze (const control_flow_graph& cfg)
   {
-    this->set_active_cfg (cfg);
-    this->compute_ue_var_and_var_kill ();
-    this->solve (cfg);
-
-    live_analysis result;
-    for (auto& blk : cfg.get_blocks ())
-      {
-        auto& my_frag = static_cast<my_fragment &> (this->get_fragment (*blk));
-        result.add_block (blk->get_id (), std::move (my_frag.live_out));
-      }
+    auto sol = this->solve (cfg);
+    this->var_map.clear ();
+    return live_analysis (sol, std::move (this->vars));
+  }
 
-    return result;
+  live_analysis
+  live_analyzer::analyze (const flat_control_flow_graph& cfg)
+  {
+    auto sol = this->solve (cfg);
+    this->var_map.clear ();
+    return live_analysis (sol, std::move (this->vars));
   }
 
 
 
+  //! \brief Assigns a dense index to every variable that appears in the CFG.
+  void
+  live_analyzer::number_vars (const block_numbering& blocks)
+  {
+    this->var_map.clear ();
+    this->vars.clear ();
+
+    auto add_var = [&] (const jtac_tagged_operand& opr) {
+      if (opr.type != JTAC_OPR_VAR)
+        return;
+      auto var = opr.val.var.get_id ();
+      if (this->var_map.find (var) == this->var_map.end ())
+        {
+          this->var_map[var] = this->vars.size ();
+          this->vars.push_back (var);
+        }
+    };
+
+    for (size_t b = 0; b < blocks.get_size (); ++b)
+      for (auto& inst : blocks.get_block ((int)b).get_instructions ())
+        {
+          int opr_count = get_operand_count (inst.op);
+          for (int i = 0; i < opr_count; ++i)
+            add_var (inst.oprs[i]);
+          if (has_extra_operands (inst.op))
+            for (int i = 0; i < inst.extra.count; ++i)
+              add_var (inst.extra.oprs[i]);
+        }
+  }
+
   //! \brief Computes the sets of upward-exposed variables and killed variables.
   void
-  live_analyzer::compute_ue_var_and_var_kill ()
+  live_analyzer::compute_ue_var_and_var_kill (const basic_block& blk,
+                                              bit_vector& ue_var,
+                                              bit_vector& var_kill)
   {
-    for (auto& blk : this->cfg->get_blocks ())
-      {
-        auto& ue_var = this->ue_vars[blk->get_id ()];
-        auto& var_kill = this->var_kills[blk->get_id ()];
+    bit_vector in_mem (this->vars.size ());
 
-        std::set<jtac_var_id> in_mem;
+    auto use = [&] (const jtac_tagged_operand& opr) {
+      if (opr.type != JTAC_OPR_VAR)
+        return;
+      auto var = this->var_map[opr.val.var.get_id ()];
+      if (!in_mem.test (var) && !var_kill.test (var))
+        ue_var.set (var);
+    };
 
-        auto& insts = blk->get_instructions ();
-        for (auto& inst : insts)
+    auto& insts = blk.get_instructions ();
+    for (auto& inst : insts)
+      {
+        if (inst.op == JTAC_SOP_STORE)
           {
-            if (inst.op == JTAC_SOP_STORE)
-              {
-                var_kill.erase (inst.oprs[1].val.var.get_id ());
-                in_mem.erase (inst.oprs[1].val.var.get_id ());
-              }
-            else if (inst.op == JTAC_SOP_UNLOAD)
-              {
-                in_mem.erase (inst.oprs[0].val.var.get_id ());
-              }
-            else if (inst.op == JTAC_SOP_LOAD)
+            auto itr = this->var_map.find (inst.oprs[1].val.var.get_id ());
+            if (itr != this->var_map.end ())
               {
-                in_mem.insert (inst.oprs[0].val.var.get_id ());
-              }
-            else
-              {
-                int opr_start = is_opcode_assign (inst.op) ? 1 : 0;
-                int opr_end = get_operand_count (inst.op);
-                for (int i = opr_start; i < opr_end; ++i)
-                  if (inst.oprs[i].type == JTAC_OPR_VAR)
-                    {
-                      auto var = inst.oprs[i].val.var.get_id ();
-                      if (in_mem.find (var) != in_mem.end ())
-                        continue;
-                      if (var_kill.find (var) == var_kill.end ())
-                        ue_var.insert (var);
-                    }
-                if (has_extra_operands (inst.op))
-                  for (int i = 0; i < inst.extra.count; ++i)
-                    if (inst.extra.oprs[i].type == JTAC_OPR_VAR)
-                      {
-                        auto var = inst.extra.oprs[i].val.var.get_id ();
-                        if (in_mem.find (var) != in_mem.end ())
-                          continue;
-                        if (var_kill.find (var) == var_kill.end ())
-                          ue_var.insert (var);
-                      }
-
-                if (is_opcode_assign (inst.op) && inst.oprs[0].type == JTAC_OPR_VAR)
-                  var_kill.insert (inst.oprs[0].val.var.get_id ());
+                var_kill.reset (itr->second);
+                in_mem.reset (itr->second);
               }
           }
+        else if (inst.op == JTAC_SOP_UNLOAD)
+          {
+            auto itr = this->var_map.find (inst.oprs[0].val.var.get_id ());
+            if (itr != this->var_map.end ())
+              in_mem.reset (itr->second);
+          }
+        else if (inst.op == JTAC_SOP_LOAD)
+          {
+            auto itr = this->var_map.find (inst.oprs[0].val.var.get_id ());
+            if (itr != this->var_map.end ())
+              in_mem.set (itr->second);
+          }
+        else
+          {
+            int opr_start = is_opcode_assign (inst.op) ? 1 : 0;
+            int opr_end = get_operand_count (inst.op);
+            for (int i = opr_start; i < opr_end; ++i)
+              use (inst.oprs[i]);
+            if (has_extra_operands (inst.op))
+              for (int i = 0; i < inst.extra.count; ++i)
+                use (inst.extra.oprs[i]);
+
+            if (is_opcode_assign (inst.op) && inst.oprs[0].type == JTAC_OPR_VAR)
+              var_kill.set (this->var_map[inst.oprs[0].val.var.get_id ()]);
+          }
       }
   }
 
-
-
-  bool
-  live_analyzer::compute_fragment (fragment& frag, const basic_block& blk)
+  size_t
+  live_analyzer::compute_local_sets (const block_numbering& blocks,
+                                     std::vector<bit_vector>& gen,
+                                     std::vector<bit_vector>& kill)
   {
-    std::set<jtac_var_id> live_out;
+    this->number_vars (blocks);
 
-    for (auto& next : blk.get_next ())
+    size_t universe = this->vars.size ();
+    for (size_t b = 0; b < blocks.get_size (); ++b)
       {
-        auto& next_frag = static_cast<my_fragment&> (this->get_fragment (*next));
-        auto& next_ue_vars = this->ue_vars[next->get_id ()];
-        auto& next_var_kill = this->var_kills[next->get_id ()];
-
-        for (auto var : next_ue_vars)
-          live_out.insert (var);
-        for (auto var : next_frag.live_out)
-          if (next_var_kill.find (var) == next_var_kill.end ())
-            live_out.insert (var);
+        gen[b] = bit_vector (universe);
+        kill[b] = bit_vector (universe);
+        this->compute_ue_var_and_var_kill (blocks.get_block ((int)b),
+                                           gen[b], kill[b]);
       }
 
-    auto& my_frag = static_cast<my_fragment&> (this->get_fragment (blk));
-    bool modified = !_sets_equal (my_frag.live_out, live_out);
-    if (modified)
-      my_frag.live_out = std::move (live_out);
-    return modified;
-  }
-
-  std::unique_ptr<live_analyzer::fragment>
-  live_analyzer::compute_init_fragment (const basic_block& blk)
-  {
-    auto frag = new my_fragment ();
-    return std::unique_ptr<fragment> (frag);
+    return universe;
   }
 }
-}
\ No newline at end of file
+}
@@ -0,0 +1,45 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "jtac/driver.hpp"
+#include "jtac/translate/x86_64/x86_64_translator.hpp"
+
+
+namespace jcc {
+namespace jtac {
+
+  program_driver::program_driver (unsigned num_threads)
+      : pool (num_threads)
+  {
+  }
+
+
+
+  //! \brief Translates every procedure in the program into x86-64.
+  std::vector<x86_64_procedure>
+  program_driver::translate_x86_64 (const program& prog)
+  {
+    return this->map_procedures (prog, [&prog] (const procedure& proc) {
+      // translators keep per-procedure state, so each task gets its own.
+      x86_64_translator translator;
+      translator.set_names (&prog.get_names ());
+      return translator.translate_procedure (proc);
+    });
+  }
+}
+}
@@ -17,7 +17,9 @@
  */
 
 #include "jtac/jtac.hpp"
+#include "jtac/arena.hpp"
 #include <stdexcept>
+#include <cstring>
 
 
 namespace jcc {
@@ -158,122 +160,152 @@ namespace jtac {
 
 
 
-  jtac_tagged_operand&
-  jtac_tagged_operand::operator= (const jtac_tagged_operand& other)
-  {
-    this->type = other.type;
-    switch (this->type)
-      {
-        case JTAC_OPR_CONST: new (&this->val.konst) jtac_const (other.val.konst); break;
-        case JTAC_OPR_VAR: new (&this->val.var) jtac_var (other.val.var); break;
-        case JTAC_OPR_LABEL: new (&this->val.lbl) jtac_label (other.val.lbl); break;
-        case JTAC_OPR_OFFSET: new (&this->val.off) jtac_offset (other.val.off); break;
-        case JTAC_OPR_NAME: new (&this->val.name) jtac_name (other.val.name); break;
-        case JTAC_OPR_BLOCK_REF: new (&this->val.blk) jtac_block_ref (other.val.blk); break;
-      }
+  static_assert (std::is_trivially_copyable<jtac_tagged_operand>::value,
+                 "jtac_tagged_operand must be trivially copyable");
 
-    return *this;
-  }
 
-  jtac_tagged_operand&
-  jtac_tagged_operand::operator= (jtac_tagged_operand&& other)
-  {
-    this->type = other.type;
-    switch (this->type)
-      {
-      case JTAC_OPR_CONST: new (&this->val.konst) jtac_const (std::move (other.val.konst)); break;
-      case JTAC_OPR_VAR: new (&this->val.var) jtac_var (std::move (other.val.var)); break;
-      case JTAC_OPR_LABEL: new (&this->val.lbl) jtac_label (std::move (other.val.lbl)); break;
-      case JTAC_OPR_OFFSET: new (&this->val.off) jtac_offset (std::move (other.val.off)); break;
-      case JTAC_OPR_NAME: new (&this->val.name) jtac_name (std::move (other.val.name)); break;
-      case JTAC_OPR_BLOCK_REF: new (&this->val.blk) jtac_block_ref (std::move (other.val.blk)); break;
-      }
 
-    return *this;
+  jtac_instruction::jtac_instruction ()
+  {
+    this->op = JTAC_OP_UNDEF;
+    this->extra.count = 0;
+    this->extra.cap = 0;
+    this->extra.arena = nullptr;
+    this->extra.oprs = nullptr;
   }
 
-  jtac_tagged_operand&
-  jtac_tagged_operand::operator= (const jtac_operand& opr)
+  jtac_instruction::jtac_instruction (const jtac_instruction& other)
+      : jtac_instruction (other, nullptr)
+  { }
+
+  //! \brief Copies an instruction into the specified arena (or onto the heap,
+  //!        if null).
+  jtac_instruction::jtac_instruction (const jtac_instruction& other,
+                                      jtac_arena *arena)
   {
-    this->type = opr.get_type ();
-    switch (opr.get_type ())
-      {
-      case JTAC_OPR_CONST:
-        new (&this->val.konst) jtac_const (static_cast<const jtac_const&> (opr));
-        break;
+    this->extra.count = 0;
+    this->extra.cap = 0;
+    this->extra.arena = arena;
+    this->extra.oprs = nullptr;
+    if (arena)
+      arena->attach ();
+    *this = other;
+  }
 
-      case JTAC_OPR_VAR:
-        new (&this->val.var) jtac_var (static_cast<const jtac_var&> (opr));
-        break;
+  jtac_instruction::jtac_instruction (jtac_instruction&& other) noexcept
+  {
+    this->copy_fixed (other);
+    this->extra = other.extra;
+    if (this->extra.arena)
+      this->extra.arena->attach ();
 
-      case JTAC_OPR_LABEL:
-        new (&this->val.lbl) jtac_label (static_cast<const jtac_label&> (opr));
-        break;
+    // the moved-from instruction stays in its arena
+    other.extra.count = 0;
+    other.extra.cap = 0;
+    other.extra.oprs = nullptr;
+  }
 
-      case JTAC_OPR_OFFSET:
-        new (&this->val.off) jtac_offset (static_cast<const jtac_offset&> (opr));
-        break;
+  jtac_instruction::~jtac_instruction ()
+  {
+    this->free_extra ();
+    if (this->extra.arena)
+      this->extra.arena->detach ();
+  }
 
-      case JTAC_OPR_NAME:
-        new (&this->val.name) jtac_name (static_cast<const jtac_name&> (opr));
-        break;
 
-      case JTAC_OPR_BLOCK_REF:
-        new (&this->val.blk) jtac_block_ref (static_cast<const jtac_block_ref&> (opr));
-        break;
-      }
 
-    return *this;
+  //! \brief Copies the trivially copyable part of another instruction.
+  void
+  jtac_instruction::copy_fixed (const jtac_instruction& other)
+  {
+    this->op = other.op;
+    std::memcpy (this->oprs, other.oprs, sizeof this->oprs);
   }
 
-
-
-  jtac_operand&
-  tagged_operand_to_operand (jtac_tagged_operand& opr)
+  /*!
+     \brief Replaces the extra operand list with one of the specified
+            capacity, allocated from the instruction's arena.
+   */
+  void
+  jtac_instruction::realloc_extra (int cap)
   {
-    switch (opr.type)
+    jtac_tagged_operand *ptr = nullptr;
+    if (cap)
       {
-      case JTAC_OPR_VAR: return opr.val.var;
-      case JTAC_OPR_CONST: return opr.val.konst;
-      case JTAC_OPR_LABEL: return opr.val.lbl;
-      case JTAC_OPR_OFFSET: return opr.val.off;
-      case JTAC_OPR_NAME: return opr.val.name;
-      case JTAC_OPR_BLOCK_REF: return opr.val.blk;
+        if (this->extra.arena)
+          ptr = this->extra.arena->allocate (cap);
+        else
+          ptr = new jtac_tagged_operand[cap];
+
+        if (this->extra.count)
+          std::memcpy (ptr, this->extra.oprs,
+                       this->extra.count * sizeof (jtac_tagged_operand));
       }
 
-    throw std::runtime_error ("tagged_operand_to_operand: unhandled operand type");
+    this->free_extra ();
+    this->extra.oprs = ptr;
+    this->extra.cap = (uint16_t)cap;
   }
 
-
-
-  jtac_instruction::jtac_instruction ()
+  //! \brief Releases the extra operand list (if it is not arena-owned).
+  void
+  jtac_instruction::free_extra ()
   {
+    if (!this->extra.arena)
+      delete[] this->extra.oprs;
+    this->extra.oprs = nullptr;
     this->extra.cap = 0;
   }
 
-  jtac_instruction::jtac_instruction (const jtac_instruction& other)
-  { *this = other; }
+  /*!
+     \brief Moves the extra operand list into the specified arena (or onto the
+            heap, if null).
+   */
+  void
+  jtac_instruction::set_arena (jtac_arena *arena)
+  {
+    if (arena == this->extra.arena)
+      return;
 
-  jtac_instruction::jtac_instruction (jtac_instruction&& other)
-  { *this = std::move (other); }
+    jtac_tagged_operand *ptr = nullptr;
+    if (this->extra.count)
+      {
+        ptr = arena ? arena->allocate (this->extra.count)
+                    : new jtac_tagged_operand[this->extra.count];
+        std::memcpy (ptr, this->extra.oprs,
+                     this->extra.count * sizeof (jtac_tagged_operand));
+      }
+
+    this->free_extra ();
+    if (this->extra.arena)
+      this->extra.arena->detach ();
+    if (arena)
+      arena->attach ();
+
+    this->extra.arena = arena;
+    this->extra.oprs = ptr;
+    this->extra.cap = this->extra.count;
+  }
 
 
 
   jtac_instruction&
   jtac_instruction::operator= (const jtac_instruction& other)
   {
-    this->op = other.op;
-    this->oprs[0] = other.oprs[0];
-    this->oprs[1] = other.oprs[1];
-    this->oprs[2] = other.oprs[2];
+    if (this == &other)
+      return *this;
+
+    this->copy_fixed (other);
+
+    // the list stays in our own arena; reuse it if it is large enough.
+    this->extra.count = 0;
+    if (this->extra.cap < other.extra.count || !other.extra.cap)
+      this->realloc_extra (other.extra.cap);
+
     this->extra.count = other.extra.count;
-    this->extra.cap = other.extra.cap;
-    if (this->extra.cap)
-      {
-        this->extra.oprs = new jtac_tagged_operand[this->extra.cap];
-        for (int i = 0; i < this->extra.count; ++i)
-          this->extra.oprs[i] = other.extra.oprs[i];
-      }
+    if (other.extra.count)
+      std::memcpy (this->extra.oprs, other.extra.oprs,
+                   other.extra.count * sizeof (jtac_tagged_operand));
 
     return *this;
   }
@@ -281,10 +313,15 @@ namespace jtac {
   jtac_instruction&
   jtac_instruction::operator= (jtac_instruction&& other)
   {
-    this->op = other.op;
-    this->oprs[0] = std::move (other.oprs[0]);
-    this->oprs[1] = std::move (other.oprs[1]);
-    this->oprs[2] = std::move (other.oprs[2]);
+    if (this == &other)
+      return *this;
+
+    // a list from another arena (or the heap) cannot be taken over
+    if (this->extra.arena != other.extra.arena)
+      return *this = (const jtac_instruction&)other;
+
+    this->free_extra ();
+    this->copy_fixed (other);
     this->extra.count = other.extra.count;
     this->extra.cap = other.extra.cap;
     this->extra.oprs = other.extra.oprs;
@@ -303,14 +340,12 @@ namespace jtac {
   {
     if (this->extra.count == this->extra.cap)
       {
-        int ncap = (int)this->extra.cap * 2;
-        if (ncap > 255) ncap = 255;
-        this->extra.cap = (unsigned char)ncap;
-        jtac_tagged_operand *tmp = new jtac_tagged_operand[ncap];
-        for (int i = 0; i < this->extra.count; ++i)
-          tmp[i] = std::move (this->extra.oprs[i]);
-        delete[] this->extra.oprs;
-        this->extra.oprs = tmp;
+        int ncap = this->extra.cap ? (int)this->extra.cap * 2 : 4;
+        if (ncap > JTAC_MAX_EXTRA_OPERANDS)
+          ncap = JTAC_MAX_EXTRA_OPERANDS;
+        if (ncap == this->extra.count)
+          throw std::runtime_error ("jtac_instruction::push_extra: too many operands");
+        this->realloc_extra (ncap);
       }
 
     this->extra.oprs[this->extra.count ++] = opr;
@@ -202,7 +202,7 @@ namespace jtac {
     while ((c = this->strm.peek ()) != EOF && _is_name_char (c))
       name.push_back ((char)this->strm.get ());
 
-    static std::unordered_map<std::string, token_type> _keywords {
+    static const std::unordered_map<std::string, token_type> _keywords {
         { "proc", JTAC_TOK_PROC },
         { "endproc", JTAC_TOK_ENDPROC },
         { "cmp", JTAC_TOK_CMP },
@@ -26,6 +26,7 @@ namespace jtac {
       : toks (toks)
   {
     this->curr_proc = nullptr;
+    this->next_name_id = 1;
   }
 
 
@@ -360,7 +361,6 @@ namespace jtac {
     auto& proc = this->prog.emplace_procedure (name);
     this->curr_proc = &proc;
     this->next_var_id = 1;
-    this->next_name_id = 1;
     this->label_map.clear ();
 
     // map parameters into variables
@@ -369,7 +369,8 @@ namespace jtac {
       {
         if (names.has_name (param.val.str))
           throw parse_error ("procedure parameter specified twice", tok.pos);
-        names.insert (param.val.str, this->next_var_id++);
+        names.insert (param.val.str, this->next_var_id);
+        proc.get_params ().push_back (this->next_var_id++);
       }
 
     // procedure body
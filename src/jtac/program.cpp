@@ -22,9 +22,11 @@
 namespace jcc {
 namespace jtac {
 
-  procedure::procedure (const std::string& name)
+  procedure::procedure (const std::string& name, bool use_arena)
       : name (name)
   {
+    if (use_arena)
+      this->arena = std::make_shared<jtac_arena> ();
   }
 
 
@@ -33,9 +35,9 @@ namespace jtac {
 
   //! \brief Inserts a new procedure and returns a reference to it.
   procedure&
-  program::emplace_procedure (const std::string& name)
+  program::emplace_procedure (const std::string& name, bool use_arena)
   {
-    this->procs.emplace_back (name);
+    this->procs.emplace_back (name, use_arena);
     return this->procs.back ();
   }
 }
@@ -29,11 +29,13 @@ namespace jtac {
   /*!
     \brief Transforms the specified CFG into SSA form.
     \param cfg The control flow graph to transform.
+    \param form Controls which phi-functions are inserted.
   */
   void
-  ssa_builder::transform (control_flow_graph& cfg)
+  ssa_builder::transform (control_flow_graph& cfg, ssa_form_type form)
   {
     this->cfg = &cfg;
+    this->form = form;
 
     dom_analyzer da;
     this->dom_results = da.analyze (*this->cfg);
@@ -48,59 +50,79 @@ namespace jtac {
 
 
 
-  static bool
-  _has_phi_function (const std::vector<jtac_instruction>& insts, jtac_var_id var)
+  //! \brief Returns the names that are candidates for phi-functions.
+  std::set<jtac_var_id>
+  ssa_builder::get_phi_candidates ()
   {
-    for (auto& inst : insts)
-      {
-        if (inst.op != JTAC_SOP_ASSIGN_PHI)
-          break;
-        if (inst.oprs[0].type == JTAC_OPR_VAR &&
-            inst.oprs[0].val.var.get_id () == var)
-          return true;
-      }
+    auto vars = this->globals;
+    if (this->form == ssa_form_type::minimal)
+      for (auto& p : this->def_blocks)
+        vars.insert (p.first);
 
-    return false;
+    return vars;
   }
 
   /*!
-     Inserts phi-functions at the start of every block that has multiple
-     predecessors. A phi-function is inserted for every name that is defined
-     or used in the control flow graph.
+     Inserts phi-functions at the iterated dominance frontier of the
+     definitions of every name that needs them (depending on the form
+     being built).
    */
   void
   ssa_builder::insert_phi_functions ()
   {
-    std::map<jtac_var_id, std::set<basic_block_id>> handled_blocks;
-    std::map<basic_block_id, assembler> asems;
-    for (auto var : this->globals)
+    auto& blocks = this->dom_results.get_numbering ();
+    size_t n = blocks.get_size ();
+
+    live_analysis live_results;
+    bool pruned = this->form == ssa_form_type::pruned;
+    if (pruned)
+      {
+        live_analyzer la;
+        live_results = la.analyze (*this->cfg);
+      }
+
+    // per-block markers, holding the index of the last variable processed
+    // that got a phi-function in/was queued from the block. saves us from
+    // having to clear or search anything between variables.
+    std::vector<int> has_phi (n, -1), queued (n, -1);
+    int iter = 0;
+
+    std::map<int, assembler> asems;
+    std::vector<int> work_list;
+    for (auto var : this->get_phi_candidates ())
       {
-        auto& var_blocks = this->def_blocks[var];
-        std::vector<basic_block_id> work_list (var_blocks.begin (), var_blocks.end ());
+        ++ iter;
+        for (auto bid : this->def_blocks[var])
+          {
+            int b = blocks.get_index (bid);
+            queued[b] = iter;
+            work_list.push_back (b);
+          }
+
         while (!work_list.empty ())
           {
-            auto bid = work_list.back ();
+            auto b = work_list.back ();
             work_list.pop_back ();
 
-            auto& dfs = this->dom_results.get_dfs (bid);
-            for (auto df : dfs)
+            for (auto df : this->dom_results.get_df (b))
               {
-                auto blk = this->cfg->find_block (df);
-                auto& asem = asems[df];
-                if (!_has_phi_function (blk->get_instructions (), var) &&
-                    !_has_phi_function (asem.get_instructions (), var))
+                if (has_phi[df] == iter)
+                  continue;
+                has_phi[df] = iter;
+
+                auto& blk = blocks.get_block (df);
+                if (pruned && !live_results.is_live_in (blk.get_id (), var))
+                  continue;
+
+                // insert phi function to the beginning of the block.
+                auto& phi = asems[df].emit_assign_phi (jtac_var (var));
+                for (size_t i = 0; i < blk.get_prev ().size (); ++i)
+                  phi.push_extra (jtac_var (var));
+
+                if (queued[df] != iter)
                   {
-                    // insert phi function to the beginning of the block.
-                    auto& phi = asem.emit_assign_phi (jtac_var (var));
-                    for (size_t i = 0; i < blk->get_prev ().size (); ++i)
-                      phi.push_extra (jtac_var (var));
-
-                    if (handled_blocks.find (var) == handled_blocks.end () ||
-                        handled_blocks[var].find (df) == handled_blocks[var].end ())
-                      {
-                        work_list.push_back (df);
-                        handled_blocks[var].insert (df);
-                      }
+                    queued[df] = iter;
+                    work_list.push_back (df);
                   }
               }
           }
@@ -108,7 +130,7 @@ namespace jtac {
 
     for (auto& p : asems)
       {
-        auto blk = this->cfg->find_block (p.first);
+        auto blk = this->cfg->find_block (blocks.get_id (p.first));
         auto& insts = p.second.get_instructions ();
         blk->push_instructions_front (insts.begin (), insts.end ());
       }
@@ -119,7 +141,7 @@ namespace jtac {
   ssa_builder::define_initial_names ()
   {
     auto root = this->cfg->get_root ();
-    auto undef_globals = this->globals;
+    auto undef_globals = this->get_phi_candidates ();
     for (auto& inst : root->get_instructions ())
       {
         if (is_opcode_assign (inst.op) && inst.oprs[0].type == JTAC_OPR_VAR)
@@ -234,16 +256,10 @@ namespace jtac {
           }
       }
 
-    // recurse
-    for (auto& b : this->cfg->get_blocks ())
-      {
-        if (b->get_id () == blk.get_id () || b->get_id () == this->cfg->get_root ()->get_id ())
-          continue;
-
-        auto idom = this->dom_results.get_idom (b->get_id ());
-        if (blk.get_id () == idom)
-          this->rename_block (*b);
-      }
+    // recurse into the blocks immediately dominated by this one
+    auto& blocks = this->dom_results.get_numbering ();
+    for (auto child : this->dom_results.get_children (blocks.get_index (blk.get_id ())))
+      this->rename_block (*this->cfg->find_block (blocks.get_id (child)));
 
     for (auto& inst : insts)
       if (is_opcode_assign (inst.op) && inst.oprs[0].type == JTAC_OPR_VAR)
@@ -19,18 +19,166 @@
 #include "jtac/translate/x86_64/x86_64_translator.hpp"
 #include "jtac/ssa.hpp"
 #include "jtac/allocation/basic/basic.hpp"
+#include <algorithm>
+#include <stdexcept>
 
 
 namespace jcc {
 namespace jtac {
 
+  using x86_64::reg_t;
+  using x86_64::mem_t;
+  using x86_64::imm_t;
+  using x86_64::lbl_t;
+  using x86_64::rel_t;
+  using M = x86_64::mnemonic;
+
 // number of general purpose registers
-#define X86_64_NUM_GP_REGISTERS 14 // rax, rbx, rcx, rdx, rsi, rdi
-                                   // r8, r9, r10 ,r11, r12, r13, r14, r15
+#define X86_64_NUM_GP_REGISTERS 13 // rax, rbx, rcx, rdx, rsi, rdi
+                                   // r8, r9, r10, r12, r13, r14, r15
+                                   // (r11 is the scratch register)
+
+  // the registers that colors map to
+  static const int _color_regs[X86_64_NUM_GP_REGISTERS] = {
+    x86_64::REG_RAX, x86_64::REG_RBX, x86_64::REG_RCX, x86_64::REG_RDX,
+    x86_64::REG_RSI, x86_64::REG_RDI, x86_64::REG_R8, x86_64::REG_R9,
+    x86_64::REG_R10, x86_64::REG_R12, x86_64::REG_R13, x86_64::REG_R14,
+    x86_64::REG_R15,
+  };
+
+  // System V integer argument registers
+  static const int _arg_regs[6] = {
+    x86_64::REG_RDI, x86_64::REG_RSI, x86_64::REG_RDX,
+    x86_64::REG_RCX, x86_64::REG_R8, x86_64::REG_R9,
+  };
+
+#define REG_MASK(R) (1u << ((R) & 0xF))
+
+  static const unsigned _callee_saved = REG_MASK(x86_64::REG_RBX)
+    | REG_MASK(x86_64::REG_R12) | REG_MASK(x86_64::REG_R13)
+    | REG_MASK(x86_64::REG_R14) | REG_MASK(x86_64::REG_R15);
+
+  static const unsigned _caller_saved = REG_MASK(x86_64::REG_RAX)
+    | REG_MASK(x86_64::REG_RCX) | REG_MASK(x86_64::REG_RDX)
+    | REG_MASK(x86_64::REG_RSI) | REG_MASK(x86_64::REG_RDI)
+    | REG_MASK(x86_64::REG_R8) | REG_MASK(x86_64::REG_R9)
+    | REG_MASK(x86_64::REG_R10);
+
+  static const reg_t _scratch (x86_64::REG_R11);
+
+
+  //! \brief Returns a quadword memory operand at the specified offset from RBP.
+  static mem_t
+  _frame_mem (int64_t disp)
+  {
+    return mem_t (x86_64::SS_QWORD, x86_64::REG_RBP, 1, x86_64::REG_NONE, 0,
+                  disp);
+  }
+
+  //! \brief Returns the 32-bit form of the specified 64-bit register.
+  static reg_t
+  _reg32 (reg_t reg)
+  {
+    return reg_t (x86_64::REG_EAX + reg.number ());
+  }
+
+  static bool
+  _fits_i32 (int64_t val)
+  {
+    return x86_64::encoder::fits_i32 (val);
+  }
+
+  static bool
+  _is_jcc (jtac_opcode op)
+  {
+    switch (op)
+      {
+      case JTAC_OP_JE:
+      case JTAC_OP_JNE:
+      case JTAC_OP_JL:
+      case JTAC_OP_JLE:
+      case JTAC_OP_JG:
+      case JTAC_OP_JGE:
+        return true;
+
+      default:
+        return false;
+      }
+  }
+
+  //! \brief Returns the condition that holds for "cmp b, a" whenever the
+  //!        specified condition holds for "cmp a, b".
+  static jtac_opcode
+  _swap_cond (jtac_opcode op)
+  {
+    switch (op)
+      {
+      case JTAC_OP_JL: return JTAC_OP_JG;
+      case JTAC_OP_JLE: return JTAC_OP_JGE;
+      case JTAC_OP_JG: return JTAC_OP_JL;
+      case JTAC_OP_JGE: return JTAC_OP_JLE;
+      default: return op;
+      }
+  }
+
+  static bool
+  _eval_cond (jtac_opcode op, int64_t a, int64_t b)
+  {
+    switch (op)
+      {
+      case JTAC_OP_JE: return a == b;
+      case JTAC_OP_JNE: return a != b;
+      case JTAC_OP_JL: return a < b;
+      case JTAC_OP_JLE: return a <= b;
+      case JTAC_OP_JG: return a > b;
+      case JTAC_OP_JGE: return a >= b;
+      default: return false;
+      }
+  }
+
+  //! \brief Checks whether the instruction at I stores the specified variable.
+  static bool
+  _is_store_of (const std::vector<jtac_instruction>& insts, size_t i,
+                const jtac_tagged_operand& var)
+  {
+    return i < insts.size () && insts[i].op == JTAC_SOP_STORE
+           && var.type == JTAC_OPR_VAR
+           && insts[i].oprs[0].val.var.get_id () == var.val.var.get_id ();
+  }
+
+  //! \brief Returns the last instruction of a block that is not an unload.
+  static const jtac_instruction*
+  _last_instruction (const basic_block& blk)
+  {
+    auto& insts = blk.get_instructions ();
+    for (size_t i = insts.size (); i-- > 0; )
+      if (insts[i].op != JTAC_SOP_UNLOAD)
+        return &insts[i];
+    return nullptr;
+  }
+
+  // The register-immediate form of imul takes a separate source register.
+  template<M Op>
+  static void
+  _emit_ri (x86_64::assembler& asem, reg_t dest, int64_t val)
+  { asem.emit<Op> (dest, imm_t (val)); }
+
+  template<>
+  void
+  _emit_ri<M::imul> (x86_64::assembler& asem, reg_t dest, int64_t val)
+  { asem.emit<M::imul> (dest, dest, imm_t (val)); }
+
+
 
   x86_64_translator::x86_64_translator ()
   {
     this->cfg = nullptr;
+    this->alloc_type = register_allocator_type::basic;
+    this->names = nullptr;
+    this->lbl_exit = 0;
+    this->has_exit = false;
+    this->has_frame = false;
+    this->frame_size = 0;
   }
 
 
@@ -41,23 +189,1222 @@ namespace jtac {
   x86_64_procedure
   x86_64_translator::translate_procedure (const procedure& proc)
   {
+    // Parameters are defined at the top of the procedure by assignments of
+    // their index (as an offset operand), so that SSA construction and
+    // register allocation see them as ordinary definitions.
+    auto& params = proc.get_params ();
+    const std::vector<jtac_instruction> *body = &proc.get_body ();
+    std::vector<jtac_instruction> param_body;
+    if (!params.empty ())
+      {
+        param_body.reserve (params.size () + body->size ());
+        for (size_t i = 0; i < params.size (); ++i)
+          {
+            jtac_instruction inst;
+            inst.op = JTAC_OP_ASSIGN;
+            inst.oprs[0] = jtac_var (params[i]);
+            inst.oprs[1] = jtac_offset ((int)i);
+            param_body.push_back (inst);
+          }
+        param_body.insert (param_body.end (), body->begin (), body->end ());
+        body = &param_body;
+      }
+
     // build control flow graph
     this->cfg.reset (new control_flow_graph (
-        std::move (control_flow_analyzer::make_cfg (proc.get_body ()))));
+        std::move (control_flow_analyzer::make_cfg (*body,
+                                            proc.get_arena () != nullptr))));
 
     // transform into SSA form
     ssa_builder ssab;
     ssab.transform (*this->cfg);
 
     // perform register allocation
-    basic_register_allocator reg_alloc;
+    auto reg_alloc = make_register_allocator (this->alloc_type);
     this->reg_res.reset (new register_allocation (std::move (
-        reg_alloc.allocate (*this->cfg, X86_64_NUM_GP_REGISTERS))));
+        reg_alloc->allocate (*this->cfg, X86_64_NUM_GP_REGISTERS))));
+
+    // instruction selection
+    this->asem.reset (new x86_64::assembler ());
+    this->syms = std::make_shared<relocation_symbol_store> ();
+    this->blk_lbls.clear ();
+    this->deferred.clear ();
+    this->stubs.clear ();
+
+    this->lay_out_blocks ();
+    this->allocate_frame ((int)params.size ());
+    for (auto blk : this->layout)
+      this->blk_lbls[blk->get_id ()] = this->asem->make_label ();
+    this->lbl_exit = this->asem->make_label ();
+    this->has_exit = false;
+
+    live_analyzer lan;
+    auto la = lan.analyze (*this->cfg);
+
+    this->emit_prologue ();
+    for (size_t i = 0; i < this->layout.size (); ++i)
+      this->select_block (i, la);
+
+    // branches past the end of the procedure and falling off its end
+    if (this->has_exit)
+      {
+        this->asem->mark_label (this->lbl_exit);
+        this->emit_epilogue ();
+      }
+
+    for (size_t i = 0; i < this->stubs.size (); ++i)
+      {
+        auto stub = this->stubs[i];
+        this->asem->mark_label (stub.lbl);
+        this->emit_phi_copies (*stub.from, stub.to);
+        this->asem->emit<M::jmp> (lbl_t (this->get_block_label (stub.to)));
+      }
+
+    this->asem->fix_labels ();
+
+    auto data = this->asem->get_data ();
+    std::vector<unsigned char> code (data, data + this->asem->get_size ());
+    std::vector<relocation> relocs (this->asem->get_relocations ());
+    this->asem.reset ();
+
+    return x86_64_procedure (proc.get_name (), std::move (code),
+                             std::move (relocs), this->syms);
+  }
+
+
+
+  //! \brief Orders the blocks of the CFG in program order.
+  void
+  x86_64_translator::lay_out_blocks ()
+  {
+    this->layout.clear ();
+    for (auto& blk : this->cfg->get_blocks ())
+      this->layout.push_back (blk.get ());
+
+    // keeping program order preserves fallthrough edges
+    std::sort (this->layout.begin (), this->layout.end (),
+               [] (const basic_block *a, const basic_block *b) {
+                 return a->get_base () < b->get_base ();
+               });
+  }
+
+  /*!
+     \brief Assigns stack slots to spilled variables and finds the
+            callee-saved registers in use.
+
+     The frame is laid out as follows:
+
+       [rbp + 16 + 8*i]    stack parameter i (from the seventh one on)
+       [rbp + 8]           return address
+       [rbp]               saved rbp
+       [rbp - 8*(i + 1)]   callee-saved register i
+       below               stack slots, padded to keep rsp 16-byte aligned
+
+     Procedures that make no calls, have no stack slots and take no stack
+     parameters do without rbp.
+   */
+  void
+  x86_64_translator::allocate_frame (int num_params)
+  {
+    this->slots.clear ();
+    unsigned used = 0;
+    bool has_calls = false;
+    for (auto blk : this->layout)
+      for (auto& inst : blk->get_instructions ())
+        {
+          // one slot for every spilled variable (spill temporaries keep the
+          // base of the variable they were made for)
+          if (inst.op == JTAC_SOP_LOAD || inst.op == JTAC_SOP_STORE)
+            {
+              int base = var_base (inst.oprs[0].val.var.get_id ());
+              if (this->slots.find (base) == this->slots.end ())
+                {
+                  int idx = (int)this->slots.size ();
+                  this->slots[base] = idx;
+                }
+            }
+          else if (inst.op == JTAC_OP_CALL || inst.op == JTAC_OP_ASSIGN_CALL)
+            has_calls = true;
+
+          for (int i = 0; i < 3; ++i)
+            if (inst.oprs[i].type == JTAC_OPR_VAR
+                && this->reg_res->has_color (inst.oprs[i].val.var.get_id ()))
+              used |= REG_MASK(this->get_reg (inst.oprs[i].val.var.get_id ()).code);
+        }
+
+    this->saved_regs.clear ();
+    for (int reg : _color_regs)
+      if (used & _callee_saved & REG_MASK(reg))
+        this->saved_regs.push_back (reg_t (reg));
+
+    this->has_frame = has_calls || !this->slots.empty () || num_params > 6;
+    this->frame_size = 0;
+    if (this->has_frame)
+      {
+        this->frame_size = 8 * (int)this->slots.size ();
+        if ((8 * this->saved_regs.size () + this->frame_size) % 16 != 0)
+          this->frame_size += 8;
+      }
+  }
+
+  void
+  x86_64_translator::emit_prologue ()
+  {
+    auto& asem = *this->asem;
+    if (this->has_frame)
+      {
+        asem.emit<M::push> (reg_t (x86_64::REG_RBP));
+        asem.emit<M::mov> (reg_t (x86_64::REG_RBP), reg_t (x86_64::REG_RSP));
+      }
+    for (auto reg : this->saved_regs)
+      asem.emit<M::push> (reg);
+    if (this->frame_size > 0)
+      asem.emit<M::sub> (reg_t (x86_64::REG_RSP), imm_t (this->frame_size));
+  }
+
+  void
+  x86_64_translator::emit_epilogue ()
+  {
+    auto& asem = *this->asem;
+    if (this->frame_size > 0)
+      asem.emit<M::add> (reg_t (x86_64::REG_RSP), imm_t (this->frame_size));
+    for (auto itr = this->saved_regs.rbegin (); itr != this->saved_regs.rend (); ++itr)
+      asem.emit<M::pop> (*itr);
+    if (this->has_frame)
+      asem.emit<M::pop> (reg_t (x86_64::REG_RBP));
+    asem.emit<M::ret> ();
+  }
+
+  /*!
+     \brief Moves incoming parameters into their variables.
+
+     Parameters that have been spilled are stored into their slots first,
+     while the argument registers are still intact. The rest are moved all
+     at once, since a parameter's register may well be another's argument
+     register.
+   */
+  size_t
+  x86_64_translator::emit_param_moves (const basic_block& root)
+  {
+    auto& insts = root.get_instructions ();
+    std::vector<x86_64_move> moves;
+    size_t i = 0;
+    for (; i < insts.size (); ++i)
+      {
+        auto& inst = insts[i];
+        if (inst.op != JTAC_OP_ASSIGN || inst.oprs[1].type != JTAC_OPR_OFFSET)
+          break;
+
+        int idx = inst.oprs[1].val.off.get_offset ();
+        x86_64_operand src;
+        if (idx < 6)
+          src = { x86_64_operand::REG, reg_t (_arg_regs[idx]), 0 };
+        else
+          src = { x86_64_operand::MEM, _scratch, 16 + 8 * (int64_t)(idx - 6) };
+
+        auto var = inst.oprs[0].val.var.get_id ();
+        if (_is_store_of (insts, i + 1, inst.oprs[0]))
+          {
+            auto mem = _frame_mem (this->get_slot_disp (var));
+            this->asem->emit<M::mov> (mem, this->to_reg (src, _scratch));
+            ++ i;
+            continue;
+          }
+
+        // skip parameters that are never used
+        bool used = false;
+        for (auto blk : this->layout)
+          for (auto& other : blk->get_instructions ())
+            {
+              int start = is_opcode_assign (other.op) ? 1 : 0;
+              int end = get_operand_count (other.op);
+              for (int j = start; j < end && !used; ++j)
+                used = other.oprs[j].type == JTAC_OPR_VAR
+                       && other.oprs[j].val.var.get_id () == var;
+              if (other.op == JTAC_SOP_ASSIGN_PHI || has_extra_operands (other.op))
+                for (int j = 0; j < other.extra.count && !used; ++j)
+                  used = other.extra.oprs[j].type == JTAC_OPR_VAR
+                         && other.extra.oprs[j].val.var.get_id () == var;
+            }
+        if (used)
+          moves.push_back ({ this->get_reg (var), src });
+      }
+
+    this->emit_parallel_copy (moves);
+    return i;
+  }
+
+  //! \brief Computes the registers live after every instruction of a block.
+  void
+  x86_64_translator::compute_live_after (const basic_block& blk,
+                                         live_analysis& la)
+  {
+    auto& insts = blk.get_instructions ();
+    this->live_after.assign (insts.size (), 0);
+
+    unsigned live = 0;
+    auto use = [&] (const jtac_tagged_operand& opr) {
+      if (opr.type == JTAC_OPR_VAR
+          && this->reg_res->has_color (opr.val.var.get_id ()))
+        live |= REG_MASK(this->get_reg (opr.val.var.get_id ()).code);
+    };
+    auto def = [&] (const jtac_tagged_operand& opr) {
+      if (opr.type == JTAC_OPR_VAR
+          && this->reg_res->has_color (opr.val.var.get_id ()))
+        live &= ~REG_MASK(this->get_reg (opr.val.var.get_id ()).code);
+    };
+
+    for (auto var : la.get_live_out (blk.get_id ()))
+      use (jtac_var (var));
+
+    for (size_t i = insts.size (); i-- > 0; )
+      {
+        auto& inst = insts[i];
+        this->live_after[i] = live;
+        switch (inst.op)
+          {
+          case JTAC_SOP_ASSIGN_PHI:
+          case JTAC_SOP_UNLOAD:
+            break;
+
+          case JTAC_SOP_LOAD:
+            def (inst.oprs[0]);
+            break;
+
+          case JTAC_SOP_STORE:
+            use (inst.oprs[0]);
+            break;
+
+          default:
+            {
+              bool assign = is_opcode_assign (inst.op);
+              if (assign)
+                def (inst.oprs[0]);
+              for (int j = assign ? 1 : 0; j < get_operand_count (inst.op); ++j)
+                use (inst.oprs[j]);
+              if (has_extra_operands (inst.op))
+                for (int j = 0; j < inst.extra.count; ++j)
+                  use (inst.extra.oprs[j]);
+            }
+            break;
+          }
+      }
+  }
+
+  void
+  x86_64_translator::select_block (size_t idx, live_analysis& la)
+  {
+    auto& blk = *this->layout[idx];
+    auto next = (idx + 1 < this->layout.size ()) ? this->layout[idx + 1] : nullptr;
+
+    this->asem->mark_label (this->get_block_label (&blk));
+    this->compute_live_after (blk, la);
+    this->deferred.clear ();
+
+    auto& insts = blk.get_instructions ();
+    size_t i = (idx == 0) ? this->emit_param_moves (blk) : 0;
+    while (i < insts.size ())
+      i = this->select_instruction (blk, i, next);
+
+    // fall through into the next block
+    auto last = _last_instruction (blk);
+    if (last)
+      switch (last->op)
+        {
+        case JTAC_OP_JMP:
+        case JTAC_OP_JE:
+        case JTAC_OP_JNE:
+        case JTAC_OP_JL:
+        case JTAC_OP_JLE:
+        case JTAC_OP_JG:
+        case JTAC_OP_JGE:
+        case JTAC_OP_RET:
+        case JTAC_OP_RETN:
+          return;
+
+        default:
+          break;
+        }
+
+    this->emit_phi_copies (blk, next);
+    this->emit_jump (next, next);
+  }
+
+  /*!
+     \brief Selects instructions for the tile starting at instruction I.
+
+     Tiles extend over the instructions that follow when they can: a
+     comparison takes the conditional branch that uses its result, and a
+     definition of a spilled variable takes the store that follows it.
+     Loads of spilled variables that are used only once are not emitted at
+     all; the instruction that uses the variable reads it from its slot.
+   */
+  size_t
+  x86_64_translator::select_instruction (const basic_block& blk, size_t i,
+                                         const basic_block *next)
+  {
+    auto& insts = blk.get_instructions ();
+    auto& inst = insts[i];
+    switch (inst.op)
+      {
+      case JTAC_SOP_ASSIGN_PHI:
+        // eliminated by copies in the predecessors
+        return i + 1;
+
+      case JTAC_SOP_LOAD:
+        {
+          auto var = inst.oprs[0].val.var.get_id ();
+          if (this->can_defer_load (blk, i))
+            this->deferred[var] = this->get_slot_disp (var);
+          else
+            this->asem->emit<M::mov> (this->get_reg (var),
+                                      _frame_mem (this->get_slot_disp (var)));
+        }
+        return i + 1;
+
+      case JTAC_SOP_STORE:
+        {
+          auto var = inst.oprs[0].val.var.get_id ();
+          this->asem->emit<M::mov> (_frame_mem (this->get_slot_disp (var)),
+                                    this->get_reg (var));
+        }
+        return i + 1;
+
+      case JTAC_SOP_UNLOAD:
+        this->deferred.erase (inst.oprs[0].val.var.get_id ());
+        return i + 1;
+
+      case JTAC_OP_ASSIGN:
+        {
+          bool store = _is_store_of (insts, i + 1, inst.oprs[0]);
+          this->select_assign (inst, store);
+          return store ? i + 2 : i + 1;
+        }
+
+      case JTAC_OP_ASSIGN_ADD:
+      case JTAC_OP_ASSIGN_SUB:
+      case JTAC_OP_ASSIGN_MUL:
+        {
+          bool store = _is_store_of (insts, i + 1, inst.oprs[0]);
+          return this->select_arith (inst, store) ? i + 2 : i + 1;
+        }
+
+      case JTAC_OP_ASSIGN_DIV:
+      case JTAC_OP_ASSIGN_MOD:
+        this->select_div (inst, this->live_after[i]);
+        return i + 1;
+
+      case JTAC_OP_CALL:
+      case JTAC_OP_ASSIGN_CALL:
+        this->select_call (inst, this->live_after[i]);
+        return i + 1;
+
+      case JTAC_OP_CMP:
+        {
+          // fuse with the branch that follows
+          size_t j = i + 1;
+          while (j < insts.size () && insts[j].op == JTAC_SOP_UNLOAD)
+            ++ j;
+          if (j < insts.size () && _is_jcc (insts[j].op))
+            {
+              this->select_cmp (blk, inst, &insts[j], next);
+              for (size_t k = i + 1; k < j; ++k)
+                this->deferred.erase (insts[k].oprs[0].val.var.get_id ());
+              return j + 1;
+            }
+
+          this->select_cmp (blk, inst, nullptr, next);
+        }
+        return i + 1;
+
+      case JTAC_OP_JMP:
+      case JTAC_OP_JE:
+      case JTAC_OP_JNE:
+      case JTAC_OP_JL:
+      case JTAC_OP_JLE:
+      case JTAC_OP_JG:
+      case JTAC_OP_JGE:
+        this->select_branch (blk, inst.op, inst.oprs[0], next);
+        return i + 1;
+
+      case JTAC_OP_RET:
+        this->emit_move (reg_t (x86_64::REG_RAX), this->get_operand (inst.oprs[0]));
+        this->emit_epilogue ();
+        return i + 1;
+
+      case JTAC_OP_RETN:
+        this->emit_epilogue ();
+        return i + 1;
+
+      case JTAC_OP_UNDEF:
+        break;
+      }
+
+    throw std::runtime_error ("x86_64_translator: unsupported instruction");
+  }
+
+  //! \brief Checks whether the variable loaded by the instruction at I
+  //!        can be read from memory by the instruction that uses it.
+  bool
+  x86_64_translator::can_defer_load (const basic_block& blk, size_t i) const
+  {
+    auto& insts = blk.get_instructions ();
+    auto var = insts[i].oprs[0].val.var.get_id ();
+
+    // the loads of an instruction's operands come right before it
+    size_t j = i + 1;
+    while (j < insts.size () && insts[j].op == JTAC_SOP_LOAD)
+      ++ j;
+    if (j == insts.size ())
+      return false;
+
+    auto& user = insts[j];
+    if (user.op == JTAC_SOP_ASSIGN_PHI || user.op == JTAC_SOP_STORE
+        || user.op == JTAC_SOP_UNLOAD)
+      return false;
+
+    int uses = 0;
+    auto count = [&] (const jtac_tagged_operand& opr) {
+      if (opr.type == JTAC_OPR_VAR && opr.val.var.get_id () == var)
+        ++ uses;
+    };
+    for (int k = is_opcode_assign (user.op) ? 1 : 0; k < get_operand_count (user.op); ++k)
+      count (user.oprs[k]);
+    if (has_extra_operands (user.op))
+      for (int k = 0; k < user.extra.count; ++k)
+        count (user.extra.oprs[k]);
+
+    return uses == 1;
+  }
+
+  void
+  x86_64_translator::select_assign (const jtac_instruction& inst, bool store)
+  {
+    auto var = inst.oprs[0].val.var.get_id ();
+    auto src = this->get_operand (inst.oprs[1]);
+    if (store)
+      {
+        // straight into the variable's stack slot
+        auto mem = _frame_mem (this->get_slot_disp (var));
+        if (src.kind == x86_64_operand::IMM && _fits_i32 (src.imm))
+          this->asem->emit<M::mov> (mem, imm_t (src.imm));
+        else
+          this->asem->emit<M::mov> (mem, this->to_reg (src, _scratch));
+        return;
+      }
+
+    this->emit_move (this->get_reg (var), src);
+  }
+
+  /*!
+     \brief Selects instructions for an addition, subtraction or
+            multiplication.
+     \return True if the store that follows the instruction was taken as
+             well.
+   */
+  bool
+  x86_64_translator::select_arith (const jtac_instruction& inst, bool store)
+  {
+    auto& asem = *this->asem;
+    auto var = inst.oprs[0].val.var.get_id ();
+    auto a = this->get_operand (inst.oprs[1]);
+    auto b = this->get_operand (inst.oprs[2]);
+    bool commutative = inst.op != JTAC_OP_ASSIGN_SUB;
+
+    if (a.kind == x86_64_operand::IMM && b.kind == x86_64_operand::IMM)
+      {
+        uint64_t x = (uint64_t)a.imm, y = (uint64_t)b.imm;
+        uint64_t val = (inst.op == JTAC_OP_ASSIGN_ADD) ? x + y
+                       : (inst.op == JTAC_OP_ASSIGN_SUB) ? x - y : x * y;
+        this->emit_load_imm (this->get_reg (var), (int64_t)val);
+        return false;
+      }
 
+    // read-modify-write of a spilled variable: op [slot], src
+    if (store && inst.op != JTAC_OP_ASSIGN_MUL)
+      {
+        auto is_dest = [&] (const jtac_tagged_operand& opr) {
+          return opr.type == JTAC_OPR_VAR && opr.val.var.get_id () == var;
+        };
+        bool a_dest = is_dest (inst.oprs[1]);
+        if (!a_dest && commutative && is_dest (inst.oprs[2]))
+          {
+            std::swap (a, b);
+            a_dest = true;
+          }
 
+        if (a_dest && a.kind == x86_64_operand::MEM)
+          {
+            auto mem = _frame_mem (a.imm);
+            if (b.kind == x86_64_operand::MEM)
+              b = { x86_64_operand::REG, this->to_reg (b, _scratch), 0 };
+            this->fit_imm (b, _scratch);
+            if (inst.op == JTAC_OP_ASSIGN_ADD)
+              {
+                if (b.kind == x86_64_operand::IMM)
+                  asem.emit<M::add> (mem, imm_t (b.imm));
+                else
+                  asem.emit<M::add> (mem, b.reg);
+              }
+            else
+              {
+                if (b.kind == x86_64_operand::IMM)
+                  asem.emit<M::sub> (mem, imm_t (b.imm));
+                else
+                  asem.emit<M::sub> (mem, b.reg);
+              }
+            return true;
+          }
+      }
+
+    auto dest = this->get_reg (var);
+
+    // keep constants and memory operands on the right, and at most one
+    // memory operand
+    if (commutative && (a.kind == x86_64_operand::IMM
+                        || (a.kind == x86_64_operand::MEM
+                            && b.kind == x86_64_operand::REG)))
+      std::swap (a, b);
+    if (a.kind == x86_64_operand::MEM && b.kind == x86_64_operand::MEM)
+      a = { x86_64_operand::REG, this->to_reg (a, _scratch), 0 };
+
+    switch (inst.op)
+      {
+      case JTAC_OP_ASSIGN_ADD:
+      case JTAC_OP_ASSIGN_SUB:
+        {
+          bool add = inst.op == JTAC_OP_ASSIGN_ADD;
+          if (a.kind == x86_64_operand::REG && b.kind == x86_64_operand::IMM
+              && _fits_i32 (b.imm) && _fits_i32 (-b.imm))
+            {
+              int64_t disp = add ? b.imm : -b.imm;
+              if (disp == 0)
+                this->emit_move (dest, a);
+              else if (dest.code == a.reg.code)
+                asem.emit<M::add> (dest, imm_t (disp));
+              else
+                asem.emit<M::lea> (dest, mem_t (x86_64::SS_QWORD, a.reg.code, 1,
+                                                x86_64::REG_NONE, 0, disp));
+              return false;
+            }
+
+          this->fit_imm (b, _scratch);
+          if (add && a.kind == x86_64_operand::REG && b.kind == x86_64_operand::REG
+              && dest.code != a.reg.code && dest.code != b.reg.code)
+            {
+              asem.emit<M::lea> (dest, mem_t (x86_64::SS_QWORD, a.reg.code, 1,
+                                              b.reg.code));
+              return false;
+            }
+
+          if (add)
+            this->emit_binary<M::add> (dest, a, b);
+          else
+            this->emit_binary<M::sub> (dest, a, b);
+        }
+        return false;
+
+      case JTAC_OP_ASSIGN_MUL:
+        if (b.kind == x86_64_operand::IMM)
+          {
+            if (b.imm == 0)
+              {
+                this->emit_load_imm (dest, 0);
+                return false;
+              }
+            if (b.imm == 1)
+              {
+                this->emit_move (dest, a);
+                return false;
+              }
+            if (b.imm > 0 && (b.imm & (b.imm - 1)) == 0)
+              {
+                int shift = 0;
+                while ((1LL << shift) != b.imm)
+                  ++ shift;
+                this->emit_move (dest, a);
+                asem.emit<M::shl> (dest, imm_t (shift));
+                return false;
+              }
+            if (_fits_i32 (b.imm))
+              {
+                if (a.kind == x86_64_operand::REG)
+                  asem.emit<M::imul> (dest, a.reg, imm_t (b.imm));
+                else
+                  asem.emit<M::imul> (dest, _frame_mem (a.imm), imm_t (b.imm));
+                return false;
+              }
+          }
+
+        this->fit_imm (b, _scratch);
+        this->emit_binary<M::imul> (dest, a, b);
+        return false;
+
+      default:
+        break;
+      }
+
+    return false;
+  }
+
+  /*!
+     \brief Selects instructions for a division or a remainder.
+
+     The dividend goes into RAX, sign-extended into RDX. Whatever these two
+     hold that is still needed afterwards is saved on the stack around the
+     division, and a divisor found in either of them is moved out of the way
+     into the scratch register.
+   */
+  void
+  x86_64_translator::select_div (const jtac_instruction& inst, unsigned live)
+  {
+    auto& asem = *this->asem;
+    auto dest = this->get_reg (inst.oprs[0].val.var.get_id ());
+    auto a = this->get_operand (inst.oprs[1]);
+    auto b = this->get_operand (inst.oprs[2]);
+    bool mod = inst.op == JTAC_OP_ASSIGN_MOD;
+
+    if (a.kind == x86_64_operand::IMM && b.kind == x86_64_operand::IMM
+        && b.imm != 0 && !(a.imm == INT64_MIN && b.imm == -1))
+      {
+        this->emit_load_imm (dest, mod ? (a.imm % b.imm) : (a.imm / b.imm));
+        return;
+      }
+
+    const reg_t rax (x86_64::REG_RAX), rdx (x86_64::REG_RDX);
+    unsigned saved = live & ~REG_MASK(dest.code)
+                     & (REG_MASK(x86_64::REG_RAX) | REG_MASK(x86_64::REG_RDX));
+    if (saved & REG_MASK(x86_64::REG_RAX))
+      asem.emit<M::push> (rax);
+    if (saved & REG_MASK(x86_64::REG_RDX))
+      asem.emit<M::push> (rdx);
+
+    if (b.kind == x86_64_operand::IMM
+        || (b.kind == x86_64_operand::REG
+            && (b.reg.code == x86_64::REG_RAX || b.reg.code == x86_64::REG_RDX)))
+      {
+        this->emit_move (_scratch, b);
+        b = { x86_64_operand::REG, _scratch, 0 };
+      }
+
+    this->emit_move (rax, a);
+    asem.emit<M::cqo> ();
+    if (b.kind == x86_64_operand::REG)
+      asem.emit<M::idiv> (b.reg);
+    else
+      asem.emit<M::idiv> (_frame_mem (b.imm));
+
+    this->emit_move (dest, { x86_64_operand::REG, mod ? rdx : rax, 0 });
+    if (saved & REG_MASK(x86_64::REG_RDX))
+      asem.emit<M::pop> (rdx);
+    if (saved & REG_MASK(x86_64::REG_RAX))
+      asem.emit<M::pop> (rax);
+  }
+
+  /*!
+     \brief Selects instructions for a procedure call.
+
+     Caller-saved registers that hold variables live across the call are
+     pushed before the arguments are set up and popped after the result is
+     in place. Calls to named procedures are emitted as relative calls with a
+     relocation against the name; any other call target is called through
+     the scratch register.
+   */
+  void
+  x86_64_translator::select_call (const jtac_instruction& inst, unsigned live)
+  {
+    auto& asem = *this->asem;
+    bool has_dest = inst.op == JTAC_OP_ASSIGN_CALL;
+    auto& target = inst.oprs[has_dest ? 1 : 0];
+
+    unsigned saved_mask = live & _caller_saved;
+    if (has_dest)
+      saved_mask &= ~REG_MASK(this->get_reg (inst.oprs[0].val.var.get_id ()).code);
+    std::vector<reg_t> saved;
+    for (int reg : _color_regs)
+      if (saved_mask & REG_MASK(reg))
+        saved.push_back (reg_t (reg));
+
+    // the stack must be 16-byte aligned at the call
+    int num_args = inst.extra.count;
+    int num_stack = std::max (0, num_args - 6);
+    int pad = ((saved.size () + num_stack) % 2 != 0) ? 8 : 0;
+
+    for (auto reg : saved)
+      asem.emit<M::push> (reg);
+    if (pad)
+      asem.emit<M::sub> (reg_t (x86_64::REG_RSP), imm_t (pad));
+
+    // stack arguments, right to left
+    for (int i = num_args - 1; i >= 6; --i)
+      {
+        auto arg = this->get_operand (inst.extra.oprs[i]);
+        switch (arg.kind)
+          {
+          case x86_64_operand::REG:
+            asem.emit<M::push> (arg.reg);
+            break;
+
+          case x86_64_operand::MEM:
+            asem.emit<M::push> (_frame_mem (arg.imm));
+            break;
+
+          case x86_64_operand::IMM:
+            if (_fits_i32 (arg.imm))
+              asem.emit<M::push> (imm_t (arg.imm));
+            else
+              {
+                this->emit_load_imm (_scratch, arg.imm);
+                asem.emit<M::push> (_scratch);
+              }
+            break;
+          }
+      }
+
+    bool direct = target.type == JTAC_OPR_NAME;
+    if (!direct)
+      this->emit_move (_scratch, this->get_operand (target));
+
+    std::vector<x86_64_move> moves;
+    for (int i = 0; i < num_args && i < 6; ++i)
+      moves.push_back ({ reg_t (_arg_regs[i]),
+                         this->get_operand (inst.extra.oprs[i]) });
+    this->emit_parallel_copy (moves);
+
+    if (direct)
+      {
+        if (!this->names)
+          throw std::runtime_error ("x86_64_translator: no names to resolve calls with");
+        auto name = this->names->get_name (target.val.name.get_id ());
+        asem.emit<M::call> (rel_t (this->syms->get (name)));
+      }
+    else
+      asem.emit<M::call> (_scratch);
+
+    if (8 * num_stack + pad > 0)
+      asem.emit<M::add> (reg_t (x86_64::REG_RSP), imm_t (8 * num_stack + pad));
+
+    if (has_dest)
+      this->emit_move (this->get_reg (inst.oprs[0].val.var.get_id ()),
+                       { x86_64_operand::REG, reg_t (x86_64::REG_RAX), 0 });
+    for (auto itr = saved.rbegin (); itr != saved.rend (); ++itr)
+      asem.emit<M::pop> (*itr);
+  }
+
+  /*!
+     \brief Selects instructions for a comparison, and for the conditional
+            branch JCC that uses its result (if not null).
+
+     Comparisons with a constant on the left are turned around when the
+     branch is known, and those of two constants decide the branch at
+     compile time.
+   */
+  void
+  x86_64_translator::select_cmp (const basic_block& blk,
+                                 const jtac_instruction& inst,
+                                 const jtac_instruction *jcc,
+                                 const basic_block *next)
+  {
+    auto& asem = *this->asem;
+    auto a = this->get_operand (inst.oprs[0]);
+    auto b = this->get_operand (inst.oprs[1]);
+    jtac_opcode cond = jcc ? jcc->op : JTAC_OP_UNDEF;
+
+    if (a.kind == x86_64_operand::IMM && b.kind == x86_64_operand::IMM)
+      {
+        if (jcc)
+          {
+            auto to = _eval_cond (cond, a.imm, b.imm)
+                      ? this->get_target (jcc->oprs[0]) : next;
+            this->emit_phi_copies (blk, to);
+            this->emit_jump (to, next);
+            return;
+          }
+
+        // comparing the sign of a - b to zero sets the flags of the signed
+        // conditions the same way
+        this->emit_load_imm (_scratch, (a.imm < b.imm) ? -1 : (a.imm > b.imm) ? 1 : 0);
+        asem.emit<M::cmp> (_scratch, imm_t (0));
+        return;
+      }
+
+    if (a.kind == x86_64_operand::IMM)
+      {
+        if (jcc)
+          {
+            std::swap (a, b);
+            cond = _swap_cond (cond);
+          }
+        else
+          a = { x86_64_operand::REG, this->to_reg (a, _scratch), 0 };
+      }
+    if (a.kind == x86_64_operand::MEM && b.kind == x86_64_operand::MEM)
+      b = { x86_64_operand::REG, this->to_reg (b, _scratch), 0 };
+    this->fit_imm (b, _scratch);
+
+    if (a.kind == x86_64_operand::REG)
+      this->emit_op<M::cmp> (a.reg, b);
+    else if (b.kind == x86_64_operand::REG)
+      asem.emit<M::cmp> (_frame_mem (a.imm), b.reg);
+    else
+      asem.emit<M::cmp> (_frame_mem (a.imm), imm_t (b.imm));
+
+    if (jcc)
+      this->select_branch (blk, cond, jcc->oprs[0], next);
+  }
+
+  void
+  x86_64_translator::select_branch (const basic_block& blk, jtac_opcode op,
+                                    const jtac_tagged_operand& target,
+                                    const basic_block *next)
+  {
+    auto to = this->get_target (target);
+    if (op == JTAC_OP_JMP || to == next)
+      {
+        this->emit_phi_copies (blk, to);
+        this->emit_jump (to, next);
+        return;
+      }
+
+    // taken, or fall through into the next block
+    this->emit_jcc (op, this->get_edge_label (blk, to));
+    this->emit_phi_copies (blk, next);
+    this->emit_jump (next, next);
+  }
+
+  void
+  x86_64_translator::emit_jcc (jtac_opcode op, x86_64::label_id lbl)
+  {
+    auto& asem = *this->asem;
+    switch (op)
+      {
+      case JTAC_OP_JE: asem.emit<M::je> (lbl_t (lbl)); break;
+      case JTAC_OP_JNE: asem.emit<M::jne> (lbl_t (lbl)); break;
+      case JTAC_OP_JL: asem.emit<M::jl> (lbl_t (lbl)); break;
+      case JTAC_OP_JLE: asem.emit<M::jle> (lbl_t (lbl)); break;
+      case JTAC_OP_JG: asem.emit<M::jg> (lbl_t (lbl)); break;
+      case JTAC_OP_JGE: asem.emit<M::jge> (lbl_t (lbl)); break;
+
+      default:
+        throw std::runtime_error ("x86_64_translator: not a conditional branch");
+      }
+  }
+
+  //! \brief Emits a jump to the specified block (null is the exit).
+  void
+  x86_64_translator::emit_jump (const basic_block *blk, const basic_block *next)
+  {
+    if (blk == next)
+      {
+        // the exit comes right after the last block
+        if (!blk)
+          this->has_exit = true;
+        return;
+      }
+
+    this->asem->emit<M::jmp> (lbl_t (this->get_block_label (blk)));
+  }
+
+  /*!
+     \brief Returns the label that a branch from one block to another should
+            target, going through a stub if phi copies are needed.
+   */
+  x86_64::label_id
+  x86_64_translator::get_edge_label (const basic_block& from,
+                                     const basic_block *to)
+  {
+    std::vector<x86_64_move> moves;
+    this->collect_phi_copies (from, to, moves);
+    if (moves.empty ())
+      return this->get_block_label (to);
+
+    auto lbl = this->asem->make_label ();
+    this->stubs.push_back ({ lbl, &from, to });
+    return lbl;
+  }
+
+  //! \brief Emits the phi copies of the edge between the specified blocks.
+  void
+  x86_64_translator::emit_phi_copies (const basic_block& from,
+                                      const basic_block *to)
+  {
+    std::vector<x86_64_move> moves;
+    this->collect_phi_copies (from, to, moves);
+    this->emit_parallel_copy (moves);
+  }
+
+  void
+  x86_64_translator::collect_phi_copies (const basic_block& from,
+                                         const basic_block *to,
+                                         std::vector<x86_64_move>& moves)
+  {
+    if (!to)
+      return;
+
+    // phi operands are in the order of the block's predecessors
+    auto& prev = to->get_prev ();
+    int idx = -1;
+    for (size_t i = 0; i < prev.size (); ++i)
+      if (prev[i].get () == &from)
+        {
+          idx = (int)i;
+          break;
+        }
+    if (idx == -1)
+      return;
+
+    for (auto& inst : to->get_instructions ())
+      {
+        if (inst.op != JTAC_SOP_ASSIGN_PHI || idx >= inst.extra.count)
+          continue;
+
+        auto& opr = inst.extra.oprs[idx];
+        if (opr.type == JTAC_OPR_VAR
+            && !this->reg_res->has_color (opr.val.var.get_id ()))
+          continue; // undefined along this edge
+
+        auto dest = this->get_reg (inst.oprs[0].val.var.get_id ());
+        auto src = this->get_operand (opr);
+        if (src.kind == x86_64_operand::REG && src.reg.code == dest.code)
+          continue;
+        moves.push_back ({ dest, src });
+      }
+  }
+
+  /*!
+     \brief Performs the specified moves as if all at once.
+
+     Register moves go first, each one as soon as no other move still needs
+     to read its destination. What remains after that are cycles, which are
+     broken up with exchanges. Constants and memory operands, which read no
+     registers, are loaded last.
+   */
+  void
+  x86_64_translator::emit_parallel_copy (std::vector<x86_64_move>& moves)
+  {
+    std::vector<x86_64_move> regs, others;
+    for (auto& m : moves)
+      if (m.src.kind != x86_64_operand::REG)
+        others.push_back (m);
+      else if (m.src.reg.code != m.dest.code)
+        regs.push_back (m);
+
+    while (!regs.empty ())
+      {
+        bool progress = false;
+        for (size_t i = 0; i < regs.size (); )
+          {
+            bool read = false;
+            for (auto& m : regs)
+              if (m.src.reg.code == regs[i].dest.code)
+                {
+                  read = true;
+                  break;
+                }
+            if (read)
+              {
+                ++ i;
+                continue;
+              }
+
+            this->asem->emit<M::mov> (regs[i].dest, regs[i].src.reg);
+            regs.erase (regs.begin () + i);
+            progress = true;
+          }
+        if (progress)
+          continue;
+
+        auto m = regs.back ();
+        regs.pop_back ();
+        this->asem->emit<M::xchg> (m.dest, m.src.reg);
+        for (auto& r : regs)
+          {
+            if (r.src.reg.code == m.dest.code)
+              r.src.reg = m.src.reg;
+            else if (r.src.reg.code == m.src.reg.code)
+              r.src.reg = m.dest;
+          }
+        regs.erase (std::remove_if (regs.begin (), regs.end (),
+                                    [] (const x86_64_move& r) {
+                                      return r.src.reg.code == r.dest.code;
+                                    }),
+                    regs.end ());
+      }
+
+    for (auto& m : others)
+      this->emit_move (m.dest, m.src);
+  }
+
+
+
+  reg_t
+  x86_64_translator::get_reg (jtac_var_id var) const
+  {
+    auto col = this->reg_res->get_color (var);
+    if (col < 0 || col >= X86_64_NUM_GP_REGISTERS)
+      throw std::runtime_error ("x86_64_translator: invalid register color");
+    return reg_t (_color_regs[col]);
+  }
+
+  int64_t
+  x86_64_translator::get_slot_disp (jtac_var_id var) const
+  {
+    auto itr = this->slots.find (var_base (var));
+    if (itr == this->slots.end ())
+      throw std::runtime_error ("x86_64_translator: variable has no stack slot");
+    return -8 * (int64_t)(this->saved_regs.size () + 1 + itr->second);
+  }
+
+  x86_64_translator::x86_64_operand
+  x86_64_translator::get_operand (const jtac_tagged_operand& opr) const
+  {
+    switch (opr.type)
+      {
+      case JTAC_OPR_CONST:
+        return { x86_64_operand::IMM, reg_t (), opr.val.konst.get_value () };
+
+      case JTAC_OPR_VAR:
+        {
+          auto var = opr.val.var.get_id ();
+          auto itr = this->deferred.find (var);
+          if (itr != this->deferred.end ())
+            return { x86_64_operand::MEM, this->get_reg (var), itr->second };
+          return { x86_64_operand::REG, this->get_reg (var), 0 };
+        }
+
+      default:
+        throw std::runtime_error ("x86_64_translator: unsupported operand");
+      }
+  }
+
+  //! \brief Returns the block a branch goes to, or null for the exit.
+  const basic_block*
+  x86_64_translator::get_target (const jtac_tagged_operand& opr) const
+  {
+    if (opr.type != JTAC_OPR_BLOCK_REF)
+      return nullptr; // past the end of the procedure
+    return this->cfg->find_block (opr.val.blk.get_id ()).get ();
+  }
+
+  x86_64::label_id
+  x86_64_translator::get_block_label (const basic_block *blk)
+  {
+    if (!blk)
+      {
+        this->has_exit = true;
+        return this->lbl_exit;
+      }
+    return this->blk_lbls.at (blk->get_id ());
+  }
+
+  reg_t
+  x86_64_translator::to_reg (const x86_64_operand& opr, reg_t scratch)
+  {
+    switch (opr.kind)
+      {
+      case x86_64_operand::REG:
+        return opr.reg;
+
+      case x86_64_operand::IMM:
+        this->emit_load_imm (scratch, opr.imm);
+        return scratch;
+
+      case x86_64_operand::MEM:
+        this->asem->emit<M::mov> (opr.reg, _frame_mem (opr.imm));
+        return opr.reg;
+      }
+
+    return scratch;
+  }
+
+  void
+  x86_64_translator::fit_imm (x86_64_operand& opr, reg_t scratch)
+  {
+    if (opr.kind == x86_64_operand::IMM && !_fits_i32 (opr.imm))
+      opr = { x86_64_operand::REG, this->to_reg (opr, scratch), 0 };
+  }
+
+  void
+  x86_64_translator::emit_move (reg_t dest, const x86_64_operand& src)
+  {
+    switch (src.kind)
+      {
+      case x86_64_operand::REG:
+        if (src.reg.code != dest.code)
+          this->asem->emit<M::mov> (dest, src.reg);
+        break;
+
+      case x86_64_operand::IMM:
+        this->emit_load_imm (dest, src.imm);
+        break;
+
+      case x86_64_operand::MEM:
+        this->asem->emit<M::mov> (dest, _frame_mem (src.imm));
+        break;
+      }
+  }
+
+  void
+  x86_64_translator::emit_load_imm (reg_t dest, int64_t val)
+  {
+    // writes to 32-bit registers zero the upper half
+    if (val == 0)
+      this->asem->emit<M::xor_> (_reg32 (dest), _reg32 (dest));
+    else if (val > 0 && val <= 0xFFFFFFFFLL)
+      this->asem->emit<M::mov> (_reg32 (dest), imm_t (val));
+    else
+      this->asem->emit<M::mov> (dest, imm_t (val));
+  }
+
+  template<M Op>
+  void
+  x86_64_translator::emit_op (reg_t dest, const x86_64_operand& src)
+  {
+    switch (src.kind)
+      {
+      case x86_64_operand::REG:
+        this->asem->emit<Op> (dest, src.reg);
+        break;
+
+      case x86_64_operand::IMM:
+        _emit_ri<Op> (*this->asem, dest, src.imm);
+        break;
+
+      case x86_64_operand::MEM:
+        this->asem->emit<Op> (dest, _frame_mem (src.imm));
+        break;
+      }
+  }
+
+  /*!
+     \brief Emits "dest = a M b" in two-address form.
+
+     B must not be a constant that does not fit in 32 bits. If DEST is the
+     register of B, the operands of a commutative operation are swapped;
+     subtraction (the only operation that is not) negates B in place and
+     adds A to it.
+   */
+  template<M Op>
+  void
+  x86_64_translator::emit_binary (reg_t dest, x86_64_operand a,
+                                  x86_64_operand b)
+  {
+    if (b.kind == x86_64_operand::REG && b.reg.code == dest.code
+        && !(a.kind == x86_64_operand::REG && a.reg.code == dest.code))
+      {
+        this->fit_imm (a, _scratch);
+        if (Op == M::sub)
+          {
+            this->asem->emit<M::neg> (dest);
+            this->emit_op<M::add> (dest, a);
+          }
+        else
+          this->emit_op<Op> (dest, a);
+        return;
+      }
 
-    x86_64_procedure xproc {};
-    return xproc;
+    this->emit_move (dest, a);
+    this->emit_op<Op> (dest, b);
   }
 }
 }
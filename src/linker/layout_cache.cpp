@@ -0,0 +1,154 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "linker/layout_cache.hpp"
+#include "common/binary.hpp"
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+
+
+namespace jcc {
+
+  // "JLC" followed by the format version
+  static const uint32_t _cache_magic = 0x02434c4a;
+
+  link_layout_cache::link_layout_cache ()
+  {
+    this->interface_hash = 0;
+  }
+
+
+
+  //! \brief Forgets the cached layout.
+  void
+  link_layout_cache::clear ()
+  {
+    this->slots.clear ();
+    this->syms.clear ();
+    this->sites.clear ();
+    this->interface_hash = 0;
+  }
+
+
+
+  static void
+  _write_string (std::ostream& strm, const std::string& str)
+  {
+    bin::write_u32_le (strm, (uint32_t)str.size ());
+    strm.write (str.data (), (std::streamsize)str.size ());
+  }
+
+  static std::string
+  _read_string (std::istream& strm)
+  {
+    uint32_t len = bin::read_u32_le (strm);
+    if (!strm)
+      return std::string ();
+
+    std::string str (len, '\0');
+    strm.read (&str[0], (std::streamsize)str.size ());
+    return str;
+  }
+
+  //! \brief Writes the cache into the specified stream.
+  void
+  link_layout_cache::save (std::ostream& strm) const
+  {
+    bin::write_u32_le (strm, _cache_magic);
+    bin::write_u64_le (strm, this->interface_hash);
+
+    bin::write_u32_le (strm, (uint32_t)this->slots.size ());
+    for (auto& s : this->slots)
+      {
+        _write_string (strm, s.name);
+        bin::write_u32_le (strm, (uint32_t)s.type);
+        bin::write_u64_le (strm, s.off);
+        bin::write_u64_le (strm, s.size);
+        bin::write_u64_le (strm, s.capacity);
+        bin::write_u64_le (strm, s.hash);
+      }
+
+    bin::write_u32_le (strm, (uint32_t)this->syms.size ());
+    for (auto& p : this->syms)
+      {
+        _write_string (strm, p.first);
+        _write_string (strm, p.second.sect);
+        bin::write_u64_le (strm, p.second.off);
+      }
+
+    bin::write_u32_le (strm, (uint32_t)this->sites.size ());
+    for (auto& site : this->sites)
+      {
+        bin::write_u64_le (strm, site.slot);
+        bin::write_u64_le (strm, site.off);
+        bin::write_u32_le (strm, site.size);
+        _write_string (strm, site.sym);
+      }
+  }
+
+  //! \brief Reads a cache previously written with save().
+  void
+  link_layout_cache::load (std::istream& strm)
+  {
+    this->clear ();
+    if (bin::read_u32_le (strm) != _cache_magic)
+      throw std::runtime_error ("link_layout_cache::load: not a layout cache");
+    this->interface_hash = bin::read_u64_le (strm);
+
+    uint32_t count = bin::read_u32_le (strm);
+    for (uint32_t i = 0; i < count && strm; ++i)
+      {
+        slot s;
+        s.name = _read_string (strm);
+        s.type = (int)bin::read_u32_le (strm);
+        s.off = (size_t)bin::read_u64_le (strm);
+        s.size = (size_t)bin::read_u64_le (strm);
+        s.capacity = (size_t)bin::read_u64_le (strm);
+        s.hash = bin::read_u64_le (strm);
+        this->slots.push_back (std::move (s));
+      }
+
+    count = bin::read_u32_le (strm);
+    for (uint32_t i = 0; i < count && strm; ++i)
+      {
+        auto name = _read_string (strm);
+        symbol_location loc;
+        loc.sect = _read_string (strm);
+        loc.off = (size_t)bin::read_u64_le (strm);
+        this->syms[name] = loc;
+      }
+
+    count = bin::read_u32_le (strm);
+    for (uint32_t i = 0; i < count && strm; ++i)
+      {
+        reloc_site site;
+        site.slot = (size_t)bin::read_u64_le (strm);
+        site.off = (size_t)bin::read_u64_le (strm);
+        site.size = bin::read_u32_le (strm);
+        site.sym = _read_string (strm);
+        this->sites.push_back (std::move (site));
+      }
+
+    if (!strm)
+      {
+        this->clear ();
+        throw std::runtime_error ("link_layout_cache::load: truncated cache");
+      }
+  }
+}
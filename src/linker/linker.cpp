@@ -17,14 +17,29 @@
  */
 
 #include "linker/linker.hpp"
+#include "common/binary.hpp"
+#include <cstring>
+#include <algorithm>
+#include <unordered_set>
+#include <map>
 
 
 namespace jcc {
 
-  linker::linker ()
+  linker::linker (unsigned num_threads)
   {
     this->out = nullptr;
+    this->cache = nullptr;
+    this->layout_reused = false;
+    this->gc = false;
+    this->gc_sects = 0;
+    this->gc_bytes = 0;
+    this->icf = icf_mode::none;
+    this->icf_bytes = 0;
+    this->profile = nullptr;
     this->rstore = std::make_shared<relocation_symbol_store> ();
+    if (num_threads != 1)
+      this->pool.reset (new thread_pool (num_threads));
   }
 
   linker::~linker ()
@@ -41,6 +56,54 @@ namespace jcc {
     this->mods.push_back (&mod);
   }
 
+  /*!
+     \brief Enables incremental mode.
+
+     The cache holds the layout of the previous link (if any), and is
+     updated with the new layout by every call to link().
+   */
+  void
+  linker::set_layout_cache (link_layout_cache *cache)
+  {
+    this->cache = cache;
+  }
+
+  //! \brief Enables or disables removal of unreferenced sections.
+  void
+  linker::set_gc_sections (bool enable)
+  {
+    this->gc = enable;
+  }
+
+  /*!
+     \brief Treats the section that defines the specified symbol as
+            referenced when removing unreferenced sections.
+   */
+  void
+  linker::keep_symbol (const std::string& name)
+  {
+    this->gc_roots.push_back (name);
+  }
+
+  //! \brief Sets which code sections identical code folding may merge.
+  void
+  linker::set_icf_mode (icf_mode mode)
+  {
+    this->icf = mode;
+  }
+
+  /*!
+     \brief Orders code sections in the output by the specified profile.
+
+     The profile must outlive calls to link(). A null profile keeps code
+     sections in input order.
+   */
+  void
+  linker::set_profile (const link_profile *profile)
+  {
+    this->profile = profile;
+  }
+
 
 
   /*!
@@ -49,11 +112,21 @@ namespace jcc {
   std::shared_ptr<generic_module>
   linker::link ()
   {
+    this->dirty.clear ();
+    this->build_symbol_table ();
     this->main = &this->find_main_module ();
     this->out = new generic_module (module_type::executable, this->main->get_target_architecture ());
 
+    this->out->set_relocation_store (this->rstore);
+
     this->add_sections ();
 
+    auto entry = this->main->get_entry_point ();
+    auto itr = this->placements.find (entry.sect);
+    if (itr != this->placements.end ())
+      this->out->set_entry_point (
+          module_location (itr->second.sect, itr->second.off + entry.off));
+
     auto ptr = std::shared_ptr<generic_module> (this->out);
     this->out = nullptr;
     return ptr;
@@ -72,84 +145,902 @@ namespace jcc {
     throw link_error ("could not find a module containing the program's entry point");
   }
 
-  //! \brief Finds the input module that contains the specified export symbol name.
-  generic_module&
-  linker::find_module_containing_export (const std::string& name)
+  //! \brief Builds the global symbol table from the input modules' exports.
+  void
+  linker::build_symbol_table ()
   {
-    generic_module *cmod = nullptr;
+    this->globals.clear ();
     for (auto mod : this->mods)
-      if (mod->has_export_symbol (name))
+      for (auto& exp : mod->get_export_symbols ())
         {
-          if (cmod)
-            throw link_error ("symbol ambiguity: " + name);
-          cmod = mod;
+          auto res = this->globals.emplace (exp.name,
+                                            global_symbol { mod, &exp, false });
+          if (res.second)
+            continue;
+
+          auto& gsym = res.first->second;
+          if (gsym.mod == mod)
+            gsym.exp = &exp; // the last definition in a module wins
+          else
+            gsym.ambiguous = true; // only an error if a relocation refers to it
         }
+  }
 
-    if (!cmod)
+  //! \brief Looks up the global symbol with the specified name.
+  const linker::global_symbol&
+  linker::find_global_symbol (const std::string& name)
+  {
+    auto itr = this->globals.find (name);
+    if (itr == this->globals.end ())
       throw link_error ("could not find module containing symbol: " + name);
-    return *cmod;
+    if (itr->second.ambiguous)
+      throw link_error ("symbol ambiguity: " + name);
+    return itr->second;
   }
 
 
 
+  // alignment of input sections within output sections
+  static const size_t _code_alignment = 16;
+  static const size_t _data_alignment = 8;
+  static const unsigned char _code_fill = 0x90; // nop
+
   //! \brief Constructs the output module's sections.
   void
   linker::add_sections ()
   {
+    std::vector<const section *> in_sects;
     for (auto mod : this->mods)
       {
         if (mod->get_type () != module_type::relocatable)
           continue;
 
         for (auto sect : mod->get_sections ())
-          this->add_section (*sect);
+          in_sects.push_back (sect);
+      }
+
+    this->gc_sects = 0;
+    this->gc_bytes = 0;
+    if (this->gc)
+      this->collect_sections (in_sects);
+
+    this->folded.clear ();
+    this->icf_bytes = 0;
+    if (this->icf != icf_mode::none)
+      this->fold_sections (in_sects);
+
+    if (this->profile && !this->profile->empty ())
+      this->order_sections (in_sects);
+
+    this->place_sections (in_sects);
+
+    // folded sections share the placement of the section that replaced them
+    for (auto& p : this->folded)
+      {
+        auto place = this->placements.at (p.second);
+        this->placements[p.first] = place;
       }
+
+    // every input section has its own range of bytes in the output, and
+    // symbols are only looked up, so sections are prepared independently.
+    std::vector<prepared_section> preps (in_sects.size ());
+    this->for_each_index (in_sects.size (), [&] (size_t i) {
+      preps[i].in = in_sects[i];
+      try
+        {
+          this->prepare_section (preps[i]);
+        }
+      catch (...)
+        {
+          // rethrown in input order by add_relocations ()
+          preps[i].error = std::current_exception ();
+        }
+    });
+
+    for (auto& prep : preps)
+      this->add_relocations (prep);
+
+    if (this->cache)
+      this->update_layout_cache (preps);
   }
 
-  //! \brief Inserts the specified section into the output module.
+
+
+  //! \brief Removes input sections that are not reachable from the entry
+  //!        point or from kept symbols.
   void
-  linker::add_section (section& sect)
+  linker::collect_sections (std::vector<const section *>& in_sects)
   {
-    switch (sect.get_type ())
+    std::unordered_set<const section *> live;
+    std::vector<const section *> work;
+    auto mark = [&] (const global_symbol& gsym) {
+      if (gsym.mod->get_type () == module_type::relocatable
+          && live.insert (gsym.exp->sect).second)
+        work.push_back (gsym.exp->sect);
+    };
+
+    auto entry = this->main->get_entry_point ().sect;
+    if (entry && live.insert (entry).second)
+      work.push_back (entry);
+    for (auto& name : this->gc_roots)
+      mark (this->find_global_symbol (name));
+
+    while (!work.empty ())
       {
-      case SECT_PROGBITS:
-        throw std::runtime_error ("linker::add_section: PROGBITS section not handled");
+        auto sect = work.back ();
+        work.pop_back ();
+        if (sect->get_type () != SECT_CODE)
+          continue;
 
-      case SECT_CODE:
-        this->add_code_section (static_cast<code_section&> (sect));
-        break;
+        for (auto& reloc : static_cast<const code_section *> (sect)->get_relocations ())
+          {
+            // unresolved references are only an error in live sections, and
+            // are reported when the section is prepared.
+            auto itr = this->globals.find (reloc.sym.store->get_name (reloc.sym.id));
+            if (itr != this->globals.end () && !itr->second.ambiguous)
+              mark (itr->second);
+          }
       }
+
+    size_t j = 0;
+    for (auto sect : in_sects)
+      {
+        if (live.count (sect))
+          {
+            in_sects[j++] = sect;
+            continue;
+          }
+
+        ++ this->gc_sects;
+        this->gc_bytes += static_cast<const progbits_section *> (sect)->get_data ().size ();
+      }
+    in_sects.resize (j);
   }
 
-  void
-  linker::add_code_section (code_section& sect_in)
+
+
+  /*!
+     \brief Checks whether the relocated field at the specified offset of a
+            code section is the operand of a direct call or jump.
+
+     This only looks at the opcode bytes that precede the field (call rel32,
+     jmp rel32 and jcc rel32), so it can mistake other references for
+     branches only if their encoding happens to end with the same bytes.
+   */
+  static bool
+  _is_branch_operand (const unsigned char *code, size_t off)
   {
-    if (this->out->find_section (sect_in.get_name ()))
-      throw std::runtime_error ("linker::add_code_section: attempting to add section with same name twice");
+    if (off >= 1 && (code[off - 1] == 0xE8 || code[off - 1] == 0xE9))
+      return true;
+    return off >= 2 && code[off - 2] == 0x0F && (code[off - 1] & 0xF0) == 0x80;
+  }
 
-    this->out->add_section (code_section (sect_in));
-    code_section& sect = static_cast<code_section&> (
-        *this->out->find_section (sect_in.get_name ()));
+  //! \brief Hashes the contents and relocations of a code section, leaving
+  //!        out the symbols that relocations refer to.
+  static uint64_t
+  _hash_code_body (const code_section& sect)
+  {
+    // FNV-1a
+    uint64_t h = 14695981039346656037ULL;
+    auto mix = [&h] (const void *data, size_t len) {
+      auto ptr = (const unsigned char *)data;
+      for (size_t i = 0; i < len; ++i)
+        h = (h ^ ptr[i]) * 1099511628211ULL;
+    };
 
-    // handle relocations
+    auto& data = sect.get_data ();
+    mix (data.data (), data.size ());
+    mix (sect.get_name ().c_str (), sect.get_name ().size () + 1);
     for (auto& reloc : sect.get_relocations ())
       {
+        uint64_t fields[] = { (uint64_t)reloc.type, (uint64_t)reloc.offset,
+                              (uint64_t)reloc.size, (uint64_t)(int64_t)reloc.add };
+        mix (fields, sizeof fields);
+      }
+
+    return h;
+  }
+
+  //! \brief Checks whether two code sections are equal, up to the symbols
+  //!        that their relocations refer to.
+  static bool
+  _same_code_body (const code_section& a, const code_section& b)
+  {
+    if (a.get_name () != b.get_name ())
+      return false;
+
+    auto& da = a.get_data ();
+    auto& db = b.get_data ();
+    if (da.size () != db.size ()
+        || (da.size () > 0 && std::memcmp (da.data (), db.data (), da.size ()) != 0))
+      return false;
+
+    auto& ra = a.get_relocations ();
+    auto& rb = b.get_relocations ();
+    if (ra.size () != rb.size ())
+      return false;
+    for (size_t i = 0; i < ra.size (); ++i)
+      if (ra[i].type != rb[i].type || ra[i].offset != rb[i].offset
+          || ra[i].size != rb[i].size || ra[i].add != rb[i].add)
+        return false;
+
+    return true;
+  }
+
+  /*!
+     \brief Removes duplicate code sections, remembering which section
+            replaces each of them.
+
+     Sections are first grouped by their contents and relocation fields, and
+     the groups are then split until the relocations of every section in a
+     group refer to the same symbols, or to the same offsets in sections of
+     the same group. This lets mutually recursive procedures fold too.
+   */
+  void
+  linker::fold_sections (std::vector<const section *>& in_sects)
+  {
+    auto resolve = [this] (const relocation& reloc) -> const global_symbol * {
+      auto itr = this->globals.find (reloc.sym.store->get_name (reloc.sym.id));
+      if (itr == this->globals.end () || itr->second.ambiguous)
+        return nullptr;
+      return &itr->second;
+    };
+
+    std::unordered_set<const section *> pinned;
+    if (this->icf == icf_mode::safe)
+      {
+        for (auto& name : this->gc_roots)
+          {
+            auto itr = this->globals.find (name);
+            if (itr != this->globals.end ())
+              pinned.insert (itr->second.exp->sect);
+          }
+
+        for (auto sect : in_sects)
+          {
+            if (sect->get_type () != SECT_CODE)
+              continue;
+
+            auto& code = static_cast<const code_section&> (*sect);
+            for (auto& reloc : code.get_relocations ())
+              {
+                auto gsym = resolve (reloc);
+                if (gsym && !_is_branch_operand (code.get_data ().data (), reloc.offset))
+                  pinned.insert (gsym->exp->sect);
+              }
+          }
+      }
+
+    // sections whose relocations do not all resolve are left alone; the
+    // error is reported when they are prepared.
+    std::vector<const code_section *> cands;
+    std::vector<std::vector<const global_symbol *>> targets;
+    std::unordered_map<const section *, size_t> cand_index;
+    for (auto sect : in_sects)
+      {
+        if (sect->get_type () != SECT_CODE || pinned.count (sect))
+          continue;
+
+        auto& code = static_cast<const code_section&> (*sect);
+        std::vector<const global_symbol *> syms;
+        for (auto& reloc : code.get_relocations ())
+          {
+            auto gsym = resolve (reloc);
+            if (!gsym)
+              break;
+            syms.push_back (gsym);
+          }
+        if (syms.size () != code.get_relocations ().size ())
+          continue;
+
+        cand_index[sect] = cands.size ();
+        cands.push_back (&code);
+        targets.push_back (std::move (syms));
+      }
+
+    // initial groups, by contents
+    std::vector<size_t> cls (cands.size ());
+    size_t num_cls = 0;
+    {
+      std::unordered_map<uint64_t, std::vector<size_t>> buckets; // by hash, to first member of groups
+      for (size_t i = 0; i < cands.size (); ++i)
+        {
+          auto& firsts = buckets[_hash_code_body (*cands[i])];
+          auto itr = std::find_if (firsts.begin (), firsts.end (), [&] (size_t j) {
+            return _same_code_body (*cands[i], *cands[j]);
+          });
+
+          if (itr != firsts.end ())
+            cls[i] = cls[*itr];
+          else
+            {
+              cls[i] = num_cls ++;
+              firsts.push_back (i);
+            }
+        }
+    }
+
+    // split groups by relocation targets until nothing changes
+    for (;;)
+      {
+        std::map<std::vector<int64_t>, size_t> keys;
+        std::vector<size_t> next (cands.size ());
+        for (size_t i = 0; i < cands.size (); ++i)
+          {
+            std::vector<int64_t> key { (int64_t)cls[i] };
+            for (auto gsym : targets[i])
+              {
+                auto itr = cand_index.find (gsym->exp->sect);
+                if (gsym->mod->get_type () == module_type::relocatable
+                    && itr != cand_index.end ())
+                  {
+                    auto in = static_cast<const progbits_section *> (gsym->exp->sect);
+                    key.push_back ((int64_t)cls[itr->second]);
+                    key.push_back ((int64_t)(gsym->exp->vaddr - in->get_vaddr ()));
+                  }
+                else
+                  {
+                    key.push_back (-1);
+                    key.push_back ((int64_t)(uintptr_t)gsym);
+                  }
+              }
+
+            next[i] = keys.emplace (std::move (key), keys.size ()).first->second;
+          }
+
+        cls = std::move (next);
+        if (keys.size () == num_cls)
+          break;
+        num_cls = keys.size ();
+      }
+
+    // the first section of every group, in link order, is kept
+    std::vector<const section *> keepers (num_cls, nullptr);
+    for (size_t i = 0; i < cands.size (); ++i)
+      {
+        if (!keepers[cls[i]])
+          keepers[cls[i]] = cands[i];
+        else
+          {
+            this->folded[cands[i]] = keepers[cls[i]];
+            this->icf_bytes += cands[i]->get_data ().size ();
+          }
+      }
+
+    size_t j = 0;
+    for (auto sect : in_sects)
+      if (!this->folded.count (sect))
+        in_sects[j++] = sect;
+    in_sects.resize (j);
+  }
+
+
+
+  // clusters are not grown past this size, or if merging would make them
+  // this many times less dense than the caller's cluster.
+  static const size_t _max_cluster_size = 1024 * 1024;
+  static const uint64_t _max_density_degradation = 8;
+
+  /*!
+     \brief Reorders code sections by the profile, leaving data sections
+            where they are.
+
+     Executed sections are clustered with C3 (Ottoni and Maher, "Optimizing
+     Function Placement for Large-Scale Data-Center Applications"): going
+     from the hottest section down, a section's cluster is appended to the
+     cluster of its most frequent caller.
+   */
+  void
+  linker::order_sections (std::vector<const section *>& in_sects)
+  {
+    auto& prof = *this->profile;
+
+    std::vector<const section *> nodes;
+    std::unordered_map<const section *, size_t> node_map;
+    for (auto sect : in_sects)
+      if (sect->get_type () == SECT_CODE)
+        {
+          node_map[sect] = nodes.size ();
+          nodes.push_back (sect);
+        }
+    size_t n = nodes.size ();
+
+    // the node of the section that a symbol ends up in, or n
+    auto find_node = [&] (const std::string& name) -> size_t {
+      auto itr = this->globals.find (name);
+      if (itr == this->globals.end () || itr->second.ambiguous
+          || itr->second.mod->get_type () != module_type::relocatable)
+        return n;
+
+      const section *sect = itr->second.exp->sect;
+      auto fitr = this->folded.find (sect);
+      if (fitr != this->folded.end ())
+        sect = fitr->second;
+
+      auto nitr = node_map.find (sect);
+      return (nitr == node_map.end ()) ? n : nitr->second;
+    };
+
+    // sections ranked by the explicit order do not take part in clustering
+    std::vector<size_t> rank (n, n);
+    std::vector<size_t> ranked;
+    for (auto& name : prof.get_order ())
+      {
+        size_t i = find_node (name);
+        if (i < n && rank[i] == n)
+          {
+            rank[i] = ranked.size ();
+            ranked.push_back (i);
+          }
+      }
+
+    // a section's weight is its call count if the profile has one, or else
+    // the number of calls into or out of it, whichever is greater.
+    std::vector<uint64_t> counts (n, 0), calls_in (n, 0), calls_out (n, 0);
+    for (auto& p : prof.get_counts ())
+      {
+        size_t i = find_node (p.first);
+        if (i < n)
+          counts[i] += p.second;
+      }
+
+    std::vector<std::unordered_map<size_t, uint64_t>> callers (n);
+    for (auto& e : prof.get_call_edges ())
+      {
+        size_t from = find_node (e.caller), to = find_node (e.callee);
+        if (from < n)
+          calls_out[from] += e.count;
+        if (to == n)
+          continue;
+
+        calls_in[to] += e.count;
+        if (from < n && from != to && rank[from] == n && e.count > 0)
+          callers[to][from] += e.count;
+      }
+
+    std::vector<uint64_t> weights (n);
+    for (size_t i = 0; i < n; ++i)
+      weights[i] = counts[i] ? counts[i] : std::max (calls_in[i], calls_out[i]);
+
+    // clustering
+    std::vector<size_t> cluster_of (n);
+    std::vector<std::vector<size_t>> clusters (n);
+    std::vector<size_t> cl_sizes (n);
+    std::vector<uint64_t> cl_weights (n);
+    std::vector<size_t> hot;
+    for (size_t i = 0; i < n; ++i)
+      {
+        cluster_of[i] = i;
+        clusters[i].push_back (i);
+        cl_sizes[i] = std::max<size_t> (1,
+            static_cast<const progbits_section *> (nodes[i])->get_data ().size ());
+        cl_weights[i] = weights[i];
+        if (weights[i] > 0 && rank[i] == n)
+          hot.push_back (i);
+      }
+    std::stable_sort (hot.begin (), hot.end (), [&] (size_t a, size_t b) {
+      return weights[a] > weights[b];
+    });
+
+    for (auto i : hot)
+      {
+        size_t best = n;
+        uint64_t best_count = 0;
+        for (auto& p : callers[i])
+          if (p.second > best_count || (p.second == best_count && p.first < best))
+            {
+              best = p.first;
+              best_count = p.second;
+            }
+        if (best == n)
+          continue;
+
+        size_t to = cluster_of[best], from = cluster_of[i];
+        if (to == from || cl_sizes[to] + cl_sizes[from] > _max_cluster_size)
+          continue;
+
+        // new density (weight / size) must not fall below a fraction of the
+        // caller cluster's density.
+        uint64_t new_weight = cl_weights[to] + cl_weights[from];
+        size_t new_size = cl_sizes[to] + cl_sizes[from];
+        if ((double)new_weight * _max_density_degradation * cl_sizes[to]
+            < (double)cl_weights[to] * new_size)
+          continue;
+
+        for (auto j : clusters[from])
+          cluster_of[j] = to;
+        clusters[to].insert (clusters[to].end (), clusters[from].begin (),
+                             clusters[from].end ());
+        clusters[from].clear ();
+        cl_sizes[to] = new_size;
+        cl_weights[to] = new_weight;
+      }
+
+    std::vector<size_t> roots;
+    for (auto i : hot)
+      if (cluster_of[i] == i)
+        roots.push_back (i);
+    std::stable_sort (roots.begin (), roots.end (), [&] (size_t a, size_t b) {
+      return (double)cl_weights[a] * cl_sizes[b] > (double)cl_weights[b] * cl_sizes[a];
+    });
+
+    std::vector<size_t> order = ranked;
+    for (auto c : roots)
+      order.insert (order.end (), clusters[c].begin (), clusters[c].end ());
+    for (size_t i = 0; i < n; ++i)
+      if (rank[i] == n && weights[i] == 0)
+        order.push_back (i);
+
+    // code sections go where code sections were
+    size_t k = 0;
+    for (auto& sect : in_sects)
+      if (sect->get_type () == SECT_CODE)
+        sect = nodes[order[k++]];
+  }
+
+
+
+  //! \brief Hashes the contents and relocations of an input section.
+  static uint64_t
+  _hash_section (const section& sect)
+  {
+    // FNV-1a
+    uint64_t h = 14695981039346656037ULL;
+    auto mix = [&h] (const void *data, size_t len) {
+      auto ptr = (const unsigned char *)data;
+      for (size_t i = 0; i < len; ++i)
+        h = (h ^ ptr[i]) * 1099511628211ULL;
+    };
+
+    auto& data = static_cast<const progbits_section&> (sect).get_data ();
+    mix (data.data (), data.size ());
+
+    if (sect.get_type () == SECT_CODE)
+      for (auto& reloc : static_cast<const code_section&> (sect).get_relocations ())
+        {
+          auto& name = reloc.sym.store->get_name (reloc.sym.id);
+          uint64_t fields[] = { (uint64_t)reloc.type, (uint64_t)reloc.offset,
+                                (uint64_t)reloc.size, (uint64_t)(int64_t)reloc.add };
+          mix (fields, sizeof fields);
+          mix (name.data (), name.size () + 1);
+        }
+
+    return h;
+  }
+
+  //! \brief Returns the room given to an input section in incremental mode.
+  static size_t
+  _slot_capacity (size_t size, size_t align)
+  {
+    // a quarter more than needed, and no less than one alignment unit.
+    size_t cap = size + std::max (size / 4, align);
+    return (cap + align - 1) & ~(align - 1);
+  }
+
+  //! \brief Lays out the output sections and creates them.
+  void
+  linker::place_sections (const std::vector<const section *>& in_sects)
+  {
+    this->placements.clear ();
+    this->capacities.assign (in_sects.size (), 0);
+
+    this->layout_reused = false;
+    if (this->cache)
+      {
+        this->hashes.assign (in_sects.size (), 0);
+        this->for_each_index (in_sects.size (), [&] (size_t i) {
+          this->hashes[i] = _hash_section (*in_sects[i]);
+        });
+
+        this->layout_reused = this->can_reuse_layout (in_sects);
+      }
+
+    std::vector<progbits_section *> out_sects;
+    std::unordered_map<progbits_section *, size_t> sizes;
+    for (size_t i = 0; i < in_sects.size (); ++i)
+      {
+        auto in = in_sects[i];
+        auto& name = in->get_name ();
+        auto sect = this->out->find_section (name);
+        if (!sect)
+          {
+            switch (in->get_type ())
+              {
+              case SECT_PROGBITS:
+                this->out->add_section (progbits_section (name));
+                break;
+
+              case SECT_CODE:
+                this->out->add_section (code_section (name));
+                break;
+              }
+
+            sect = this->out->find_section (name);
+            out_sects.push_back (static_cast<progbits_section *> (sect));
+          }
+        else if (sect->get_type () != in->get_type ())
+          throw link_error ("section type mismatch: " + name);
+
+        auto out_sect = static_cast<progbits_section *> (sect);
+        size_t align = (in->get_type () == SECT_CODE)
+                       ? _code_alignment : _data_alignment;
+        size_t in_size = static_cast<const progbits_section *> (in)->get_data ().size ();
+        size_t& size = sizes[out_sect];
+
+        size_t off;
+        if (this->layout_reused)
+          {
+            auto& slot = this->cache->get_slots ()[i];
+            off = slot.off;
+            this->capacities[i] = slot.capacity;
+          }
+        else
+          {
+            off = (size + align - 1) & ~(align - 1);
+            this->capacities[i] = this->cache ? _slot_capacity (in_size, align)
+                                              : in_size;
+          }
+
+        this->placements[in] = { out_sect, off, nullptr };
+        size = std::max (size, off + this->capacities[i]);
+      }
+
+    for (auto sect : out_sects)
+      sect->get_data ().get_vector ().assign (
+          sizes[sect], (sect->get_type () == SECT_CODE) ? _code_fill : 0);
+    for (auto& p : this->placements)
+      p.second.data = p.second.sect->get_data ().get_mutable_data () + p.second.off;
+  }
+
+  //! \brief Checks whether the cached layout can hold the input sections.
+  bool
+  linker::can_reuse_layout (const std::vector<const section *>& in_sects) const
+  {
+    auto& slots = this->cache->get_slots ();
+    if (slots.size () != in_sects.size ())
+      return false;
+
+    for (size_t i = 0; i < slots.size (); ++i)
+      {
+        auto in = in_sects[i];
+        if (slots[i].name != in->get_name ()
+            || slots[i].type != (int)in->get_type ()
+            || slots[i].capacity < static_cast<const progbits_section *> (in)->get_data ().size ())
+          return false;
+      }
+
+    return true;
+  }
+
+  /*!
+     \brief Returns a hash of the output module's imports and exports.
+
+     Export addresses are left out: they only matter to relocation sites,
+     which are tracked separately.
+   */
+  static uint64_t
+  _hash_interface (const generic_module& mod, const relocation_symbol_store& store)
+  {
+    std::vector<std::string> parts;
+    for (auto& imp : mod.get_imports ())
+      parts.push_back ("m" + imp);
+    for (auto& p : mod.get_import_symbols ())
+      parts.push_back ("i" + std::to_string (p.second.index) + ":"
+                       + store.get_name (p.first) + ":"
+                       + std::to_string (p.second.mod) + ":"
+                       + std::to_string (p.second.ver));
+    for (auto& exp : mod.get_export_symbols ())
+      parts.push_back ("e" + exp.name + ":" + exp.sect->get_name ());
+
+    // import symbols are kept in a hash table
+    std::sort (parts.begin (), parts.end ());
+
+    uint64_t h = 14695981039346656037ULL;
+    for (auto& part : parts)
+      for (size_t i = 0; i <= part.size (); ++i)
+        h = (h ^ (unsigned char)part.c_str ()[i]) * 1099511628211ULL;
+    return h;
+  }
+
+  //! \brief Finds the changed ranges of the output and updates the cache.
+  void
+  linker::update_layout_cache (const std::vector<prepared_section>& preps)
+  {
+    auto& cache = *this->cache;
+
+    // where statically resolved symbols are now
+    std::unordered_map<std::string, link_layout_cache::symbol_location> syms;
+    for (auto& p : this->globals)
+      {
+        auto& gsym = p.second;
+        if (gsym.ambiguous || gsym.mod->get_type () != module_type::relocatable
+            || !this->placements.count (gsym.exp->sect))
+          continue;
+
+        auto loc = this->find_definition (gsym);
+        syms[p.first] = { loc.sect->get_name (), loc.off };
+      }
+
+    std::vector<link_layout_cache::reloc_site> sites;
+    for (size_t i = 0; i < preps.size (); ++i)
+      {
+        auto& prep = preps[i];
+        if (prep.in->get_type () != SECT_CODE)
+          continue;
+
+        auto& place = this->placements.at (prep.in);
+        auto& relocs = static_cast<const code_section&> (*prep.in).get_relocations ();
+        for (size_t j = 0; j < relocs.size (); ++j)
+          if (prep.reloc_syms[j]->mod->get_type () == module_type::relocatable)
+            sites.push_back ({ i, place.off + relocs[j].offset, relocs[j].size,
+                               prep.reloc_syms[j]->exp->name });
+      }
+
+    uint64_t interface_hash = _hash_interface (*this->out, *this->rstore);
+
+    this->dirty.clear ();
+    if (this->layout_reused && interface_hash != cache.get_interface_hash ())
+      this->layout_reused = false;
+    if (this->layout_reused)
+      {
+        auto& slots = cache.get_slots ();
+        auto slot_sect = [&] (size_t i) {
+          return this->placements.at (preps[i].in).sect;
+        };
+
+        for (size_t i = 0; i < slots.size (); ++i)
+          if (slots[i].hash != this->hashes[i])
+            this->dirty.push_back ({ slot_sect (i), slots[i].off, slots[i].capacity });
+
+        // sites in unchanged sections that refer to symbols that have moved
+        auto& old_syms = cache.get_symbols ();
+        for (auto& site : cache.get_reloc_sites ())
+          {
+            if (site.slot >= slots.size () || slots[site.slot].hash != this->hashes[site.slot])
+              continue;
+
+            auto itr_old = old_syms.find (site.sym);
+            auto itr_new = syms.find (site.sym);
+            if (itr_old == old_syms.end () || itr_new == syms.end ()
+                || itr_old->second.sect != itr_new->second.sect
+                || itr_old->second.off != itr_new->second.off)
+              this->dirty.push_back ({ slot_sect (site.slot), site.off, site.size });
+          }
+      }
+
+    // remember the new layout
+    auto& slots = cache.get_slots ();
+    slots.resize (preps.size ());
+    for (size_t i = 0; i < preps.size (); ++i)
+      {
+        auto in = preps[i].in;
+        auto& place = this->placements.at (in);
+        slots[i] = { in->get_name (), (int)in->get_type (), place.off,
+                     static_cast<const progbits_section *> (in)->get_data ().size (),
+                     this->capacities[i], this->hashes[i] };
+      }
+
+    cache.get_symbols () = std::move (syms);
+    cache.get_reloc_sites () = std::move (sites);
+    cache.set_interface_hash (interface_hash);
+  }
+
+  //! \brief Copies an input section into its output section and resolves
+  //!        its relocations.
+  void
+  linker::prepare_section (prepared_section& prep)
+  {
+    auto& in = static_cast<const progbits_section&> (*prep.in);
+    auto& place = this->placements.at (prep.in);
+    if (!in.get_data ().empty ())
+      std::memcpy (place.data, in.get_data ().data (), in.get_data ().size ());
+
+    if (in.get_type () != SECT_CODE)
+      return;
+
+    auto& relocs = static_cast<const code_section&> (in).get_relocations ();
+    prep.applied.assign (relocs.size (), 0);
+    for (size_t i = 0; i < relocs.size (); ++i)
+      {
+        auto& reloc = relocs[i];
+        auto& gsym = this->find_global_symbol (reloc.sym.store->get_name (reloc.sym.id));
+        prep.reloc_syms.push_back (&gsym);
+
+        switch (gsym.mod->get_type ())
+          {
+          case module_type::shared:
+            break;
+
+          case module_type::relocatable:
+            {
+              // direct PC-relative references within the same output section
+              // do not depend on where the section is loaded.
+              auto def = this->find_definition (gsym);
+              if (def.sect != place.sect || reloc.type != R_PC32)
+                break;
+
+              if (reloc.size != 4)
+                throw std::runtime_error ("linker::prepare_section: unhandled relocation size");
+              if (reloc.offset + reloc.size > in.get_data ().size ())
+                throw std::runtime_error ("linker::prepare_section: relocation out of bounds");
+
+              auto val = (long long)def.off + reloc.add
+                         - (long long)(place.off + reloc.offset);
+              bin::write_u32_le (place.data + reloc.offset, (uint32_t)val);
+              prep.applied[i] = 1;
+            }
+            break;
+
+          case module_type::executable:
+            throw std::runtime_error ("linker::prepare_section: relocations from executables not handled");
+          }
+      }
+  }
+
+  //! \brief Records the relocations of a prepared section that could not
+  //!        be applied by the linker in the output module.
+  void
+  linker::add_relocations (prepared_section& prep)
+  {
+    if (prep.error)
+      std::rethrow_exception (prep.error);
+    if (prep.in->get_type () != SECT_CODE)
+      return;
+
+    auto& place = this->placements.at (prep.in);
+    auto& sect = static_cast<code_section&> (*place.sect);
+    auto& relocs = static_cast<const code_section&> (*prep.in).get_relocations ();
+    for (size_t i = 0; i < relocs.size (); ++i)
+      {
+        if (prep.applied[i])
+          continue;
+
+        auto& gsym = *prep.reloc_syms[i];
+        auto& sym_name = gsym.exp->name;
+
         // move relocation into linker's store
-        reloc.sym = this->rstore->get (reloc.sym.store->get_name (reloc.sym.id));
+        auto reloc = relocs[i];
+        reloc.sym = this->rstore->get (sym_name);
+        reloc.offset += place.off;
+        sect.add_relocation (reloc);
 
-        auto& sym_name = reloc.sym.store->get_name (reloc.sym.id);
-        auto& mod = this->find_module_containing_export (sym_name);
-        if (mod.get_type () != module_type::shared)
-          throw std::runtime_error ("linker::add_code_section: relocations from non-shared objects not handled yet");
+        if (gsym.mod->get_type () == module_type::relocatable)
+          {
+            // left to the module translator, through the output's exports
+            if (!this->out->has_export_symbol (sym_name))
+              {
+                auto def = this->find_definition (gsym);
+                this->out->add_export_symbol (sym_name, gsym.exp->type,
+                                              def.sect, def.off,
+                                              VERSION_ID_GLOBAL);
+              }
+            continue;
+          }
 
+        auto& mod = *gsym.mod;
         module_import_id mod_id;
         if (this->out->has_import (mod.get_export_name ()))
           mod_id = this->out->get_import (mod.get_export_name ());
         else
           mod_id = this->out->add_import (mod.get_export_name ());
 
-        auto& exp_sym = mod.get_export_symbol (sym_name);
-        this->out->add_import_symbol (reloc.sym.id, mod_id, exp_sym.version);
+        if (!this->out->get_import_symbols ().count (reloc.sym.id))
+          this->out->add_import_symbol (reloc.sym.id, mod_id, gsym.exp->version);
       }
   }
+
+  //! \brief Returns the location of a symbol defined by a relocatable
+  //!        module in the output module.
+  module_location
+  linker::find_definition (const global_symbol& gsym) const
+  {
+    auto itr = this->placements.find (gsym.exp->sect);
+    if (itr == this->placements.end ())
+      throw link_error ("symbol defined outside of any section: " + gsym.exp->name);
+
+    // export addresses are relative to the module's own layout
+    auto in = static_cast<const progbits_section *> (gsym.exp->sect);
+    return module_location (itr->second.sect,
+                            itr->second.off + (gsym.exp->vaddr - in->get_vaddr ()));
+  }
 }
@@ -0,0 +1,130 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "linker/profile.hpp"
+#include <cctype>
+#include <istream>
+#include <sstream>
+#include <stdexcept>
+
+
+namespace jcc {
+
+  //! \brief Appends a symbol to the explicit order.
+  void
+  link_profile::add_ordered_symbol (const std::string& name)
+  {
+    this->order.push_back (name);
+  }
+
+  //! \brief Adds to the number of times a function was called.
+  void
+  link_profile::add_count (const std::string& name, uint64_t count)
+  {
+    this->counts[name] += count;
+  }
+
+  //! \brief Adds to the number of calls from one function to another.
+  void
+  link_profile::add_call (const std::string& caller, const std::string& callee,
+                          uint64_t count)
+  {
+    auto res = this->edge_map.emplace (caller + " " + callee, this->edges.size ());
+    if (res.second)
+      this->edges.push_back ({ caller, callee, 0 });
+    this->edges[res.first->second].count += count;
+  }
+
+  //! \brief Forgets the profile.
+  void
+  link_profile::clear ()
+  {
+    this->order.clear ();
+    this->counts.clear ();
+    this->edges.clear ();
+    this->edge_map.clear ();
+  }
+
+
+
+  static uint64_t
+  _parse_count (const std::string& str, size_t ln)
+  {
+    size_t end = 0;
+    unsigned long long val = 0;
+
+    // stoull would also accept a sign, and negate the count
+    if (!str.empty () && std::isdigit ((unsigned char)str[0]))
+      try
+        {
+          val = std::stoull (str, &end);
+        }
+      catch (const std::exception&)
+        {
+          end = 0;
+        }
+
+    if (end == 0 || end != str.size ())
+      throw std::runtime_error ("link_profile::load: invalid count on line "
+                                + std::to_string (ln));
+    return (uint64_t)val;
+  }
+
+  /*!
+     \brief Reads profile entries from the specified stream.
+     \throws std::runtime_error if a line is malformed.
+   */
+  void
+  link_profile::load (std::istream& strm)
+  {
+    std::string line;
+    for (size_t ln = 1; std::getline (strm, line); ++ln)
+      {
+        auto hash = line.find ('#');
+        if (hash != std::string::npos)
+          line.erase (hash);
+
+        std::istringstream ss (line);
+        std::vector<std::string> toks;
+        for (std::string tok; ss >> tok; )
+          toks.push_back (tok);
+
+        switch (toks.size ())
+          {
+          case 0:
+            break;
+
+          case 1:
+            this->add_ordered_symbol (toks[0]);
+            break;
+
+          case 2:
+            this->add_count (toks[0], _parse_count (toks[1], ln));
+            break;
+
+          case 3:
+            this->add_call (toks[0], toks[1], _parse_count (toks[2], ln));
+            break;
+
+          default:
+            throw std::runtime_error ("link_profile::load: too many fields on line "
+                                      + std::to_string (ln));
+          }
+      }
+  }
+}
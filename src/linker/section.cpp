@@ -17,7 +17,6 @@
  */
 
 #include "linker/section.hpp"
-#include <cstring>
 #include <stdexcept>
 
 
@@ -47,11 +46,16 @@ namespace jcc {
 
   progbits_section::progbits_section (const std::string& name,
       const unsigned char *data, unsigned int len, size_t vaddr)
-      : section (name)
+      : section (name), data (data, len)
+  {
+    this->vaddr = vaddr;
+  }
+
+  progbits_section::progbits_section (const std::string& name,
+      const cow_buffer& data, size_t vaddr)
+      : section (name), data (data)
   {
     this->vaddr = vaddr;
-    this->data.resize (len);
-    std::memcpy (this->data.data (), data, len);
   }
 
 
@@ -89,6 +93,12 @@ namespace jcc {
   {
   }
 
+  code_section::code_section (const std::string& name,
+      const cow_buffer& data, size_t vaddr)
+      : progbits_section (name, data, vaddr)
+  {
+  }
+
 
 
   //! \brief Inserts the specified relocation to the section's relocation list.
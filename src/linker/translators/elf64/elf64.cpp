@@ -34,8 +34,22 @@ namespace jcc {
         h = (h << 4) + c;
         if ((g = h & 0xf0000000))
           h ^= g >> 24;
+        h &= ~g;
       }
 
     return h;
   }
+
+  /*!
+     \brief The hash function used in GNU-style hash tables (.gnu.hash).
+   */
+  elf64_word_t
+  elf64_gnu_hash (const char *name)
+  {
+    elf64_word_t h = 5381;
+    for (; *name; ++name)
+      h = (h << 5) + h + (unsigned char)*name;
+
+    return h;
+  }
 }
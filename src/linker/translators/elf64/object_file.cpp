@@ -24,6 +24,7 @@
 #include <iostream>
 #include <algorithm>
 #include <set>
+#include <istream>
 
 namespace jcc {
 
@@ -44,6 +45,9 @@ namespace jcc {
 
     this->entry_off = other.entry_off;
     this->image_base = other.image_base;
+
+    this->image = nullptr;
+    this->image_size = 0;
   }
 
   elf64_object_file::~elf64_object_file ()
@@ -240,6 +244,44 @@ namespace jcc {
     return *s;
   }
 
+  //! \brief Inserts a SysV symbol hash table section.
+  elf64_hash_section&
+  elf64_object_file::add_hash_section (const std::string& name,
+                                       elf64_dynsym_section& dynsym)
+  {
+    if (!this->def_strtab)
+      throw std::runtime_error ("add_hash_section: No default string table set");
+
+    auto s = new elf64_hash_section (*this, dynsym);
+    s->set_index ((int)this->sections.size ());
+    this->sections.push_back (s);
+
+    auto& hdr = s->get_header ();
+    hdr.sh_name = (elf64_word_t)this->def_strtab->add_string (name);
+    ++ this->ehdr.e_shnum;
+
+    return *s;
+  }
+
+  //! \brief Inserts a GNU symbol hash table section.
+  elf64_gnu_hash_section&
+  elf64_object_file::add_gnu_hash_section (const std::string& name,
+                                           elf64_dynsym_section& dynsym)
+  {
+    if (!this->def_strtab)
+      throw std::runtime_error ("add_gnu_hash_section: No default string table set");
+
+    auto s = new elf64_gnu_hash_section (*this, dynsym);
+    s->set_index ((int)this->sections.size ());
+    this->sections.push_back (s);
+
+    auto& hdr = s->get_header ();
+    hdr.sh_name = (elf64_word_t)this->def_strtab->add_string (name);
+    ++ this->ehdr.e_shnum;
+
+    return *s;
+  }
+
 
   //! \brief Inserts a new program segment.
   elf64_segment&
@@ -408,19 +450,24 @@ namespace jcc {
 
     while (!behind_map.empty ())
       {
-        // find a section that has no other sections behind it
+        // find a section that has no other sections behind it (the first
+        // such section in insertion order, so that the layout does not depend
+        // on where sections happen to be allocated).
         bool found = false;
-        for (auto& p : behind_map)
-          if (p.second.empty ())
-            {
-              sects.push_back (p.first);
-              for (auto& p2 : behind_map)
-                p2.second.erase (p.first);
-              behind_map.erase (p.first);
+        for (auto s : this->sections)
+          {
+            auto itr = behind_map.find (s);
+            if (itr != behind_map.end () && itr->second.empty ())
+              {
+                sects.push_back (s);
+                behind_map.erase (itr);
+                for (auto& p2 : behind_map)
+                  p2.second.erase (s);
 
-              found = true;
-              break;
-            }
+                found = true;
+                break;
+              }
+          }
 
         if (!found)
           throw std::runtime_error ("elf64_object_file::order_sections: order collision");
@@ -601,6 +648,7 @@ namespace jcc {
       case SHT_STRTAB:
         return 0;
       case SHT_PROGBITS:
+      case SHT_GNU_HASH: // reorders the dynamic symbol table
         return 1;
       case SHT_SYMTAB:
       case SHT_DYNSYM:
@@ -635,98 +683,196 @@ namespace jcc {
 
 
   /*!
-     \brief Saves the object file into a stream.
+     \brief Bakes all sections and fills in the remaining file header fields.
+     \return The size of the output file in bytes.
+
+     The layout must have been computed beforehand, so at this point the
+     offset and size of every part of the file are known.
    */
-  void
-  elf64_object_file::save (std::ostream& strm)
+  size_t
+  elf64_object_file::prepare_image ()
   {
-    size_t curr_off = 0;
-
     this->bake_sections ();
 
-    this->write_header (strm, curr_off);
+    auto& ehdr = this->ehdr;
+    if (this->entry_sect)
+      ehdr.e_entry = this->entry_sect->get_header ().sh_addr + this->entry_off;
+    else
+      ehdr.e_entry = 0;
+
+    if (this->segments.empty ())
+      ehdr.e_phnum = 0;
+    else
+      ehdr.e_phnum = (elf64_half_t)(this->segments.size () + 1); // +1 for PHDR segment
 
-    // write program headers
-    this->write_program_headers (strm, curr_off);
+    return (size_t)ehdr.e_shoff
+           + this->sections.size () * ELF64_SECTION_HEADER_SIZE;
+  }
+
+  /*!
+     \brief Writes the whole file image into the specified buffer.
+
+     The buffer must be zero-filled and at least as large as the size
+     returned by prepare_image(); padding between sections is skipped over.
+   */
+  void
+  elf64_object_file::write_image (unsigned char *out)
+  {
+    this->write_header (out);
+    this->write_program_headers (out + this->ehdr.e_phoff);
 
     // write section data
     for (size_t i = 1; i < this->sections.size (); ++i)
       {
         auto s = this->sections[i];
         auto& hdr = s->get_header ();
+        if (hdr.sh_type == SHT_NOBITS || hdr.sh_size == 0)
+          continue;
 
-        if (curr_off < hdr.sh_offset)
-          {
-            // insert padding
-            bin::write_zeroes (strm, (int)(hdr.sh_offset - curr_off));
-            curr_off = hdr.sh_offset;
-          }
+        if (hdr.sh_offset + hdr.sh_size > this->ehdr.e_shoff)
+          throw std::runtime_error ("elf64_object_file::write_image: section does not fit layout");
+        s->write (out + hdr.sh_offset);
+      }
+
+    // write section headers
+    this->write_section_headers (out + this->ehdr.e_shoff);
+  }
+
+  /*!
+     \brief Saves the object file into a stream.
+
+     The image is assembled in memory and handed to the stream in a single
+     write.
+   */
+  void
+  elf64_object_file::save (std::ostream& strm)
+  {
+    std::vector<unsigned char> image (this->prepare_image ());
+    this->write_image (image.data ());
+    strm.write ((const char *)image.data (), (std::streamsize)image.size ());
+  }
+
+  /*!
+     \brief Saves the object file into the file at the specified path.
+
+     The output file is sized up front and mapped into memory, and the image
+     is written into it directly.
+   */
+  void
+  elf64_object_file::save (const std::string& path)
+  {
+    mapped_output_file out (path, this->prepare_image ());
+    this->write_image (out.data ());
+  }
+
+  /*!
+     \brief Rewrites the specified ranges of section contents in a file
+            previously saved with the same layout.
+     \return False, leaving the file untouched, if the file does not match
+             the object file's layout.
+   */
+  bool
+  elf64_object_file::update (const std::string& path,
+                             const std::vector<elf64_section_range>& ranges)
+  {
+    size_t size = this->prepare_image ();
+
+    std::unique_ptr<mapped_output_file> file;
+    try
+      {
+        file.reset (new mapped_output_file (path));
+      }
+    catch (const std::runtime_error&)
+      {
+        return false;
+      }
+    if (file->size () != size)
+      return false;
+    unsigned char *out = file->data ();
+
+    // everything but the contents of PROGBITS sections must be as before
+    std::vector<unsigned char> buf (ELF64_FILE_HEADER_SIZE);
+    this->write_header (buf.data ());
+    if (std::memcmp (buf.data (), out, buf.size ()) != 0)
+      return false;
+
+    buf.assign (this->ehdr.e_phnum * ELF64_PROGRAM_HEADER_SIZE, 0);
+    this->write_program_headers (buf.data ());
+    if (!buf.empty () && (this->ehdr.e_phoff + buf.size () > size
+        || std::memcmp (buf.data (), out + this->ehdr.e_phoff, buf.size ()) != 0))
+      return false;
+
+    buf.assign (this->sections.size () * ELF64_SECTION_HEADER_SIZE, 0);
+    this->write_section_headers (buf.data ());
+    if (std::memcmp (buf.data (), out + this->ehdr.e_shoff, buf.size ()) != 0)
+      return false;
 
-        auto data = s->get_data ();
-        strm.write (data, hdr.sh_size);
-        curr_off += hdr.sh_size;
+    for (size_t i = 1; i < this->sections.size (); ++i)
+      {
+        auto s = this->sections[i];
+        auto& hdr = s->get_header ();
+        if (hdr.sh_type == SHT_PROGBITS || hdr.sh_type == SHT_NOBITS
+            || hdr.sh_size == 0)
+          continue;
+
+        buf.assign (hdr.sh_size, 0);
+        s->write (buf.data ());
+        if (std::memcmp (buf.data (), out + hdr.sh_offset, buf.size ()) != 0)
+          return false;
       }
 
-    // insert padding before section headers if necessary
-    if (curr_off < this->ehdr.e_shoff)
+    for (auto& r : ranges)
       {
-        bin::write_zeroes (strm, (int)(this->ehdr.e_shoff - curr_off));
-        curr_off = this->ehdr.e_shoff;
+        auto& hdr = r.sect->get_header ();
+        if (hdr.sh_type != SHT_PROGBITS)
+          throw std::runtime_error ("elf64_object_file::update: range not in a PROGBITS section");
+        if (r.off + r.len > hdr.sh_size)
+          throw std::runtime_error ("elf64_object_file::update: range out of bounds");
+
+        auto& sect = static_cast<elf64_progbits_section&> (*r.sect);
+        std::memcpy (out + hdr.sh_offset + r.off, sect.get_data () + r.off, r.len);
       }
 
-    // write section headers
-    this->write_section_headers (strm, curr_off);
+    return true;
   }
 
   void
-  elf64_object_file::write_header (std::ostream& strm, size_t& curr_off)
+  elf64_object_file::write_header (unsigned char *out)
   {
     auto& ehdr = this->ehdr;
 
-    if (this->entry_sect)
-      ehdr.e_entry = this->entry_sect->get_header ().sh_addr + this->entry_off;
-    else
-      ehdr.e_entry = 0;
-
-    if (this->segments.empty ())
-      ehdr.e_phnum = 0;
-    else
-      ehdr.e_phnum = (elf64_half_t)(this->segments.size () + 1); // +1 for PHDR segment
-
-    strm.write ((char *)ehdr.e_ident, 16);
-    bin::write_u16_le (strm, ehdr.e_type);
-    bin::write_u16_le (strm, ehdr.e_machine);
-    bin::write_u32_le (strm, ehdr.e_version);
-    bin::write_u64_le (strm, ehdr.e_entry);
-    bin::write_u64_le (strm, ehdr.e_phoff);
-    bin::write_u64_le (strm, ehdr.e_shoff);
-    bin::write_u32_le (strm, ehdr.e_flags);
-    bin::write_u16_le (strm, ehdr.e_ehsize);
-    bin::write_u16_le (strm, ehdr.e_phentsize);
-    bin::write_u16_le (strm, ehdr.e_phnum);
-    bin::write_u16_le (strm, ehdr.e_shentsize);
-    bin::write_u16_le (strm, ehdr.e_shnum);
-    bin::write_u16_le (strm, ehdr.e_shstrndx);
-
-    curr_off += ELF64_FILE_HEADER_SIZE;
+    std::memcpy (out, ehdr.e_ident, 16);
+    bin::write_u16_le (out + 16, ehdr.e_type);
+    bin::write_u16_le (out + 18, ehdr.e_machine);
+    bin::write_u32_le (out + 20, ehdr.e_version);
+    bin::write_u64_le (out + 24, ehdr.e_entry);
+    bin::write_u64_le (out + 32, ehdr.e_phoff);
+    bin::write_u64_le (out + 40, ehdr.e_shoff);
+    bin::write_u32_le (out + 48, ehdr.e_flags);
+    bin::write_u16_le (out + 52, ehdr.e_ehsize);
+    bin::write_u16_le (out + 54, ehdr.e_phentsize);
+    bin::write_u16_le (out + 56, ehdr.e_phnum);
+    bin::write_u16_le (out + 58, ehdr.e_shentsize);
+    bin::write_u16_le (out + 60, ehdr.e_shnum);
+    bin::write_u16_le (out + 62, ehdr.e_shstrndx);
   }
 
 
   static void
-  _write_program_header (std::ostream& strm, elf64_phdr_t& hdr)
+  _write_program_header (unsigned char *out, const elf64_phdr_t& hdr)
   {
-    bin::write_u32_le (strm, hdr.p_type);
-    bin::write_u32_le (strm, hdr.p_flags);
-    bin::write_u64_le (strm, hdr.p_offset);
-    bin::write_u64_le (strm, hdr.p_vaddr);
-    bin::write_u64_le (strm, hdr.p_paddr);
-    bin::write_u64_le (strm, hdr.p_filesz);
-    bin::write_u64_le (strm, hdr.p_memsz);
-    bin::write_u64_le (strm, hdr.p_align);
+    bin::write_u32_le (out, hdr.p_type);
+    bin::write_u32_le (out + 4, hdr.p_flags);
+    bin::write_u64_le (out + 8, hdr.p_offset);
+    bin::write_u64_le (out + 16, hdr.p_vaddr);
+    bin::write_u64_le (out + 24, hdr.p_paddr);
+    bin::write_u64_le (out + 32, hdr.p_filesz);
+    bin::write_u64_le (out + 40, hdr.p_memsz);
+    bin::write_u64_le (out + 48, hdr.p_align);
   }
 
   void
-  elf64_object_file::write_program_headers (std::ostream& strm, size_t& curr_off)
+  elf64_object_file::write_program_headers (unsigned char *out)
   {
     if (this->segments.empty ())
       return;
@@ -742,39 +888,38 @@ namespace jcc {
       hdr.p_flags = PF_R | PF_X;
       hdr.p_align = 8;
       hdr.p_type = PT_PHDR;
-      _write_program_header (strm, hdr);
-      curr_off += ELF64_PROGRAM_HEADER_SIZE;
+      _write_program_header (out, hdr);
+      out += ELF64_PROGRAM_HEADER_SIZE;
     }
 
     for (size_t i = 0; i < this->segments.size (); ++i)
       {
         auto seg = this->segments[i];
-        auto& hdr = seg->get_header ();
-        _write_program_header (strm, hdr);
-        curr_off += ELF64_PROGRAM_HEADER_SIZE;
+        _write_program_header (out, seg->get_header ());
+        out += ELF64_PROGRAM_HEADER_SIZE;
       }
   }
 
 
   void
-  elf64_object_file::write_section_headers (std::ostream& strm, size_t& curr_off)
+  elf64_object_file::write_section_headers (unsigned char *out)
   {
     for (size_t i = 0; i < this->sections.size (); ++i)
       {
         auto s = this->sections[i];
         auto& hdr = s->get_header ();
 
-        bin::write_u32_le (strm, hdr.sh_name);
-        bin::write_u32_le (strm, hdr.sh_type);
-        bin::write_u64_le (strm, hdr.sh_flags);
-        bin::write_u64_le (strm, hdr.sh_addr);
-        bin::write_u64_le (strm, hdr.sh_offset);
-        bin::write_u64_le (strm, hdr.sh_size);
-        bin::write_u32_le (strm, hdr.sh_link);
-        bin::write_u32_le (strm, hdr.sh_info);
-        bin::write_u64_le (strm, hdr.sh_addralign);
-        bin::write_u64_le (strm, hdr.sh_entsize);
-        curr_off += ELF64_SECTION_HEADER_SIZE;
+        bin::write_u32_le (out, hdr.sh_name);
+        bin::write_u32_le (out + 4, hdr.sh_type);
+        bin::write_u64_le (out + 8, hdr.sh_flags);
+        bin::write_u64_le (out + 16, hdr.sh_addr);
+        bin::write_u64_le (out + 24, hdr.sh_offset);
+        bin::write_u64_le (out + 32, hdr.sh_size);
+        bin::write_u32_le (out + 40, hdr.sh_link);
+        bin::write_u32_le (out + 44, hdr.sh_info);
+        bin::write_u64_le (out + 48, hdr.sh_addralign);
+        bin::write_u64_le (out + 56, hdr.sh_entsize);
+        out += ELF64_SECTION_HEADER_SIZE;
       }
   }
 
@@ -799,6 +944,9 @@ namespace jcc {
     this->entry_sect = nullptr;
     this->entry_off = 0;
 
+    this->image = nullptr;
+    this->image_size = 0;
+
     // create null section
     this->sections.push_back (new elf64_null_section (*this));
     this->sections.back ()->set_index (0);
@@ -809,68 +957,134 @@ namespace jcc {
 
   /*!
      \brief Loads the object file from the specified stream.
+
+     The stream is read into memory in one go; PROGBITS sections then keep
+     views into that buffer rather than copies of their own.
    */
   void
   elf64_object_file::load (std::istream& strm)
+  {
+    strm.seekg (0, std::ios_base::end);
+    auto size = (size_t)strm.tellg ();
+    strm.seekg (0, std::ios_base::beg);
+
+    auto buf = std::make_shared<std::vector<unsigned char>> (size);
+    strm.read ((char *)buf->data (), size);
+    if ((size_t)strm.gcount () != size)
+      throw std::runtime_error ("elf64_object_file::load: could not read stream");
+
+    this->load_image (buf, buf->data (), buf->size ());
+  }
+
+  /*!
+     \brief Loads the object file from a file mapped into memory.
+
+     No section data is copied up front: PROGBITS sections are views into the
+     mapping (which they keep alive), and are copied only when modified.
+   */
+  void
+  elf64_object_file::load (std::shared_ptr<const mapped_file> file)
+  {
+    auto data = file->data ();
+    auto size = file->size ();
+    this->load_image (std::move (file), data, size);
+  }
+
+  void
+  elf64_object_file::load_image (std::shared_ptr<const void> owner,
+                                 const unsigned char *data, size_t size)
   {
     this->clear ();
 
-    this->read_header (strm);
-    this->read_sections (strm);
+    this->image_owner = std::move (owner);
+    this->image = data;
+    this->image_size = size;
+
+    try
+      {
+        this->read_header ();
+        this->read_sections ();
+      }
+    catch (...)
+      {
+        this->image_owner.reset ();
+        this->image = nullptr;
+        this->image_size = 0;
+        this->shdrs.clear ();
+        throw;
+      }
+
+    this->image_owner.reset ();
+    this->image = nullptr;
+    this->image_size = 0;
+  }
+
+  //! \brief Returns a pointer to len bytes at the specified offset of the
+  //!        image being loaded.
+  const unsigned char*
+  elf64_object_file::get_image_range (elf64_off_t off, size_t len) const
+  {
+    if (off > this->image_size || len > this->image_size - off)
+      throw std::runtime_error ("elf64_object_file::get_image_range: out of bounds");
+    return this->image + off;
   }
 
   void
-  elf64_object_file::read_header (std::istream& strm)
+  elf64_object_file::read_header ()
   {
-    strm.seekg (0, std::ios_base::beg);
-    strm.read ((char *)this->ehdr.e_ident, 16);
-    this->ehdr.e_type = bin::read_u16_le (strm);
-    this->ehdr.e_machine = bin::read_u16_le (strm);
-    this->ehdr.e_version = bin::read_u32_le (strm);
-    this->ehdr.e_entry = bin::read_u64_le (strm);
-    this->ehdr.e_phoff = bin::read_u64_le (strm);
-    this->ehdr.e_shoff = bin::read_u64_le (strm);
-    this->ehdr.e_flags = bin::read_u32_le (strm);
-    this->ehdr.e_ehsize = bin::read_u16_le (strm);
-    this->ehdr.e_phentsize = bin::read_u16_le (strm);
-    this->ehdr.e_phnum = bin::read_u16_le (strm);
-    this->ehdr.e_shentsize = bin::read_u16_le (strm);
-    this->ehdr.e_shnum = bin::read_u16_le (strm);
-    this->ehdr.e_shstrndx = bin::read_u16_le (strm);
+    auto p = this->get_image_range (0, ELF64_FILE_HEADER_SIZE);
+    std::memcpy (this->ehdr.e_ident, p, 16);
+    this->ehdr.e_type = bin::read_u16_le (p + 16);
+    this->ehdr.e_machine = bin::read_u16_le (p + 18);
+    this->ehdr.e_version = bin::read_u32_le (p + 20);
+    this->ehdr.e_entry = bin::read_u64_le (p + 24);
+    this->ehdr.e_phoff = bin::read_u64_le (p + 32);
+    this->ehdr.e_shoff = bin::read_u64_le (p + 40);
+    this->ehdr.e_flags = bin::read_u32_le (p + 48);
+    this->ehdr.e_ehsize = bin::read_u16_le (p + 52);
+    this->ehdr.e_phentsize = bin::read_u16_le (p + 54);
+    this->ehdr.e_phnum = bin::read_u16_le (p + 56);
+    this->ehdr.e_shentsize = bin::read_u16_le (p + 58);
+    this->ehdr.e_shnum = bin::read_u16_le (p + 60);
+    this->ehdr.e_shstrndx = bin::read_u16_le (p + 62);
   }
 
 
   static elf64_shdr_t
-  _read_section_header (std::istream& strm)
+  _read_section_header (const unsigned char *p)
   {
     elf64_shdr_t shdr;
 
-    shdr.sh_name = bin::read_u32_le (strm);
-    shdr.sh_type = bin::read_u32_le (strm);
-    shdr.sh_flags = bin::read_u64_le (strm);
-    shdr.sh_addr = bin::read_u64_le (strm);
-    shdr.sh_offset = bin::read_u64_le (strm);
-    shdr.sh_size = bin::read_u64_le (strm);
-    shdr.sh_link = bin::read_u32_le (strm);
-    shdr.sh_info = bin::read_u32_le (strm);
-    shdr.sh_addralign = bin::read_u64_le (strm);
-    shdr.sh_entsize = bin::read_u64_le (strm);
+    shdr.sh_name = bin::read_u32_le (p);
+    shdr.sh_type = bin::read_u32_le (p + 4);
+    shdr.sh_flags = bin::read_u64_le (p + 8);
+    shdr.sh_addr = bin::read_u64_le (p + 16);
+    shdr.sh_offset = bin::read_u64_le (p + 24);
+    shdr.sh_size = bin::read_u64_le (p + 32);
+    shdr.sh_link = bin::read_u32_le (p + 40);
+    shdr.sh_info = bin::read_u32_le (p + 44);
+    shdr.sh_addralign = bin::read_u64_le (p + 48);
+    shdr.sh_entsize = bin::read_u64_le (p + 56);
 
     return shdr;
   }
 
   void
-  elf64_object_file::read_sections (std::istream& strm)
+  elf64_object_file::read_sections ()
   {
-    strm.seekg (this->ehdr.e_shoff, std::ios_base::beg);
+    auto p = this->get_image_range (this->ehdr.e_shoff,
+        (size_t)this->ehdr.e_shnum * ELF64_SECTION_HEADER_SIZE);
+    if (this->ehdr.e_shstrndx >= this->ehdr.e_shnum)
+      throw std::runtime_error ("elf64_object_file::read_sections: invalid section name table index");
 
     // read all section headers
     for (unsigned i = 0; i < this->ehdr.e_shnum; ++i)
-      this->shdrs.push_back (_read_section_header (strm));
+      this->shdrs.push_back (
+          _read_section_header (p + i * ELF64_SECTION_HEADER_SIZE));
 
     // read section name string table section first.
     this->def_strtab = static_cast<elf64_strtab_section *> (
-      this->read_section (strm, this->shdrs[this->ehdr.e_shstrndx]));
+      this->read_section (this->shdrs[this->ehdr.e_shstrndx]));
     this->def_strtab->set_id (this->ehdr.e_shstrndx);
 
     std::vector<std::pair<int, elf64_shdr_t>> process_shdrs;
@@ -889,7 +1103,7 @@ namespace jcc {
 
     for (auto& p : process_shdrs)
       {
-        auto s = this->read_section (strm, p.second);
+        auto s = this->read_section (p.second);
         if (s)
           s->set_id (p.first);
       }
@@ -898,28 +1112,28 @@ namespace jcc {
   }
 
   elf64_section*
-  elf64_object_file::read_section (std::istream& strm, elf64_shdr_t& shdr)
+  elf64_object_file::read_section (elf64_shdr_t& shdr)
   {
     switch (shdr.sh_type)
       {
       case SHT_STRTAB:
-        return &this->read_strtab_section (strm, shdr);
+        return &this->read_strtab_section (shdr);
 
       case SHT_PROGBITS:
-        return &this->read_progbits_section (strm, shdr);
+        return &this->read_progbits_section (shdr);
 
       case SHT_SYMTAB:
       case SHT_DYNSYM:
-        return &this->read_symtab_section (strm, shdr);
+        return &this->read_symtab_section (shdr);
 
       case SHT_GNU_VERDEF:
-        return &this->read_verdef_section (strm, shdr);
+        return &this->read_verdef_section (shdr);
 
       case SHT_GNU_VERSYM:
-        return &this->read_versym_section (strm, shdr);
+        return &this->read_versym_section (shdr);
 
       case SHT_DYNAMIC:
-        return &this->read_dynamic_section (strm, shdr);
+        return &this->read_dynamic_section (shdr);
 
       default:
         //throw std::runtime_error ("elf64_object_file::read_section: unknown section type");
@@ -928,77 +1142,82 @@ namespace jcc {
   }
 
   void
-  elf64_object_file::read_section_generic (elf64_section& s, std::istream& strm,
-                                           elf64_shdr_t& shdr)
+  elf64_object_file::read_section_generic (elf64_section& s, elf64_shdr_t& shdr)
   {
     s.get_header () = shdr;
 
-    unsigned char *raw = new unsigned char [shdr.sh_size];
-    strm.seekg (shdr.sh_offset, std::ios_base::beg);
-    strm.read ((char *)raw, shdr.sh_size);
-    s.load_raw (raw, (unsigned int)shdr.sh_size);
-    delete[] raw;
+    auto raw = this->get_image_range (shdr.sh_offset, shdr.sh_size);
+    s.load_view (this->image_owner, raw, (unsigned int)shdr.sh_size);
+  }
+
+  //! \brief Returns the section linked to by the specified section header.
+  elf64_section&
+  elf64_object_file::get_linked_section (elf64_shdr_t& shdr)
+  {
+    if (shdr.sh_link >= this->shdrs.size ())
+      throw std::runtime_error ("elf64_object_file::get_linked_section: invalid section link");
+    return this->get_section_by_offset (this->shdrs[shdr.sh_link].sh_offset);
   }
 
   elf64_strtab_section&
-  elf64_object_file::read_strtab_section (std::istream& strm, elf64_shdr_t& shdr)
+  elf64_object_file::read_strtab_section (elf64_shdr_t& shdr)
   {
     auto s = new elf64_strtab_section (*this);
-    this->read_section_generic (*s, strm, shdr);
     this->sections.push_back (s);
+    this->read_section_generic (*s, shdr);
     return *s;
   }
 
   elf64_symtab_section&
-  elf64_object_file::read_symtab_section (std::istream& strm, elf64_shdr_t& shdr)
+  elf64_object_file::read_symtab_section (elf64_shdr_t& shdr)
   {
     auto& link_strtab = static_cast<elf64_strtab_section&> (
-        this->get_section_by_offset (this->shdrs[shdr.sh_link].sh_offset));
+        this->get_linked_section (shdr));
     auto s = new elf64_symtab_section (*this, link_strtab);
-    this->read_section_generic (*s, strm, shdr);
     this->sections.push_back (s);
+    this->read_section_generic (*s, shdr);
     return *s;
   }
 
   elf64_verdef_section&
-  elf64_object_file::read_verdef_section (std::istream& strm, elf64_shdr_t& shdr)
+  elf64_object_file::read_verdef_section (elf64_shdr_t& shdr)
   {
     auto& link_strtab = static_cast<elf64_strtab_section&> (
-        this->get_section_by_offset (this->shdrs[shdr.sh_link].sh_offset));
+        this->get_linked_section (shdr));
     auto s = new elf64_verdef_section (*this, link_strtab);
-    this->read_section_generic (*s, strm, shdr);
     this->sections.push_back (s);
+    this->read_section_generic (*s, shdr);
     return *s;
   }
 
   elf64_versym_section&
-  elf64_object_file::read_versym_section (std::istream& strm, elf64_shdr_t& shdr)
+  elf64_object_file::read_versym_section (elf64_shdr_t& shdr)
   {
     auto& link_dynsym = static_cast<elf64_dynsym_section&> (
-        this->get_section_by_offset (this->shdrs[shdr.sh_link].sh_offset));
+        this->get_linked_section (shdr));
     auto s = new elf64_versym_section (*this, link_dynsym);
-    this->read_section_generic (*s, strm, shdr);
     this->sections.push_back (s);
+    this->read_section_generic (*s, shdr);
     return *s;
   }
 
   elf64_progbits_section&
-  elf64_object_file::read_progbits_section (std::istream& strm, elf64_shdr_t& shdr)
+  elf64_object_file::read_progbits_section (elf64_shdr_t& shdr)
   {
     auto s = new elf64_progbits_section (*this);
-    this->read_section_generic (*s, strm, shdr);
     this->sections.push_back (s);
+    this->read_section_generic (*s, shdr);
     return *s;
   }
 
   elf64_dynamic_section&
-  elf64_object_file::read_dynamic_section (std::istream& strm, elf64_shdr_t& shdr)
+  elf64_object_file::read_dynamic_section (elf64_shdr_t& shdr)
   {
     auto& link_strtab = static_cast<elf64_strtab_section&> (
-        this->get_section_by_offset (this->shdrs[shdr.sh_link].sh_offset));
+        this->get_linked_section (shdr));
     auto s = new elf64_dynamic_section (*this, link_strtab);
-    this->read_section_generic (*s, strm, shdr);
     this->sections.push_back (s);
+    this->read_section_generic (*s, shdr);
     return *s;
   }
 }
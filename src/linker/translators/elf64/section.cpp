@@ -19,7 +19,7 @@
 #include "linker/translators/elf64/section.hpp"
 #include "linker/translators/elf64/object_file.hpp"
 #include <cstring>
-#include <sstream>
+#include <algorithm>
 #include <common/binary.hpp>
 #include <iostream>
 
@@ -47,12 +47,6 @@ namespace jcc {
 
 
 
-  void
-  elf64_null_section::bake ()
-  {
-    this->data = std::string (24, '\0');
-  }
-
   size_t
   elf64_null_section::compute_size ()
   {
@@ -144,6 +138,13 @@ namespace jcc {
     return (size_t)this->shdr.sh_size;
   }
 
+  void
+  elf64_strtab_section::write (unsigned char *out) const
+  {
+    std::memcpy (out, this->data.data (),
+                 std::min ((size_t)this->shdr.sh_size, this->data.size ()));
+  }
+
   void
   elf64_strtab_section::load_raw (const unsigned char *raw, unsigned int len)
   {
@@ -176,25 +177,34 @@ namespace jcc {
 
 
 
-  //! \brief Inserts a new symbol to the end of the table.
-  int
-  elf64_symtab_section::add_symbol (
-      const std::string& name, elf64_symbol_type type, elf64_symbol_binding bind,
-      int sect_id, elf64_addr_t value, elf64_xword_t size)
+  elf64_symtab_section::symbol&
+  elf64_symtab_section::new_symbol (elf64_symbol_binding bind)
   {
     symbol *sym = nullptr;
     if (bind == STB_LOCAL)
       {
+        this->id_locs.push_back ((int)this->syms_local.size ());
         this->syms_local.emplace_back ();
         sym = &this->syms_local.back ();
       }
     else
       {
+        this->id_locs.push_back (-(int)this->syms_global.size () - 1);
         this->syms_global.emplace_back ();
         sym = &this->syms_global.back ();
       }
 
     sym->id = this->next_sym_id ++;
+    return *sym;
+  }
+
+  //! \brief Inserts a new symbol to the end of the table.
+  int
+  elf64_symtab_section::add_symbol (
+      const std::string& name, elf64_symbol_type type, elf64_symbol_binding bind,
+      int sect_id, elf64_addr_t value, elf64_xword_t size)
+  {
+    symbol *sym = &this->new_symbol (bind);
     sym->index = 0;
     sym->name = (elf64_word_t)this->strtab.add_string (name);
     sym->type = type;
@@ -218,19 +228,7 @@ namespace jcc {
       const std::string& name, elf64_symbol_type type, elf64_symbol_binding bind,
       int sect_id, elf64_addr_t offset, elf64_xword_t size)
   {
-    symbol *sym = nullptr;
-    if (bind == STB_LOCAL)
-      {
-        this->syms_local.emplace_back ();
-        sym = &this->syms_local.back ();
-      }
-    else
-      {
-        this->syms_global.emplace_back ();
-        sym = &this->syms_global.back ();
-      }
-
-    sym->id = this->next_sym_id ++;
+    symbol *sym = &this->new_symbol (bind);
     sym->index = 0;
     sym->name = (elf64_word_t)this->strtab.add_string (name);
     sym->type = type;
@@ -261,29 +259,17 @@ namespace jcc {
   const elf64_symtab_section::symbol&
   elf64_symtab_section::get_symbol (int id) const
   {
-    for (auto& sym : this->syms_local)
-      {
-        if (sym.id == id)
-          return sym;
-        else if (sym.id > id)
-          break;
-      }
-
-    for (auto& sym : this->syms_global)
-      {
-        if (sym.id == id)
-          return sym;
-        else if (sym.id > id)
-          break;
-      }
+    if (id < 0 || id >= (int)this->id_locs.size ())
+      throw std::runtime_error ("elf64_symtab_section::get_symbol: ID not found");
 
-    throw std::runtime_error ("elf64_symtab_section::get_symbol: ID not found");
+    int loc = this->id_locs[id];
+    return (loc >= 0) ? this->syms_local[loc] : this->syms_global[-loc - 1];
   }
 
 
 
   void
-  elf64_symtab_section::write_symbol (std::ostream& strm, symbol& sym)
+  elf64_symtab_section::write_symbol (unsigned char *out, const symbol& sym) const
   {
     elf64_half_t sect_idx = sym.sect_id;
     elf64_section *sect = nullptr;
@@ -293,40 +279,29 @@ namespace jcc {
         sect_idx = (elf64_half_t)sect->get_index ();
       }
 
-    bin::write_u32_le (strm, sym.name);
-    bin::write_u8 (strm, ((unsigned char)sym.bind << 4) | (unsigned char)sym.type);
-    bin::write_u8 (strm, 0);
-    bin::write_u16_le (strm, sect_idx);
+    bin::write_u32_le (out, sym.name);
+    bin::write_u8 (out + 4, ((unsigned char)sym.bind << 4) | (unsigned char)sym.type);
+    bin::write_u8 (out + 5, 0);
+    bin::write_u16_le (out + 6, sect_idx);
     if (sym.val.is_ptr)
-      bin::write_u64_le (strm, sect->get_header ().sh_addr + sym.val.ptr.off);
+      bin::write_u64_le (out + 8, sect->get_header ().sh_addr + sym.val.ptr.off);
     else
-      bin::write_i64_le (strm, sym.val.num);
-    bin::write_i64_le (strm, sym.size);
+      bin::write_i64_le (out + 8, sym.val.num);
+    bin::write_i64_le (out + 16, sym.size);
   }
 
   void
   elf64_symtab_section::bake ()
   {
-    this->data.clear ();
-    std::ostringstream ss;
-
-    // null entry
-    bin::write_zeroes (ss, 24);
-
+    // symbol indices are needed by relocation sections, which are baked
+    // after symbol tables.
     int sym_idx = 1;
     for (auto& sym : this->syms_local)
-      {
-        sym.index = sym_idx ++;
-        this->write_symbol (ss, sym);
-      }
+      sym.index = sym_idx ++;
     for (auto& sym : this->syms_global)
-      {
-        sym.index = sym_idx ++;
-        this->write_symbol (ss, sym);
-      }
+      sym.index = sym_idx ++;
 
-    this->data = ss.str ();
-    this->shdr.sh_size = this->data.size ();
+    this->compute_size ();
     this->shdr.sh_link = (elf64_half_t)this->strtab.get_index ();
     this->shdr.sh_info = (elf64_word_t)this->syms_local.size () + 1; // +1 for null entry
   }
@@ -343,6 +318,25 @@ namespace jcc {
     return (size_t)this->shdr.sh_size;
   }
 
+  void
+  elf64_symtab_section::write (unsigned char *out) const
+  {
+    // null entry
+    std::memset (out, 0, 24);
+    out += 24;
+
+    for (auto& sym : this->syms_local)
+      {
+        this->write_symbol (out, sym);
+        out += 24;
+      }
+    for (auto& sym : this->syms_global)
+      {
+        this->write_symbol (out, sym);
+        out += 24;
+      }
+  }
+
   void
   elf64_symtab_section::load_raw (const unsigned char *raw, unsigned int len)
   {
@@ -352,21 +346,16 @@ namespace jcc {
     int next_idx = 1;
     for (unsigned int off = 24; off < len; off += 24)
       {
-        symbol sym;
-        sym.id = this->next_sym_id ++;
+        auto bind = (elf64_symbol_binding)(raw[off + 4] >> 4);
+        symbol& sym = this->new_symbol (bind);
         sym.index = next_idx ++;
         sym.name = bin::read_u32_le (raw + off);
         sym.type = (elf64_symbol_type)(raw[off + 4] & 0xf);
-        sym.bind = (elf64_symbol_binding)(raw[off + 4] >> 4);
+        sym.bind = bind;
         sym.sect_id = bin::read_u16_le (raw + off + 6);
         sym.val.is_ptr = false;
         sym.val.num = bin::read_u64_le (raw + off + 8);
         sym.size = bin::read_u64_le (raw + off + 16);
-
-        if (sym.bind == STB_LOCAL)
-          this->syms_local.push_back (sym);
-        else
-          this->syms_global.push_back (sym);
       }
   }
 
@@ -407,11 +396,8 @@ namespace jcc {
 
   elf64_progbits_section ::elf64_progbits_section (
       elf64_object_file& obj, const unsigned char *data, size_t len)
-    : elf64_section (obj)
+    : elf64_section (obj), data (data, len)
   {
-    this->data.resize (len);
-    std::memcpy (this->data.data (), data, len);
-
     this->init ();
   }
 
@@ -431,8 +417,7 @@ namespace jcc {
   void
   elf64_progbits_section::set_data (const unsigned char *data, size_t len)
   {
-    this->data.resize (len);
-    std::memcpy (this->data.data (), data, len);
+    this->data.assign (data, len);
     this->shdr.sh_size = this->data.size ();
   }
 
@@ -444,11 +429,25 @@ namespace jcc {
     return this->data.size ();
   }
 
+  void
+  elf64_progbits_section::write (unsigned char *out) const
+  {
+    if (!this->data.empty ())
+      std::memcpy (out, this->data.data (), this->data.size ());
+  }
+
   void
   elf64_progbits_section::load_raw (const unsigned char *raw, unsigned int len)
   {
-    this->data.resize (len);
-    std::memcpy (this->data.data (), raw, len);
+    this->data.assign (raw, len);
+    this->shdr.sh_size = len;
+  }
+
+  void
+  elf64_progbits_section::load_view (std::shared_ptr<const void> owner,
+                                     const unsigned char *raw, unsigned int len)
+  {
+    this->data = cow_buffer::make_view (std::move (owner), raw, len);
     this->shdr.sh_size = len;
   }
 
@@ -478,6 +477,13 @@ namespace jcc {
     return (size_t)this->shdr.sh_size;
   }
 
+  void
+  elf64_interp_section::write (unsigned char *out) const
+  {
+    std::memcpy (out, this->interp.data (),
+                 std::min ((size_t)this->shdr.sh_size, this->interp.size ()));
+  }
+
 
 
 //------------------------------------------------------------------------------
@@ -533,22 +539,24 @@ namespace jcc {
   elf64_dynamic_section::bake ()
   {
     this->shdr.sh_link = (elf64_word_t)this->strtab.get_index ();
+  }
 
-    std::ostringstream ss;
+  void
+  elf64_dynamic_section::write (unsigned char *out) const
+  {
     for (auto& ent : this->entries)
       {
-        bin::write_i64_le (ss, ent.tag);
+        bin::write_i64_le (out, ent.tag);
         if (ent.is_ptr)
-          bin::write_u64_le (ss, ent.ptr.sect->get_header ().sh_addr + ent.ptr.off);
+          bin::write_u64_le (out + 8, ent.ptr.sect->get_header ().sh_addr + ent.ptr.off);
         else
-          bin::write_i64_le (ss, ent.val);
+          bin::write_i64_le (out + 8, ent.val);
+        out += 16;
       }
 
     // include null entry
-    bin::write_i64_le (ss, DT_NULL);
-    bin::write_i64_le (ss, 0);
-
-    this->data = ss.str ();
+    bin::write_i64_le (out, DT_NULL);
+    bin::write_i64_le (out + 8, 0);
   }
 
   size_t
@@ -616,17 +624,19 @@ namespace jcc {
   {
     this->shdr.sh_info = (elf64_word_t)this->sect.get_index ();
     this->shdr.sh_link = (elf64_word_t)this->symtab.get_index ();
+  }
 
-    std::ostringstream ss;
+  void
+  elf64_rela_section::write (unsigned char *out) const
+  {
     for (auto& e : this->entries)
       {
         auto& sym = this->symtab.get_symbol (e.sym_id);
-        bin::write_u64_le (ss, (e.sect ? e.sect->get_header ().sh_addr : 0) + e.offset);
-        bin::write_u64_le (ss, ((elf64_xword_t)sym.index << 32) | e.type);
-        bin::write_i64_le (ss, e.add);
+        bin::write_u64_le (out, (e.sect ? e.sect->get_header ().sh_addr : 0) + e.offset);
+        bin::write_u64_le (out + 8, ((elf64_xword_t)sym.index << 32) | e.type);
+        bin::write_i64_le (out + 16, e.add);
+        out += 0x18;
       }
-
-    this->data = ss.str ();
   }
 
   size_t
@@ -688,32 +698,40 @@ namespace jcc {
     this->shdr.sh_link = (elf64_half_t)this->strtab.get_index ();
     this->compute_size ();
 
-    std::ostringstream ss;
+    for (auto& entry : this->entries)
+      for (auto& name : entry.names)
+        this->strtab.add_string (name);
+  }
+
+  void
+  elf64_verdef_section::write (unsigned char *out) const
+  {
     for (size_t i = 0; i < this->entries.size (); ++i)
       {
         auto& entry = this->entries[i];
 
-        bin::write_u16_le (ss, 1); // revision
-        bin::write_u16_le (ss, entry.flags);
-        bin::write_u16_le (ss, entry.index);
-        bin::write_u16_le (ss, (elf64_half_t)entry.names.size ());
-        bin::write_u32_le (ss, entry.hash);
-        bin::write_u32_le (ss, 0x14); // offset to auxiliary entries
+        bin::write_u16_le (out, 1); // revision
+        bin::write_u16_le (out + 2, entry.flags);
+        bin::write_u16_le (out + 4, entry.index);
+        bin::write_u16_le (out + 6, (elf64_half_t)entry.names.size ());
+        bin::write_u32_le (out + 8, entry.hash);
+        bin::write_u32_le (out + 12, 0x14); // offset to auxiliary entries
 
         // offset to next entry
-        bin::write_u32_le (ss,
+        bin::write_u32_le (out + 16,
           (i == this->entries.size () - 1)
             ? 0
             : (0x14 + (elf64_word_t)entry.names.size () * 8));
+        out += 0x14;
 
         // auxiliary entries:
         for (size_t j = 0; j < entry.names.size (); ++j)
           {
-            bin::write_u32_le (ss, (elf64_word_t)this->strtab.add_string (entry.names[j]));
-            bin::write_u32_le (ss, (j == entry.names.size () - 1) ? 0 : 8);
+            bin::write_u32_le (out, (elf64_word_t)this->strtab.get_string (entry.names[j]));
+            bin::write_u32_le (out + 4, (j == entry.names.size () - 1) ? 0 : 8);
+            out += 8;
           }
       }
-
   }
 
   size_t
@@ -797,22 +815,20 @@ namespace jcc {
   void
   elf64_versym_section::bake ()
   {
-    std::ostringstream ss;
-    for (elf64_half_t e : this->entries)
-      bin::write_u16_le (ss, e);
-
-    if (this->entries.size () < this->dynsym.get_count ())
-      {
-        size_t rem = this->dynsym.get_count () - this->entries.size ();
-        while (rem --> 0)
-          bin::write_u16_le (ss, 0);
-      }
-
-    this->data = ss.str ();
-    this->shdr.sh_size = this->data.size ();
+    this->compute_size ();
     this->shdr.sh_link = (elf64_half_t)this->dynsym.get_index ();
   }
 
+  void
+  elf64_versym_section::write (unsigned char *out) const
+  {
+    // symbols without an entry are local (zero)
+    size_t count = (size_t)this->shdr.sh_size / 2;
+    for (size_t i = 0; i < count; ++i)
+      bin::write_u16_le (out + 2 * i,
+                         (i < this->entries.size ()) ? this->entries[i] : 0);
+  }
+
   size_t
   elf64_versym_section::compute_size ()
   {
@@ -834,4 +850,235 @@ namespace jcc {
         this->entries[index++] = e;
       }
   }
+
+
+
+//------------------------------------------------------------------------------
+
+  //! \brief Returns the number of hash buckets to use for the specified number
+  //!        of symbols (the same sizes GNU ld uses).
+  static elf64_word_t
+  _hash_bucket_count (size_t num_syms)
+  {
+    static const elf64_word_t _sizes[] = {
+      1, 3, 17, 37, 67, 97, 131, 197, 263, 521, 1031, 2053, 4099, 8209,
+      16411, 32771, 65537, 131101, 262147, 0
+    };
+
+    elf64_word_t best = 1;
+    for (int i = 0; _sizes[i] != 0; ++i)
+      {
+        best = _sizes[i];
+        if (_sizes[i + 1] == 0 || num_syms < _sizes[i + 1])
+          break;
+      }
+
+    return best;
+  }
+
+
+
+  elf64_hash_section::elf64_hash_section (elf64_object_file& obj,
+                                          elf64_dynsym_section& dynsym)
+    : elf64_section (obj), dynsym (dynsym)
+  {
+    this->shdr.sh_type = SHT_HASH;
+    this->shdr.sh_addralign = 8;
+    this->shdr.sh_entsize = 4;
+    this->shdr.sh_flags = SHF_ALLOC;
+    this->num_buckets = 1;
+  }
+
+
+
+  void
+  elf64_hash_section::bake ()
+  {
+    this->compute_size ();
+    this->shdr.sh_link = (elf64_word_t)this->dynsym.get_index ();
+  }
+
+  size_t
+  elf64_hash_section::compute_size ()
+  {
+    size_t count = this->dynsym.get_count ();
+    this->num_buckets = _hash_bucket_count (count);
+    this->shdr.sh_size = 4 * (2 + this->num_buckets + count);
+    return (size_t)this->shdr.sh_size;
+  }
+
+  void
+  elf64_hash_section::write (unsigned char *out) const
+  {
+    size_t count = this->dynsym.get_count ();
+    std::vector<elf64_word_t> buckets (this->num_buckets, 0);
+    std::vector<elf64_word_t> chains (count, 0);
+
+    auto& strtab = this->dynsym.get_strtab ();
+    auto insert = [&] (const elf64_symtab_section::symbol& sym) {
+      auto b = elf64_hash (strtab.get_string ((int)sym.name)) % this->num_buckets;
+      chains[sym.index] = buckets[b];
+      buckets[b] = (elf64_word_t)sym.index;
+    };
+    for (auto& sym : this->dynsym.get_local_symbols ())
+      insert (sym);
+    for (auto& sym : this->dynsym.get_global_symbols ())
+      insert (sym);
+
+    bin::write_u32_le (out, this->num_buckets);
+    bin::write_u32_le (out + 4, (elf64_word_t)count);
+    out += 8;
+    for (auto b : buckets)
+      {
+        bin::write_u32_le (out, b);
+        out += 4;
+      }
+    for (auto c : chains)
+      {
+        bin::write_u32_le (out, c);
+        out += 4;
+      }
+  }
+
+
+
+//------------------------------------------------------------------------------
+
+  elf64_gnu_hash_section::elf64_gnu_hash_section (elf64_object_file& obj,
+                                                  elf64_dynsym_section& dynsym)
+    : elf64_section (obj), dynsym (dynsym)
+  {
+    this->shdr.sh_type = SHT_GNU_HASH;
+    this->shdr.sh_addralign = 8;
+    this->shdr.sh_flags = SHF_ALLOC;
+    this->num_buckets = 1;
+    this->bloom_size = 1;
+    this->bloom_shift = 6;
+    this->num_hashed = 0;
+  }
+
+
+
+  static bool
+  _is_hashed (const elf64_symtab_section::symbol& sym)
+  {
+    return sym.sect_id != 0; // undefined symbols are not hashed
+  }
+
+  void
+  elf64_gnu_hash_section::bake ()
+  {
+    this->compute_size ();
+    this->shdr.sh_link = (elf64_word_t)this->dynsym.get_index ();
+
+    // move hashed symbols to the end of the table, grouped by bucket.
+    auto& strtab = this->dynsym.get_strtab ();
+    std::unordered_map<int, elf64_word_t> keys;
+    for (auto& sym : this->dynsym.get_global_symbols ())
+      keys[sym.id] = _is_hashed (sym)
+          ? 1 + elf64_gnu_hash (strtab.get_string ((int)sym.name)) % this->num_buckets
+          : 0;
+
+    this->dynsym.sort_global_symbols (
+      [&keys] (const elf64_symtab_section::symbol& a,
+               const elf64_symtab_section::symbol& b) {
+        return keys[a.id] < keys[b.id];
+      });
+  }
+
+  size_t
+  elf64_gnu_hash_section::compute_size ()
+  {
+    this->num_hashed = 0;
+    for (auto& sym : this->dynsym.get_global_symbols ())
+      if (_is_hashed (sym))
+        ++ this->num_hashed;
+
+    this->num_buckets = _hash_bucket_count (this->num_hashed);
+
+    // bloom filter dimensions, as chosen by GNU ld for 64-bit targets
+    // (roughly 2-4 filter words per 64 symbols, two bits set per symbol).
+    int log2 = 0;
+    while (((size_t)1 << log2) < this->num_hashed)
+      ++ log2;
+    int mask_bits_log2 = log2 + 1;
+    if (mask_bits_log2 < 3)
+      mask_bits_log2 = 6;
+    else if (((size_t)1 << (mask_bits_log2 - 2)) & this->num_hashed)
+      mask_bits_log2 += 3;
+    else
+      mask_bits_log2 += 2;
+    if (mask_bits_log2 < 6)
+      mask_bits_log2 = 6;
+
+    this->bloom_shift = (elf64_word_t)mask_bits_log2;
+    this->bloom_size = (elf64_word_t)1 << (mask_bits_log2 - 6);
+
+    this->shdr.sh_size = 16 + 8 * this->bloom_size + 4 * this->num_buckets
+                         + 4 * this->num_hashed;
+    return (size_t)this->shdr.sh_size;
+  }
+
+  void
+  elf64_gnu_hash_section::write (unsigned char *out) const
+  {
+    size_t sym_offset = this->dynsym.get_count () - this->num_hashed;
+
+    std::vector<uint64_t> bloom (this->bloom_size, 0);
+    std::vector<elf64_word_t> buckets (this->num_buckets, 0);
+    std::vector<elf64_word_t> chains (this->num_hashed, 0);
+
+    auto& strtab = this->dynsym.get_strtab ();
+    elf64_word_t prev_bucket = 0;
+    for (auto& sym : this->dynsym.get_global_symbols ())
+      {
+        if (!_is_hashed (sym))
+          continue;
+        if ((size_t)sym.index < sym_offset)
+          throw std::runtime_error ("elf64_gnu_hash_section::write: symbol table not ordered");
+
+        auto h = elf64_gnu_hash (strtab.get_string ((int)sym.name));
+        auto b = h % this->num_buckets;
+
+        bloom[(h / 64) % this->bloom_size] |= ((uint64_t)1 << (h % 64))
+            | ((uint64_t)1 << ((h >> this->bloom_shift) % 64));
+
+        size_t ci = sym.index - sym_offset;
+        if (buckets[b] == 0)
+          {
+            // first symbol in bucket: terminate the previous bucket's chain
+            if (ci > 0)
+              chains[ci - 1] |= 1;
+            buckets[b] = (elf64_word_t)sym.index;
+          }
+        else if (b != prev_bucket)
+          throw std::runtime_error ("elf64_gnu_hash_section::write: symbol table not ordered");
+
+        chains[ci] = h & ~(elf64_word_t)1;
+        prev_bucket = b;
+      }
+    if (!chains.empty ())
+      chains.back () |= 1;
+
+    bin::write_u32_le (out, this->num_buckets);
+    bin::write_u32_le (out + 4, (elf64_word_t)sym_offset);
+    bin::write_u32_le (out + 8, this->bloom_size);
+    bin::write_u32_le (out + 12, this->bloom_shift);
+    out += 16;
+    for (auto w : bloom)
+      {
+        bin::write_u64_le (out, w);
+        out += 8;
+      }
+    for (auto b : buckets)
+      {
+        bin::write_u32_le (out, b);
+        out += 4;
+      }
+    for (auto c : chains)
+      {
+        bin::write_u32_le (out, c);
+        out += 4;
+      }
+  }
 }
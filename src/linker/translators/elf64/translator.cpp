@@ -22,6 +22,7 @@
 #include <ostream>
 #include <iostream>
 #include <sstream>
+#include <unordered_set>
 #include <common/binary.hpp>
 
 namespace jcc {
@@ -48,11 +49,73 @@ namespace jcc {
     this->obj.save (strm);
   }
 
+  /*!
+     \brief Translates the specified module straight into a memory mapping of
+            the output file.
+   */
+  void
+  elf64_module_translator::save_file (generic_module& mod,
+                                      const std::string& path)
+  {
+    this->mod = &mod;
+    this->build_object_file ();
+    this->mod = nullptr;
+
+    this->obj.save (path);
+  }
+
+  /*!
+     \brief Rewrites only the changed ranges of a previously saved module in
+            place, as long as the file's layout still matches.
+   */
+  bool
+  elf64_module_translator::update_file (generic_module& mod,
+                                        const std::string& path,
+                                        const std::vector<module_range>& ranges)
+  {
+    this->mod = &mod;
+    this->build_object_file ();
+    this->mod = nullptr;
+
+    std::vector<elf64_section_range> elf_ranges;
+    for (auto& r : ranges)
+      {
+        auto itr = this->sect_map.find (r.sect);
+        if (itr == this->sect_map.end ())
+          throw std::runtime_error ("elf64_module_translator::update_file: range in unknown section");
+        elf_ranges.push_back ({ itr->second, (elf64_xword_t)r.off, (elf64_xword_t)r.len });
+      }
+
+    if (this->obj.update (path, elf_ranges))
+      return true;
+
+    this->obj.save (path);
+    return false;
+  }
+
   std::shared_ptr<generic_module>
   elf64_module_translator::load (std::istream& strm)
   {
     this->obj.load (strm);
+    return this->translate_loaded ();
+  }
+
+  /*!
+     \brief Maps the specified file into memory and translates it.
 
+     Sections of the resulting module reference the mapping directly, and
+     are only copied if modified.
+   */
+  std::shared_ptr<generic_module>
+  elf64_module_translator::load_file (const std::string& path)
+  {
+    this->obj.load (std::make_shared<const mapped_file> (path));
+    return this->translate_loaded ();
+  }
+
+  std::shared_ptr<generic_module>
+  elf64_module_translator::translate_loaded ()
+  {
     auto& ehdr = this->obj.get_file_header ();
 
     // figure out module type
@@ -64,13 +127,13 @@ namespace jcc {
       case ET_DYN: mtype = module_type::shared; break;
 
       default:
-        throw std::runtime_error ("elf64_module_translator::load: unknown object file type");
+        throw std::runtime_error ("elf64_module_translator::translate_loaded: unknown object file type");
       }
 
     // extract target architecture
     target_architecture arch = target_architecture::x86_64;
     if (ehdr.e_machine != 62) // x86_64
-      throw std::runtime_error ("elf64_module_translator::load: unsupported architecture");
+      throw std::runtime_error ("elf64_module_translator::translate_loaded: unsupported architecture");
 
     this->mod = new generic_module (mtype, arch);
     this->parse_object_file ();
@@ -109,6 +172,7 @@ namespace jcc {
     this->add_got_plt ();
     this->add_plt ();
     this->add_relocations ();
+    this->add_exports ();
     this->add_dynamic_section ();
     this->set_entry_point ();
     this->add_segments ();
@@ -127,6 +191,10 @@ namespace jcc {
   {
     switch (s.get_type ())
       {
+      case SECT_PROGBITS:
+        this->handle_progbits_section (static_cast<progbits_section&> (s));
+        break;
+
       case SECT_CODE:
         this->handle_code_section (static_cast<code_section&> (s));
         break;
@@ -147,6 +215,17 @@ namespace jcc {
     this->sect_map[&s] = &text;
   }
 
+  void
+  elf64_module_translator::handle_progbits_section (progbits_section& s)
+  {
+    auto& sect = this->obj.add_progbits_section (s.get_name (),
+      s.get_data ().data (), s.get_data ().size ());
+    sect.set_flags (SHF_ALLOC | SHF_WRITE);
+    sect.set_alignment (8);
+
+    this->sect_map[&s] = &sect;
+  }
+
 
 
   void
@@ -162,11 +241,16 @@ namespace jcc {
     auto& dynstr = static_cast<elf64_strtab_section&> (this->obj.get_section_by_name (".dynstr"));
     auto& dynsym = static_cast<elf64_dynsym_section&> (this->obj.get_section_by_name (".dynsym"));
 
+    auto& hash = this->obj.add_hash_section (".hash", dynsym);
+    auto& gnu_hash = this->obj.add_gnu_hash_section (".gnu.hash", dynsym);
+
     auto& dynamic = this->obj.add_dynamic_section (".dynamic", dynstr);
 
     for (auto& imp : this->mod->get_imports ())
       dynamic.add (DT_NEEDED, (elf64_xword_t)dynstr.add_string (imp));
 
+    dynamic.add (DT_HASH, hash);
+    dynamic.add (DT_GNU_HASH, gnu_hash);
     dynamic.add (DT_STRTAB, dynstr);
     dynamic.add (DT_SYMTAB, dynsym);
     dynamic.add (DT_STRSZ, dynstr.compute_size ());
@@ -182,6 +266,27 @@ namespace jcc {
 
   }
 
+  //! \brief Inserts the module's export symbols into the dynamic symbol table.
+  void
+  elf64_module_translator::add_exports ()
+  {
+    if (this->mod->get_type () != module_type::shared)
+      return;
+
+    auto& dynsym = static_cast<elf64_dynsym_section&> (this->obj.get_section_by_name (".dynsym"));
+    for (auto& exp : this->mod->get_export_symbols ())
+      {
+        auto itr = this->sect_map.find (exp.sect);
+        if (itr == this->sect_map.end ())
+          throw std::runtime_error ("elf64_module_translator::add_exports: export symbol in unknown section");
+
+        auto type = (exp.type == export_symbol_type::function) ? STT_FUNC : STT_OBJECT;
+        auto off = exp.vaddr - static_cast<progbits_section *> (exp.sect)->get_vaddr ();
+        dynsym.add_symbol_ptr (exp.name, type, STB_GLOBAL,
+                               itr->second->get_id (), (elf64_addr_t)off);
+      }
+  }
+
   void
   elf64_module_translator::add_got_plt ()
   {
@@ -215,6 +320,7 @@ namespace jcc {
   void
   elf64_module_translator::add_relocations ()
   {
+    std::unordered_set<relocation_symbol_id> jump_slots;
     for (auto s : this->mod->get_sections ())
       {
         if (s->get_type () != SECT_CODE)
@@ -236,16 +342,7 @@ namespace jcc {
             rela = &this->obj.add_rela_section (".rela.text", text, *symtab);
           }
         else
-          {
-            symtab = static_cast<elf64_symtab_section*> (&this->obj.get_section_by_name (".dynsym"));
-            if (this->obj.has_section (".rela.plt"))
-              rela = static_cast<elf64_rela_section*> (&this->obj.get_section_by_name (".rela.plt"));
-            else
-              {
-                auto& plt = this->obj.get_section_by_name (".plt");
-                rela = &this->obj.add_rela_section (".rela.plt", plt, *symtab);
-              }
-          }
+          symtab = static_cast<elf64_symtab_section*> (&this->obj.get_section_by_name (".dynsym"));
 
         int sym_id;
         for (auto& reloc : relocs)
@@ -256,6 +353,27 @@ namespace jcc {
                   break;
 
                 case R_PC32:
+                if (this->mod->get_type () != module_type::relocatable)
+                  {
+                    // symbols defined in the module itself are resolved
+                    // statically, and every import needs only one slot.
+                    auto& imp_syms = this->mod->get_import_symbols ();
+                    auto itr = imp_syms.find (reloc.sym.id);
+                    if (itr == imp_syms.end () || !jump_slots.insert (reloc.sym.id).second)
+                      break;
+
+                    if (!rela)
+                      {
+                        if (this->obj.has_section (".rela.plt"))
+                          rela = static_cast<elf64_rela_section*> (&this->obj.get_section_by_name (".rela.plt"));
+                        else
+                          {
+                            auto& plt = this->obj.get_section_by_name (".plt");
+                            rela = &this->obj.add_rela_section (".rela.plt", plt, *symtab);
+                          }
+                      }
+                  }
+
                   sym_id = symtab->find_symbol_id (reloc.sym.store->get_name (reloc.sym.id));
                 if (sym_id == -1)
                   sym_id = symtab->add_symbol (reloc.sym.store->get_name (reloc.sym.id),
@@ -341,8 +459,8 @@ namespace jcc {
         // push relocation index
         asem.emit_push (imm_t (SS_DWORD, 4, i));
 
-        // jump to PLT[0]
-        asem.emit_jmp (lbl_t (lbl_start));
+        // jump to PLT[0] (not relaxed, entries are 16 bytes apart)
+        asem.emit_jmp (lbl_t (lbl_start, SS_DWORD));
 
         while (asem.get_size () % 16 != 0)
           asem.emit_nop ();
@@ -365,47 +483,58 @@ namespace jcc {
     if (!this->obj.has_section (".got.plt"))
       return;
 
-    auto plt_addr = this->obj.get_section_by_name (".plt").get_header ().sh_addr;
-
-    auto& imp_syms = this->mod->get_import_symbols ();
-    for (auto& p : imp_syms)
+    for (auto s : this->mod->get_sections ())
       {
-        auto sym = p.second;
-        auto& s = this->find_section_with_relocation (sym.rel);
-        auto& reloc = s.get_relocation (sym.rel);
-        auto plt_entry_addr = plt_addr + 16 + sym.index*8;
+        if (s->get_type () != SECT_CODE)
+          continue;
 
         // get corresponding ELF section
-        auto& sect = static_cast<elf64_progbits_section&> (*this->sect_map[&s]);
+        auto& cs = static_cast<code_section&> (*s);
+        auto& sect = static_cast<elf64_progbits_section&> (*this->sect_map[&cs]);
 
-        // fix relocation
         unsigned char* data = sect.get_data ();
-        switch (reloc.size)
+        for (auto& reloc : cs.get_relocations ())
           {
-          case 4:
-            bin::write_u32_le (data + reloc.offset,
-                               plt_entry_addr - (sect.get_header ().sh_addr + reloc.offset) + reloc.add);
-            break;
+            auto target = this->get_relocation_target (reloc);
+            switch (reloc.size)
+              {
+              case 4:
+                bin::write_u32_le (data + reloc.offset,
+                                   target - (sect.get_header ().sh_addr + reloc.offset) + reloc.add);
+                break;
 
-          default:
-            throw std::runtime_error ("elf64_module_translator::fix_relocations: unhandled relocation size");
+              default:
+                throw std::runtime_error ("elf64_module_translator::fix_relocations: unhandled relocation size");
+              }
           }
       }
   }
 
-  //! \brief Searches for the section that contains the specified relocation.
-  code_section&
-  elf64_module_translator::find_section_with_relocation (relocation_symbol_id id)
+  //! \brief Returns the address the specified relocation refers to.
+  elf64_addr_t
+  elf64_module_translator::get_relocation_target (const relocation& reloc)
   {
-    for (auto s : this->mod->get_sections ())
-      if (s->get_type () == SECT_CODE)
-        {
-          auto &sect = static_cast<code_section &> (*s);
-          if (sect.has_relocation (id))
-            return sect;
-        }
-
-    throw std::runtime_error ("elf64_module_translator::find_section_with_relocation: could not find section");
+    // imported symbols are reached through the PLT
+    auto& imp_syms = this->mod->get_import_symbols ();
+    auto itr = imp_syms.find (reloc.sym.id);
+    if (itr != imp_syms.end ())
+      {
+        auto plt_addr = this->obj.get_section_by_name (".plt").get_header ().sh_addr;
+        return plt_addr + 16 + itr->second.index*8;
+      }
+
+    // otherwise, the symbol is defined in this module
+    auto& name = reloc.sym.store->get_name (reloc.sym.id);
+    if (!this->mod->has_export_symbol (name))
+      throw std::runtime_error ("elf64_module_translator::fix_relocations: unresolved symbol: " + name);
+
+    auto& exp = this->mod->get_export_symbol (name);
+    auto sitr = this->sect_map.find (exp.sect);
+    if (sitr == this->sect_map.end ())
+      throw std::runtime_error ("elf64_module_translator::fix_relocations: symbol in unknown section: " + name);
+
+    auto off = exp.vaddr - static_cast<progbits_section *> (exp.sect)->get_vaddr ();
+    return sitr->second->get_header ().sh_addr + off;
   }
 
 
@@ -416,12 +545,21 @@ namespace jcc {
     if (!this->obj.has_section (".text"))
       return;
 
-    auto& text = this->obj.get_section_by_name (".text");
+    elf64_section *sect = &this->obj.get_section_by_name (".text");
+    elf64_xword_t off = 0;
 
-    this->obj.set_entry_point (text);
+    auto entry = this->mod->get_entry_point ();
+    auto itr = this->sect_map.find (entry.sect);
+    if (itr != this->sect_map.end ())
+      {
+        sect = itr->second;
+        off = (elf64_xword_t)entry.off;
+      }
+
+    this->obj.set_entry_point (*sect, off);
 
     auto& symtab = static_cast<elf64_symtab_section&> (this->obj.get_section_by_name (".symtab"));
-    symtab.add_symbol_ptr ("_start", STT_FUNC, STB_GLOBAL, text.get_id ());
+    symtab.add_symbol_ptr ("_start", STT_FUNC, STB_GLOBAL, sect->get_id (), off);
   }
 
 
@@ -440,7 +578,9 @@ namespace jcc {
     auto& main_seg = this->obj.add_segment (PT_LOAD);
     if (this->obj.has_section (".interp"))
       main_seg.add_section (obj.get_section_by_name (".interp"));
-    main_seg.add_section (obj.get_section_by_name (".dynsym"))
+    main_seg.add_section (obj.get_section_by_name (".hash"))
+        .add_section (obj.get_section_by_name (".gnu.hash"))
+        .add_section (obj.get_section_by_name (".dynsym"))
         .add_section (obj.get_section_by_name (".dynstr"));
     if (this->obj.has_section (".rela.plt"))
       main_seg.add_section (obj.get_section_by_name (".rela.plt"));
@@ -452,6 +592,9 @@ namespace jcc {
     auto& dyn_load_seg = this->obj.add_segment (PT_LOAD);
 //    if (this->obj.has_section (".got.plt"))
 //      dyn_load_seg.add_section (this->obj.get_section_by_name (".got.plt"));
+    for (auto s : this->mod->get_sections ())
+      if (s->get_type () == SECT_PROGBITS)
+        dyn_load_seg.add_section (*this->sect_map[s]);
     dyn_load_seg.add_section (obj.get_section_by_name (".dynamic"));
     dyn_load_seg.set_flags (PF_R | PF_W);
 
@@ -511,16 +654,14 @@ namespace jcc {
       {
         code_section sect (
             this->obj.get_shstrtab ()->get_string (shdr.sh_name),
-            (const unsigned char *)s.get_data (), (unsigned int)shdr.sh_size,
-            shdr.sh_addr);
+            s.get_buffer (), shdr.sh_addr);
         this->mod->add_section (std::move (sect));
       }
     else
       {
         progbits_section sect (
             this->obj.get_shstrtab ()->get_string (shdr.sh_name),
-            (const unsigned char *)s.get_data (), (unsigned int)shdr.sh_size,
-            shdr.sh_addr);
+            s.get_buffer (), shdr.sh_addr);
         this->mod->add_section (std::move (sect));
       }
   }
@@ -19,6 +19,7 @@
 #include "linker/translators/translator.hpp"
 #include <unordered_map>
 #include <stdexcept>
+#include <fstream>
 
 // translators:
 #include "linker/translators/elf64/translator.hpp"
@@ -30,6 +31,46 @@ namespace jcc {
   _create_elf64 ()
     { return std::make_unique<elf64_module_translator> (); }
   
+  /*!
+     \brief Translates the specified generic module into the file at the
+            specified path.
+   */
+  void
+  module_translator::save_file (generic_module& mod, const std::string& path)
+  {
+    std::ofstream fs (path, std::ios_base::out | std::ios_base::binary);
+    if (!fs)
+      throw std::runtime_error ("module_translator::save_file: could not open file");
+    this->save (mod, fs);
+  }
+
+  /*!
+     \brief Updates a file previously saved from an earlier version of the
+            specified module, which has kept its layout.
+   */
+  bool
+  module_translator::update_file (generic_module& mod, const std::string& path,
+                                  const std::vector<module_range>& ranges)
+  {
+    this->save_file (mod, path);
+    return false;
+  }
+
+  /*!
+     \brief Translates the platform-specific module stored in the file at
+            the specified path.
+   */
+  std::shared_ptr<generic_module>
+  module_translator::load_file (const std::string& path)
+  {
+    std::ifstream fs (path, std::ios_base::in | std::ios_base::binary);
+    if (!fs)
+      throw std::runtime_error ("module_translator::load_file: could not open file");
+    return this->load (fs);
+  }
+
+
+
   /*!
     \brief Factory method for creating translators.
    */
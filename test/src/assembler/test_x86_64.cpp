@@ -0,0 +1,249 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "catch.hpp"
+#include <assembler/x86_64/assembler.hpp>
+#include <vector>
+
+
+using namespace jcc::x86_64;
+
+
+//! \brief Returns the code emitted by the specified function.
+template<typename Fn>
+static std::vector<unsigned char>
+_encode (Fn&& fn)
+{
+  assembler asem;
+  fn (asem);
+  return std::vector<unsigned char> (asem.get_data (),
+                                     asem.get_data () + asem.get_size ());
+}
+
+using bytes = std::vector<unsigned char>;
+using M = mnemonic;
+
+TEST_CASE( "Table-driven x86-64 encoding", "[assembler][x86_64]" ) {
+
+  SECTION( "Integer instructions" ) {
+    REQUIRE( _encode ([] (assembler& a) { a.emit<M::add> (reg_t (REG_RAX), reg_t (REG_RCX)); })
+             == bytes ({ 0x48, 0x01, 0xC8 }) );
+    REQUIRE( _encode ([] (assembler& a) { a.emit<M::add> (reg_t (REG_R12B), reg_t (REG_AL)); })
+             == bytes ({ 0x41, 0x00, 0xC4 }) );
+    REQUIRE( _encode ([] (assembler& a) { a.emit<M::add> (reg_t (REG_SIL), reg_t (REG_DL)); })
+             == bytes ({ 0x40, 0x00, 0xD6 }) );
+    REQUIRE( _encode ([] (assembler& a) { a.emit<M::add> (reg_t (REG_R15), imm_t (-3)); })
+             == bytes ({ 0x49, 0x83, 0xC7, 0xFD }) );
+    REQUIRE( _encode ([] (assembler& a) { a.emit<M::add> (reg_t (REG_AX), imm_t (5)); })
+             == bytes ({ 0x66, 0x83, 0xC0, 0x05 }) );
+    REQUIRE( _encode ([] (assembler& a) { a.emit<M::mov> (reg_t (REG_EAX), imm_t (5)); })
+             == bytes ({ 0xB8, 0x05, 0x00, 0x00, 0x00 }) );
+    REQUIRE( _encode ([] (assembler& a) { a.emit<M::mov> (reg_t (REG_RAX), imm_t (5)); })
+             == bytes ({ 0x48, 0xC7, 0xC0, 0x05, 0x00, 0x00, 0x00 }) );
+    REQUIRE( _encode ([] (assembler& a) { a.emit<M::mov> (reg_t (REG_RAX), imm_t (0x123456789aLL)); })
+             == bytes ({ 0x48, 0xB8, 0x9A, 0x78, 0x56, 0x34, 0x12, 0x00, 0x00, 0x00 }) );
+    REQUIRE( _encode ([] (assembler& a) { a.emit<M::movzx> (reg_t (REG_R11), reg_t (REG_CX)); })
+             == bytes ({ 0x4C, 0x0F, 0xB7, 0xD9 }) );
+    REQUIRE( _encode ([] (assembler& a) { a.emit<M::imul> (reg_t (REG_EAX), reg_t (REG_ECX), imm_t (10)); })
+             == bytes ({ 0x6B, 0xC1, 0x0A }) );
+    REQUIRE( _encode ([] (assembler& a) { a.emit<M::setg> (reg_t (REG_R9B)); })
+             == bytes ({ 0x41, 0x0F, 0x9F, 0xC1 }) );
+    REQUIRE( _encode ([] (assembler& a) { a.emit<M::push> (reg_t (REG_R12)); })
+             == bytes ({ 0x41, 0x54 }) );
+    REQUIRE( _encode ([] (assembler& a) { a.emit<M::cqo> (); })
+             == bytes ({ 0x48, 0x99 }) );
+
+    REQUIRE_THROWS_AS( _encode ([] (assembler& a) { a.emit<M::add> (reg_t (REG_AH), reg_t (REG_SIL)); }),
+                       invalid_instruction_error );
+  }
+
+  SECTION( "Memory operands" ) {
+    REQUIRE( _encode ([] (assembler& a) { a.emit<M::mov> (reg_t (REG_RAX), mem_t (SS_QWORD, REG_R13)); })
+             == bytes ({ 0x49, 0x8B, 0x45, 0x00 }) );
+    REQUIRE( _encode ([] (assembler& a) {
+               a.emit<M::mov> (mem_t (SS_QWORD, REG_R12, 8, REG_R9, 0, 0x100), reg_t (REG_RDX)); })
+             == bytes ({ 0x4B, 0x89, 0x94, 0xCC, 0x00, 0x01, 0x00, 0x00 }) );
+    REQUIRE( _encode ([] (assembler& a) {
+               a.emit<M::sub> (mem_t (SS_QWORD, REG_RSP, 1, REG_NONE, 0, 8), imm_t (1)); })
+             == bytes ({ 0x48, 0x83, 0x6C, 0x24, 0x08, 0x01 }) );
+    REQUIRE( _encode ([] (assembler& a) {
+               a.emit<M::mov> (reg_t (REG_EAX), mem_t (SS_DWORD, REG_RIP, 1, REG_NONE, 4, 0x10)); })
+             == bytes ({ 0x8B, 0x05, 0x10, 0x00, 0x00, 0x00 }) );
+    REQUIRE( _encode ([] (assembler& a) {
+               a.emit<M::mov> (reg_t (REG_EDX), mem_t (SS_DWORD, REG_NONE, 4, REG_RAX, 4, 0x20)); })
+             == bytes ({ 0x8B, 0x14, 0x85, 0x20, 0x00, 0x00, 0x00 }) );
+  }
+
+  SECTION( "SSE instructions" ) {
+    REQUIRE( _encode ([] (assembler& a) { a.emit<M::addsd> (reg_t (reg_xmm (0)), reg_t (reg_xmm (1))); })
+             == bytes ({ 0xF2, 0x0F, 0x58, 0xC1 }) );
+    REQUIRE( _encode ([] (assembler& a) {
+               a.emit<M::movsd> (mem_t (SS_QWORD, REG_RSP, 1, REG_NONE, 0, 16), reg_t (reg_xmm (9))); })
+             == bytes ({ 0xF2, 0x44, 0x0F, 0x11, 0x4C, 0x24, 0x10 }) );
+    REQUIRE( _encode ([] (assembler& a) { a.emit<M::cvtsi2sd> (reg_t (reg_xmm (0)), reg_t (REG_RAX)); })
+             == bytes ({ 0xF2, 0x48, 0x0F, 0x2A, 0xC0 }) );
+    REQUIRE( _encode ([] (assembler& a) { a.emit<M::movq> (reg_t (REG_R10), reg_t (reg_xmm (12))); })
+             == bytes ({ 0x66, 0x4D, 0x0F, 0x7E, 0xE2 }) );
+    REQUIRE( _encode ([] (assembler& a) { a.emit<M::pmulld> (reg_t (reg_xmm (9)), reg_t (reg_xmm (2))); })
+             == bytes ({ 0x66, 0x44, 0x0F, 0x38, 0x40, 0xCA }) );
+  }
+
+  SECTION( "AVX instructions" ) {
+    REQUIRE( _encode ([] (assembler& a) {
+               a.emit<M::vaddps> (reg_t (reg_ymm (0)), reg_t (reg_ymm (1)), reg_t (reg_ymm (2))); })
+             == bytes ({ 0xC5, 0xF4, 0x58, 0xC2 }) );
+    REQUIRE( _encode ([] (assembler& a) {
+               a.emit<M::vsubps> (reg_t (reg_ymm (1)), reg_t (reg_ymm (2)), reg_t (reg_ymm (12))); })
+             == bytes ({ 0xC4, 0xC1, 0x6C, 0x5C, 0xCC }) );
+    REQUIRE( _encode ([] (assembler& a) {
+               a.emit<M::vfmadd231sd> (reg_t (reg_xmm (0)), reg_t (reg_xmm (1)), reg_t (reg_xmm (2))); })
+             == bytes ({ 0xC4, 0xE2, 0xF1, 0xB9, 0xC2 }) );
+    REQUIRE( _encode ([] (assembler& a) { a.emit<M::vmovdqu> (reg_t (reg_ymm (1)), reg_t (reg_ymm (9))); })
+             == bytes ({ 0xC5, 0x7E, 0x7F, 0xC9 }) );
+    REQUIRE( _encode ([] (assembler& a) { a.emit<M::vzeroupper> (); })
+             == bytes ({ 0xC5, 0xF8, 0x77 }) );
+  }
+
+  SECTION( "Labels" ) {
+    auto code = _encode ([] (assembler& a) {
+      auto lbl = a.make_and_mark_label ();
+      a.emit<M::nop> ();
+      a.emit<M::jne> (lbl_t (lbl, SS_BYTE));
+      a.emit<M::jmp> (lbl_t (lbl, SS_DWORD));
+      a.emit_jmp (lbl_t (lbl, SS_DWORD));
+      a.fix_labels ();
+    });
+    REQUIRE( code == bytes ({ 0x90, 0x75, 0xFD, 0xE9, 0xF8, 0xFF, 0xFF, 0xFF,
+                              0xE9, 0xF3, 0xFF, 0xFF, 0xFF }) );
+  }
+
+  SECTION( "External memory" ) {
+    unsigned char mem[18];
+    assembler asem (mem, sizeof mem);
+    asem.emit<M::add> (reg_t (REG_RAX), reg_t (REG_RCX));
+    asem.emit_nop ();
+    REQUIRE( asem.get_data () == mem );
+    REQUIRE( asem.get_size () == 4 );
+    REQUIRE( bytes (mem, mem + 4) == bytes ({ 0x48, 0x01, 0xC8, 0x90 }) );
+
+    // less room left than a worst-case instruction, but these still fit
+    auto lbl = asem.make_label ();
+    asem.mark_label (lbl);
+    asem.emit<M::call> (rel_t (jcc::relocation_symbol { nullptr, 1 }));
+    asem.emit<M::jmp> (lbl_t (lbl, SS_DWORD));
+    REQUIRE( asem.get_size () == 14 );
+
+    // code that does not fit is dropped along with what it recorded
+    REQUIRE_THROWS_AS( asem.emit<M::mov> (reg_t (REG_RAX),
+                                          imm_t (0x123456789aLL)),
+                       jcc::code_buffer_full_error );
+    REQUIRE_THROWS_AS( asem.emit<M::call> (rel_t (
+                           jcc::relocation_symbol { nullptr, 2 })),
+                       jcc::code_buffer_full_error );
+    REQUIRE_THROWS_AS( asem.emit<M::jmp> (lbl_t (lbl, SS_DWORD)),
+                       jcc::code_buffer_full_error );
+    REQUIRE( asem.get_size () == 14 );
+
+    for (int i = 0; i < 4; ++i)
+      asem.emit<M::nop> ();
+    REQUIRE_THROWS_AS( asem.emit<M::nop> (), jcc::code_buffer_full_error );
+    asem.fix_labels ();
+
+    REQUIRE( bytes (mem, mem + 18) == bytes ({
+        0x48, 0x01, 0xC8, 0x90, 0xE8, 0x00, 0x00, 0x00, 0x00,
+        0xE9, 0xF6, 0xFF, 0xFF, 0xFF, 0x90, 0x90, 0x90, 0x90 }) );
+    REQUIRE( asem.get_relocations ().size () == 1 );
+    REQUIRE( asem.get_relocations ()[0].offset == 5 );
+  }
+
+  SECTION( "Buffer growth" ) {
+    assembler asem;
+    for (int i = 0; i < 1000; ++i)
+      asem.emit<M::mov> (reg_t (REG_RAX), imm_t (0x123456789aLL));
+    REQUIRE( asem.get_size () == 10000 );
+    REQUIRE( asem.get_data ()[9990] == 0x48 );
+    REQUIRE( asem.get_data ()[9999] == 0x00 );
+  }
+}
+
+TEST_CASE( "Branch relaxation", "[assembler][x86_64]" ) {
+
+  SECTION( "Short branches" ) {
+    auto code = _encode ([] (assembler& a) {
+      auto lbl_top = a.make_and_mark_label ();
+      auto lbl_end = a.make_label ();
+      a.emit<M::je> (lbl_t (lbl_end));
+      a.emit<M::nop> ();
+      a.emit_jmp (lbl_t (lbl_top));
+      a.mark_label (lbl_end);
+      a.emit<M::jmp> (lbl_t (lbl_top));
+      a.fix_labels ();
+    });
+    REQUIRE( code == bytes ({ 0x74, 0x03, 0x90, 0xEB, 0xFB, 0xEB, 0xF9 }) );
+  }
+
+  SECTION( "Long branches" ) {
+    // the second jump is too far from its label, and growing it pushes
+    // the first jump's label out of range as well.
+    for (int nops : { 121, 122 })
+      {
+        auto code = _encode ([nops] (assembler& a) {
+          auto lbl_a = a.make_label ();
+          auto lbl_b = a.make_label ();
+          a.emit<M::jmp> (lbl_t (lbl_a));
+          for (int i = 0; i < nops; ++i)
+            a.emit<M::nop> ();
+          a.emit<M::jne> (lbl_t (lbl_b));
+          a.mark_label (lbl_a);
+          for (int i = 0; i < 200; ++i)
+            a.emit<M::nop> ();
+          a.mark_label (lbl_b);
+          a.fix_labels ();
+        });
+
+        size_t j2 = (nops == 121) ? 123 : 127;
+        REQUIRE( code.size () == j2 + 6 + 200 );
+        if (nops == 121)
+          REQUIRE( bytes (code.begin (), code.begin () + 2) == bytes ({ 0xEB, 0x7F }) );
+        else
+          REQUIRE( bytes (code.begin (), code.begin () + 5)
+                   == bytes ({ 0xE9, 0x80, 0x00, 0x00, 0x00 }) );
+        REQUIRE( bytes (code.begin () + j2, code.begin () + j2 + 6)
+                 == bytes ({ 0x0F, 0x85, 0xC8, 0x00, 0x00, 0x00 }) );
+      }
+  }
+
+  SECTION( "Offsets are updated" ) {
+    assembler asem;
+    auto lbl = asem.make_label ();
+    asem.emit<M::jmp> (lbl_t (lbl));
+    asem.fix_labels ();
+    REQUIRE( asem.get_size () == 5 );
+
+    asem.emit<M::call> (rel_t (jcc::relocation_symbol { nullptr, 1 }));
+    asem.mark_label (lbl);
+    asem.emit<M::jmp> (lbl_t (lbl));
+    asem.fix_labels ();
+
+    auto code = bytes (asem.get_data (), asem.get_data () + asem.get_size ());
+    REQUIRE( code == bytes ({ 0xEB, 0x05, 0xE8, 0x00, 0x00, 0x00, 0x00,
+                              0xEB, 0xFE }) );
+    REQUIRE( asem.get_relocations ().size () == 1 );
+    REQUIRE( asem.get_relocations ()[0].offset == 3 );
+  }
+}
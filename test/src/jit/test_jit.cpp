@@ -0,0 +1,141 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "catch.hpp"
+#include <jit/jit.hpp>
+#include <cstring>
+
+
+using namespace jcc;
+using namespace jcc::x86_64;
+using M = mnemonic;
+
+
+static int
+_host_twice (int x)
+{
+  return x * 2;
+}
+
+TEST_CASE( "JIT", "[jit]" ) {
+  jit j;
+
+  SECTION( "Simple function" ) {
+    // int add (int a, int b) { return a + b; }
+    assembler asem;
+    asem.emit<M::mov> (reg_t (REG_EAX), reg_t (REG_EDI));
+    asem.emit<M::add> (reg_t (REG_EAX), reg_t (REG_ESI));
+    asem.emit<M::ret> ();
+
+    auto ptr = j.load ("add", asem);
+    auto fn = j.get_function<int (int, int)> ("add");
+    REQUIRE( (void *)fn == ptr );
+    REQUIRE( fn (2, 3) == 5 );
+    REQUIRE( fn (-7, 3) == -4 );
+  }
+
+  SECTION( "Calls to other symbols" ) {
+    relocation_symbol_store store;
+    j.define_symbol ("twice", (const void *)&_host_twice);
+
+    // int quad (int x) { return twice (twice (x)); }
+    assembler asem;
+    asem.emit<M::sub> (reg_t (REG_RSP), imm_t (8));
+    asem.emit<M::call> (rel_t (store.get ("twice")));
+    asem.emit<M::mov> (reg_t (REG_EDI), reg_t (REG_EAX));
+    asem.emit<M::call> (rel_t (store.get ("twice")));
+    asem.emit<M::add> (reg_t (REG_RSP), imm_t (8));
+    asem.emit<M::ret> ();
+    j.load ("quad", asem);
+    REQUIRE( j.get_function<int (int)> ("quad") (5) == 20 );
+
+    // int fact (int n) { return (n <= 1) ? 1 : n * fact (n - 1); }
+    assembler fact;
+    auto lbl_rec = fact.make_label ();
+    fact.emit<M::cmp> (reg_t (REG_EDI), imm_t (1));
+    fact.emit<M::jg> (lbl_t (lbl_rec));
+    fact.emit<M::mov> (reg_t (REG_EAX), imm_t (1));
+    fact.emit<M::ret> ();
+    fact.mark_label (lbl_rec);
+    fact.emit<M::push> (reg_t (REG_RBX));
+    fact.emit<M::mov> (reg_t (REG_EBX), reg_t (REG_EDI));
+    fact.emit<M::lea> (reg_t (REG_EDI), mem_t (SS_DWORD, REG_RDI, 1, REG_NONE, 0, -1));
+    fact.emit<M::call> (rel_t (store.get ("fact")));
+    fact.emit<M::imul> (reg_t (REG_EAX), reg_t (REG_EBX));
+    fact.emit<M::pop> (reg_t (REG_RBX));
+    fact.emit<M::ret> ();
+    fact.fix_labels ();
+    j.load ("fact", fact);
+    REQUIRE( j.get_function<int (int)> ("fact") (5) == 120 );
+
+    // loaded code can be called like any other symbol
+    assembler asem2;
+    asem2.emit<M::jmp> (rel_t (store.get ("quad")));
+    j.load ("quad2", asem2);
+    REQUIRE( j.get_function<int (int)> ("quad2") (3) == 12 );
+
+    assembler bad;
+    bad.emit<M::jmp> (rel_t (store.get ("undefined")));
+    REQUIRE_THROWS_AS( j.load ("bad", bad), jit_error );
+    REQUIRE( j.find_symbol ("bad") == nullptr );
+  }
+
+  SECTION( "Out-of-range references" ) {
+    relocation_symbol_store store;
+
+    // far from anything the JIT maps (never dereferenced)
+    auto mem = j.allocate (64);
+    auto far = (const unsigned char *)((uintptr_t)mem + ((uintptr_t)1 << 40));
+    j.define_symbol ("far", far);
+
+    // jmp far: goes through a stub
+    std::vector<unsigned char> jmp { 0xE9, 0, 0, 0, 0 };
+    auto ptr = (unsigned char *)j.load ("jmp_far", jmp.data (), jmp.size (),
+        { { R_PC32, store.get ("far"), 1, 4, -4, true } });
+    int32_t disp;
+    std::memcpy (&disp, ptr + 1, 4);
+    auto stub = ptr + 5 + disp;
+    REQUIRE( stub[0] == 0xFF );
+    REQUIRE( stub[1] == 0x25 );
+    const unsigned char *stub_target;
+    std::memcpy (&stub_target, stub + 6, 8);
+    REQUIRE( stub_target == far );
+
+    // lea rax, [rip + far]; ret: a stub would give the wrong address
+    std::vector<unsigned char> lea { 0x48, 0x8D, 0x05, 0, 0, 0, 0, 0xC3 };
+    REQUIRE_THROWS_AS( j.load ("lea_far", lea.data (), lea.size (),
+        { { R_PC32, store.get ("far"), 3, 4, -4, false } }), jit_error );
+    REQUIRE( j.find_symbol ("lea_far") == nullptr );
+
+    // also when emitted in place
+    std::memcpy (mem, lea.data (), lea.size ());
+    REQUIRE_THROWS_AS( j.load ("lea_far", mem, lea.size (),
+        { { R_PC32, store.get ("far"), 3, 4, -4, false } }), jit_error );
+  }
+
+  SECTION( "Emitting in place" ) {
+    auto mem = j.allocate (64);
+    assembler asem (mem, 48);
+    asem.emit<M::lea> (reg_t (REG_EAX), mem_t (SS_DWORD, REG_RDI, 1, REG_RDI, 0));
+    asem.emit<M::ret> ();
+
+    auto ptr = j.load ("dbl", asem);
+    REQUIRE( ptr == (void *)mem );
+    REQUIRE( j.get_function<int (int)> ("dbl") (21) == 42 );
+  }
+}
@@ -0,0 +1,362 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "catch.hpp"
+#include <jtac/assembler.hpp>
+#include <jtac/control_flow.hpp>
+#include <jtac/data_flow.hpp>
+#include <jtac/ssa.hpp>
+#include <jtac/allocation/allocator.hpp>
+#include <jtac/allocation/interference_graph.hpp>
+#include <set>
+#include <stdexcept>
+#include <unordered_map>
+
+
+using namespace jcc;
+
+
+//! \brief Emits a loop that keeps five variables live across its body.
+static std::vector<jtac::jtac_instruction>
+_make_loop_insts ()
+{
+  using namespace jcc::jtac;
+  assembler asem;
+
+  for (int i = 1; i <= 5; ++i)
+    asem.emit_assign (jtac_var (i), jtac_const (i));
+  asem.emit_assign (jtac_var (6), jtac_const (0));
+
+  int lbl_loop = asem.make_and_mark_label ();
+  int lbl_end = asem.make_label ();
+  asem.emit_cmp (jtac_var (6), jtac_const (100));
+  asem.emit_jge (jtac_label (lbl_end));
+  asem.emit_assign_add (jtac_var (7), jtac_var (1), jtac_var (2));
+  asem.emit_assign_add (jtac_var (8), jtac_var (3), jtac_var (4));
+  asem.emit_assign (jtac_var (9), jtac_var (8));   // move
+  asem.emit_assign_add (jtac_var (7), jtac_var (7), jtac_var (9));
+  asem.emit_assign_add (jtac_var (7), jtac_var (7), jtac_var (5));
+  asem.emit_assign_add (jtac_var (6), jtac_var (6), jtac_var (7));
+  asem.emit_jmp (jtac_label (lbl_loop));
+
+  asem.mark_label (lbl_end);
+  asem.emit_ret (jtac_var (6));
+
+  asem.fix_labels ();
+  return asem.get_instructions ();
+}
+
+/*!
+   \brief Checks that no two interfering variables in the specified CFG have
+          been assigned the same color.
+   \return The number of moves left in the CFG.
+
+   Names joined by a phi-function form a single live range, and so are not
+   considered to interfere with each other. Names left without a definition
+   (their move was coalesced away) share the register of the move's source
+   and are skipped as well.
+ */
+static int
+_check_coloring (const jtac::control_flow_graph& cfg,
+                 const jtac::register_allocation& res, int num_colors)
+{
+  using namespace jcc::jtac;
+
+  live_analyzer la;
+  auto lr = la.analyze (cfg);
+
+  auto color_of = [&] (const jtac_tagged_operand& opr) {
+    auto col = res.get_color (opr.val.var.get_id ());
+    REQUIRE( col >= 0 );
+    REQUIRE( col < num_colors );
+    return col;
+  };
+
+  std::set<jtac_var_id> defined;
+  std::unordered_map<jtac_var_id, int> phi_groups;
+  for (auto blk : cfg.get_blocks ())
+    for (auto& inst : blk->get_instructions ())
+      {
+        if (inst.op == JTAC_SOP_LOAD || (is_opcode_assign (inst.op)
+                                         && inst.oprs[0].type == JTAC_OPR_VAR))
+          defined.insert (inst.oprs[0].val.var.get_id ());
+        if (inst.op == JTAC_SOP_ASSIGN_PHI)
+          {
+            int group = (int)phi_groups.size () + 1;
+            phi_groups[inst.oprs[0].val.var.get_id ()] = group;
+            for (int i = 0; i < inst.extra.count; ++i)
+              phi_groups[inst.extra.oprs[i].val.var.get_id ()] = group;
+          }
+      }
+  auto same_group = [&] (jtac_var_id a, jtac_var_id b) {
+    auto itr_a = phi_groups.find (a);
+    auto itr_b = phi_groups.find (b);
+    return itr_a != phi_groups.end () && itr_b != phi_groups.end ()
+           && itr_a->second == itr_b->second;
+  };
+
+  int num_moves = 0;
+  for (auto blk : cfg.get_blocks ())
+    {
+      auto live = lr.get_live_out (blk->get_id ());
+
+      auto& insts = blk->get_instructions ();
+      for (auto itr = insts.rbegin (); itr != insts.rend (); ++itr)
+        {
+          auto& inst = *itr;
+          if (inst.op == JTAC_SOP_UNLOAD)
+            continue;
+          else if (inst.op == JTAC_SOP_STORE)
+            {
+              live.insert (inst.oprs[0].val.var.get_id ());
+              continue;
+            }
+
+          jtac_var_id move_src = 0;
+          bool is_move = inst.op == JTAC_OP_ASSIGN
+                         && inst.oprs[1].type == JTAC_OPR_VAR;
+          if (is_move)
+            {
+              ++ num_moves;
+              move_src = inst.oprs[1].val.var.get_id ();
+            }
+
+          bool defines = inst.op == JTAC_SOP_LOAD
+                         || (is_opcode_assign (inst.op)
+                             && inst.oprs[0].type == JTAC_OPR_VAR);
+          if (defines)
+            {
+              auto def = inst.oprs[0].val.var.get_id ();
+              for (auto var : live)
+                if (var != def && !(is_move && var == move_src)
+                    && defined.count (var) && !same_group (var, def))
+                  REQUIRE( color_of (inst.oprs[0])
+                           != res.get_color (var) );
+
+              // names joined by a phi-function share a register, so a
+              // definition ends the lifetime of its whole group.
+              for (auto itr = live.begin (); itr != live.end (); )
+                if (*itr == def || same_group (*itr, def))
+                  itr = live.erase (itr);
+                else
+                  ++ itr;
+            }
+
+          if (inst.op == JTAC_SOP_LOAD || inst.op == JTAC_SOP_ASSIGN_PHI)
+            continue;
+
+          int opr_start = is_opcode_assign (inst.op) ? 1 : 0;
+          for (int i = opr_start; i < get_operand_count (inst.op); ++i)
+            if (inst.oprs[i].type == JTAC_OPR_VAR)
+              {
+                color_of (inst.oprs[i]);
+                live.insert (inst.oprs[i].val.var.get_id ());
+              }
+        }
+    }
+
+  return num_moves;
+}
+
+
+//! \brief Counts the number of spill stores in the specified CFG.
+static int
+_count_spills (const jtac::control_flow_graph& cfg)
+{
+  int num_spills = 0;
+  for (auto blk : cfg.get_blocks ())
+    for (auto& inst : blk->get_instructions ())
+      if (inst.op == jtac::JTAC_SOP_STORE)
+        ++ num_spills;
+  return num_spills;
+}
+
+
+//! \brief Emits a loop whose variable is copied into a short-lived
+//!        variable after the loop, while three cold variables stay live
+//!        across it.
+static std::vector<jtac::jtac_instruction>
+_make_coalesced_loop_insts ()
+{
+  using namespace jcc::jtac;
+  assembler asem;
+
+  for (int i = 1; i <= 3; ++i)
+    asem.emit_assign (jtac_var (i), jtac_const (i));
+  asem.emit_assign (jtac_var (4), jtac_const (7));
+  asem.emit_assign (jtac_var (5), jtac_const (0));
+
+  int lbl_loop = asem.make_and_mark_label ();
+  int lbl_end = asem.make_label ();
+  asem.emit_cmp (jtac_var (5), jtac_const (100));
+  asem.emit_jge (jtac_label (lbl_end));
+  asem.emit_assign_add (jtac_var (4), jtac_var (4), jtac_var (5));
+  asem.emit_assign_add (jtac_var (4), jtac_var (4), jtac_var (5));
+  asem.emit_assign_add (jtac_var (5), jtac_var (5), jtac_const (1));
+  asem.emit_jmp (jtac_label (lbl_loop));
+
+  asem.mark_label (lbl_end);
+  asem.emit_assign (jtac_var (6), jtac_var (4));   // move
+  asem.emit_assign_add (jtac_var (7), jtac_var (1), jtac_var (2));
+  asem.emit_assign_add (jtac_var (7), jtac_var (7), jtac_var (3));
+  asem.emit_assign_add (jtac_var (7), jtac_var (7), jtac_var (6));
+  asem.emit_ret (jtac_var (7));
+
+  asem.fix_labels ();
+  return asem.get_instructions ();
+}
+
+
+TEST_CASE( "Iterated register coalescing", "[jtac][ssa][allocation]" ) {
+  using namespace jcc::jtac;
+
+  auto insts = _make_loop_insts ();
+
+  SECTION( "Enough registers" ) {
+    auto cfg = control_flow_analyzer::make_cfg (insts);
+    ssa_builder ssab;
+    ssab.transform (cfg);
+
+    auto alloc = make_register_allocator (register_allocator_type::irc);
+    auto res = alloc->allocate (cfg, 8);
+
+    // the move t9 = t8 is coalesced away
+    REQUIRE( _check_coloring (cfg, res, 8) == 0 );
+    REQUIRE( _count_spills (cfg) == 0 );
+  }
+
+  SECTION( "Spilling under register pressure" ) {
+    auto cfg = control_flow_analyzer::make_cfg (insts);
+    ssa_builder ssab;
+    ssab.transform (cfg);
+
+    auto alloc = make_register_allocator (register_allocator_type::irc);
+    auto res = alloc->allocate (cfg, 3);
+
+    REQUIRE( _count_spills (cfg) > 0 );
+    _check_coloring (cfg, res, 3);
+  }
+
+  SECTION( "Coalesced nodes keep their partners' spill costs" ) {
+    // the loop variable is coalesced into the copy made after the loop;
+    // the merged node must be ranked by the loop's uses, not by the copy's.
+    auto cfg = control_flow_analyzer::make_cfg (_make_coalesced_loop_insts ());
+    ssa_builder ssab;
+    ssab.transform (cfg);
+
+    auto alloc = make_register_allocator (register_allocator_type::irc);
+    auto res = alloc->allocate (cfg, 3);
+    _check_coloring (cfg, res, 3);
+
+    REQUIRE( _count_spills (cfg) > 0 );
+    for (auto blk : cfg.get_blocks ())
+      if (blk->get_id () == 2 || blk->get_id () == 3)  // loop header and body
+        for (auto& inst : blk->get_instructions ())
+          {
+            REQUIRE( inst.op != JTAC_SOP_LOAD );
+            REQUIRE( inst.op != JTAC_SOP_STORE );
+          }
+  }
+}
+
+TEST_CASE( "Linear scan register allocation", "[jtac][ssa][allocation]" ) {
+  using namespace jcc::jtac;
+
+  auto insts = _make_loop_insts ();
+
+  SECTION( "Enough registers" ) {
+    auto cfg = control_flow_analyzer::make_cfg (insts);
+    ssa_builder ssab;
+    ssab.transform (cfg);
+
+    auto alloc = make_register_allocator (register_allocator_type::linear_scan);
+    auto res = alloc->allocate (cfg, 8);
+
+    // t9 is hinted to t8's register, so the move goes away
+    REQUIRE( _check_coloring (cfg, res, 8) == 0 );
+    REQUIRE( _count_spills (cfg) == 0 );
+  }
+
+  SECTION( "Spilling under register pressure" ) {
+    auto cfg = control_flow_analyzer::make_cfg (insts);
+    ssa_builder ssab;
+    ssab.transform (cfg);
+
+    auto alloc = make_register_allocator (register_allocator_type::linear_scan);
+    auto res = alloc->allocate (cfg, 3);
+
+    REQUIRE( _count_spills (cfg) > 0 );
+    _check_coloring (cfg, res, 3);
+  }
+}
+
+TEST_CASE( "Interference graph", "[jtac][allocation]" ) {
+  using namespace jcc::jtac;
+
+  // a triangle (0, 1, 2) with a tail (2 - 3)
+  interference_graph g (4);
+  g.add_edge (0, 1);
+  g.add_edge (1, 2);
+  g.add_edge (2, 0);
+  g.add_edge (2, 3);
+  g.add_edge (3, 2); // duplicate
+
+  REQUIRE( g.interferes (0, 2) );
+  REQUIRE( g.interferes (3, 2) );
+  REQUIRE( !g.interferes (0, 3) );
+  REQUIRE( !g.interferes (1, 1) );
+  REQUIRE( g.get_degree (2) == 3 );
+  REQUIRE( g.get_adjacent (3).size () == 1 );
+
+  REQUIRE( g.find_less_k (3) == 3 );
+  REQUIRE( !g.has_less_k (1) );
+
+  g.remove_node (2);
+  REQUIRE( g.size () == 3 );
+  REQUIRE( g.get_degree (0) == 1 );
+  REQUIRE( g.get_degree (3) == 0 );
+  REQUIRE( g.has_less_k (1) );
+  REQUIRE( g.interferes (0, 2) ); // edges are kept
+
+  g.restore_node (2);
+  REQUIRE( g.size () == 4 );
+  REQUIRE( g.get_degree (2) == 3 );
+  REQUIRE( g.get_degree (3) == 1 );
+  REQUIRE( !g.has_less_k (1) );
+  REQUIRE( g.find_less_k (2) == 3 );
+
+  // an empty graph has no node of any degree
+  for (int i = 0; i < 4; ++i)
+    g.remove_node (i);
+  REQUIRE( !g.has_less_k (16) );
+  REQUIRE_THROWS_AS( g.find_less_k (16), std::runtime_error );
+}
+
+TEST_CASE( "Basic register allocation", "[jtac][ssa][allocation]" ) {
+  using namespace jcc::jtac;
+
+  auto cfg = control_flow_analyzer::make_cfg (_make_loop_insts ());
+  ssa_builder ssab;
+  ssab.transform (cfg);
+
+  auto alloc = make_register_allocator (register_allocator_type::basic);
+  auto res = alloc->allocate (cfg, 8);
+
+  REQUIRE( _check_coloring (cfg, res, 8) == 1 );
+  REQUIRE( _count_spills (cfg) == 0 );
+}
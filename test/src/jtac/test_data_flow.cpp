@@ -0,0 +1,194 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "catch.hpp"
+#include <jtac/assembler.hpp>
+#include <jtac/control_flow.hpp>
+#include <jtac/data_flow.hpp>
+#include <jtac/allocation/spill.hpp>
+
+
+using namespace jcc;
+
+
+static std::vector<jtac::jtac_instruction>
+_make_diamond_insts ()
+{
+  using namespace jcc::jtac;
+  assembler asem;
+
+  asem.emit_assign (jtac_var (1), jtac_const (5));
+  asem.emit_assign (jtac_var (2), jtac_const (7));
+  asem.emit_assign_add (jtac_var (3), jtac_var(1), jtac_var(2));
+
+  int lbl_else = asem.make_label ();
+  asem.emit_cmp (jtac_var (3), jtac_const (8));
+  asem.emit_jle (jtac_label (lbl_else));
+
+  asem.emit_assign_add (jtac_var (3), jtac_var (3), jtac_const (3));
+  int lbl_end = asem.make_label ();
+  asem.emit_jmp (jtac_label (lbl_end));
+
+  asem.mark_label (lbl_else);
+  asem.emit_assign_mul (jtac_var (3), jtac_var (3), jtac_const (2));
+
+  asem.mark_label (lbl_end);
+  asem.emit_assign (jtac_var (4), jtac_const (1));
+  asem.emit_assign_add (jtac_var (5), jtac_var (3), jtac_var (4));
+
+  asem.fix_labels ();
+  return asem.get_instructions ();
+}
+
+static jtac::control_flow_graph
+_make_diamond_cfg ()
+{
+  return jtac::control_flow_analyzer::make_cfg (_make_diamond_insts ());
+}
+
+
+TEST_CASE( "Dominance analysis", "[control_flow][data_flow]" ) {
+
+  using namespace jcc::jtac;
+  auto cfg = _make_diamond_cfg ();
+
+  dom_analyzer da;
+  auto dr = da.analyze (cfg);
+
+  REQUIRE( dr.get_block (1) == std::set<basic_block_id> { 1 } );
+  REQUIRE( dr.get_block (4) == std::set<basic_block_id> { 1, 4 } );
+  REQUIRE( dr.dominates (1, 3) );
+  REQUIRE( !dr.dominates (2, 4) );
+
+  REQUIRE( dr.get_idom (2) == 1 );
+  REQUIRE( dr.get_idom (3) == 1 );
+  REQUIRE( dr.get_idom (4) == 1 );
+
+  REQUIRE( dr.get_dfs (2) == std::set<basic_block_id> { 4 } );
+  REQUIRE( dr.get_dfs (3) == std::set<basic_block_id> { 4 } );
+  REQUIRE( dr.get_dfs (4).empty () );
+}
+
+TEST_CASE( "Dominance of unreachable blocks", "[control_flow][data_flow]" ) {
+
+  using namespace jcc::jtac;
+  assembler asem;
+
+  // blocks 2 and 3 branch to each other but cannot be reached from the root
+  int lbl_a = asem.make_label ();
+  int lbl_b = asem.make_label ();
+  int lbl_end = asem.make_label ();
+  asem.emit_assign (jtac_var (1), jtac_const (1));
+  asem.emit_jmp (jtac_label (lbl_end));
+
+  asem.mark_label (lbl_a);
+  asem.emit_assign (jtac_var (2), jtac_const (2));
+  asem.emit_jmp (jtac_label (lbl_b));
+
+  asem.mark_label (lbl_b);
+  asem.emit_assign (jtac_var (3), jtac_const (3));
+  asem.emit_jmp (jtac_label (lbl_a));
+
+  asem.mark_label (lbl_end);
+  asem.emit_ret (jtac_var (1));
+  asem.fix_labels ();
+
+  auto cfg = control_flow_analyzer::make_cfg (asem.get_instructions ());
+  REQUIRE( cfg.get_size () == 4 );
+
+  dom_analyzer da;
+  auto dr = da.analyze (cfg);
+
+  REQUIRE( dr.dominates (1, 4) );
+  REQUIRE( !dr.dominates (2, 3) );
+  REQUIRE( !dr.dominates (3, 2) );
+  REQUIRE( !dr.dominates (1, 2) );
+  REQUIRE( !dr.dominates (2, 4) );
+
+  // the cycle between them is not a loop
+  auto depths = compute_loop_depths (cfg);
+  REQUIRE( depths == std::vector<int> { 0, 0, 0, 0 } );
+}
+
+TEST_CASE( "Live-variable analysis", "[control_flow][data_flow]" ) {
+
+  using namespace jcc::jtac;
+  auto cfg = _make_diamond_cfg ();
+
+  live_analyzer la;
+  auto lr = la.analyze (cfg);
+
+  REQUIRE( lr.get_live_out (1) == std::set<jtac_var_id> { 3 } );
+  REQUIRE( lr.get_live_out (2) == std::set<jtac_var_id> { 3 } );
+  REQUIRE( lr.get_live_out (3) == std::set<jtac_var_id> { 3 } );
+  REQUIRE( lr.get_live_out (4).empty () );
+
+  REQUIRE( lr.is_live_in (2, 3) );
+  REQUIRE( !lr.is_live_in (1, 3) );
+  REQUIRE( !lr.is_live_out (4, 5) );
+}
+
+TEST_CASE( "Reaching definitions analysis", "[control_flow][data_flow]" ) {
+
+  using namespace jcc::jtac;
+  auto cfg = _make_diamond_cfg ();
+
+  reach_def_analyzer ra;
+  auto rr = ra.analyze (cfg);
+
+  REQUIRE( rr.get_block (1).empty () );
+  REQUIRE( rr.get_block (2) == std::set<definition> { { 1, 0 }, { 1, 1 }, { 1, 2 } } );
+  REQUIRE( rr.get_block (4) == std::set<definition> { { 1, 0 }, { 1, 1 }, { 2, 0 }, { 3, 0 } } );
+  REQUIRE( rr.reaches (4, { 2, 0 }) );
+  REQUIRE( !rr.reaches (4, { 1, 2 }) );
+}
+
+TEST_CASE( "Flat control flow graph", "[control_flow][data_flow]" ) {
+
+  using namespace jcc::jtac;
+  auto cfg = control_flow_analyzer::make_flat_cfg (_make_diamond_insts ());
+
+  REQUIRE( cfg.get_size () == 4 );
+  REQUIRE( cfg.get_root ().get_id () == 1 );
+  REQUIRE( cfg.find_block (3)->get_base () == 7 );
+  REQUIRE( cfg.find_block (5) == nullptr );
+
+  auto succs = [&] (int idx) {
+    return std::vector<int> (cfg.succs_begin (idx), cfg.succs_end (idx)); };
+  auto preds = [&] (int idx) {
+    return std::vector<int> (cfg.preds_begin (idx), cfg.preds_end (idx)); };
+  REQUIRE( succs (0) == std::vector<int> { 2, 1 } );
+  REQUIRE( succs (1) == std::vector<int> { 3 } );
+  REQUIRE( preds (3) == std::vector<int> { 1, 2 } );
+  REQUIRE( preds (0).empty () );
+
+  // branches refer to blocks, as in the linked representation
+  auto& jle = cfg.get_block (0).get_instructions ().back ();
+  REQUIRE( jle.oprs[0].type == JTAC_OPR_BLOCK_REF );
+  REQUIRE( jle.oprs[0].val.blk.get_id () == 3 );
+
+  // analyses agree with the ones performed on the linked representation
+  dom_analyzer da;
+  auto dr = da.analyze (cfg);
+  REQUIRE( dr.get_idom (4) == 1 );
+  REQUIRE( dr.get_dfs (2) == std::set<basic_block_id> { 4 } );
+
+  live_analyzer la;
+  auto lr = la.analyze (cfg);
+  REQUIRE( lr.get_live_out (1) == std::set<jtac_var_id> { 3 } );
+  REQUIRE( lr.get_live_out (4).empty () );
+}
@@ -0,0 +1,83 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "catch.hpp"
+#include <jtac/driver.hpp>
+#include <jtac/assembler.hpp>
+#include <jtac/control_flow.hpp>
+#include <jtac/ssa.hpp>
+#include <string>
+#include <stdexcept>
+
+
+using namespace jcc;
+
+
+static jtac::program
+_make_program (int num_procs)
+{
+  using namespace jcc::jtac;
+
+  program prog;
+  for (int i = 0; i < num_procs; ++i)
+    {
+      assembler asem;
+      int lbl_end = asem.make_label ();
+      asem.emit_assign (jtac_var (1), jtac_const (i));
+      asem.emit_cmp (jtac_var (1), jtac_const (8));
+      asem.emit_jle (jtac_label (lbl_end));
+      asem.emit_assign (jtac_var (1), jtac_const (8));
+      asem.mark_label (lbl_end);
+      asem.emit_ret (jtac_var (1));
+      asem.fix_labels ();
+
+      auto& proc = prog.emplace_procedure ("p" + std::to_string (i));
+      auto& insts = asem.get_instructions ();
+      proc.insert_instructions (insts.begin (), insts.end ());
+    }
+
+  return prog;
+}
+
+
+TEST_CASE( "Parallel per-procedure pipeline", "[jtac][driver]" ) {
+
+  using namespace jcc::jtac;
+  auto prog = _make_program (64);
+
+  program_driver driver (4);
+  REQUIRE( driver.get_thread_count () == 4 );
+
+  auto results = driver.map_procedures (prog, [] (const procedure& proc) {
+    auto cfg = control_flow_analyzer::make_cfg (proc.get_body ());
+    ssa_builder ssab;
+    ssab.transform (cfg);
+    return proc.get_name () + ":" + std::to_string (cfg.get_size ());
+  });
+
+  // results come back in procedure order
+  REQUIRE( results.size () == 64 );
+  for (size_t i = 0; i < results.size (); ++i)
+    REQUIRE( results[i] == "p" + std::to_string (i) + ":3" );
+
+  REQUIRE_THROWS_AS( driver.map_procedures (prog, [] (const procedure& proc) {
+    if (proc.get_name () == "p13")
+      throw std::runtime_error ("failed");
+    return 0;
+  }), std::runtime_error );
+}
@@ -0,0 +1,143 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "catch.hpp"
+#include <jtac/jtac.hpp>
+#include <jtac/arena.hpp>
+#include <jtac/control_flow.hpp>
+#include <jtac/program.hpp>
+#include <stdexcept>
+#include <vector>
+
+
+using namespace jcc;
+
+
+TEST_CASE( "JTAC instruction extra operands", "[jtac]" ) {
+  using namespace jcc::jtac;
+
+  jtac_instruction inst;
+  inst.op = JTAC_OP_CALL;
+  inst.oprs[0] = jtac_name (1);
+
+  SECTION( "Long operand lists" ) {
+    for (int i = 0; i < 300; ++i)
+      inst.push_extra (jtac_var (i + 1));
+    REQUIRE( inst.extra.count == 300 );
+
+    auto copy = inst;
+    REQUIRE( copy.extra.count == 300 );
+    for (int i = 0; i < 300; ++i)
+      REQUIRE( copy.extra.oprs[i].val.var.get_id () == (jtac_var_id)(i + 1) );
+  }
+
+  SECTION( "Operand limit" ) {
+    for (int i = 0; i < JTAC_MAX_EXTRA_OPERANDS; ++i)
+      inst.push_extra (jtac_const (i));
+    REQUIRE( inst.extra.count == JTAC_MAX_EXTRA_OPERANDS );
+    REQUIRE( inst.extra.oprs[JTAC_MAX_EXTRA_OPERANDS - 1].val.konst.get_value ()
+             == JTAC_MAX_EXTRA_OPERANDS - 1 );
+    REQUIRE_THROWS_AS( inst.push_extra (jtac_const (0)), std::runtime_error );
+  }
+}
+
+TEST_CASE( "JTAC instructions are placed in their container's arena",
+           "[jtac][arena]" ) {
+  using namespace jcc::jtac;
+
+  jtac_instruction call;
+  call.op = JTAC_OP_CALL;
+  call.oprs[0] = jtac_name (1);
+  call.push_extra (jtac_var (1)).push_extra (jtac_var (2));
+  REQUIRE( call.get_arena () == nullptr );
+
+  SECTION( "Basic blocks" ) {
+    auto arena = std::make_shared<jtac_arena> ();
+    basic_block blk (1, arena.get ());
+
+    blk.push_instruction (call);
+    auto& inst = blk.get_instructions ().back ();
+    REQUIRE( inst.get_arena () == arena.get () );
+    REQUIRE( inst.extra.oprs != call.extra.oprs );
+    REQUIRE( inst.extra.oprs[1].val.var.get_id () == 2 );
+
+    // growing the list allocates from the block's arena
+    size_t allocated = arena->get_allocated ();
+    for (int i = 0; i < 10; ++i)
+      inst.push_extra (jtac_var (3));
+    REQUIRE( arena->get_allocated () > allocated );
+
+    // copies do not depend on the arena, whatever the current container
+    jtac_instruction copy = inst;
+    REQUIRE( copy.get_arena () == nullptr );
+    REQUIRE( copy.extra.count == 12 );
+
+    // assignment keeps the destination's storage
+    jtac_instruction heap;
+    heap = inst;
+    REQUIRE( heap.get_arena () == nullptr );
+    blk.get_instructions ().front () = call;
+    REQUIRE( blk.get_instructions ().front ().get_arena () == arena.get () );
+    REQUIRE( blk.get_instructions ().front ().extra.count == 2 );
+
+    // instructions moved into the block from elsewhere are moved into its
+    // arena
+    std::vector<jtac_instruction> insts;
+    insts.push_back (call);
+    insts.push_back (copy);
+    blk.set_instructions (std::move (insts));
+    for (auto& inst : blk.get_instructions ())
+      REQUIRE( inst.get_arena () == arena.get () );
+    REQUIRE( blk.get_instructions ()[1].extra.count == 12 );
+
+    // and back out of it
+    blk.set_arena (nullptr);
+    for (auto& inst : blk.get_instructions ())
+      REQUIRE( inst.get_arena () == nullptr );
+  }
+
+  SECTION( "Control flow graphs" ) {
+    std::vector<jtac_instruction> insts { call };
+    insts.emplace_back ();
+    insts.back ().op = JTAC_OP_RETN;
+
+    auto cfg = control_flow_analyzer::make_cfg (insts, true);
+    auto& inst = cfg.get_root ()->get_instructions ().front ();
+    REQUIRE( inst.get_arena () == cfg.get_arena () );
+
+    cfg.set_arena (nullptr);
+    REQUIRE( inst.get_arena () == nullptr );
+    REQUIRE( inst.extra.oprs[0].val.var.get_id () == 1 );
+
+    auto flat = control_flow_analyzer::make_flat_cfg (insts, true);
+    REQUIRE( flat.get_root ().get_instructions ().front ().get_arena ()
+             == flat.get_arena () );
+  }
+
+  SECTION( "Procedures" ) {
+    procedure proc ("p", true);
+    std::vector<jtac_instruction> insts { call, call };
+    proc.insert_instructions (insts.begin (), insts.end ());
+    for (auto& inst : proc.get_body ())
+      REQUIRE( inst.get_arena () == proc.get_arena () );
+
+    auto body = proc.get_body ();
+    for (auto& inst : body)
+      REQUIRE( inst.get_arena () == nullptr );
+  }
+}
@@ -105,3 +105,87 @@ TEST_CASE( "Transforming a CFG into maximal SSA form",
       "Prev: #3 #2\n"
       "Next: none" );
 }
+
+TEST_CASE( "Minimal, semi-pruned and pruned SSA forms",
+           "[jtac_assembler][control_flow][ssa]" ) {
+
+  using namespace jcc::jtac;
+  assembler asem;
+
+  asem.emit_assign (jtac_var (1), jtac_const (5));
+  asem.emit_assign (jtac_var (7), jtac_const (1));
+
+  int lbl_else = asem.make_label ();
+  asem.emit_cmp (jtac_var (1), jtac_const (8));
+  asem.emit_jle (jtac_label (lbl_else));
+
+  // t7 is upward-exposed here, but dead after the join point
+  asem.emit_assign_add (jtac_var (2), jtac_var (7), jtac_const (1));
+  int lbl_end = asem.make_label ();
+  asem.emit_jmp (jtac_label (lbl_end));
+
+  asem.mark_label (lbl_else);
+  asem.emit_assign (jtac_var (7), jtac_const (3));
+  asem.emit_assign_mul (jtac_var (2), jtac_var (7), jtac_const (2));
+  asem.emit_assign (jtac_var (8), jtac_const (4));
+
+  asem.mark_label (lbl_end);
+  asem.emit_assign_add (jtac_var (3), jtac_var (2), jtac_const (1));
+
+  asem.fix_labels ();
+
+  auto count_phis = [&] (ssa_form_type form) {
+    auto cfg = control_flow_analyzer::make_cfg (asem.get_instructions ());
+    ssa_builder ssab;
+    ssab.transform (cfg, form);
+
+    int count = 0;
+    for (auto& inst : cfg.find_block (4)->get_instructions ())
+      if (inst.op == JTAC_SOP_ASSIGN_PHI)
+        ++ count;
+    return count;
+  };
+
+  REQUIRE( count_phis (ssa_form_type::minimal) == 3 );     // t2, t7, t8
+  REQUIRE( count_phis (ssa_form_type::semi_pruned) == 2 ); // t2, t7
+  REQUIRE( count_phis (ssa_form_type::pruned) == 1 );      // t2
+}
+
+TEST_CASE( "Arena-backed CFGs produce the same SSA form",
+           "[jtac][ssa][arena]" ) {
+  using namespace jtac;
+
+  assembler asem;
+
+  asem.emit_assign (jtac_var (1), jtac_const (0));
+  int lbl_loop = asem.make_and_mark_label ();
+  int lbl_end = asem.make_label ();
+  asem.emit_cmp (jtac_var (1), jtac_const (10));
+  asem.emit_jge (jtac_label (lbl_end));
+  auto& call = asem.emit_assign_call (jtac_var (2), jtac_name (1));
+  for (int i = 0; i < 9; ++i) // force the extra operands to grow
+    call.push_extra (jtac_var (1));
+  asem.emit_assign_add (jtac_var (1), jtac_var (2), jtac_const (1));
+  asem.emit_jmp (jtac_label (lbl_loop));
+  asem.mark_label (lbl_end);
+  asem.emit_ret (jtac_var (1));
+
+  asem.fix_labels ();
+
+  auto print_ssa = [&] (bool use_arena) {
+    auto cfg = control_flow_analyzer::make_cfg (asem.get_instructions (),
+                                                use_arena);
+    REQUIRE( (cfg.get_arena () != nullptr) == use_arena );
+
+    ssa_builder ssab;
+    ssab.transform (cfg);
+
+    printer p;
+    std::string str;
+    for (auto blk : cfg.get_blocks ())
+      str += p.print_basic_block (*blk);
+    return str;
+  };
+
+  REQUIRE( print_ssa (true) == print_ssa (false) );
+}
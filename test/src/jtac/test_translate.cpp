@@ -0,0 +1,395 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "catch.hpp"
+#include <jtac/parse/lexer.hpp>
+#include <jtac/parse/parser.hpp>
+#include <jtac/translate/x86_64/x86_64_translator.hpp>
+#include <jtac/driver.hpp>
+#include <jit/jit.hpp>
+#include <sstream>
+#include <string>
+
+
+using namespace jcc;
+
+
+static jtac::program
+_parse (const std::string& src)
+{
+  using namespace jcc::jtac;
+
+  std::istringstream ss (src);
+  lexer lx (ss);
+  auto toks = lx.tokenize ();
+  parser p (toks);
+  return p.parse ();
+}
+
+//! \brief Translates every procedure in the program and loads it into the
+//!        JIT, in program order.
+static void
+_load (jit& j, const jtac::program& prog, jtac::register_allocator_type type)
+{
+  using namespace jcc::jtac;
+
+  for (auto& proc : prog.get_procedures ())
+    {
+      x86_64_translator translator;
+      translator.set_allocator_type (type);
+      translator.set_names (&prog.get_names ());
+      j.load (translator.translate_procedure (proc));
+    }
+}
+
+
+static int64_t
+_host_twice (int64_t x)
+{
+  return x * 2;
+}
+
+TEST_CASE( "JTAC to x86-64 translation", "[jtac][translate]" ) {
+  using namespace jcc::jtac;
+  using fn1 = int64_t (int64_t);
+  using fn2 = int64_t (int64_t, int64_t);
+  using fn3 = int64_t (int64_t, int64_t, int64_t);
+
+  const register_allocator_type types[] = {
+    register_allocator_type::basic,
+    register_allocator_type::irc,
+    register_allocator_type::linear_scan,
+  };
+
+  SECTION( "Arithmetic" ) {
+    auto prog = _parse (R"(
+      proc add(a, b):
+        c = a + b
+        ret c
+      endproc
+
+      proc arith(a, b):
+        c = a * b
+        d = c - a
+        e = 10 - d
+        f = e * 8
+        g = f + 100000
+        h = g * 3
+        i = 5000000000 + h
+        j = i - b
+        ret j
+      endproc
+
+      proc divmod(a, b):
+        q = a / b
+        r = a % b
+        s = q * 1000
+        t = s + r
+        ret t
+      endproc
+
+      proc consts():
+        a = 7
+        b = a * 6
+        c = 100 / b
+        ret c
+      endproc
+    )");
+
+    for (auto type : types)
+      {
+        jit j;
+        _load (j, prog, type);
+
+        auto add = j.get_function<fn2> ("add");
+        REQUIRE( add (2, 3) == 5 );
+        REQUIRE( add (-7, 3) == -4 );
+
+        auto arith = j.get_function<fn2> ("arith");
+        auto ref = [] (int64_t a, int64_t b) {
+          return 5000000000LL + (((10 - (a * b - a)) * 8) + 100000) * 3 - b;
+        };
+        REQUIRE( arith (3, 4) == ref (3, 4) );
+        REQUIRE( arith (-12, 7) == ref (-12, 7) );
+
+        auto divmod = j.get_function<fn2> ("divmod");
+        REQUIRE( divmod (47, 5) == 9002 );
+        REQUIRE( divmod (-47, 5) == -9002 );
+        REQUIRE( divmod (47, -5) == -8998 );
+
+        auto consts = j.get_function<int64_t ()> ("consts");
+        REQUIRE( consts () == 2 );
+      }
+  }
+
+  SECTION( "Branches and loops" ) {
+    auto prog = _parse (R"(
+      proc sum(n):
+        s = 0
+        i = 1
+      .loop:
+        cmp i, n
+        jg .end
+        s = s + i
+        i = i + 1
+        jmp .loop
+      .end:
+        ret s
+      endproc
+
+      proc clamp(x):
+        cmp 100, x
+        jl .big
+        cmp x, 0
+        jl .small
+        ret x
+      .big:
+        ret 100
+      .small:
+        ret 0
+      endproc
+
+      proc swap(n, a, b):
+      .loop:
+        cmp n, 0
+        je .end
+        t = a
+        a = b
+        b = t
+        n = n - 1
+        jmp .loop
+      .end:
+        c = a * 10
+        d = c + b
+        ret d
+      endproc
+
+      proc fall(x):
+        cmp x, 3
+        jge .done
+        x = 3
+      .done:
+      endproc
+    )");
+
+    for (auto type : types)
+      {
+        jit j;
+        _load (j, prog, type);
+
+        auto sum = j.get_function<fn1> ("sum");
+        REQUIRE( sum (0) == 0 );
+        REQUIRE( sum (10) == 55 );
+        REQUIRE( sum (1000) == 500500 );
+
+        auto clamp = j.get_function<fn1> ("clamp");
+        REQUIRE( clamp (50) == 50 );
+        REQUIRE( clamp (150) == 100 );
+        REQUIRE( clamp (-3) == 0 );
+
+        auto swap = j.get_function<fn3> ("swap");
+        REQUIRE( swap (0, 1, 2) == 12 );
+        REQUIRE( swap (1, 1, 2) == 21 );
+        REQUIRE( swap (4, 1, 2) == 12 );
+        REQUIRE( swap (7, 1, 2) == 21 );
+
+        auto fall = j.get_function<void (int64_t)> ("fall");
+        fall (1);
+        fall (5);
+      }
+  }
+
+  SECTION( "Calls" ) {
+    auto prog = _parse (R"(
+      proc sq(x):
+        y = x * x
+        ret y
+      endproc
+
+      proc sumsq(a, b):
+        c = call sq(a)
+        d = call sq(b)
+        e = c + d
+        f = e + a
+        g = f + b
+        ret g
+      endproc
+
+      proc fib(n):
+        cmp n, 2
+        jl .base
+        a = n - 1
+        b = call fib(a)
+        c = n - 2
+        d = call fib(c)
+        e = b + d
+        ret e
+      .base:
+        ret n
+      endproc
+
+      proc many(a, b, c, d, e, f, g, h):
+        x = a * 1
+        y = b * 2
+        x = x + y
+        y = c * 3
+        x = x + y
+        y = d * 4
+        x = x + y
+        y = e * 5
+        x = x + y
+        y = f * 6
+        x = x + y
+        y = g * 7
+        x = x + y
+        y = h * 8
+        x = x + y
+        ret x
+      endproc
+
+      proc callmany(p, q):
+        r = call many(q, 2, 3, 4, 5, 6, p, 8000000000)
+        s = r - p
+        ret s
+      endproc
+
+      proc host(x):
+        y = call twice(x)
+        z = y + x
+        ret z
+      endproc
+    )");
+
+    for (auto type : types)
+      {
+        jit j;
+        j.define_symbol ("twice", (const void *)&_host_twice);
+        _load (j, prog, type);
+
+        auto sumsq = j.get_function<fn2> ("sumsq");
+        REQUIRE( sumsq (3, 4) == 32 );
+
+        auto fib = j.get_function<fn1> ("fib");
+        REQUIRE( fib (1) == 1 );
+        REQUIRE( fib (10) == 55 );
+        REQUIRE( fib (20) == 6765 );
+
+        auto many = j.get_function<int64_t (int64_t, int64_t, int64_t, int64_t,
+                                            int64_t, int64_t, int64_t, int64_t)> ("many");
+        REQUIRE( many (1, 1, 1, 1, 1, 1, 1, 1) == 36 );
+        REQUIRE( many (8, 7, 6, 5, 4, 3, 2, 1) == 120 );
+
+        auto callmany = j.get_function<fn2> ("callmany");
+        int64_t expected = 10 + 4 + 9 + 16 + 25 + 36 + 7 * 11 + 64000000000LL - 11;
+        REQUIRE( callmany (11, 10) == expected );
+
+        auto host = j.get_function<fn1> ("host");
+        REQUIRE( host (21) == 63 );
+      }
+  }
+
+  SECTION( "Spilled variables" ) {
+    // twenty variables are live at once, more than there are registers
+    std::string src = "proc spill(x, n):\n";
+    for (int i = 1; i <= 20; ++i)
+      src += "  v" + std::to_string (i) + " = x * " + std::to_string (i) + "\n";
+    src += "  s = 0\n"
+           ".loop:\n"
+           "  cmp n, 0\n"
+           "  jle .end\n";
+    for (int i = 1; i <= 20; ++i)
+      src += "  s = s + v" + std::to_string (i) + "\n";
+    src += "  n = n - 1\n"
+           "  jmp .loop\n"
+           ".end:\n";
+    for (int i = 1; i <= 20; ++i)
+      src += "  s = s + v" + std::to_string (i) + "\n";
+    src += "  ret s\n"
+           "endproc\n";
+    auto prog = _parse (src);
+
+    for (auto type : types)
+      {
+        jit j;
+        _load (j, prog, type);
+
+        auto spill = j.get_function<fn2> ("spill");
+        REQUIRE( spill (1, 0) == 210 );
+        REQUIRE( spill (3, 4) == 3 * 210 * 5 );
+      }
+  }
+
+  SECTION( "Tiling" ) {
+    auto prog = _parse (R"(
+      proc inc(a):
+        b = a + 1
+        ret b
+      endproc
+
+      proc less(a, b):
+        cmp a, b
+        jl .yes
+        ret 0
+      .yes:
+        ret 1
+      endproc
+    )");
+
+    x86_64_translator translator;
+    translator.set_names (&prog.get_names ());
+
+    // mov + lea (or add) + ret, without a frame
+    auto inc = translator.translate_procedure (prog.get_procedures ()[0]);
+    REQUIRE( inc.get_name () == "inc" );
+    REQUIRE( inc.get_code ().size () <= 12 );
+    REQUIRE( inc.get_code ().back () == 0xC3 );
+
+    // the comparison is immediately followed by a short jl
+    auto less = translator.translate_procedure (prog.get_procedures ()[1]);
+    auto& code = less.get_code ();
+    bool fused = false;
+    for (size_t i = 0; i + 4 < code.size (); ++i)
+      if ((code[i] & 0xF0) == 0x40 && code[i + 1] == 0x39 && code[i + 3] == 0x7C)
+        fused = true;
+    REQUIRE( fused );
+  }
+
+  SECTION( "Program driver" ) {
+    auto prog = _parse (R"(
+      proc one():
+        ret 1
+      endproc
+
+      proc two():
+        a = call one()
+        b = a + 1
+        ret b
+      endproc
+    )");
+
+    program_driver driver (2);
+    auto procs = driver.translate_x86_64 (prog);
+    REQUIRE( procs.size () == 2 );
+    REQUIRE( procs[1].get_relocations ().size () == 1 );
+
+    jit j;
+    j.load (procs[0]);
+    j.load (procs[1]);
+    REQUIRE( j.get_function<int64_t ()> ("two") () == 2 );
+  }
+}
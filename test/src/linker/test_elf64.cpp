@@ -0,0 +1,359 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "catch.hpp"
+#include <linker/translators/translator.hpp>
+#include <linker/translators/elf64/elf64.hpp>
+#include <linker/section.hpp>
+#include <common/binary.hpp>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <unordered_map>
+
+
+using namespace jcc;
+
+
+static std::string
+_save (generic_module& mod)
+{
+  std::ostringstream ss;
+  module_translator::create ("elf64")->save (mod, ss);
+  return ss.str ();
+}
+
+static std::string
+_read_file (const std::string& path)
+{
+  std::ifstream fs (path, std::ios::binary);
+  return std::string (std::istreambuf_iterator<char> (fs),
+                      std::istreambuf_iterator<char> ());
+}
+
+static std::string
+_section_data (generic_module& mod, const std::string& name)
+{
+  auto sect = static_cast<progbits_section *> (mod.find_section (name));
+  REQUIRE( sect );
+  auto& data = sect->get_data ();
+  return std::string ((const char *)data.data (), data.size ());
+}
+
+TEST_CASE( "ELF64 load and save", "[elf64]" ) {
+  const std::vector<unsigned char> code { 0xB8, 0x2A, 0x00, 0x00, 0x00, 0xC3 };
+  const std::vector<unsigned char> data { 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+
+  generic_module mod (module_type::relocatable, target_architecture::x86_64);
+  mod.add_section (code_section (".text", code, 0));
+  mod.add_section (progbits_section (".data", data, 0));
+  auto image = _save (mod);
+
+  auto check_loaded = [&] (generic_module& loaded) {
+    REQUIRE( loaded.get_type () == module_type::relocatable );
+    REQUIRE( loaded.find_section (".text")->get_type () == SECT_CODE );
+    REQUIRE( _section_data (loaded, ".text") == std::string (code.begin (), code.end ()) );
+    REQUIRE( _section_data (loaded, ".data") == std::string (data.begin (), data.end ()) );
+  };
+
+  SECTION( "Through streams" ) {
+    std::istringstream ss (image);
+    auto loaded = module_translator::create ("elf64")->load (ss);
+    check_loaded (*loaded);
+    REQUIRE( _save (*loaded) == image );
+  }
+
+  SECTION( "Through memory-mapped files" ) {
+    std::string path = std::string (P_tmpdir) + "/jcc_test_elf64_a.o";
+    std::string path2 = std::string (P_tmpdir) + "/jcc_test_elf64_b.o";
+    module_translator::create ("elf64")->save_file (mod, path);
+    REQUIRE( _read_file (path) == image );
+
+    {
+      auto loaded = module_translator::create ("elf64")->load_file (path);
+      check_loaded (*loaded);
+      module_translator::create ("elf64")->save_file (*loaded, path2);
+
+      // modifying a loaded section must not write through to the file
+      auto& text = static_cast<progbits_section *> (loaded->find_section (".text"))->get_data ();
+      REQUIRE( text.is_view () );
+      text.get_mutable_data ()[1] = 0x2B;
+      REQUIRE( _section_data (*loaded, ".text")[1] == 0x2B );
+    }
+
+    REQUIRE( _read_file (path) == image );
+    REQUIRE( _read_file (path2) == image );
+    std::remove (path.c_str ());
+    std::remove (path2.c_str ());
+  }
+}
+
+
+
+TEST_CASE( "ELF64 hash functions", "[elf64]" ) {
+  // reference values, as computed by the functions given in the System V
+  // ABI and in GNU's description of .gnu.hash.
+  REQUIRE( elf64_hash ("") == 0 );
+  REQUIRE( elf64_hash ("printf") == 0x077905a6 );
+  REQUIRE( elf64_hash ("exit") == 0x0006cf04 );
+  REQUIRE( elf64_hash ("syscall") == 0x0b09985c );
+  REQUIRE( elf64_hash ("flapenguin.me") == 0x03987915 );
+
+  REQUIRE( elf64_gnu_hash ("") == 0x00001505 );
+  REQUIRE( elf64_gnu_hash ("printf") == 0x156b2bb8 );
+  REQUIRE( elf64_gnu_hash ("exit") == 0x7c967e3f );
+  REQUIRE( elf64_gnu_hash ("syscall") == 0xbac212a0 );
+  REQUIRE( elf64_gnu_hash ("flapenguin.me") == 0x8ae9f18e );
+}
+
+
+
+namespace {
+
+  //! Sections of a saved ELF image, found through its section headers.
+  class elf_image
+  {
+    struct sect_info
+    {
+      elf64_addr_t addr;
+      size_t off;
+      size_t size;
+    };
+
+    const std::string& image;
+    std::unordered_map<std::string, sect_info> sects;
+
+   public:
+    elf_image (const std::string& image)
+        : image (image)
+    {
+      auto data = this->get_data ();
+      auto shoff = bin::read_u64_le (data + 40);
+      auto shnum = bin::read_u16_le (data + 60);
+      auto shstrndx = bin::read_u16_le (data + 62);
+
+      auto shstrtab = data + bin::read_u64_le (data + shoff + 64 * shstrndx + 24);
+      for (unsigned i = 0; i < shnum; ++i)
+        {
+          auto shdr = data + shoff + 64 * i;
+          auto name = (const char *)shstrtab + bin::read_u32_le (shdr);
+          this->sects[name] = { bin::read_u64_le (shdr + 16),
+                                (size_t)bin::read_u64_le (shdr + 24),
+                                (size_t)bin::read_u64_le (shdr + 32) };
+        }
+    }
+
+   public:
+    inline const unsigned char* get_data () const
+    { return (const unsigned char *)this->image.data (); }
+
+    const sect_info&
+    get_section (const std::string& name) const
+    {
+      auto itr = this->sects.find (name);
+      REQUIRE( itr != this->sects.end () );
+      return itr->second;
+    }
+
+    const unsigned char*
+    get_section_data (const std::string& name) const
+    { return this->get_data () + this->get_section (name).off; }
+
+    //! Returns the name of the dynamic symbol at the specified index.
+    std::string
+    get_dynsym_name (size_t index) const
+    {
+      auto sym = this->get_section_data (".dynsym") + 24 * index;
+      return (const char *)this->get_section_data (".dynstr") + bin::read_u32_le (sym);
+    }
+
+    //! Returns the value of the dynamic symbol at the specified index.
+    elf64_addr_t
+    get_dynsym_value (size_t index) const
+    { return bin::read_u64_le (this->get_section_data (".dynsym") + 24 * index + 8); }
+
+    size_t
+    get_dynsym_count () const
+    { return this->get_section (".dynsym").size / 24; }
+  };
+}
+
+//! Looks up a dynamic symbol through .hash, returning its index or 0.
+static size_t
+_sysv_lookup (const elf_image& elf, const std::string& name)
+{
+  auto hash = elf.get_section_data (".hash");
+  auto nbucket = bin::read_u32_le (hash);
+  auto buckets = hash + 8;
+  auto chains = buckets + 4 * nbucket;
+
+  auto i = bin::read_u32_le (buckets + 4 * (elf64_hash (name) % nbucket));
+  for (; i != 0; i = bin::read_u32_le (chains + 4 * i))
+    if (elf.get_dynsym_name (i) == name)
+      return i;
+  return 0;
+}
+
+//! Looks up a dynamic symbol through .gnu.hash, the way the dynamic loader
+//! does, returning its index or 0.
+static size_t
+_gnu_lookup (const elf_image& elf, const std::string& name)
+{
+  auto hash = elf.get_section_data (".gnu.hash");
+  auto nbuckets = bin::read_u32_le (hash);
+  auto symoffset = bin::read_u32_le (hash + 4);
+  auto bloom_size = bin::read_u32_le (hash + 8);
+  auto bloom_shift = bin::read_u32_le (hash + 12);
+  auto bloom = hash + 16;
+  auto buckets = bloom + 8 * bloom_size;
+  auto chains = buckets + 4 * nbuckets;
+
+  auto h = elf64_gnu_hash (name.c_str ());
+  auto word = bin::read_u64_le (bloom + 8 * ((h / 64) % bloom_size));
+  uint64_t mask = ((uint64_t)1 << (h % 64)) | ((uint64_t)1 << ((h >> bloom_shift) % 64));
+  if ((word & mask) != mask)
+    return 0;
+
+  auto i = bin::read_u32_le (buckets + 4 * (h % nbuckets));
+  if (i < symoffset)
+    return 0;
+  for (;; ++i)
+    {
+      auto h2 = bin::read_u32_le (chains + 4 * (i - symoffset));
+      if ((h | 1) == (h2 | 1) && elf.get_dynsym_name (i) == name)
+        return i;
+      if (h2 & 1)
+        return 0;
+    }
+}
+
+//! Saves a shared object with the specified number of exports and checks
+//! its hash tables.
+static void
+_check_hash_tables (int num_exports)
+{
+  // a shared object that defines num_exports functions and imports one
+  auto store = std::make_shared<relocation_symbol_store> ();
+  generic_module mod (module_type::shared, target_architecture::x86_64);
+  mod.set_relocation_store (store);
+  mod.set_export_name ("libtest.so");
+
+  std::vector<unsigned char> code (8 + 4 * num_exports, 0xC3);
+  code[0] = 0xE9; // jmp puts
+  code_section text (".text", code, 0);
+  text.add_relocation ({ R_PC32, store->get ("puts"), 1, 4, -4 });
+  mod.add_section (std::move (text));
+  auto sect = mod.find_section (".text");
+  mod.add_import_symbol (store->get ("puts").id, mod.add_import ("libc.so.6"),
+                         VERSION_ID_GLOBAL);
+
+  std::vector<std::string> names;
+  for (int i = 0; i < num_exports; ++i)
+    {
+      names.push_back ("fn_" + std::to_string (i));
+      mod.add_export_symbol (names.back (), export_symbol_type::function,
+                             sect, 8 + 4 * i, VERSION_ID_GLOBAL);
+    }
+
+  auto image = _save (mod);
+  elf_image elf (image);
+  auto text_addr = elf.get_section (".text").addr;
+
+  // every export is found through both tables
+  for (int i = 0; i < num_exports; ++i)
+    {
+      auto si = _sysv_lookup (elf, names[i]);
+      auto gi = _gnu_lookup (elf, names[i]);
+      REQUIRE( si != 0 );
+      REQUIRE( gi == si );
+      REQUIRE( elf.get_dynsym_value (gi) == text_addr + 8 + 4 * i );
+    }
+
+  // undefined symbols are only in .hash
+  REQUIRE( _sysv_lookup (elf, "puts") != 0 );
+  REQUIRE( _gnu_lookup (elf, "puts") == 0 );
+
+  REQUIRE( _sysv_lookup (elf, "fn_missing") == 0 );
+  REQUIRE( _gnu_lookup (elf, "fn_missing") == 0 );
+
+  // .gnu.hash layout
+  auto hash = elf.get_section_data (".gnu.hash");
+  auto nbuckets = bin::read_u32_le (hash);
+  auto symoffset = bin::read_u32_le (hash + 4);
+  auto bloom_size = bin::read_u32_le (hash + 8);
+  auto bloom_shift = bin::read_u32_le (hash + 12);
+  auto buckets = hash + 16 + 8 * bloom_size;
+  auto chains = buckets + 4 * nbuckets;
+
+  // sized the way GNU ld sizes bloom filters for 64-bit targets
+  if (num_exports == 1)
+    {
+      REQUIRE( bloom_size == 1 );
+      REQUIRE( bloom_shift == 6 );
+    }
+  else
+    {
+      REQUIRE( bloom_size == 32 );
+      REQUIRE( bloom_shift == 11 );
+    }
+
+  // the null symbol and the import come first
+  REQUIRE( symoffset == 2 );
+  REQUIRE( elf.get_dynsym_count () == symoffset + num_exports );
+
+  // hashed symbols are grouped by bucket, in bucket order, and every
+  // bucket's chain ends with the last symbol in its group.
+  size_t prev_bucket = 0;
+  size_t num_walked = 0;
+  for (size_t i = symoffset; i < elf.get_dynsym_count (); ++i)
+    {
+      auto b = elf64_gnu_hash (elf.get_dynsym_name (i).c_str ()) % nbuckets;
+      REQUIRE( b >= prev_bucket );
+      prev_bucket = b;
+    }
+  for (size_t b = 0; b < nbuckets; ++b)
+    {
+      auto i = bin::read_u32_le (buckets + 4 * b);
+      if (i == 0)
+        continue;
+
+      for (;; ++i)
+        {
+          ++ num_walked;
+          auto name = elf.get_dynsym_name (i);
+          REQUIRE( elf64_gnu_hash (name.c_str ()) % nbuckets == b );
+
+          auto h2 = bin::read_u32_le (chains + 4 * (i - symoffset));
+          REQUIRE( (h2 | 1) == (elf64_gnu_hash (name.c_str ()) | 1) );
+          if (h2 & 1)
+            break;
+        }
+    }
+  REQUIRE( num_walked == (size_t)num_exports );
+}
+
+TEST_CASE( "ELF64 symbol hash tables", "[elf64]" ) {
+  SECTION( "One export" ) {
+    _check_hash_tables (1);
+  }
+
+  SECTION( "Many exports" ) {
+    _check_hash_tables (100);
+  }
+}
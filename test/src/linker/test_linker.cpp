@@ -0,0 +1,702 @@
+/*
+ * jcc - A compiler framework.
+ * Copyright (C) 2016-2017 Jacob Zhitomirsky
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "catch.hpp"
+#include <linker/linker.hpp>
+#include <linker/profile.hpp>
+#include <linker/translators/translator.hpp>
+#include <common/binary.hpp>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+
+
+using namespace jcc;
+
+
+namespace {
+
+  /*!
+     Relocatable modules that define one function each, in their .text
+     section.
+   */
+  class test_objects
+  {
+    relocation_symbol_store store;
+    std::vector<std::unique_ptr<generic_module>> mods;
+
+   public:
+    inline relocation_symbol_store& get_store () { return this->store; }
+    inline std::vector<std::unique_ptr<generic_module>>& get_modules () { return this->mods; }
+
+   public:
+    /*!
+       Inserts a module that defines the function \p name. \p refs lists
+       the offsets of the rel32 fields in \p code and the symbols they refer
+       to.
+     */
+    generic_module&
+    add (const std::string& name, const std::vector<unsigned char>& code,
+         const std::vector<std::pair<size_t, std::string>>& refs = {})
+    {
+      code_section text (".text", code, 0);
+      for (auto& ref : refs)
+        text.add_relocation ({ R_PC32, this->store.get (ref.second), ref.first, 4, -4 });
+
+      this->mods.emplace_back (new generic_module (module_type::relocatable,
+                                                   target_architecture::x86_64));
+      auto& mod = *this->mods.back ();
+      mod.add_section (std::move (text));
+
+      auto sect = mod.find_section (".text");
+      mod.add_export_symbol (name, export_symbol_type::function, sect, 0,
+                             VERSION_ID_GLOBAL);
+      if (name == "_start")
+        mod.set_entry_point (module_location (sect));
+      return mod;
+    }
+
+    //! Links all modules with the specified linker.
+    std::shared_ptr<generic_module>
+    link (linker& lnk)
+    {
+      for (auto& mod : this->mods)
+        lnk.add_module (*mod);
+      return lnk.link ();
+    }
+  };
+}
+
+static const std::vector<unsigned char>&
+_section_data (generic_module& mod, const std::string& name)
+{
+  auto sect = static_cast<progbits_section *> (mod.find_section (name));
+  REQUIRE( sect );
+  return sect->get_data ().get_vector ();
+}
+
+static std::string
+_save (generic_module& mod)
+{
+  std::ostringstream ss;
+  module_translator::create ("elf64")->save (mod, ss);
+  return ss.str ();
+}
+
+//! Returns the target of the rel32 field at the specified offset of .text.
+static size_t
+_rel32_target (generic_module& mod, size_t off)
+{
+  auto& text = _section_data (mod, ".text");
+  return off + 4 + (size_t)(int32_t)bin::read_u32_le (text.data () + off);
+}
+
+TEST_CASE( "Static linking", "[linker]" ) {
+  test_objects objs;
+
+  SECTION( "Calls between relocatable modules" ) {
+    // _start: call foo; call bar; ret
+    objs.add ("_start", { 0xE8, 0, 0, 0, 0, 0xE8, 0, 0, 0, 0, 0xC3 },
+              { { 1, "foo" }, { 6, "bar" } });
+    // foo: mov eax, 1; ret
+    auto& foo = objs.add ("foo", { 0xB8, 0x01, 0x00, 0x00, 0x00, 0xC3 });
+    // bar: call foo; ret
+    objs.add ("bar", { 0xE8, 0, 0, 0, 0, 0xC3 }, { { 1, "foo" } });
+
+    foo.add_section (progbits_section (".data", std::vector<unsigned char> { 1, 2, 3 }, 0));
+    objs.get_modules ()[2]->add_section (
+        progbits_section (".data", std::vector<unsigned char> { 4, 5 }, 0));
+
+    linker lnk;
+    auto out = objs.link (lnk);
+
+    // code sections are placed 16 bytes apart, in input order, and the gaps
+    // between them are filled with nops.
+    auto& text = _section_data (*out, ".text");
+    REQUIRE( text.size () == 38 );
+    REQUIRE( text[11] == 0x90 );
+    REQUIRE( _rel32_target (*out, 1) == 16 );
+    REQUIRE( _rel32_target (*out, 6) == 32 );
+    REQUIRE( _rel32_target (*out, 33) == 16 );
+
+    // every call was resolved by the linker
+    REQUIRE( static_cast<code_section *> (out->find_section (".text"))->get_relocations ().empty () );
+    REQUIRE( out->get_imports ().empty () );
+    REQUIRE( out->get_entry_point ().sect == out->find_section (".text") );
+    REQUIRE( out->get_entry_point ().off == 0 );
+
+    // data sections are merged, 8 bytes apart
+    REQUIRE( _section_data (*out, ".data")
+             == std::vector<unsigned char> ({ 1, 2, 3, 0, 0, 0, 0, 0, 4, 5 }) );
+
+    // the patched calls survive translation into an executable
+    std::istringstream is (_save (*out));
+    auto loaded = module_translator::create ("elf64")->load (is);
+    REQUIRE( _section_data (*loaded, ".text") == text );
+  }
+
+  SECTION( "Unresolved symbols" ) {
+    objs.add ("_start", { 0xE8, 0, 0, 0, 0, 0xC3 }, { { 1, "foo" } });
+
+    linker lnk;
+    REQUIRE_THROWS_AS( objs.link (lnk), link_error );
+  }
+
+  SECTION( "Ambiguous symbols" ) {
+    objs.add ("_start", { 0xE8, 0, 0, 0, 0, 0xC3 }, { { 1, "foo" } });
+    objs.add ("foo", { 0xC3 });
+    objs.add ("foo", { 0x90, 0xC3 });
+
+    linker lnk;
+    REQUIRE_THROWS_AS( objs.link (lnk), link_error );
+  }
+
+  SECTION( "Unreferenced duplicate symbols" ) {
+    objs.add ("_start", { 0xC3 });
+    objs.add ("foo", { 0xC3 });
+    objs.add ("foo", { 0x90, 0xC3 });
+
+    linker lnk;
+    REQUIRE_NOTHROW( objs.link (lnk) );
+  }
+}
+
+
+TEST_CASE( "Parallel linking", "[linker]" ) {
+  test_objects objs;
+
+  // a shared object that defines puts
+  generic_module libc (module_type::shared, target_architecture::x86_64);
+  libc.set_export_name ("libc.so.6");
+  libc.add_section (code_section (".text", std::vector<unsigned char> (16, 0xC3), 0));
+  libc.add_export_symbol ("puts", export_symbol_type::function,
+                          libc.find_section (".text"), 0, VERSION_ID_GLOBAL);
+
+  // _start: call fn_0; ret
+  objs.add ("_start", { 0xE8, 0, 0, 0, 0, 0xC3 }, { { 1, "fn_0" } });
+
+  // fn_i: call fn_j; call puts; ret (with some data)
+  const int num_fns = 40;
+  for (int i = 0; i < num_fns; ++i)
+    {
+      std::vector<unsigned char> code { 0xE8, 0, 0, 0, 0, 0xE8, 0, 0, 0, 0 };
+      code.resize (code.size () + i % 5, 0x90);
+      code.push_back (0xC3);
+
+      auto& mod = objs.add ("fn_" + std::to_string (i), code,
+          { { 1, "fn_" + std::to_string ((i * 7 + 3) % num_fns) },
+            { 6, "puts" } });
+      mod.add_section (progbits_section (".data",
+          std::vector<unsigned char> (i + 1, (unsigned char)i), 0));
+    }
+
+  linker serial (1);
+  serial.add_module (libc);
+  auto out_serial = objs.link (serial);
+
+  linker parallel (4);
+  parallel.add_module (libc);
+  auto out_parallel = objs.link (parallel);
+
+  REQUIRE( _section_data (*out_parallel, ".text") == _section_data (*out_serial, ".text") );
+  REQUIRE( _section_data (*out_parallel, ".data") == _section_data (*out_serial, ".data") );
+  REQUIRE( out_parallel->get_imports () == out_serial->get_imports () );
+  REQUIRE( _save (*out_parallel) == _save (*out_serial) );
+}
+
+
+
+static std::string
+_read_file (const std::string& path)
+{
+  std::ifstream fs (path, std::ios::binary);
+  return std::string (std::istreambuf_iterator<char> (fs),
+                      std::istreambuf_iterator<char> ());
+}
+
+static void
+_set_code (generic_module& mod, const std::vector<unsigned char>& code)
+{
+  static_cast<progbits_section *> (mod.find_section (".text"))->get_data ()
+      .get_vector () = code;
+}
+
+TEST_CASE( "Incremental linking", "[linker]" ) {
+  std::string path = std::string (P_tmpdir) + "/jcc_test_incremental";
+  test_objects objs;
+
+  // a shared object that defines puts
+  generic_module libc (module_type::shared, target_architecture::x86_64);
+  libc.set_export_name ("libc.so.6");
+  libc.add_section (code_section (".text", std::vector<unsigned char> (16, 0xC3), 0));
+  libc.add_export_symbol ("puts", export_symbol_type::function,
+                          libc.find_section (".text"), 0, VERSION_ID_GLOBAL);
+
+  // _start: call foo; call bar; ret
+  auto& start = objs.add ("_start", { 0xE8, 0, 0, 0, 0, 0xE8, 0, 0, 0, 0, 0xC3 },
+                          { { 1, "foo" }, { 6, "bar" } });
+  // foo: mov eax, 1; ret
+  auto& foo = objs.add ("foo", { 0xB8, 0x01, 0x00, 0x00, 0x00, 0xC3 });
+  // bar: call foo; jmp puts
+  objs.add ("bar", { 0xE8, 0, 0, 0, 0, 0xE9, 0, 0, 0, 0 },
+            { { 1, "foo" }, { 6, "puts" } });
+
+  // links the objects and writes the output the way a driver would; updated
+  // is set if only the changed ranges of the file were rewritten.
+  link_layout_cache cache;
+  bool updated = false;
+  auto relink = [&] () {
+    linker lnk;
+    lnk.set_layout_cache (&cache);
+    lnk.add_module (libc);
+    auto out = objs.link (lnk);
+
+    auto trans = module_translator::create ("elf64");
+    if (lnk.is_incremental ())
+      updated = trans->update_file (*out, path, lnk.get_dirty_ranges ());
+    else
+      {
+        trans->save_file (*out, path);
+        updated = false;
+      }
+    return out;
+  };
+
+  // the image of a link from scratch
+  auto full_link = [&] () {
+    link_layout_cache fresh;
+    linker lnk;
+    lnk.set_layout_cache (&fresh);
+    lnk.add_module (libc);
+    return _save (*objs.link (lnk));
+  };
+
+  auto out = relink ();
+  REQUIRE_FALSE( updated );
+  REQUIRE( _read_file (path) == full_link () );
+
+  SECTION( "Relinking without changes" ) {
+    linker lnk;
+    lnk.set_layout_cache (&cache);
+    lnk.add_module (libc);
+    objs.link (lnk);
+    REQUIRE( lnk.is_incremental () );
+    REQUIRE( lnk.get_dirty_ranges ().empty () );
+  }
+
+  SECTION( "Growth within a section's slot" ) {
+    // foo: mov eax, 2; (8 nops); ret
+    _set_code (foo, { 0xB8, 0x02, 0x00, 0x00, 0x00,
+                      0x90, 0x90, 0x90, 0x90, 0x90, 0x90, 0x90, 0x90, 0xC3 });
+    out = relink ();
+    REQUIRE( updated );
+    REQUIRE( _read_file (path) == full_link () );
+    REQUIRE( _read_file (path) == _save (*out) );
+  }
+
+  SECTION( "Growth past a section's slot" ) {
+    std::vector<unsigned char> code (40, 0x90);
+    code.back () = 0xC3;
+    _set_code (foo, code);
+    out = relink ();
+    REQUIRE_FALSE( updated );
+    REQUIRE( _read_file (path) == full_link () );
+
+    // the new layout is cached
+    _set_code (foo, std::vector<unsigned char> (42, 0xC3));
+    out = relink ();
+    REQUIRE( updated );
+    REQUIRE( _read_file (path) == full_link () );
+  }
+
+  SECTION( "Changes to the file header" ) {
+    // the entry point moves, but no section changes
+    auto prev = _read_file (path);
+    start.set_entry_point (module_location (start.find_section (".text"), 5));
+    out = relink ();
+    REQUIRE_FALSE( updated );
+    REQUIRE( _read_file (path).size () == prev.size () );
+    REQUIRE( _read_file (path) == full_link () );
+    REQUIRE( _read_file (path) == _save (*out) );
+  }
+
+  SECTION( "Changes to sections other than PROGBITS sections" ) {
+    // bar jumps to putc instead, which only changes .dynstr and the hash
+    // tables. The linker does not keep the layout when imports change, but
+    // the translator must notice the change as well.
+    libc.add_export_symbol ("putc", export_symbol_type::function,
+                            libc.find_section (".text"), 8, VERSION_ID_GLOBAL);
+    auto bar = static_cast<code_section *> (objs.get_modules ()[2]->find_section (".text"));
+    bar->get_relocations ()[1].sym = objs.get_store ().get ("putc");
+
+    linker lnk;
+    lnk.set_layout_cache (&cache);
+    lnk.add_module (libc);
+    out = objs.link (lnk);
+    REQUIRE_FALSE( lnk.is_incremental () );
+    REQUIRE( _save (*out).size () == _read_file (path).size () );
+
+    REQUIRE_FALSE( module_translator::create ("elf64")->update_file (*out, path, {}) );
+    REQUIRE( _read_file (path) == full_link () );
+  }
+
+  std::remove (path.c_str ());
+}
+
+
+TEST_CASE( "Section garbage collection", "[linker]" ) {
+  test_objects objs;
+
+  // _start: call foo; ret
+  objs.add ("_start", { 0xE8, 0, 0, 0, 0, 0xC3 }, { { 1, "foo" } });
+  // foo: mov eax, 1; ret
+  objs.add ("foo", { 0xB8, 0x01, 0x00, 0x00, 0x00, 0xC3 });
+  // bar: call baz; ret (unreferenced)
+  auto& bar = objs.add ("bar", { 0xE8, 0, 0, 0, 0, 0xC3 }, { { 1, "baz" } });
+  bar.add_section (progbits_section (".data", std::vector<unsigned char> { 1, 2, 3 }, 0));
+  // baz: ret (only referenced by bar)
+  objs.add ("baz", { 0xC3 });
+  // qux: nop; ret (unreferenced)
+  objs.add ("qux", { 0x90, 0xC3 });
+
+  SECTION( "Disabled" ) {
+    linker lnk;
+    auto out = objs.link (lnk);
+    REQUIRE( lnk.get_collected_sections () == 0 );
+    REQUIRE( lnk.get_collected_bytes () == 0 );
+    REQUIRE( _section_data (*out, ".text").size () == 66 );
+    REQUIRE( out->find_section (".data") );
+  }
+
+  SECTION( "Unreferenced sections are removed" ) {
+    linker lnk;
+    lnk.set_gc_sections (true);
+    auto out = objs.link (lnk);
+    REQUIRE( lnk.get_collected_sections () == 4 );
+    REQUIRE( lnk.get_collected_bytes () == 6 + 3 + 1 + 2 );
+    REQUIRE( _section_data (*out, ".text").size () == 22 );
+    REQUIRE( _rel32_target (*out, 1) == 16 );
+    REQUIRE_FALSE( out->find_section (".data") );
+  }
+
+  SECTION( "Kept symbols" ) {
+    linker lnk;
+    lnk.set_gc_sections (true);
+    lnk.keep_symbol ("qux");
+    auto out = objs.link (lnk);
+    REQUIRE( lnk.get_collected_sections () == 3 );
+    REQUIRE( lnk.get_collected_bytes () == 6 + 3 + 1 );
+    REQUIRE( _section_data (*out, ".text").size () == 34 );
+    REQUIRE( _section_data (*out, ".text")[32] == 0x90 );
+  }
+
+  SECTION( "Unresolved references in removed sections" ) {
+    // another unreferenced function, that calls an undefined one
+    objs.add ("quux", { 0xE8, 0, 0, 0, 0, 0xC3 }, { { 1, "undefined" } });
+
+    linker lnk;
+    REQUIRE_THROWS_AS( objs.link (lnk), link_error );
+
+    linker gc_lnk;
+    gc_lnk.set_gc_sections (true);
+    REQUIRE_NOTHROW( objs.link (gc_lnk) );
+    REQUIRE( gc_lnk.get_collected_sections () == 5 );
+  }
+}
+
+
+TEST_CASE( "Identical code folding", "[linker]" ) {
+  test_objects objs;
+
+  SECTION( "Identical sections" ) {
+    // _start: call f1; call f2; ret
+    objs.add ("_start", { 0xE8, 0, 0, 0, 0, 0xE8, 0, 0, 0, 0, 0xC3 },
+              { { 1, "f1" }, { 6, "f2" } });
+    // f1, f2: mov eax, 7; ret
+    objs.add ("f1", { 0xB8, 0x07, 0x00, 0x00, 0x00, 0xC3 });
+    objs.add ("f2", { 0xB8, 0x07, 0x00, 0x00, 0x00, 0xC3 });
+
+    linker lnk;
+    lnk.set_icf_mode (icf_mode::all);
+    auto out = objs.link (lnk);
+    REQUIRE( lnk.get_folded_sections () == 1 );
+    REQUIRE( lnk.get_folded_bytes () == 6 );
+    REQUIRE( _section_data (*out, ".text").size () == 22 );
+    REQUIRE( _rel32_target (*out, 1) == 16 );
+    REQUIRE( _rel32_target (*out, 6) == 16 );
+  }
+
+  SECTION( "Same contents, different relocation targets" ) {
+    // _start: call g1; call g2; ret
+    objs.add ("_start", { 0xE8, 0, 0, 0, 0, 0xE8, 0, 0, 0, 0, 0xC3 },
+              { { 1, "g1" }, { 6, "g2" } });
+    // g1: jmp f1
+    objs.add ("g1", { 0xE9, 0, 0, 0, 0 }, { { 1, "f1" } });
+    // g2: jmp f2
+    objs.add ("g2", { 0xE9, 0, 0, 0, 0 }, { { 1, "f2" } });
+    // f1: mov eax, 1; ret
+    objs.add ("f1", { 0xB8, 0x01, 0x00, 0x00, 0x00, 0xC3 });
+    // f2: mov eax, 2; ret
+    objs.add ("f2", { 0xB8, 0x02, 0x00, 0x00, 0x00, 0xC3 });
+
+    linker lnk;
+    lnk.set_icf_mode (icf_mode::all);
+    auto out = objs.link (lnk);
+    REQUIRE( lnk.get_folded_sections () == 0 );
+    REQUIRE( _rel32_target (*out, 1) == 16 );
+    REQUIRE( _rel32_target (*out, 6) == 32 );
+  }
+
+  SECTION( "Mutually recursive sections" ) {
+    // _start: call a1; call a2; ret
+    objs.add ("_start", { 0xE8, 0, 0, 0, 0, 0xE8, 0, 0, 0, 0, 0xC3 },
+              { { 1, "a1" }, { 6, "a2" } });
+    // ai: call bi; ret
+    // bi: nop; call ai; ret
+    objs.add ("a1", { 0xE8, 0, 0, 0, 0, 0xC3 }, { { 1, "b1" } });
+    objs.add ("b1", { 0x90, 0xE8, 0, 0, 0, 0, 0xC3 }, { { 2, "a1" } });
+    objs.add ("a2", { 0xE8, 0, 0, 0, 0, 0xC3 }, { { 1, "b2" } });
+    objs.add ("b2", { 0x90, 0xE8, 0, 0, 0, 0, 0xC3 }, { { 2, "a2" } });
+
+    linker lnk;
+    lnk.set_icf_mode (icf_mode::all);
+    auto out = objs.link (lnk);
+    REQUIRE( lnk.get_folded_sections () == 2 );
+    REQUIRE( lnk.get_folded_bytes () == 6 + 7 );
+    REQUIRE( _section_data (*out, ".text").size () == 39 );
+    REQUIRE( _rel32_target (*out, 1) == 16 );
+    REQUIRE( _rel32_target (*out, 6) == 16 );
+    REQUIRE( _rel32_target (*out, 17) == 32 );
+    REQUIRE( _rel32_target (*out, 34) == 16 );
+  }
+
+  SECTION( "Sections whose address is taken" ) {
+    // _start: call f1; lea rax, [rip + f2]; ret
+    objs.add ("_start", { 0xE8, 0, 0, 0, 0, 0x48, 0x8D, 0x05, 0, 0, 0, 0, 0xC3 },
+              { { 1, "f1" }, { 8, "f2" } });
+    // f1, f2: mov eax, 7; ret
+    objs.add ("f1", { 0xB8, 0x07, 0x00, 0x00, 0x00, 0xC3 });
+    objs.add ("f2", { 0xB8, 0x07, 0x00, 0x00, 0x00, 0xC3 });
+
+    linker safe;
+    safe.set_icf_mode (icf_mode::safe);
+    auto out = objs.link (safe);
+    REQUIRE( safe.get_folded_sections () == 0 );
+    REQUIRE( _rel32_target (*out, 1) == 16 );
+    REQUIRE( _rel32_target (*out, 8) == 32 );
+
+    linker all;
+    all.set_icf_mode (icf_mode::all);
+    out = objs.link (all);
+    REQUIRE( all.get_folded_sections () == 1 );
+    REQUIRE( _rel32_target (*out, 1) == 16 );
+    REQUIRE( _rel32_target (*out, 8) == 16 );
+  }
+
+  SECTION( "Kept symbols in safe mode" ) {
+    // _start: call f1; call f2; ret
+    objs.add ("_start", { 0xE8, 0, 0, 0, 0, 0xE8, 0, 0, 0, 0, 0xC3 },
+              { { 1, "f1" }, { 6, "f2" } });
+    objs.add ("f1", { 0xB8, 0x07, 0x00, 0x00, 0x00, 0xC3 });
+    objs.add ("f2", { 0xB8, 0x07, 0x00, 0x00, 0x00, 0xC3 });
+
+    linker lnk;
+    lnk.set_icf_mode (icf_mode::safe);
+    lnk.keep_symbol ("f2");
+    objs.link (lnk);
+    REQUIRE( lnk.get_folded_sections () == 0 );
+  }
+}
+
+
+
+TEST_CASE( "Link profiles", "[linker]" ) {
+  link_profile prof;
+
+  SECTION( "Parsing" ) {
+    std::istringstream ss (
+      "# explicit order\n"
+      "main\n"
+      "  init   # after main\n"
+      "\n"
+      "hot 100\n"
+      "hot 20\n"
+      "main hot 42\n"
+      "main\thot 8\n"
+      "hot cold 1\n");
+    prof.load (ss);
+
+    REQUIRE( prof.get_order () == std::vector<std::string> ({ "main", "init" }) );
+    REQUIRE( prof.get_counts ().size () == 1 );
+    REQUIRE( prof.get_counts ().at ("hot") == 120 );
+
+    auto& edges = prof.get_call_edges ();
+    REQUIRE( edges.size () == 2 );
+    REQUIRE( edges[0].caller == "main" );
+    REQUIRE( edges[0].callee == "hot" );
+    REQUIRE( edges[0].count == 50 );
+    REQUIRE( edges[1].caller == "hot" );
+    REQUIRE( edges[1].callee == "cold" );
+    REQUIRE( edges[1].count == 1 );
+  }
+
+  SECTION( "Malformed lines" ) {
+    for (auto line : { "foo bar", "foo 12x", "foo -5", "foo +5", "a b 1.5",
+                       "a b c", "a b c d", "foo 99999999999999999999" })
+      {
+        std::istringstream ss (std::string ("main\n") + line + "\n");
+        REQUIRE_THROWS_AS( prof.load (ss), std::runtime_error );
+      }
+  }
+}
+
+
+
+//! Adds _start, which calls each of the specified functions in turn.
+static void
+_add_caller (test_objects& objs, const std::vector<std::string>& callees)
+{
+  std::vector<unsigned char> code;
+  std::vector<std::pair<size_t, std::string>> refs;
+  for (auto& name : callees)
+    {
+      code.insert (code.end (), { 0xE8, 0, 0, 0, 0 });
+      refs.emplace_back (code.size () - 4, name);
+    }
+  code.push_back (0xC3);
+  objs.add ("_start", code, refs);
+}
+
+//! Returns the offsets in .text of the functions called by _start, which
+//! must be placed first.
+static std::vector<size_t>
+_callee_offsets (generic_module& out, size_t count)
+{
+  std::vector<size_t> offs;
+  for (size_t i = 0; i < count; ++i)
+    offs.push_back (_rel32_target (out, 5 * i + 1));
+  return offs;
+}
+
+TEST_CASE( "Profile-guided code ordering", "[linker]" ) {
+  test_objects objs;
+  link_profile prof;
+  prof.add_ordered_symbol ("_start");
+
+  // functions of the specified size: nops, then ret
+  auto add_fn = [&] (const std::string& name, size_t size) {
+    std::vector<unsigned char> code (size, 0x90);
+    code.back () = 0xC3;
+    objs.add (name, code);
+  };
+
+  SECTION( "Explicit order, then hot clusters, then the rest" ) {
+    _add_caller (objs, { "a", "b", "c", "d", "e", "f", "g" });
+    for (auto name : { "a", "b", "c", "d", "e", "f", "g" })
+      add_fn (name, 3);
+
+    prof.add_ordered_symbol ("e");
+    prof.add_count ("a", 10);
+    prof.add_count ("b", 1000);
+    prof.add_call ("b", "c", 900);
+    prof.add_call ("a", "d", 5);
+    prof.add_call ("e", "f", 10000); // ranked callers do not take part
+
+    linker lnk;
+    lnk.set_profile (&prof);
+    auto out = objs.link (lnk);
+
+    // _start, e, then clusters by density: f, [b, c], [a, d], then g
+    REQUIRE( _callee_offsets (*out, 7)
+             == std::vector<size_t> ({ 112, 80, 96, 128, 48, 64, 144 }) );
+  }
+
+  SECTION( "Data sections keep their place" ) {
+    _add_caller (objs, { "a", "b" });
+    add_fn ("a", 3);
+    add_fn ("b", 3);
+    objs.get_modules ()[1]->add_section (
+        progbits_section (".data", std::vector<unsigned char> { 1 }, 0));
+    objs.get_modules ()[2]->add_section (
+        progbits_section (".data", std::vector<unsigned char> { 2 }, 0));
+
+    prof.add_count ("b", 1);
+
+    linker lnk;
+    lnk.set_profile (&prof);
+    auto out = objs.link (lnk);
+    REQUIRE( _callee_offsets (*out, 2) == std::vector<size_t> ({ 32, 16 }) );
+    REQUIRE( _section_data (*out, ".data")[0] == 1 );
+    REQUIRE( _section_data (*out, ".data")[8] == 2 );
+  }
+
+  // links the objects and returns the offsets of the functions
+  // called by _start
+  auto link = [&] (size_t count) {
+    linker lnk;
+    lnk.set_profile (&prof);
+    return _callee_offsets (*objs.link (lnk), count);
+  };
+
+  SECTION( "Cluster size limit" ) {
+    // x is called only from big, and is appended to big's cluster unless
+    // that would make the cluster larger than 1 MiB.
+    _add_caller (objs, { "big", "x" });
+    prof.add_count ("big", 100);
+    prof.add_call ("big", "x", 100);
+
+    SECTION( "Within the limit" ) {
+      add_fn ("big", 1024);
+      add_fn ("x", 3);
+      REQUIRE( link (2) == std::vector<size_t> ({ 16, 16 + 1024 }) );
+    }
+
+    SECTION( "Past the limit" ) {
+      add_fn ("big", 1024 * 1024);
+      add_fn ("x", 3);
+      REQUIRE( link (2) == std::vector<size_t> ({ 32, 16 }) );
+    }
+  }
+
+  SECTION( "Cluster density limit" ) {
+    // q is called only from p, and is appended to p's cluster unless that
+    // would make the cluster over 8 times less dense than p alone. r is
+    // placed between the two otherwise.
+    _add_caller (objs, { "p", "q", "r" });
+    prof.add_count ("p", 1000);
+    prof.add_count ("r", 10);
+    prof.add_call ("p", "q", 1);
+
+    SECTION( "Within the limit" ) {
+      add_fn ("p", 16);
+      add_fn ("q", 16);
+      add_fn ("r", 16);
+      prof.add_count ("q", 100);
+      REQUIRE( link (3) == std::vector<size_t> ({ 16, 32, 48 }) );
+    }
+
+    SECTION( "Past the limit" ) {
+      add_fn ("p", 16);
+      add_fn ("q", 4096);
+      add_fn ("r", 16);
+      REQUIRE( link (3) == std::vector<size_t> ({ 16, 48, 32 }) );
+    }
+  }
+}
@@ -18,19 +18,23 @@
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <string>
 #include <jtac/parse/lexer.hpp>
 #include <jtac/parse/parser.hpp>
 #include <jtac/control_flow.hpp>
 #include <jtac/printer.hpp>
 #include <jtac/ssa.hpp>
 #include <jtac/allocation/basic/basic.hpp>
+#include <jtac/driver.hpp>
 
 
 int
 main (int argc, char *argv[])
 {
   if (argc < 2)
-    { std::cerr << "usage: " << argv[0] << " <JTAC file>" << std::endl; return -1; }
+    { std::cerr << "usage: " << argv[0] << " <JTAC file> [threads]" << std::endl; return -1; }
+  unsigned num_threads = (argc > 2) ? (unsigned)std::stoul (argv[2]) : 0;
 
   std::ifstream fs (argv[1]);
   if (!fs)
@@ -54,16 +58,19 @@ main (int argc, char *argv[])
 
   std::cout << "Parsed.\n" << std::endl;
 
-  for (auto& proc : prog.get_procedures ())
-    {
-      std::cout << "Procedure " << proc.get_name () << std::endl;
-      std::cout << std::string (10 + proc.get_name ().length (), '=') << std::endl;
+  // procedures are compiled concurrently, each into its own buffer, and
+  // printed in program order.
+  jcc::jtac::program_driver driver (num_threads);
+  auto outputs = driver.map_procedures (prog, [] (const jcc::jtac::procedure& proc) {
+      std::ostringstream out;
+      out << "Procedure " << proc.get_name () << std::endl;
+      out << std::string (10 + proc.get_name ().length (), '=') << std::endl;
 
       auto cfg = jcc::jtac::control_flow_analyzer::make_cfg (proc.get_body ());
 
       /*
-      std::cout << "Normal form:" << std::endl;
-      std::cout << "============\n" << std::endl;
+      out << "Normal form:" << std::endl;
+      out << "============\n" << std::endl;
 
       jcc::jtac::dom_analyzer da;
       auto dr = da.analyze (cfg);
@@ -73,30 +80,30 @@ main (int argc, char *argv[])
           auto blk = cfg.find_block (i);
           jcc::jtac::printer printer;
           printer.set_var_names (proc.get_var_names ());
-          std::cout << printer.print_basic_block (*blk) << std::endl;
-          std::cout << "##" << std::endl;
+          out << printer.print_basic_block (*blk) << std::endl;
+          out << "##" << std::endl;
 
           if (i != 1)
             {
-              std::cout << "IDom: #" << dr.get_idom (i) << std::endl;
+              out << "IDom: #" << dr.get_idom (i) << std::endl;
 
-              std::cout << "Doms: ";
+              out << "Doms: ";
               for (auto id : dr.get_block (i))
-                std::cout << "#" << id << " ";
-              std::cout << std::endl;
+                out << "#" << id << " ";
+              out << std::endl;
             }
 
-          std::cout << "DF: ";
+          out << "DF: ";
           for (auto id : dr.get_dfs (i))
-            std::cout << "#" << id << " ";
-          std::cout << std::endl;
+            out << "#" << id << " ";
+          out << std::endl;
 
-          std::cout << std::endl;
+          out << std::endl;
         }
       */
 
-      std::cout << "SSA form:" << std::endl;
-      std::cout << "=========\n" << std::endl;
+      out << "SSA form:" << std::endl;
+      out << "=========\n" << std::endl;
 
       jcc::jtac::ssa_builder ssab;
       ssab.transform (cfg);
@@ -106,13 +113,14 @@ main (int argc, char *argv[])
           auto blk = cfg.find_block (i);
           jcc::jtac::printer printer;
           printer.set_var_names (proc.get_var_names ());
-          std::cout << printer.print_basic_block (*blk) << std::endl << std::endl;
+          out << printer.print_basic_block (*blk) << std::endl << std::endl;
         }
 
-      std::cout << std::endl;
+      out << std::endl;
 
       jcc::jtac::basic_register_allocator ra;
       ra.set_var_names (proc.get_var_names ());
+      ra.set_debug_stream (out);
       ra.allocate (cfg, 12);
 
       for (size_t i = 1; i <= cfg.get_size (); ++i)
@@ -120,11 +128,16 @@ main (int argc, char *argv[])
           auto blk = cfg.find_block (i);
           jcc::jtac::printer printer;
           printer.set_var_names (proc.get_var_names ());
-          std::cout << printer.print_basic_block (*blk) << std::endl << std::endl;
+          out << printer.print_basic_block (*blk) << std::endl << std::endl;
         }
 
-      std::cout << std::endl;
-    }
+      out << std::endl;
+
+      return out.str ();
+    });
+
+  for (auto& out : outputs)
+    std::cout << out;
 
   return 0;
 }